@@ -0,0 +1,96 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+#include <libnest2d.h>
+#include <libnest2d/utils/rotfinder.hpp>
+#include <libnest2d/tools/benchmark.h>
+#include <libnest2d/tests/printer_parts.h>
+
+const std::string USAGE_STR = {
+    "Usage: arrangebench [copies]"
+};
+
+using namespace libnest2d;
+
+struct RotationSet {
+    const char *name;
+    double      step;       // degrees, 0 = no rotation
+    bool        min_bb;     // start from the minimum bounding box rotation
+};
+
+// Nest the parts the way ModelArrange does and report the bins.
+template<class Data>
+static void run(const char *dataname, const Data &data, int copies,
+                const RotationSet &rs)
+{
+    using std::cout; using std::endl;
+
+    std::vector<Item> input;
+    input.reserve(data.size() * copies);
+    for (int i = 0; i < copies; ++ i)
+        for (auto &p : data) input.emplace_back(p);
+
+    Box bin(250000000, 210000000);
+    Coord dist = 6000000;
+
+    NfpPlacer::Config pcfg;
+    pcfg.alignment      = NfpPlacer::Config::Alignment::CENTER;
+    pcfg.starting_point = NfpPlacer::Config::Alignment::CENTER;
+    pcfg.accuracy       = 0.65f;
+    pcfg.explore_holes  = true;
+    pcfg.rotations      = { 0.0 };
+    if (rs.step > 0)
+        for (double r = rs.step; r < 360. - rs.step / 2; r += rs.step)
+            pcfg.rotations.emplace_back(Radians(r * Pi / 180.));
+
+    Benchmark bench;
+    bench.start();
+    if (rs.min_bb)
+        findMinimumBoundingBoxRotations(input.begin(), input.end());
+    PackGroup result = nest<NfpPlacer, FirstFitSelection>(input, bin, dist, pcfg);
+    bench.stop();
+
+    double first = 0;
+    size_t packed = 0;
+    for (auto &b : result) packed += b.size();
+    if (! result.empty())
+        for (Item &item : result.front()) first += item.area();
+
+    cout << std::setw(10) << dataname << std::setw(14) << rs.name
+         << std::setw(8) << pcfg.rotations.size()
+         << std::setw(8) << packed << std::setw(6) << result.size()
+         << std::setw(12) << first / bin.area()
+         << std::setw(10) << bench.getElapsedSec() << endl;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    int copies = argc > 1 ? std::atoi(argv[1]) : 1;
+    if (copies < 1) {
+        cout << USAGE_STR << endl;
+        return EXIT_FAILURE;
+    }
+
+    const RotationSet sets[] = {
+        { "none",        0.,  false },
+        { "90deg",       90., false },
+        { "45deg",       45., false },
+        { "15deg",       15., false },
+        { "minbb",       0.,  true  },
+        { "minbb+90deg", 90., true  },
+    };
+
+    cout << std::setprecision(4);
+    cout << std::setw(10) << "parts" << std::setw(14) << "rotations"
+         << std::setw(8) << "count" << std::setw(8) << "items"
+         << std::setw(6) << "bins" << std::setw(12) << "first bed"
+         << std::setw(10) << "seconds" << endl;
+
+    for (auto &rs : sets) run("convex", PRINTER_PART_POLYGONS, copies, rs);
+    for (auto &rs : sets) run("holes", PRINTER_PART_POLYGONS_EX, copies, rs);
+
+    return EXIT_SUCCESS;
+}
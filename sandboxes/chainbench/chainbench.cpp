@@ -0,0 +1,118 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <random>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/ChainedPath.hpp>
+#include <libslic3r/Geometry.hpp>
+#include <libslic3r/PolylineCollection.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: chainbench [max_linear_items]"
+};
+
+using namespace Slic3r;
+
+// Greedy nearest neighbor walk by a linear search over the remaining end points.
+// This is how PolylineCollection::_chained_path_from() used to chain the polylines.
+static Polylines chain_linear(const Polylines &src, Point start_near)
+{
+    std::vector<size_t> remaining;
+    remaining.reserve(src.size());
+    for (size_t i = 0; i < src.size(); ++ i)
+        remaining.push_back(i);
+    Polylines out;
+    out.reserve(src.size());
+    while (! remaining.empty()) {
+        double dmin = std::numeric_limits<double>::max();
+        size_t idx  = 0;
+        for (size_t i = 0; i < remaining.size() * 2 && dmin >= EPSILON; ++ i) {
+            const Polyline &pl = src[remaining[i / 2]];
+            const Point    &pt = (i & 1) ? pl.last_point() : pl.first_point();
+            double d = sqr(double(start_near(0) - pt(0))) + sqr(double(start_near(1) - pt(1)));
+            if (d < dmin) {
+                dmin = d;
+                idx  = i;
+            }
+        }
+        out.push_back(src[remaining[idx / 2]]);
+        if (idx & 1)
+            out.back().reverse();
+        remaining.erase(remaining.begin() + idx / 2);
+        start_near = out.back().last_point();
+    }
+    return out;
+}
+
+// Short random segments scattered over a 250x250mm bed, resembling gap fill or sparse infill.
+static Polylines random_segments(size_t n, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<coord_t> pos(0, coord_t(scale_(250.)));
+    std::uniform_int_distribution<coord_t> len(-coord_t(scale_(2.)), coord_t(scale_(2.)));
+    Polylines out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++ i) {
+        Point a(pos(rng), pos(rng));
+        out.emplace_back(Polyline(a, a + Point(len(rng), len(rng))));
+    }
+    return out;
+}
+
+static bool same_order(const Polylines &a, const Polylines &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++ i)
+        if (a[i].points != b[i].points)
+            return false;
+    return true;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    // The linear search is O(n^2), it is only run up to this number of items.
+    size_t max_linear = (argc > 1) ? size_t(atol(argv[1])) : 100000;
+
+    Benchmark bench;
+    std::mt19937 rng(0);
+    cout << std::setprecision(10);
+
+    for (size_t n : { size_t(10000), size_t(100000), size_t(1000000) }) {
+        Polylines polylines = random_segments(n, rng);
+        cout << n << " segments" << endl;
+
+        bench.start();
+        Polylines chained = PolylineCollection::chained_path_from(polylines, Point(0, 0));
+        bench.stop();
+        cout << "PolylineCollection::chained_path_from(): " << bench.getElapsedSec() << " seconds." << endl;
+
+        if (n <= max_linear) {
+            bench.start();
+            Polylines chained_linear = chain_linear(polylines, Point(0, 0));
+            bench.stop();
+            cout << "Linear search: " << bench.getElapsedSec() << " seconds, " <<
+                (same_order(chained, chained_linear) ? "same order" : "ORDER DIFFERS") << "." << endl;
+        }
+
+        Points points;
+        points.reserve(n);
+        for (const Polyline &pl : polylines)
+            points.emplace_back(pl.first_point());
+        std::vector<Points::size_type> order;
+        bench.start();
+        Slic3r::Geometry::chained_path(points, order);
+        bench.stop();
+        cout << "Geometry::chained_path(): " << bench.getElapsedSec() << " seconds." << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <random>
+#include <atomic>
+#include <new>
+
+#include <tbb/parallel_for.h>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/ClipperUtils.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: clipperbench [num_layers]"
+};
+
+// Count the heap allocations of the whole process.
+static std::atomic<size_t> g_heap_allocations(0);
+
+void* operator new(std::size_t size)
+{
+    ++ g_heap_allocations;
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+using namespace Slic3r;
+
+static Polygon circle(const Point &center, coord_t radius, size_t num_points)
+{
+    Polygon poly;
+    poly.points.reserve(num_points);
+    for (size_t i = 0; i < num_points; ++ i) {
+        double angle = 2. * PI * double(i) / double(num_points);
+        poly.points.emplace_back(center + Point(coord_t(radius * cos(angle)), coord_t(radius * sin(angle))));
+    }
+    return poly;
+}
+
+// Islands of a layer: discs with two holes each, scattered over a 250x250mm bed.
+static ExPolygons random_islands(size_t n, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<coord_t> pos(coord_t(scale_(20.)), coord_t(scale_(230.)));
+    std::uniform_int_distribution<coord_t> radius(coord_t(scale_(8.)), coord_t(scale_(15.)));
+    ExPolygons out;
+    for (size_t i = 0; i < n; ++ i) {
+        Point   center(pos(rng), pos(rng));
+        coord_t r = radius(rng);
+        ExPolygon expoly;
+        expoly.contour = circle(center, r, 256);
+        for (int j = -1; j <= 1; j += 2) {
+            Polygon hole = circle(center + Point(j * r / 2, 0), r / 5, 64);
+            hole.reverse();
+            expoly.holes.emplace_back(std::move(hole));
+        }
+        out.emplace_back(std::move(expoly));
+    }
+    return union_ex(to_polygons(out));
+}
+
+// Clipper operations of a layer, resembling the perimeter generator and the infill preparation.
+static size_t process_layer(const ExPolygons &islands)
+{
+    const float spacing = float(scale_(0.45));
+    size_t num_points = 0;
+    ExPolygons last = islands;
+    for (int i = 0; i < 3 && ! last.empty(); ++ i) {
+        ExPolygons next = offset2_ex(last, - 1.5f * spacing, 0.5f * spacing);
+        Polygons   loops = to_polygons(next);
+        for (const Polygon &loop : loops)
+            num_points += loop.points.size();
+        last = std::move(next);
+    }
+    ExPolygons infill = offset_ex(last, - 0.5f * spacing);
+    Polygons   solid  = diff(to_polygons(infill), offset(to_polygons(islands), - 4.f * spacing));
+    Polygons   sparse = intersection(to_polygons(infill), offset(to_polygons(islands), - 4.f * spacing));
+    for (const Polygon &poly : union_(solid, sparse))
+        num_points += poly.points.size();
+    return num_points;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t num_layers = (argc > 1) ? size_t(atol(argv[1])) : 200;
+
+    Benchmark bench;
+    std::mt19937 rng(0);
+    cout << std::setprecision(10);
+
+    std::vector<ExPolygons> layers;
+    for (size_t i = 0; i < num_layers; ++ i)
+        layers.emplace_back(random_islands(30, rng));
+
+    size_t allocations = g_heap_allocations;
+    size_t num_points  = 0;
+    bench.start();
+    for (const ExPolygons &islands : layers)
+        num_points += process_layer(islands);
+    bench.stop();
+    ClipperLib::ScratchPoolStats stats = ClipperLib::GetScratchPoolStats();
+    cout << "Sequential: " << bench.getElapsedSec() << " seconds, " << g_heap_allocations - allocations << " heap allocations, " <<
+        num_points << " points." << endl;
+    cout << "Clipper scratch blocks: " << stats.HeapAllocations << " allocated, " << stats.PoolAllocations << " recycled, " <<
+        stats.BytesRetained / 1024 << " kB retained." << endl;
+
+    std::vector<size_t> layer_points(num_layers, 0);
+    allocations = g_heap_allocations;
+    bench.start();
+    tbb::parallel_for(size_t(0), num_layers, [&layers, &layer_points](size_t idx) {
+        layer_points[idx] = process_layer(layers[idx]);
+    });
+    bench.stop();
+    size_t num_points_parallel = 0;
+    for (size_t n : layer_points)
+        num_points_parallel += n;
+    cout << "Parallel: " << bench.getElapsedSec() << " seconds, " << g_heap_allocations - allocations << " heap allocations, " <<
+        (num_points_parallel == num_points ? "same result" : "RESULT DIFFERS") << "." << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <random>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/GCodeWriter.hpp>
+#include <libslic3r/PrintConfig.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: gcodebench [number_of_lines]"
+};
+
+using namespace Slic3r;
+
+// A G1 extrusion move formatted by a fresh std::ostringstream,
+// the way GCodeWriter::extrude_to_xy() used to produce it.
+static std::string extrude_line_stream(const Vec2d &point, double E, const std::string &comment)
+{
+    std::ostringstream gcode;
+    gcode << "G1 X" << std::fixed << std::setprecision(3) << point(0)
+          <<   " Y" << std::fixed << std::setprecision(3) << point(1)
+          <<   " E" << std::fixed << std::setprecision(5) << E;
+    if (! comment.empty())
+        gcode << " ; " << comment;
+    gcode << "\n";
+    return gcode.str();
+}
+
+static void setup(GCodeWriter &writer)
+{
+    writer.apply_print_config(FullPrintConfig::defaults());
+    writer.config.gcode_comments.value = true;
+    writer.set_extruders({ 0 });
+    writer.set_extruder(0);
+}
+
+static void report(const char *name, size_t lines, size_t bytes, Benchmark &bench)
+{
+    double sec = bench.getElapsedSec();
+    std::cout << std::setw(28) << std::left << name << std::right
+              << std::setw(10) << sec << " s"
+              << std::setw(14) << size_t(double(lines) / sec) << " lines/s"
+              << std::setw(10) << double(bytes) / (1024. * 1024. * sec) << " MB/s" << std::endl;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    size_t nlines = argc > 1 ? size_t(std::atoll(argv[1])) : 2000000;
+    if (nlines == 0) {
+        cout << USAGE_STR << endl;
+        return EXIT_FAILURE;
+    }
+
+    // Random moves over a 250x250mm bed with short extrusions.
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> pos(0., 250.);
+    std::uniform_real_distribution<double> de(0., 0.2);
+    std::vector<Vec2d>  points;
+    std::vector<double> dEs;
+    points.reserve(nlines);
+    dEs.reserve(nlines);
+    for (size_t i = 0; i < nlines; ++ i) {
+        points.emplace_back(pos(rng), pos(rng));
+        dEs.emplace_back(de(rng));
+    }
+    const std::string comment = "perimeter";
+    Benchmark bench;
+    cout << std::setprecision(4);
+
+    // Before: one ostringstream and one std::string per line, concatenated into the layer buffer.
+    std::string out_stream;
+    {
+        GCodeWriter writer;
+        setup(writer);
+        bench.start();
+        for (size_t i = 0; i < nlines; ++ i) {
+            writer.extruder()->extrude(dEs[i]);
+            out_stream += extrude_line_stream(points[i], writer.extruder()->E(), comment);
+        }
+        bench.stop();
+        report("ostringstream", nlines, out_stream.size(), bench);
+    }
+
+    // The string returning GCodeWriter::extrude_to_xy().
+    std::string out_string;
+    {
+        GCodeWriter writer;
+        setup(writer);
+        bench.start();
+        for (size_t i = 0; i < nlines; ++ i)
+            out_string += writer.extrude_to_xy(points[i], dEs[i], comment);
+        bench.stop();
+        report("extrude_to_xy() string", nlines, out_string.size(), bench);
+    }
+
+    // After: GCodeWriter::extrude_to_xy() appending to the layer buffer.
+    std::string out_append;
+    {
+        GCodeWriter writer;
+        setup(writer);
+        bench.start();
+        for (size_t i = 0; i < nlines; ++ i)
+            writer.extrude_to_xy(out_append, points[i], dEs[i], comment);
+        bench.stop();
+        report("extrude_to_xy() appending", nlines, out_append.size(), bench);
+    }
+
+    if (out_stream != out_string || out_stream != out_append) {
+        cout << "The outputs differ!" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "The outputs are identical, " << out_stream.size() << " bytes" << endl;
+
+    return EXIT_SUCCESS;
+}
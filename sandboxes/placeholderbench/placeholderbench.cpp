@@ -0,0 +1,108 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <tbb/parallel_for.h>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/PlaceholderParser.hpp>
+#include <libslic3r/PrintConfig.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: placeholderbench [number_of_layers]"
+};
+
+using namespace Slic3r;
+
+struct LayerTemplate {
+    const char *name;
+    const char *templ;
+};
+
+// Per layer custom G-code the way the printer profiles use it.
+static const LayerTemplate layer_templates[] = {
+    { "before_layer_gcode", ";BEFORE_LAYER_CHANGE\nG92 E0.0\n;[layer_z]\n\n" },
+    { "layer_gcode",        ";AFTER_LAYER_CHANGE\n;[layer_z]" },
+    { "conditional",        "{if layer_num == 1}M104 S[temperature]{elsif layer_num > 100 and layer_z < 50}; layer {layer_num}{else}; z {layer_z + 0.2}{endif}\n"
+                            "G1 Z{layer_z + 0.6} F{travel_speed * 60}\nM117 Layer {layer_num} of [total_layer_count]\n" },
+};
+
+static void report(const char *name, size_t layers, Benchmark &bench)
+{
+    double sec = bench.getElapsedSec();
+    std::cout << std::setw(28) << std::left << name << std::right
+              << std::setw(10) << sec << " s"
+              << std::setw(12) << 1e6 * sec / double(layers) << " us/layer" << std::endl;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    size_t nlayers = argc > 1 ? size_t(std::atoll(argv[1])) : 20000;
+    if (nlayers == 0) {
+        cout << USAGE_STR << endl;
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<DynamicPrintConfig> config(DynamicPrintConfig::new_from_defaults());
+    PlaceholderParser parser;
+    parser.apply_config(*config);
+    parser.set("total_layer_count", int(nlayers));
+
+    for (const LayerTemplate &lt : layer_templates) {
+        cout << lt.name << ":" << endl;
+        // The template is parsed for each layer.
+        Benchmark bench;
+        std::string parsed;
+        bench.start();
+        for (size_t i = 0; i < nlayers; ++ i) {
+            DynamicConfig layer_config;
+            layer_config.set_key_value("layer_num", new ConfigOptionInt(int(i) + 1));
+            layer_config.set_key_value("layer_z",   new ConfigOptionFloat(0.2 * double(i + 1)));
+            parsed += parser.process(lt.templ, 0, &layer_config);
+        }
+        bench.stop();
+        report("  parsed per layer", nlayers, bench);
+
+        // The template is compiled once and evaluated for each layer.
+        std::string compiled;
+        bench.start();
+        PlaceholderParser::Template templ = PlaceholderParser::compile(lt.templ);
+        for (size_t i = 0; i < nlayers; ++ i) {
+            DynamicConfig layer_config;
+            layer_config.set_key_value("layer_num", new ConfigOptionInt(int(i) + 1));
+            layer_config.set_key_value("layer_z",   new ConfigOptionFloat(0.2 * double(i + 1)));
+            compiled += parser.process(templ, 0, &layer_config);
+        }
+        bench.stop();
+        report("  compiled once", nlayers, bench);
+
+        // The compiled template shared by concurrent exports.
+        const size_t nexports = 8;
+        std::vector<std::string> exported(nexports);
+        bench.start();
+        tbb::parallel_for(size_t(0), nexports, [&](size_t iexport) {
+            for (size_t i = 0; i < nlayers; ++ i) {
+                DynamicConfig layer_config;
+                layer_config.set_key_value("layer_num", new ConfigOptionInt(int(i) + 1));
+                layer_config.set_key_value("layer_z",   new ConfigOptionFloat(0.2 * double(i + 1)));
+                exported[iexport] += parser.process(templ, 0, &layer_config);
+            }
+        });
+        bench.stop();
+        report("  compiled, 8 exports", nlayers * nexports, bench);
+
+        bool same = compiled == parsed;
+        for (const std::string &out : exported)
+            same &= out == parsed;
+        if (! same) {
+            cout << "  Outputs differ!" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
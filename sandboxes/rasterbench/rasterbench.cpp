@@ -0,0 +1,178 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+
+#include <tbb/parallel_for.h>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/ExPolygon.hpp>
+#include <libslic3r/Utils.hpp>
+#include <libslic3r/Rasterizer/Rasterizer.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: rasterbench [dense|tiled]\n"
+    "The peak RSS only grows, run a single backend to measure its peak."
+};
+
+using namespace Slic3r;
+
+// Slice of a layer: a grid of rings of the given layer dependent radius,
+// covering a few percent of the display the way a typical plate does.
+static ExPolygons make_slice(unsigned layer)
+{
+    ExPolygons out;
+    double r = 3. + 2. * std::sin(layer * 0.05);
+    for (int i = 0; i < 4; ++ i)
+        for (int j = 0; j < 2; ++ j) {
+            ExPolygon ring;
+            Vec2d center(20. + 25. * i, 20. + 25. * j);
+            const int segments = 200;
+            for (int k = 0; k < segments; ++ k) {
+                double a = 2. * PI * k / segments;
+                ring.contour.points.emplace_back(scale_(center(0) + r * std::cos(a)), scale_(center(1) + r * std::sin(a)));
+            }
+            Polygon hole;
+            for (int k = segments; k > 0; -- k) {
+                double a = 2. * PI * k / segments;
+                hole.points.emplace_back(scale_(center(0) + 0.5 * r * std::cos(a)), scale_(center(1) + 0.5 * r * std::sin(a)));
+            }
+            ring.holes.emplace_back(std::move(hole));
+            out.emplace_back(std::move(ring));
+        }
+    return out;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    bool dense = true, tiled = true;
+    if (argc > 1) {
+        std::string arg = argv[1];
+        if (arg == "dense")
+            tiled = false;
+        else if (arg == "tiled")
+            dense = false;
+        else {
+            cout << USAGE_STR << endl;
+            return arg == "-h" || arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    // log_memory_info() reports the peak RSS at the info level.
+    set_logging_level(4);
+
+    const unsigned num_layers = 50;
+    std::vector<ExPolygons> slices;
+    for (unsigned i = 0; i < num_layers; ++ i)
+        slices.emplace_back(make_slice(i));
+
+    // Resolutions of the 2K, 4K and 8K LCD printers over the same display area.
+    const Raster::Resolution resolutions[] = { Raster::Resolution(2560, 1440), Raster::Resolution(3840, 2160), Raster::Resolution(7680, 4320) };
+    const double width_mm = 120.96, height_mm = 68.04;
+
+    Benchmark bench;
+    cout << std::setprecision(4);
+
+    for (const Raster::Resolution &res : resolutions) {
+        Raster::PixelDim pxdim(width_mm / res.width_px, height_mm / res.height_px);
+
+        cout << res.width_px << "x" << res.height_px << ":" << endl;
+        for (int b = 0; b < 2; ++ b) {
+            if (! (b == 0 ? dense : tiled))
+                continue;
+            Raster::Backend backend = b == 0 ? Raster::Backend::DENSE : Raster::Backend::TILED;
+            // Memory of the rasters in flight, as the SLA print rasterizes the layers in parallel.
+            std::atomic<size_t> in_flight(0), peak(0);
+            bench.start();
+            tbb::parallel_for<unsigned>(0, num_layers, [&](unsigned i) {
+                Raster raster(res, pxdim, Raster::Origin::TOP_LEFT, backend);
+                for (const ExPolygon &expoly : slices[i])
+                    raster.draw(expoly);
+                size_t mem = raster.memory_used();
+                size_t now = (in_flight += mem);
+                for (size_t p = peak; p < now && ! peak.compare_exchange_weak(p, now); ) ;
+                std::ostringstream ss;
+                raster.save(ss, Raster::Compression::PNG);
+                in_flight -= mem;
+            });
+            bench.stop();
+            cout << "    " << (b == 0 ? "dense" : "tiled") << ": " << 1000. * bench.getElapsedSec() / num_layers << " ms per layer, " <<
+                "rasters in flight " << format_memsize_MB(peak) << "," << log_memory_info() << endl;
+        }
+
+        // Both backends have to produce the same PNG. Checked after the timing, not to count the dense raster into the peak RSS of the tiled one.
+        std::string png[2];
+        for (int b = 0; b < 2; ++ b) {
+            Raster raster(res, pxdim, Raster::Origin::TOP_LEFT, b == 0 ? Raster::Backend::DENSE : Raster::Backend::TILED);
+            for (const ExPolygon &expoly : slices.front())
+                raster.draw(expoly);
+            // Clipped at the edges of the display.
+            for (ExPolygon expoly : slices.front()) {
+                expoly.translate(- scale_(20.), - scale_(20.));
+                raster.draw(expoly);
+                expoly.translate(scale_(width_mm - 60.), scale_(height_mm - 5.));
+                raster.draw(expoly);
+            }
+            std::ostringstream ss;
+            raster.save(ss, Raster::Compression::PNG);
+            png[b] = ss.str();
+        }
+        cout << "    " << (png[0] == png[1] ? "same images" : "IMAGES DIFFER") << endl;
+    }
+
+    // A plate of many instances of the same object, drawn the way SLAPrint draws the levels.
+    {
+        const Raster::Resolution res(2560, 1440);
+        Raster::PixelDim pxdim(width_mm / res.width_px, height_mm / res.height_px);
+        ExPolygons slice = make_slice(0);
+        for (ExPolygon &expoly : slice)
+            expoly.translate(- scale_(20.), - scale_(20.));
+        struct Instance { Point shift; double rotation; };
+        std::vector<Instance> instances;
+        for (int i = 0; i < 10; ++ i)
+            for (int j = 0; j < 5; ++ j)
+                instances.push_back({ Point(scale_(6. + 12. * i), scale_(6. + 12. * j)), 0.3 * (i + j) });
+        const unsigned num_draws = 20;
+        cout << instances.size() << " instances, portrait:" << endl;
+
+        std::string png[2];
+        for (int b = 0; b < 2; ++ b) {
+            Raster raster(res, pxdim, Raster::Origin::TOP_LEFT, Raster::Backend::TILED);
+            bench.start();
+            for (unsigned k = 0; k < num_draws; ++ k)
+                for (const Instance &inst : instances)
+                    if (b == 0) {
+                        // Copy and transform each slice, then draw it.
+                        for (ExPolygon expoly : slice) {
+                            expoly.rotate(inst.rotation);
+                            expoly.translate(inst.shift(0), inst.shift(1));
+                            for (Point &pt : expoly.contour.points)
+                                std::swap(pt(0), pt(1));
+                            for (Polygon &hole : expoly.holes)
+                                for (Point &pt : hole.points)
+                                    std::swap(pt(0), pt(1));
+                            raster.draw(expoly);
+                        }
+                    } else {
+                        // Draw the shared slices transformed by the rasterizer.
+                        Raster::Trafo trafo(inst.rotation, double(inst.shift(0)), double(inst.shift(1)), true);
+                        for (const ExPolygon &expoly : slice)
+                            raster.draw(expoly, trafo);
+                    }
+            bench.stop();
+            cout << "    " << (b == 0 ? "copied slices" : "transformed slices") << ": " << 1000. * bench.getElapsedSec() / num_draws << " ms per layer" << endl;
+            std::ostringstream ss;
+            raster.save(ss, Raster::Compression::PNG);
+            png[b] = ss.str();
+        }
+        cout << "    " << (png[0] == png[1] ? "same images" : "IMAGES DIFFER") << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <random>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/TriangleMesh.hpp>
+#include <libslic3r/SLA/SLASupportTree.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: raycastbench [stlfilename.stl]"
+};
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    TriangleMesh model;
+    if (argc > 1)
+        model.ReadSTLFile(argv[1]);
+    else
+        // A sphere of 130k triangles.
+        model = make_sphere(20.);
+    model.align_to_origin();
+
+    Benchmark bench;
+    cout << std::setprecision(10);
+
+    sla::EigenMesh3D emesh = sla::to_eigenmesh(model);
+    cout << emesh.F.rows() << " triangles" << endl;
+
+    // Rays from random points inside the bounding box of the mesh in random directions,
+    // the way the support tree generator checks the heads, pillars and bridges.
+    BoundingBoxf3 bb = model.bounding_box();
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> ux(bb.min(0), bb.max(0)), uy(bb.min(1), bb.max(1)), uz(bb.min(2), bb.max(2));
+    std::normal_distribution<double> un;
+    const size_t num_rays = 100000;
+    std::vector<std::pair<Vec3d, Vec3d>> rays;
+    for (size_t i = 0; i < num_rays; ++ i)
+        rays.emplace_back(Vec3d(ux(rng), uy(rng), uz(rng)), Vec3d(un(rng), un(rng), un(rng)).normalized());
+
+    // Testing all the triangles is slow, only a subset of the rays is cast that way.
+    const size_t num_rays_brute = 200;
+    std::vector<double> t_brute;
+    bench.start();
+    for (size_t i = 0; i < num_rays_brute; ++ i)
+        t_brute.emplace_back(emesh.query_ray_hit(rays[i].first, rays[i].second).t);
+    bench.stop();
+    cout << "All triangles: " << double(num_rays_brute) / bench.getElapsedSec() << " rays per second." << endl;
+
+    bench.start();
+    emesh.build_aabb();
+    bench.stop();
+    cout << "AABB tree built in " << bench.getElapsedSec() << " seconds." << endl;
+
+    std::vector<double> t_aabb;
+    bench.start();
+    for (size_t i = 0; i < num_rays; ++ i)
+        t_aabb.emplace_back(emesh.query_ray_hit(rays[i].first, rays[i].second).t);
+    bench.stop();
+    size_t num_diff = 0;
+    for (size_t i = 0; i < num_rays_brute; ++ i)
+        if (t_aabb[i] != t_brute[i])
+            ++ num_diff;
+    cout << "AABB tree: " << double(num_rays) / bench.getElapsedSec() << " rays per second, " <<
+        (num_diff == 0 ? "same hits" : "HITS DIFFER") << "." << endl;
+
+    bench.start();
+    double sum = 0.;
+    for (size_t i = 0; i < num_rays; ++ i) {
+        int   face;
+        Vec3d closest;
+        sum += emesh.squared_distance(rays[i].first, face, closest);
+    }
+    bench.stop();
+    cout << "AABB tree: " << double(num_rays) / bench.getElapsedSec() << " squared distance queries per second." << endl;
+
+    return EXIT_SUCCESS;
+}
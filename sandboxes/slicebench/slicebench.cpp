@@ -0,0 +1,146 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+#include <boost/thread.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/TriangleMesh.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: slicebench stlfilename.stl [layer_height]"
+};
+
+using namespace Slic3r;
+
+// Collect the intersection lines into shared per layer buckets guarded by a single mutex.
+// This is how TriangleMeshSlicer::slice() used to collect the lines.
+static size_t collect_mutex(const TriangleMesh &mesh, const TriangleMeshSlicer &slicer, const std::vector<float> &z)
+{
+    std::vector<IntersectionLines> lines(z.size());
+    boost::mutex lines_mutex;
+    tbb::parallel_for(tbb::blocked_range<int>(0, mesh.stl.stats.number_of_facets),
+        [&](const tbb::blocked_range<int> &range) {
+            for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
+                const stl_facet &facet = mesh.stl.facet_start[facet_idx];
+                const float min_z = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
+                const float max_z = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
+                auto it_end = std::upper_bound(z.begin(), z.end(), max_z);
+                for (auto it = std::lower_bound(z.begin(), z.end(), min_z); it != it_end; ++ it) {
+                    IntersectionLine il;
+                    if (slicer.slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing) {
+                        boost::lock_guard<boost::mutex> l(lines_mutex);
+                        lines[it - z.begin()].emplace_back(il);
+                    }
+                }
+            }
+        });
+    size_t n = 0;
+    for (const IntersectionLines &l : lines)
+        n += l.size();
+    return n;
+}
+
+// Collect the intersection lines into thread local per layer buckets, merge them afterwards.
+static size_t collect_thread_local(const TriangleMesh &mesh, const TriangleMeshSlicer &slicer, const std::vector<float> &z)
+{
+    std::vector<IntersectionLines> lines(z.size());
+    tbb::enumerable_thread_specific<std::vector<IntersectionLines>> lines_tls([&z]() { return std::vector<IntersectionLines>(z.size()); });
+    tbb::parallel_for(tbb::blocked_range<int>(0, mesh.stl.stats.number_of_facets),
+        [&](const tbb::blocked_range<int> &range) {
+            std::vector<IntersectionLines> &lines_local = lines_tls.local();
+            for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
+                const stl_facet &facet = mesh.stl.facet_start[facet_idx];
+                const float min_z = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
+                const float max_z = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
+                auto it_end = std::upper_bound(z.begin(), z.end(), max_z);
+                for (auto it = std::lower_bound(z.begin(), z.end(), min_z); it != it_end; ++ it) {
+                    IntersectionLine il;
+                    if (slicer.slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing)
+                        lines_local[it - z.begin()].emplace_back(il);
+                }
+            }
+        });
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, z.size()),
+        [&](const tbb::blocked_range<size_t> &range) {
+            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx)
+                for (std::vector<IntersectionLines> &lines_local : lines_tls)
+                    append(lines[layer_idx], std::move(lines_local[layer_idx]));
+        });
+    size_t n = 0;
+    for (const IntersectionLines &l : lines)
+        n += l.size();
+    return n;
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    if(argc < 2) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    float layer_height = (argc > 2) ? float(atof(argv[2])) : 0.05f;
+
+    TriangleMesh model;
+    Benchmark bench;
+
+    model.ReadSTLFile(argv[1]);
+    model.align_to_origin();
+
+    TriangleMeshSlicer slicer(&model);
+    BoundingBoxf3 bb = model.bounding_box();
+    std::vector<float> z;
+    for (float h = float(bb.min(2)) + 0.5f * layer_height; h < bb.max(2); h += layer_height)
+        z.emplace_back(h);
+
+    cout << model.facets_count() << " facets, " << z.size() << " layers" << endl;
+    cout << std::setprecision(10);
+
+    bench.start();
+    size_t n = collect_mutex(model, slicer, z);
+    bench.stop();
+    cout << "Mutex guarded buckets: " << n << " lines, " << bench.getElapsedSec() << " seconds." << endl;
+
+    bench.start();
+    n = collect_thread_local(model, slicer, z);
+    bench.stop();
+    cout << "Thread local buckets: " << n << " lines, " << bench.getElapsedSec() << " seconds." << endl;
+
+    std::vector<ExPolygons> layers;
+    bench.start();
+    slicer.slice(z, &layers, [](){});
+    bench.stop();
+    cout << "TriangleMeshSlicer::slice(): " << bench.getElapsedSec() << " seconds." << endl;
+
+    // Slice a narrow band of layers in the middle of the object with and without the Z sorted facet index.
+    size_t band_begin = z.size() / 2;
+    std::vector<float> z_band(z.begin() + band_begin, z.begin() + std::min(z.size(), band_begin + 20));
+    bench.start();
+    slicer.slice(z_band, &layers, [](){});
+    bench.stop();
+    cout << "TriangleMeshSlicer::slice() of " << z_band.size() << " layers: " << bench.getElapsedSec() << " seconds." << endl;
+
+    bench.start();
+    slicer.init_z_index([](){});
+    bench.stop();
+    cout << "TriangleMeshSlicer::init_z_index(): " << bench.getElapsedSec() << " seconds." << endl;
+
+    bench.start();
+    slicer.slice(z_band, &layers, [](){});
+    bench.stop();
+    cout << "TriangleMeshSlicer::slice() of " << z_band.size() << " layers with Z index: " << bench.getElapsedSec() << " seconds." << endl;
+
+    bench.start();
+    slicer.slice(z, &layers, [](){});
+    bench.stop();
+    cout << "TriangleMeshSlicer::slice() with Z index: " << bench.getElapsedSec() << " seconds." << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+#include <boost/filesystem.hpp>
+
+#include <admesh/stl.h>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: stlbench stlfilename.stl"
+};
+
+// Read the file the way stl_open() used to, facet by facet with fread().
+static void read_sequential(stl_file *stl, const char *path)
+{
+    stl_initialize(stl);
+    stl_count_facets(stl, path);
+    stl_allocate(stl);
+    stl_read(stl, 0, true);
+    if (! stl->error)
+        fclose(stl->fp);
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    if(argc < 2) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    const char *path = argv[1];
+    double      mb   = double(boost::filesystem::file_size(path)) / (1024. * 1024.);
+    Benchmark   bench;
+    cout << std::setprecision(4);
+
+    stl_file stl;
+    bench.start();
+    read_sequential(&stl, path);
+    bench.stop();
+    if (stl.error) {
+        cout << "Failed to read " << path << endl;
+        return EXIT_FAILURE;
+    }
+    cout << stl.stats.number_of_facets << " facets, " << mb << " MB" << endl;
+    cout << "Sequential read: " << bench.getElapsedSec() << " seconds, " << mb / bench.getElapsedSec() << " MB/s" << endl;
+    stl_close(&stl);
+
+    bench.start();
+    stl_open(&stl, path);
+    bench.stop();
+    cout << "stl_open(): " << bench.getElapsedSec() << " seconds, " << mb / bench.getElapsedSec() << " MB/s" << endl;
+
+    bench.start();
+    stl_check_facets_exact(&stl);
+    bench.stop();
+    cout << "stl_check_facets_exact(): " << bench.getElapsedSec() << " seconds, " << mb / bench.getElapsedSec() << " MB/s, " <<
+        stl.stats.connected_edges << " connected edges" << endl;
+    stl_close(&stl);
+
+    return EXIT_SUCCESS;
+}
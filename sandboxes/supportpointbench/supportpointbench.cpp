@@ -0,0 +1,61 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/TriangleMesh.hpp>
+#include <libslic3r/SLA/SLASupportTree.hpp>
+#include <libslic3r/SLA/SLAAutoSupports.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: supportpointbench [stlfilename.stl]"
+};
+
+int main(const int argc, const char *argv[]) {
+    using namespace Slic3r;
+    using std::cout; using std::endl;
+
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    TriangleMesh model;
+    if (argc > 1)
+        model.ReadSTLFile(argv[1]);
+    else
+        // A sphere of 260k triangles, its lower half needs supports.
+        model = make_sphere(20.);
+    model.align_to_origin();
+
+    Benchmark bench;
+    cout << std::setprecision(10);
+
+    sla::EigenMesh3D emesh = sla::to_eigenmesh(model);
+    emesh.build_aabb();
+    cout << emesh.F.rows() << " triangles" << endl;
+
+    // Slice the same way SLAPrint does, with the default layer height.
+    std::vector<float> heights;
+    BoundingBoxf3 bb = model.bounding_box();
+    for (double z = bb.min(2) + 0.05; z < bb.max(2); z += 0.05)
+        heights.emplace_back(float(z));
+    std::vector<ExPolygons> slices;
+    TriangleMeshSlicer slicer(&model);
+    slicer.slice(heights, &slices, [](){});
+
+    // Default configuration of SLAPrintObjectConfig.
+    SLAAutoSupports::Config config;
+    config.minimal_z             = 0.f;
+    config.density_at_horizontal = 500 / 10000.f;
+    config.density_at_45         = 250 / 10000.f;
+
+    bench.start();
+    SLAAutoSupports auto_supports(model, emesh, slices, heights, config, [](){});
+    bench.stop();
+    cout << auto_supports.output().size() << " support points placed in " << bench.getElapsedSec() << " seconds." << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <random>
+
+#include <libslic3r/libslic3r.h>
+#include <libslic3r/ExtrusionEntityCollection.hpp>
+#include <libslic3r/ExtrusionEntityCompact.hpp>
+#include <libnest2d/tools/benchmark.h>
+
+const std::string USAGE_STR = {
+    "Usage: toolpathbench [num_layers]"
+};
+
+using namespace Slic3r;
+
+// A layer resembling the output of the perimeter and infill generators: islands of three perimeter loops
+// each wrapped in its own collection, followed by a collection of short infill lines.
+static void random_layer(ExtrusionEntityCollection &perimeters, ExtrusionEntityCollection &fills, std::mt19937 &rng)
+{
+    std::uniform_int_distribution<coord_t> pos(0, coord_t(scale_(250.)));
+    std::uniform_int_distribution<coord_t> len(-coord_t(scale_(5.)), coord_t(scale_(5.)));
+    const coord_t r = coord_t(scale_(10.));
+    const coord_t w = coord_t(scale_(0.45));
+    for (size_t island = 0; island < 20; ++ island) {
+        Point center(pos(rng), pos(rng));
+        ExtrusionEntityCollection loops;
+        for (coord_t i = 0; i < 3; ++ i) {
+            Polygon poly;
+            for (size_t j = 0; j < 64; ++ j) {
+                double angle = 2. * PI * double(j) / 64.;
+                poly.points.emplace_back(center + Point(coord_t((r - i * w) * cos(angle)), coord_t((r - i * w) * sin(angle))));
+            }
+            ExtrusionEntitiesPtr tmp;
+            extrusion_entities_append_loops(tmp, Polygons { poly }, i == 0 ? erExternalPerimeter : erPerimeter, 0.05, 0.45f, 0.2f);
+            loops.append(std::move(tmp));
+        }
+        perimeters.append(loops);
+        Polylines lines;
+        for (size_t i = 0; i < 200; ++ i) {
+            Point a(pos(rng), pos(rng));
+            lines.emplace_back(Polyline(a, a + Point(len(rng), len(rng))));
+        }
+        ExtrusionEntityCollection infill;
+        extrusion_entities_append_paths(infill.entities, std::move(lines), erInternalInfill, 0.05, 0.45f, 0.2f);
+        fills.append(infill);
+    }
+}
+
+// Number of heap allocations and the memory held by a polymorphic extrusion tree.
+static void count_allocations(const ExtrusionEntity &entity, size_t &allocations, size_t &memory)
+{
+    auto count_path = [&allocations, &memory](const ExtrusionPath &path) {
+        ++ allocations;
+        memory += path.polyline.points.capacity() * sizeof(Point);
+    };
+    if (const ExtrusionPath *path = dynamic_cast<const ExtrusionPath*>(&entity)) {
+        ++ allocations;
+        memory += sizeof(ExtrusionPath);
+        count_path(*path);
+    } else if (const ExtrusionMultiPath *multipath = dynamic_cast<const ExtrusionMultiPath*>(&entity)) {
+        allocations += 2;
+        memory += sizeof(ExtrusionMultiPath) + multipath->paths.capacity() * sizeof(ExtrusionPath);
+        for (const ExtrusionPath &path : multipath->paths)
+            count_path(path);
+    } else if (const ExtrusionLoop *loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
+        allocations += 2;
+        memory += sizeof(ExtrusionLoop) + loop->paths.capacity() * sizeof(ExtrusionPath);
+        for (const ExtrusionPath &path : loop->paths)
+            count_path(path);
+    } else if (const ExtrusionEntityCollection *collection = dynamic_cast<const ExtrusionEntityCollection*>(&entity)) {
+        allocations += 2;
+        memory += sizeof(ExtrusionEntityCollection) + collection->entities.capacity() * sizeof(ExtrusionEntity*);
+        for (const ExtrusionEntity *nested : collection->entities)
+            count_allocations(*nested, allocations, memory);
+    }
+}
+
+int main(const int argc, const char *argv[]) {
+    using std::cout; using std::endl;
+
+    if (argc > 1 && (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help")) {
+        cout << USAGE_STR << endl;
+        return EXIT_SUCCESS;
+    }
+
+    size_t num_layers = (argc > 1) ? size_t(atol(argv[1])) : 200;
+
+    Benchmark bench;
+    std::mt19937 rng(0);
+    cout << std::setprecision(10);
+
+    std::vector<ExtrusionEntityCollection> layers(num_layers);
+    bench.start();
+    for (ExtrusionEntityCollection &layer : layers) {
+        ExtrusionEntityCollection perimeters, fills;
+        random_layer(perimeters, fills, rng);
+        layer.append(perimeters);
+        layer.append(fills);
+    }
+    bench.stop();
+    cout << num_layers << " layers generated in " << bench.getElapsedSec() << " seconds." << endl;
+
+    size_t allocations = 0;
+    size_t memory      = 0;
+    for (const ExtrusionEntityCollection &layer : layers)
+        count_allocations(layer, allocations, memory);
+    cout << "ExtrusionEntityCollection: " << allocations << " allocations, " << memory / 1024 << " kB" << endl;
+
+    std::vector<ExtrusionEntityCompact> compact(num_layers);
+    bench.start();
+    for (size_t i = 0; i < num_layers; ++ i) {
+        compact[i].append_entities(layers[i]);
+        compact[i].shrink_to_fit();
+    }
+    bench.stop();
+    memory = 0;
+    for (const ExtrusionEntityCompact &layer : compact)
+        memory += layer.memory_used();
+    cout << "ExtrusionEntityCompact: " << num_layers * 3 << " allocations, " << memory / 1024 << " kB, converted in " << bench.getElapsedSec() << " seconds." << endl;
+
+    double volume = 0.;
+    bench.start();
+    for (const ExtrusionEntityCollection &layer : layers)
+        volume += layer.total_volume();
+    bench.stop();
+    cout << "ExtrusionEntityCollection::total_volume(): " << volume << ", " << bench.getElapsedSec() << " seconds." << endl;
+
+    double volume_compact = 0.;
+    bench.start();
+    for (const ExtrusionEntityCompact &layer : compact)
+        volume_compact += layer.total_volume();
+    bench.stop();
+    cout << "ExtrusionEntityCompact::total_volume(): " << volume_compact << ", " << bench.getElapsedSec() << " seconds." << endl;
+
+    BoundingBox bbox;
+    bench.start();
+    for (const ExtrusionEntityCollection &layer : layers)
+        bbox.merge(get_extents(layer.as_polylines()));
+    bench.stop();
+    cout << "get_extents(ExtrusionEntityCollection::as_polylines()): " << bench.getElapsedSec() << " seconds." << endl;
+
+    BoundingBox bbox_compact;
+    bench.start();
+    for (const ExtrusionEntityCompact &layer : compact)
+        bbox_compact.merge(layer.bounding_box());
+    bench.stop();
+    cout << "ExtrusionEntityCompact::bounding_box(): " << bench.getElapsedSec() << " seconds, " <<
+        (bbox.min == bbox_compact.min && bbox.max == bbox_compact.max ? "same" : "BOUNDING BOX DIFFERS") << "." << endl;
+
+    bench.start();
+    bool same = true;
+    for (size_t i = 0; i < num_layers; ++ i) {
+        ExtrusionEntityCollection restored;
+        compact[i].to_collection(restored);
+        ExtrusionEntityCompact again(restored);
+        same &= again.points == compact[i].points && again.paths.size() == compact[i].paths.size() && again.entities.size() == compact[i].entities.size();
+    }
+    bench.stop();
+    cout << "Round trip through ExtrusionEntityCollection: " << bench.getElapsedSec() << " seconds, " <<
+        (same ? "same" : "ENTITIES DIFFER") << "." << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -26,10 +26,14 @@
 #include <math.h>
 
 #include <algorithm>
+#include <functional>
 #include <vector>
 
 #include <boost/detail/endian.hpp>
 
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+
 #include "stl.h"
 
 
@@ -37,10 +41,13 @@ static void stl_match_neighbors_nearby(stl_file *stl,
                                        stl_hash_edge *edge_a, stl_hash_edge *edge_b);
 static void stl_record_neighbors(stl_file *stl,
                                  stl_hash_edge *edge_a, stl_hash_edge *edge_b);
-static void stl_initialize_facet_check_exact(stl_file *stl);
+static void stl_link_neighbors(stl_file *stl,
+                               const stl_hash_edge *edge_a, const stl_hash_edge *edge_b);
+static int stl_match_edges_exact(stl_file *stl, stl_hash_edge *begin, stl_hash_edge *end,
+                                 std::vector<stl_hash_edge*> &unmatched);
 static void stl_initialize_facet_check_nearby(stl_file *stl);
-static void stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
-                                stl_vertex *a, stl_vertex *b);
+static float stl_load_edge_exact(stl_hash_edge *edge,
+                                 const stl_vertex *a, const stl_vertex *b);
 static int stl_load_edge_nearby(stl_file *stl, stl_hash_edge *edge,
                                 stl_vertex *a, stl_vertex *b, float tolerance);
 static void insert_hash_edge(stl_file *stl, stl_hash_edge edge,
@@ -66,24 +73,32 @@ stl_check_facets_exact(stl_file *stl) {
   /* This function builds the neighbors list.  No modifications are made
    *  to any of the facets.  The edges are said to match only if all six
    *  floats of the first edge matches all six floats of the second edge.
+   *
+   *  Instead of inserting the edges into a hash table one by one, the edges
+   *  of all facets are collected and sorted in parallel, so that the equal edges
+   *  end up next to each other. The groups of equal edges are then matched in parallel
+   *  in the same order the hash table used to match them.
    */
 
-  stl_hash_edge  edge;
-  stl_facet      facet;
-  int            i;
-  int            j;
-
   if (stl->error) return;
 
   stl->stats.connected_edges = 0;
   stl->stats.connected_facets_1_edge = 0;
   stl->stats.connected_facets_2_edge = 0;
   stl->stats.connected_facets_3_edge = 0;
+  stl->stats.malloced = 0;
+  stl->stats.freed = 0;
+  stl->stats.collisions = 0;
 
-  stl_initialize_facet_check_exact(stl);
+  for (int i = 0; i < stl->stats.number_of_facets; i++) {
+    /* initialize neighbors list to -1 to mark unconnected edges */
+    stl->neighbors_start[i].neighbor[0] = -1;
+    stl->neighbors_start[i].neighbor[1] = -1;
+    stl->neighbors_start[i].neighbor[2] = -1;
+  }
 
-  for(i = 0; i < stl->stats.number_of_facets; i++) {
-    facet = stl->facet_start[i];
+  for (int i = 0; i < stl->stats.number_of_facets; i++) {
+    const stl_facet &facet = stl->facet_start[i];
     // If any two of the three vertices are found to be exactally the same, call them degenerate and remove the facet.
     if (facet.vertex[0] == facet.vertex[1] ||
         facet.vertex[1] == facet.vertex[2] ||
@@ -91,16 +106,67 @@ stl_check_facets_exact(stl_file *stl) {
       stl->stats.degenerate_facets += 1;
       stl_remove_facet(stl, i);
       -- i;
-      continue;
-    }
-    for(j = 0; j < 3; j++) {
-      edge.facet_number = i;
-      edge.which_edge = j;
-      stl_load_edge_exact(stl, &edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]);
-      insert_hash_edge(stl, edge, stl_record_neighbors);
     }
   }
-  stl_free_edges(stl);
+
+  // Load the edges of all facets, edge j of facet i is stored at edges[i * 3 + j].
+  size_t num_facets = stl->stats.number_of_facets;
+  std::vector<stl_hash_edge> edges(num_facets * 3);
+  stl->stats.shortest_edge = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_facets), stl->stats.shortest_edge,
+    [stl, &edges](const tbb::blocked_range<size_t> &range, float shortest_edge) {
+      for (size_t i = range.begin(); i < range.end(); ++ i) {
+        const stl_facet &facet = stl->facet_start[i];
+        for (int j = 0; j < 3; ++ j) {
+          stl_hash_edge &edge = edges[i * 3 + j];
+          edge.facet_number = int(i);
+          edge.which_edge = j;
+          edge.next = nullptr;
+          shortest_edge = std::min(shortest_edge, stl_load_edge_exact(&edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]));
+        }
+      }
+      return shortest_edge;
+    },
+    [](float a, float b) { return std::min(a, b); });
+
+  // Sort the edges by their keys. Equal edges are sorted in the order the hash table used to receive them.
+  tbb::parallel_sort(edges.begin(), edges.end(), [](const stl_hash_edge &a, const stl_hash_edge &b) {
+    int cmp = memcmp(a.key, b.key, sizeof(a.key));
+    return (cmp != 0) ? (cmp < 0) : 
+      (size_t(a.facet_number) * 3 + a.which_edge % 3 < size_t(b.facet_number) * 3 + b.which_edge % 3);
+  });
+
+  // Match the groups of equal edges. A group straddling a range boundary is processed by the range it starts in.
+  // Each facet edge is matched at most once, therefore the neighbors are written to without locking.
+  int num_matched = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, edges.size()), 0,
+    [stl, &edges](const tbb::blocked_range<size_t> &range, int num_matched) {
+      std::vector<stl_hash_edge*> unmatched;
+      size_t i = range.begin();
+      while (i < range.end() && i > 0 && edges[i] == edges[i - 1])
+        ++ i;
+      while (i < range.end()) {
+        size_t j = i + 1;
+        while (j < edges.size() && edges[j] == edges[i])
+          ++ j;
+        num_matched += stl_match_edges_exact(stl, edges.data() + i, edges.data() + j, unmatched);
+        i = j;
+      }
+      return num_matched;
+    },
+    std::plus<int>());
+
+  /* Count successful connects */
+  stl->stats.connected_edges = 2 * num_matched;
+  for (size_t i = 0; i < num_facets; ++ i) {
+    int connected = (stl->neighbors_start[i].neighbor[0] != -1) +
+                    (stl->neighbors_start[i].neighbor[1] != -1) +
+                    (stl->neighbors_start[i].neighbor[2] != -1);
+    if (connected > 0)
+      stl->stats.connected_facets_1_edge += 1;
+    if (connected > 1)
+      stl->stats.connected_facets_2_edge += 1;
+    if (connected > 2)
+      stl->stats.connected_facets_3_edge += 1;
+  }
 
 #if 0
   printf("Number of faces: %d, number of manifold edges: %d, number of connected edges: %d, number of unconnected edges: %d\r\n", 
@@ -109,17 +175,34 @@ stl_check_facets_exact(stl_file *stl) {
 #endif
 }
 
-static void
-stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
-                    stl_vertex *a, stl_vertex *b) {
+// Match a group of equal edges the way insert_hash_edge() used to: Each edge is matched with the first
+// yet unmatched edge of another facet. Returns the number of matched pairs.
+static int stl_match_edges_exact(stl_file *stl, stl_hash_edge *begin, stl_hash_edge *end,
+                                 std::vector<stl_hash_edge*> &unmatched)
+{
+  int num_matched = 0;
+  unmatched.clear();
+  for (stl_hash_edge *edge = begin; edge != end; ++ edge) {
+    auto it = std::find_if(unmatched.begin(), unmatched.end(),
+      [edge](stl_hash_edge *other) { return ! stl_compare_function(edge, other); });
+    if (it == unmatched.end()) {
+      unmatched.push_back(edge);
+    } else {
+      stl_link_neighbors(stl, edge, *it);
+      unmatched.erase(it);
+      ++ num_matched;
+    }
+  }
+  return num_matched;
+}
 
-  if (stl->error) return;
+// Fill in the key of the edge, returns the length of the edge (maximum of the coordinate differences).
+static float
+stl_load_edge_exact(stl_hash_edge *edge,
+                    const stl_vertex *a, const stl_vertex *b) {
 
-  {
-    stl_vertex diff = (*a - *b).cwiseAbs();
-    float max_diff = std::max(diff(0), std::max(diff(1), diff(2)));
-    stl->stats.shortest_edge = std::min(max_diff, stl->stats.shortest_edge);
-  }
+  stl_vertex diff = (*a - *b).cwiseAbs();
+  float max_diff = std::max(diff(0), std::max(diff(1), diff(2)));
 
   // Ensure identical vertex ordering of equal edges.
   // This method is numerically robust.
@@ -143,6 +226,7 @@ stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
       p[0] = 0;
 #endif /* BOOST_LITTLE_ENDIAN */
   }
+  return max_diff;
 }
 
 static inline size_t hash_size_from_nr_faces(const size_t nr_faces)
@@ -155,38 +239,6 @@ static inline size_t hash_size_from_nr_faces(const size_t nr_faces)
 	return (it == primes.end()) ? primes.back() : *it;
 }
 
-static void
-stl_initialize_facet_check_exact(stl_file *stl) {
-  int i;
-
-  if (stl->error) return;
-
-  stl->stats.malloced = 0;
-  stl->stats.freed = 0;
-  stl->stats.collisions = 0;
-
-  stl->M = hash_size_from_nr_faces(stl->stats.number_of_facets);
-
-  for (i = 0; i < stl->stats.number_of_facets ; i++) {
-    /* initialize neighbors list to -1 to mark unconnected edges */
-    stl->neighbors_start[i].neighbor[0] = -1;
-    stl->neighbors_start[i].neighbor[1] = -1;
-    stl->neighbors_start[i].neighbor[2] = -1;
-  }
-
-  stl->heads = (stl_hash_edge**)calloc(stl->M, sizeof(*stl->heads));
-  if(stl->heads == NULL) perror("stl_initialize_facet_check_exact");
-
-  stl->tail = (stl_hash_edge*)malloc(sizeof(stl_hash_edge));
-  if(stl->tail == NULL) perror("stl_initialize_facet_check_exact");
-
-  stl->tail->next = stl->tail;
-
-  for(i = 0; i < stl->M; i++) {
-    stl->heads[i] = stl->tail;
-  }
-}
-
 static void insert_hash_edge(stl_file *stl, stl_hash_edge edge,
                  void (*match_neighbors)(stl_file *stl,
                      stl_hash_edge *edge_a, stl_hash_edge *edge_b))
@@ -367,14 +419,10 @@ static void stl_initialize_facet_check_nearby(stl_file *stl)
 
 
 
+// Record the facets of edge_a and edge_b as neighbors, don't update the statistics.
 static void
-stl_record_neighbors(stl_file *stl,
-                     stl_hash_edge *edge_a, stl_hash_edge *edge_b) {
-  int i;
-  int j;
-
-  if (stl->error) return;
-
+stl_link_neighbors(stl_file *stl,
+                   const stl_hash_edge *edge_a, const stl_hash_edge *edge_b) {
   /* Facet a's neighbor is facet b */
   stl->neighbors_start[edge_a->facet_number].neighbor[edge_a->which_edge % 3] =
     edge_b->facet_number;	/* sets the .neighbor part */
@@ -400,7 +448,17 @@ stl_record_neighbors(stl_file *stl,
     stl->neighbors_start[edge_b->facet_number].
     which_vertex_not[edge_b->which_edge % 3] += 3;
   }
+}
+
+static void
+stl_record_neighbors(stl_file *stl,
+                     stl_hash_edge *edge_a, stl_hash_edge *edge_b) {
+  int i;
+  int j;
+
+  if (stl->error) return;
 
+  stl_link_neighbors(stl, edge_a, edge_b);
 
   /* Count successful connects */
   /* Total connects */
@@ -817,8 +875,8 @@ stl_fill_holes(stl_file *stl) {
       if(stl->neighbors_start[i].neighbor[j] != -1) continue;
       edge.facet_number = i;
       edge.which_edge = j;
-      stl_load_edge_exact(stl, &edge, &facet.vertex[j],
-                          &facet.vertex[(j + 1) % 3]);
+      stl->stats.shortest_edge = std::min(stl->stats.shortest_edge,
+        stl_load_edge_exact(&edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]));
 
       insert_hash_edge(stl, edge, stl_record_neighbors);
     }
@@ -873,8 +931,8 @@ stl_fill_holes(stl_file *stl) {
           for(k = 0; k < 3; k++) {
             edge.facet_number = stl->stats.number_of_facets - 1;
             edge.which_edge = k;
-            stl_load_edge_exact(stl, &edge, &new_facet.vertex[k],
-                                &new_facet.vertex[(k + 1) % 3]);
+            stl->stats.shortest_edge = std::min(stl->stats.shortest_edge,
+              stl_load_edge_exact(&edge, &new_facet.vertex[k], &new_facet.vertex[(k + 1) % 3]));
 
             insert_hash_edge(stl, edge, stl_record_neighbors);
           }
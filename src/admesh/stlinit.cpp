@@ -28,6 +28,11 @@
 
 #include <boost/nowide/cstdio.hpp>
 #include <boost/detail/endian.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
 #include "stl.h"
 
@@ -40,7 +45,10 @@ stl_open(stl_file *stl, const char *file) {
   stl_initialize(stl);
   stl_count_facets(stl, file);
   stl_allocate(stl);
-  stl_read(stl, 0, true);
+  // Binary files are mapped into memory and parsed in parallel. ASCII files and files,
+  // which could not be mapped, are read sequentially.
+  if (stl->error || stl->stats.type != binary || ! stl_read_binary_mapped(stl, file))
+    stl_read(stl, 0, true);
   if (!stl->error) fclose(stl->fp);
 }
 
@@ -342,6 +350,60 @@ void stl_read(stl_file *stl, int first_facet, bool first) {
   stl->stats.bounding_diameter = stl->stats.size.norm();
 }
 
+/* Reads the facets of a binary .STL file by mapping the file into memory and parsing the facets
+   in parallel directly into stl->facet_start. stl_count_facets() and stl_allocate() have to be called first.
+   Returns false if the file could not be mapped, the caller shall fall back to stl_read() then. */
+bool stl_read_binary_mapped(stl_file *stl, const char *file) {
+  if (stl->error) return true;
+
+  const size_t num_facets = stl->stats.number_of_facets;
+  try {
+    boost::interprocess::file_mapping  mapping(file, boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+    if (region.get_size() < HEADER_SIZE + num_facets * SIZEOF_STL_FACET) {
+      stl->error = 1;
+      return true;
+    }
+    const char *data = static_cast<const char*>(region.get_address()) + HEADER_SIZE;
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_facets), 
+      [stl, data](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i < range.end(); ++ i) {
+          /* we assume little-endian architecture! */
+          memcpy(stl->facet_start + i, data + i * SIZEOF_STL_FACET, SIZEOF_STL_FACET);
+#ifndef BOOST_LITTLE_ENDIAN
+          // Convert the loaded little endian data to big endian.
+          stl_internal_reverse_quads((char*)(stl->facet_start + i), 48);
+#endif /* BOOST_LITTLE_ENDIAN */
+        }
+      });
+  } catch (const boost::interprocess::interprocess_exception &) {
+    return false;
+  }
+
+  if (num_facets > 0) {
+    // Same statistics as collected by stl_facet_stats() when reading the facets one by one.
+    const stl_facet &facet0 = stl->facet_start[0];
+    stl_vertex diff = (facet0.vertex[1] - facet0.vertex[0]).cwiseAbs();
+    stl->stats.shortest_edge = std::max(diff(0), std::max(diff(1), diff(2)));
+    typedef std::pair<stl_vertex, stl_vertex> MinMax;
+    MinMax bbox = tbb::parallel_reduce(tbb::blocked_range<size_t>(0, num_facets), MinMax(facet0.vertex[0], facet0.vertex[0]),
+      [stl](const tbb::blocked_range<size_t> &range, MinMax bbox) {
+        for (size_t i = range.begin(); i < range.end(); ++ i)
+          for (size_t j = 0; j < 3; ++ j) {
+            bbox.first  = bbox.first .cwiseMin(stl->facet_start[i].vertex[j]);
+            bbox.second = bbox.second.cwiseMax(stl->facet_start[i].vertex[j]);
+          }
+        return bbox;
+      },
+      [](const MinMax &a, const MinMax &b) { return MinMax(a.first.cwiseMin(b.first), a.second.cwiseMax(b.second)); });
+    stl->stats.min = bbox.first;
+    stl->stats.max = bbox.second;
+  }
+  stl->stats.size = stl->stats.max - stl->stats.min;
+  stl->stats.bounding_diameter = stl->stats.size.norm();
+  return true;
+}
+
 void stl_facet_stats(stl_file *stl, stl_facet facet, bool &first)
 {
   if (stl->error)
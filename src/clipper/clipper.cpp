@@ -39,6 +39,7 @@
 *******************************************************************************/
 
 #include "clipper.hpp"
+#include <atomic>
 #include <cmath>
 #include <vector>
 #include <algorithm>
@@ -85,6 +86,175 @@ struct OutRec {
   OutPt    *BottomPt;
 };
 
+//------------------------------------------------------------------------------
+// ScratchPool
+//------------------------------------------------------------------------------
+
+// Each clipping operation allocates its edges, output records and output points anew and releases them
+// at its end. The slicing steps execute millions of clipping operations from all the worker threads,
+// hammering the global heap. Instead, the released blocks are kept in a pool owned by the thread
+// and handed to the next clipping operation executed by the same thread, without any locking.
+class ScratchPool
+{
+public:
+  ~ScratchPool() { Release(); }
+
+  // Pool of the calling thread. A pool drops the blocks it keeps at its first use after ReleaseScratchPool().
+  static ScratchPool& Local()
+  {
+    static thread_local ScratchPool pool;
+    unsigned int epoch = s_releaseEpoch.load(std::memory_order_relaxed);
+    if (pool.m_releaseEpoch != epoch) {
+      pool.Release();
+      pool.m_releaseEpoch = epoch;
+    }
+    return pool;
+  }
+  static void ReleaseAll() { ++ s_releaseEpoch; }
+
+  // The edges are value initialized, as if a new vector was allocated.
+  void AllocateEdges(std::vector<TEdge> &edges, size_t n)
+  {
+    if (m_edges.empty())
+      edges.clear();
+    else {
+      edges = std::move(m_edges.back());
+      m_edges.pop_back();
+      m_stats.BytesRetained -= edges.capacity() * sizeof(TEdge);
+    }
+    ++ (edges.capacity() < n ? m_stats.HeapAllocations : m_stats.PoolAllocations);
+    edges.assign(n, TEdge());
+  }
+  void ReleaseEdges(std::vector<TEdge> &&edges)
+  {
+    if (Retain(edges.capacity() * sizeof(TEdge)))
+      m_edges.emplace_back(std::move(edges));
+  }
+
+  // Output points are allocated in chunks of OutPtsChunkSize.
+  static const size_t OutPtsChunkSize = 32;
+  OutPt* AllocateOutPts()
+  {
+    if (m_outPts.empty()) {
+      ++ m_stats.HeapAllocations;
+      return new OutPt[OutPtsChunkSize];
+    }
+    OutPt *pts = m_outPts.back();
+    m_outPts.pop_back();
+    m_stats.BytesRetained -= OutPtsChunkSize * sizeof(OutPt);
+    ++ m_stats.PoolAllocations;
+    return pts;
+  }
+  void ReleaseOutPts(OutPt *pts)
+  {
+    if (Retain(OutPtsChunkSize * sizeof(OutPt)))
+      m_outPts.emplace_back(pts);
+    else
+      delete[] pts;
+  }
+
+  OutRec* AllocateOutRec()
+  {
+    if (m_outRecs.empty()) {
+      ++ m_stats.HeapAllocations;
+      return new OutRec;
+    }
+    OutRec *rec = m_outRecs.back();
+    m_outRecs.pop_back();
+    m_stats.BytesRetained -= sizeof(OutRec);
+    ++ m_stats.PoolAllocations;
+    return rec;
+  }
+  void ReleaseOutRec(OutRec *rec)
+  {
+    if (Retain(sizeof(OutRec)))
+      m_outRecs.emplace_back(rec);
+    else
+      delete rec;
+  }
+
+  // The node is returned with an empty Contour, which keeps its capacity.
+  PolyNode* AllocatePolyNode()
+  {
+    if (m_polyNodes.empty()) {
+      ++ m_stats.HeapAllocations;
+      return new PolyNode();
+    }
+    PolyNode *node = m_polyNodes.back();
+    m_polyNodes.pop_back();
+    m_stats.BytesRetained -= sizeof(PolyNode) + node->Contour.capacity() * sizeof(IntPoint);
+    ++ m_stats.PoolAllocations;
+    return node;
+  }
+  void ReleasePolyNode(PolyNode *node)
+  {
+    node->Contour.clear();
+    node->Childs.clear();
+    node->Parent = nullptr;
+    if (Retain(sizeof(PolyNode) + node->Contour.capacity() * sizeof(IntPoint)))
+      m_polyNodes.emplace_back(node);
+    else
+      delete node;
+  }
+
+  void Release()
+  {
+    for (OutPt *pts : m_outPts)
+      delete[] pts;
+    for (OutRec *rec : m_outRecs)
+      delete rec;
+    for (PolyNode *node : m_polyNodes)
+      delete node;
+    m_edges.clear();
+    m_edges.shrink_to_fit();
+    m_outPts.clear();
+    m_outPts.shrink_to_fit();
+    m_outRecs.clear();
+    m_outRecs.shrink_to_fit();
+    m_polyNodes.clear();
+    m_polyNodes.shrink_to_fit();
+    m_stats.BytesRetained = 0;
+  }
+
+  const ScratchPoolStats& Stats() const { return m_stats; }
+
+private:
+  // Upper limit of the memory kept by a single thread. Blocks released above the limit are returned to the heap.
+  // The pool recycles the blocks of the small and medium sized clipping operations, which are the most frequent ones.
+  static const size_t MaxBytesRetained = 1024 * 1024;
+
+  bool Retain(size_t bytes)
+  {
+    if (m_stats.BytesRetained + bytes > MaxBytesRetained)
+      return false;
+    m_stats.BytesRetained += bytes;
+    return true;
+  }
+
+  std::vector<std::vector<TEdge>> m_edges;
+  std::vector<OutPt*>             m_outPts;
+  std::vector<OutRec*>            m_outRecs;
+  std::vector<PolyNode*>          m_polyNodes;
+  ScratchPoolStats                m_stats { 0, 0, 0 };
+  unsigned int                    m_releaseEpoch { 0 };
+
+  static std::atomic<unsigned int> s_releaseEpoch;
+};
+
+std::atomic<unsigned int> ScratchPool::s_releaseEpoch(0);
+
+ScratchPoolStats GetScratchPoolStats()
+{
+  return ScratchPool::Local().Stats();
+}
+
+void ReleaseScratchPool()
+{
+  ScratchPool::ReleaseAll();
+  // Release the pool of the calling thread right now.
+  ScratchPool::Local();
+}
+
 //------------------------------------------------------------------------------
 
 inline cInt Round(double val)
@@ -723,7 +893,8 @@ bool ClipperBase::AddPath(const Path &pg, PolyType PolyTyp, bool Closed)
     return false;
 
   // Allocate a new edge array.
-  std::vector<TEdge> edges(highI + 1);
+  std::vector<TEdge> edges;
+  ScratchPool::Local().AllocateEdges(edges, highI + 1);
   // Fill in the edge array.
   bool result = AddPathInternal(pg, highI, PolyTyp, Closed, edges.data());
   if (result)
@@ -756,7 +927,8 @@ bool ClipperBase::AddPaths(const Paths &ppg, PolyType PolyTyp, bool Closed)
     return false;
 
   // Allocate a new edge array.
-  std::vector<TEdge> edges(num_edges_total);
+  std::vector<TEdge> edges;
+  ScratchPool::Local().AllocateEdges(edges, num_edges_total);
   // Fill in the edge array.
   bool result = false;
   TEdge *p_edge = edges.data();
@@ -952,6 +1124,9 @@ void ClipperBase::Clear()
 {
   PROFILE_FUNC();
   m_MinimaList.clear();
+  ScratchPool &pool = ScratchPool::Local();
+  for (std::vector<TEdge> &edges : m_edges)
+    pool.ReleaseEdges(std::move(edges));
   m_edges.clear();
   m_UseFullRange = false;
   m_HasOpenPaths = false;
@@ -1035,7 +1210,7 @@ IntRect ClipperBase::GetBounds()
 Clipper::Clipper(int initOptions) : 
   ClipperBase(),
   m_OutPtsFree(nullptr),
-  m_OutPtsChunkSize(32),
+  m_OutPtsChunkSize(ScratchPool::OutPtsChunkSize),
   m_OutPtsChunkLast(32),
   m_ActiveEdges(nullptr),
   m_SortedEdges(nullptr)
@@ -1179,7 +1354,7 @@ OutPt* Clipper::AllocateOutPt()
     pt = m_OutPts.back() + (m_OutPtsChunkLast ++);
   } else {
     // The last chunk is full. Allocate a new one.
-    m_OutPts.push_back(new OutPt[m_OutPtsChunkSize]);
+    m_OutPts.push_back(ScratchPool::Local().AllocateOutPts());
     m_OutPtsChunkLast = 1;
     pt = m_OutPts.back();
   }
@@ -1188,10 +1363,11 @@ OutPt* Clipper::AllocateOutPt()
 
 void Clipper::DisposeAllOutRecs()
 {
+  ScratchPool &pool = ScratchPool::Local();
   for (OutPt *pts : m_OutPts)
-    delete[] pts;
+    pool.ReleaseOutPts(pts);
   for (OutRec *rec : m_PolyOuts)
-    delete rec;
+    pool.ReleaseOutRec(rec);
   m_OutPts.clear();
   m_OutPtsFree = nullptr;
   m_OutPtsChunkLast = m_OutPtsChunkSize;
@@ -1975,7 +2151,7 @@ void Clipper::AppendPolygon(TEdge *e1, TEdge *e2) const
 
 OutRec* Clipper::CreateOutRec()
 {
-  OutRec* result = new OutRec;
+  OutRec* result = ScratchPool::Local().AllocateOutRec();
   result->IsHole = false;
   result->IsOpen = false;
   result->FirstLeft = 0;
@@ -3322,8 +3498,9 @@ DoublePoint GetUnitNormal(const IntPoint &pt1, const IntPoint &pt2)
 
 void ClipperOffset::Clear()
 {
+  ScratchPool &pool = ScratchPool::Local();
   for (int i = 0; i < m_polyNodes.ChildCount(); ++i)
-    delete m_polyNodes.Childs[i];
+    pool.ReleasePolyNode(m_polyNodes.Childs[i]);
   m_polyNodes.Childs.clear();
   m_lowest.X = -1;
 }
@@ -3333,7 +3510,7 @@ void ClipperOffset::AddPath(const Path& path, JoinType joinType, EndType endType
 {
   int highI = (int)path.size() - 1;
   if (highI < 0) return;
-  PolyNode* newNode = new PolyNode();
+  PolyNode* newNode = ScratchPool::Local().AllocatePolyNode();
   newNode->m_jointype = joinType;
   newNode->m_endtype = endType;
 
@@ -3373,7 +3550,7 @@ void ClipperOffset::AddPath(const Path& path, JoinType joinType, EndType endType
   }
   if (endType == etClosedPolygon && j < 2)
   {
-    delete newNode;
+    ScratchPool::Local().ReleasePolyNode(newNode);
     return;
   }
   m_polyNodes.AddChild(*newNode);
@@ -469,6 +469,22 @@ private:
 };
 //------------------------------------------------------------------------------
 
+// Clipper and ClipperOffset take their scratch memory (edges, output records, output points and offset nodes)
+// from a pool owned by the calling thread and return it there, see ScratchPool in clipper.cpp.
+struct ScratchPoolStats {
+  // Number of blocks allocated from the heap / recycled from the pool.
+  size_t HeapAllocations;
+  size_t PoolAllocations;
+  // Memory kept by the pool for the next clipping operations.
+  size_t BytesRetained;
+};
+// Statistics of the pool of the calling thread.
+ScratchPoolStats GetScratchPoolStats();
+// Return the memory kept by the pools back to the heap. The pool of the calling thread is released immediately,
+// the pools of the other threads at their next clipping operation. To be called at the end of a processing job.
+void ReleaseScratchPool();
+//------------------------------------------------------------------------------
+
 class clipperException : public std::exception
 {
   public:
@@ -447,6 +447,136 @@ merge(const std::vector<PolygonImpl>& shapes)
     return _merge(clipper);
 }
 
+template<> struct MaxNfpLevel<PolygonImpl> {
+    static const BP2D_CONSTEXPR NfpLevel value =
+            NfpLevel::BOTH_CONCAVE_WITH_HOLES;
+};
+
+/**
+ * No fit polygon of arbitrary polygons (concave, with holes) calculated as the
+ * Minkowski sum of the stationary polygon and the orbiting polygon reflected
+ * about its reference vertex.
+ *
+ * The sum is assembled from the sums of every contour pair (contour and holes
+ * of both polygons), which cover all the positions where the boundaries
+ * intersect, plus the stationary polygon translated by a vertex of every
+ * reflected orbiter contour and the reflected orbiter translated by a vertex of
+ * the stationary polygon. The latter two fill the positions where one polygon
+ * lies fully inside the other one. What is left uncovered are the holes of the
+ * NFP: positions inside the holes or inside the closed cavities of the
+ * stationary polygon where the orbiter fits without touching it, even if it
+ * could not get there by sliding around.
+ *
+ * The resulting NFP is positioned so that it is the locus of the orbiter's
+ * reference vertex, its reference point is the orbiter's reference vertex in
+ * the configuration used by correctNfpPosition(), so the correction is a no-op
+ * for the input polygons and a plain translation for their translated copies.
+ */
+inline NfpResult<PolygonImpl> nfpMinkowski(const PolygonImpl& sh,
+                                           const PolygonImpl& other)
+{
+    using ClipperLib::Path;
+    using ClipperLib::Paths;
+
+    // Clipper does not want the closing vertex libnest2d keeps in its paths
+    auto open = [](Path p) {
+        if(p.size() > 1 && p.front() == p.back()) p.pop_back();
+        return p;
+    };
+
+    // Point reflection keeps the orientation of the paths
+    auto ref = rightmostUpVertex(other);
+    auto reflect = [&open, &ref](const Path& path) {
+        Path p = open(path);
+        for(auto& v : p) v = ref - v;
+        return p;
+    };
+
+    Paths stationary, pattern;
+    stationary.emplace_back(open(sh.Contour));
+    for(auto& h : sh.Holes) stationary.emplace_back(open(h));
+    pattern.emplace_back(reflect(other.Contour));
+    for(auto& h : other.Holes) pattern.emplace_back(reflect(h));
+
+    if(stationary.front().size() < 3 || pattern.front().size() < 3)
+        throw GeometryException(GeomErr::NFP);
+
+    ClipperLib::Clipper clipper(ClipperLib::ioReverseSolution);
+
+    bool closed = true;
+    bool valid = true;
+
+    auto translated = [](Path p, const PointImpl& d) {
+        for(auto& v : p) v += d;
+        return p;
+    };
+
+    Paths sweep;
+    for(auto& pt : pattern) {
+        if(pt.empty()) continue;
+        for(auto& st : stationary) {
+            if(st.empty()) continue;
+
+            // The sums come with positive contours and negative holes which is
+            // the opposite of the orientation of the libnest2d polygons.
+            ClipperLib::MinkowskiSum(pt, st, sweep, closed);
+            for(auto& p : sweep) {
+                ClipperLib::ReversePath(p);
+                valid &= clipper.AddPath(p, ClipperLib::ptSubject, closed);
+            }
+
+            valid &= clipper.AddPath(translated(st, pt.front()),
+                                     ClipperLib::ptSubject, closed);
+        }
+    }
+
+    auto& a0 = stationary.front().front();
+    for(auto& pt : pattern) if(!pt.empty())
+        valid &= clipper.AddPath(translated(pt, a0),
+                                 ClipperLib::ptSubject, closed);
+
+    if(!valid) throw GeometryException(GeomErr::NFP);
+
+    auto result = _merge(clipper);
+    if(result.empty()) throw GeometryException(GeomErr::NFP);
+
+    // The sum of two connected polygons is connected, anything else are
+    // numerical slivers.
+    auto it = std::max_element(result.begin(), result.end(),
+                               [](const PolygonImpl& p1, const PolygonImpl& p2)
+    {
+        return std::abs(ClipperLib::Area(p1.Contour)) <
+               std::abs(ClipperLib::Area(p2.Contour));
+    });
+
+    // The rounding of the edge intersections leaves hairline holes along the
+    // overlapping edges of the sums. A genuine hole where the orbiter fits is
+    // wider than a couple of units.
+    auto& holes = it->Holes;
+    holes.erase(std::remove_if(holes.begin(), holes.end(), [](const Path& h) {
+        double circ = 0;
+        for(size_t i = 1; i < h.size(); ++i) {
+            double dx = double(h[i].X - h[i - 1].X);
+            double dy = double(h[i].Y - h[i - 1].Y);
+            circ += std::sqrt(dx*dx + dy*dy);
+        }
+        return std::abs(ClipperLib::Area(h)) < 2.0 * circ;
+    }), holes.end());
+
+    auto top_nfp = rightmostUpVertex(sh) - leftmostDownVertex(other) + ref;
+
+    return {std::move(*it), top_nfp};
+}
+
+template<NfpLevel nfptype> struct NfpImpl<PolygonImpl, nfptype> {
+    NfpResult<PolygonImpl> operator()(const PolygonImpl& sh,
+                                      const PolygonImpl& other)
+    {
+        return nfptype == NfpLevel::CONVEX_ONLY ? nfpConvexOnly(sh, other) :
+                                                  nfpMinkowski(sh, other);
+    }
+};
+
 }
 
 }
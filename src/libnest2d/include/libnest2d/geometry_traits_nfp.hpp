@@ -188,8 +188,8 @@ inline TPoint<RawShape> referenceVertex(const RawShape& sh)
  * The "trivial" Cuninghame-Green implementation of NFP for convex polygons.
  *
  * You can use this even if you provide implementations for the more complex
- * cases (Through specializing the the NfpImpl struct). Currently, no other
- * cases are covered in the library.
+ * cases (Through specializing the the NfpImpl struct). The Clipper backend
+ * covers the remaining cases with a Minkowski sum based implementation.
  *
  * Complexity should be no more than nlogn (std::sort) in the number of edges
  * of the input polygons.
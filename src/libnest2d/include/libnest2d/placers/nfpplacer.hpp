@@ -5,6 +5,10 @@
 
 // For caching nfps
 #include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <tuple>
 
 // For parallel for
 #include <functional>
@@ -120,13 +124,120 @@ Key hash(const _Item<S>& item) {
     return std::hash<std::string>()(ret);
 }
 
+/**
+ * Exact key of the item geometry without the translation: the shape inflated
+ * and rotated. The no fit polygons of two item pairs with equal geometry
+ * keys differ by a translation only. The key holds the vertex count and the
+ * vertices relative to the translation of every path of the shape, the keys
+ * are compared by their hashes first, then vertex by vertex.
+ */
+struct GeometryKey {
+    Key hash = 0;
+    std::vector<long long> coords;
+
+    bool operator==(const GeometryKey& other) const {
+        return hash == other.hash && coords == other.coords;
+    }
+};
+
 template<class S>
-using Hash = std::unordered_map<Key, nfp::NfpResult<S>>;
+GeometryKey geometryKey(const _Item<S>& item) {
+    auto& sh = item.transformedShape();
+    auto tr = item.translation();
+
+    GeometryKey key;
+    auto add_path = [&key, &tr](const TContour<S>& path) {
+        key.coords.emplace_back(static_cast<long long>(path.size()));
+        for(auto& v : path) {
+            key.coords.emplace_back(static_cast<long long>(getX(v) - getX(tr)));
+            key.coords.emplace_back(static_cast<long long>(getY(v) - getY(tr)));
+        }
+    };
+
+    add_path(sl::contour(sh));
+    for(size_t i = 0; i < sl::holeCount(sh); ++i) add_path(sl::hole(sh, i));
+
+    for(long long v : key.coords)
+        key.hash ^= std::hash<long long>()(v) + 0x9e3779b9 +
+                    (key.hash << 6) + (key.hash >> 2);
+
+    return key;
+}
 
 }
 
 namespace placers {
 
+/**
+ * Cache of the no fit polygons of item pairs.
+ *
+ * The entries are keyed by the geometry keys of the stationary and the orbiting
+ * item (see __itemhash::geometryKey()), so the rotation and the inflation of
+ * the items are part of the key while the translation is not: a cached NFP is
+ * moved into place by correctNfpPosition(). A cached NFP is only returned for
+ * the same geometries, not for a hash collision. The cache is thread safe, it
+ * is filled by the parallel NFP calculation and it may be shared by several
+ * placers through NfpPConfig::nfp_cache.
+ */
+template<class RawShape> class NfpCache {
+public:
+
+    using GeometryKeyPtr = std::shared_ptr<const __itemhash::GeometryKey>;
+
+    /// Stationary item key, orbiting item key, holes of the stationary item
+    /// considered. The geometry keys are shared by the lookups of an item.
+    using Key = std::tuple<GeometryKeyPtr, GeometryKeyPtr, bool>;
+
+    /// The cache is dropped as a whole if it grows over the capacity.
+    explicit NfpCache(size_t capacity = 10000): capacity_(capacity) {}
+
+    bool find(const Key& key, nfp::NfpResult<RawShape>& result) const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto it = map_.find(key);
+        if(it == map_.end()) return false;
+        result = it->second;
+        return true;
+    }
+
+    void insert(const Key& key, const nfp::NfpResult<RawShape>& result) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if(map_.size() >= capacity_) map_.clear();
+        map_.emplace(key, result);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lk(mtx_);
+        map_.clear();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return map_.size();
+    }
+
+private:
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            size_t h = std::get<0>(k)->hash;
+            h ^= std::get<1>(k)->hash + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return std::get<2>(k) ? h : ~h;
+        }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Key& k1, const Key& k2) const {
+            return std::get<2>(k1) == std::get<2>(k2) &&
+                   *std::get<0>(k1) == *std::get<0>(k2) &&
+                   *std::get<1>(k1) == *std::get<1>(k2);
+        }
+    };
+
+    mutable std::mutex mtx_;
+    std::unordered_map<Key, nfp::NfpResult<RawShape>, KeyHash, KeyEqual> map_;
+    size_t capacity_;
+};
+
 template<class RawShape>
 struct NfpPConfig {
 
@@ -179,11 +290,20 @@ struct NfpPConfig {
      * @brief If you want to see items inside other item's holes, you have to
      * turn this switch on.
      *
-     * This will only work if a suitable nfp implementation is provided.
-     * The library has no such implementation right now.
+     * This will only work if a suitable nfp implementation is provided
+     * (see nfp::MaxNfpLevel), e.g. the one of the Clipper backend.
      */
     bool explore_holes = false;
 
+    /**
+     * @brief Cache of the calculated no fit polygons. (Optional)
+     *
+     * The placer always caches the no fit polygons of the item pairs it has
+     * seen. Set a shared cache here to reuse them across placers, e.g. in the
+     * subsequent arrangements of the same parts.
+     */
+    std::shared_ptr<NfpCache<RawShape>> nfp_cache;
+
     /**
      * @brief If true, use all CPUs available. Run on a single core otherwise.
      */
@@ -527,8 +647,8 @@ class _NofitPolyPlacer: public PlacerBoilerplate<_NofitPolyPlacer<RawShape, TBin
     // Norming factor for the optimization function
     const double norm_;
 
-    // Caching calculated nfps
-    __itemhash::Hash<RawShape> nfpcache_;
+    // Caching calculated nfps, used if no cache is provided in the config
+    std::shared_ptr<NfpCache<RawShape>> nfpcache_;
 
     // Storing item hash keys
     ItemKeys item_keys_;
@@ -539,7 +659,8 @@ public:
 
     inline explicit _NofitPolyPlacer(const BinType& bin):
         Base(bin),
-        norm_(std::sqrt(sl::area(bin))) {}
+        norm_(std::sqrt(sl::area(bin))),
+        nfpcache_(std::make_shared<NfpCache<RawShape>>()) {}
 
     _NofitPolyPlacer(const _NofitPolyPlacer&) = default;
     _NofitPolyPlacer& operator=(const _NofitPolyPlacer&) = default;
@@ -666,29 +787,63 @@ private:
     { // Function for arbitrary level of nfp implementation
         using namespace nfp;
 
-        Shapes nfps;
+        Shapes nfps(items_.size());
         const Item& trsh = itsh.first;
+        NfpCache<RawShape>& cache = config_.nfp_cache ? *config_.nfp_cache :
+                                                        *nfpcache_;
+        bool holes = config_.explore_holes;
 
-        auto& orb = trsh.transformedShape();
+        // Same workaround as in the convex case: fill the mutable caches of
+        // the items before they get accessed from multiple threads.
+        trsh.transformedShape();
+        trsh.referenceVertex();
+        trsh.rightmostTopVertex();
+        trsh.leftmostBottomVertex();
         bool orbconvex = trsh.isContourConvex();
+        using GeometryKeyPtr = typename NfpCache<RawShape>::GeometryKeyPtr;
+        GeometryKeyPtr orbkey = std::make_shared<__itemhash::GeometryKey>(
+                    __itemhash::geometryKey(trsh));
+
+        std::vector<GeometryKeyPtr> keys;
+        keys.reserve(items_.size());
+        for(Item& itm : items_) {
+            itm.transformedShape();
+            itm.referenceVertex();
+            itm.rightmostTopVertex();
+            itm.leftmostBottomVertex();
+            itm.isContourConvex();
+            keys.emplace_back(std::make_shared<__itemhash::GeometryKey>(
+                                  __itemhash::geometryKey(itm)));
+        }
 
-        for(Item& sh : items_) {
+        __parallel::enumerate(items_.begin(), items_.end(),
+                              [&nfps, &trsh, &cache, &keys, orbkey, orbconvex,
+                               holes]
+                              (const Item& sh, size_t n)
+        {
             nfp::NfpResult<RawShape> subnfp;
-            auto& stat = sh.transformedShape();
+            auto key = typename NfpCache<RawShape>::Key(keys[n], orbkey, holes);
 
-            if(sh.isContourConvex() && orbconvex)
-                subnfp = nfp::noFitPolygon<NfpLevel::CONVEX_ONLY>(stat, orb);
-            else if(orbconvex)
-                subnfp = nfp::noFitPolygon<NfpLevel::ONE_CONVEX>(stat, orb);
-            else
-                subnfp = nfp::noFitPolygon<Level::value>(stat, orb);
+            if(!cache.find(key, subnfp)) {
+                auto& orb = trsh.transformedShape();
+                RawShape stat = sh.transformedShape();
+                if(!holes) sl::holes(stat).clear();
 
-            correctNfpPosition(subnfp, sh, trsh);
+                if(sh.isContourConvex() && orbconvex)
+                    subnfp = noFitPolygon<NfpLevel::CONVEX_ONLY>(stat, orb);
+                else if(orbconvex)
+                    subnfp = noFitPolygon<NfpLevel::ONE_CONVEX>(stat, orb);
+                else
+                    subnfp = noFitPolygon<Level::value>(stat, orb);
 
-            nfps = nfp::merge(nfps, subnfp.first);
-        }
+                cache.insert(key, subnfp);
+            }
+
+            correctNfpPosition(subnfp, sh, trsh);
+            nfps[n] = std::move(subnfp.first);
+        });
 
-        return nfps;
+        return nfp::merge(nfps);
     }
 
     // Very much experimental
@@ -863,9 +1018,75 @@ private:
             auto initial_rot = item.rotation();
             Vertex final_tr = {0, 0};
             Radians final_rot = initial_rot;
-            Shapes nfps;
 
-            for(auto rot : config_.rotations) {
+            // The pile does not depend on the rotation of the candidate, so it
+            // is prepared once for all the rotations.
+            Shapes pile;
+            pile.reserve(items_.size()+1);
+            // double pile_area = 0;
+            for(Item& mitem : items_) {
+                pile.emplace_back(mitem.transformedShape());
+                // pile_area += mitem.area();
+            }
+
+            auto merged_pile = nfp::merge(pile);
+            auto& bin = bin_;
+            double norm = norm_;
+            auto pbb = sl::boundingBox(merged_pile);
+            auto binbb = sl::boundingBox(bin);
+
+            // This is the kernel part of the object function that is
+            // customizable by the library client
+            auto _objfunc = config_.object_function?
+                        config_.object_function :
+                        [norm, bin, binbb, pbb](const Item& item)
+            {
+                auto ibb = item.boundingBox();
+                auto fullbb = boundingBox(pbb, ibb);
+
+                double score = pl::distance(ibb.center(), binbb.center());
+                score /= norm;
+
+                double miss = overfit(fullbb, bin);
+                miss = miss > 0? miss : 0;
+                score += std::pow(miss, 2);
+
+                return score;
+            };
+
+            std::launch policy = std::launch::deferred;
+            if(config_.parallel) policy |= std::launch::async;
+
+            if(config_.before_packing)
+                config_.before_packing(merged_pile, items_, remlist);
+
+            // The rotations are evaluated in parallel, each on its own copy of
+            // the candidate. Fill the mutable caches of the packed items first,
+            // so that the evaluations only read them.
+            for(Item& itm : items_) {
+                itm.transformedShape();
+                itm.referenceVertex();
+                itm.rightmostTopVertex();
+                itm.leftmostBottomVertex();
+                itm.isContourConvex();
+            }
+
+            struct RotationResult {
+                double score = std::numeric_limits<double>::max();
+                double overfit = std::numeric_limits<double>::max();
+                Vertex tr = {0, 0};
+            };
+
+            std::vector<RotationResult> rotresults(config_.rotations.size());
+
+            const Item& candidate = item;
+            auto evaluate = [this, &candidate, &rotresults, &merged_pile,
+                             &_objfunc, &bin, itemhash, initial_tr,
+                             initial_rot, policy]
+                    (Radians rot, size_t ri)
+            {
+                Item item = candidate;
+                double best_overfit = std::numeric_limits<double>::max();
 
                 item.translation(initial_tr);
                 item.rotation(initial_rot + rot);
@@ -875,7 +1096,8 @@ private:
                 // it is disjunct from the current merged pile
                 placeOutsideOfBin(item);
 
-                nfps = calcnfp({item, itemhash}, Lvl<MaxNfpLevel::value>());
+                auto nfps = calcnfp({item, itemhash},
+                                    Lvl<MaxNfpLevel::value>());
 
                 auto iv = item.referenceVertex();
 
@@ -889,38 +1111,8 @@ private:
                     ecache.back().accuracy(config_.accuracy);
                 }
 
-                Shapes pile;
-                pile.reserve(items_.size()+1);
-                // double pile_area = 0;
-                for(Item& mitem : items_) {
-                    pile.emplace_back(mitem.transformedShape());
-                    // pile_area += mitem.area();
-                }
-
-                auto merged_pile = nfp::merge(pile);
-                auto& bin = bin_;
-                double norm = norm_;
-                auto pbb = sl::boundingBox(merged_pile);
-                auto binbb = sl::boundingBox(bin);
-
-                // This is the kernel part of the object function that is
-                // customizable by the library client
-                auto _objfunc = config_.object_function?
-                            config_.object_function :
-                            [norm, bin, binbb, pbb](const Item& item)
-                {
-                    auto ibb = item.boundingBox();
-                    auto fullbb = boundingBox(pbb, ibb);
-
-                    double score = pl::distance(ibb.center(), binbb.center());
-                    score /= norm;
-
-                    double miss = overfit(fullbb, bin);
-                    miss = miss > 0? miss : 0;
-                    score += std::pow(miss, 2);
-
-                    return score;
-                };
+                // The boundary check extends the pile temporarily
+                auto mpile = merged_pile;
 
                 // Our object function for placement
                 auto rawobjfunc =
@@ -939,7 +1131,7 @@ private:
                 };
 
                 auto boundaryCheck =
-                    [&merged_pile, &getNfpPoint, &item, &bin, &iv, &startpos]
+                    [&mpile, &getNfpPoint, &item, &bin, &iv, &startpos]
                     (const Optimum& o)
                 {
                     auto v = getNfpPoint(o);
@@ -947,20 +1139,15 @@ private:
                     d += startpos;
                     item.translation(d);
 
-                    merged_pile.emplace_back(item.transformedShape());
-                    auto chull = sl::convexHull(merged_pile);
-                    merged_pile.pop_back();
+                    mpile.emplace_back(item.transformedShape());
+                    auto chull = sl::convexHull(mpile);
+                    mpile.pop_back();
 
                     return overfit(chull, bin);
                 };
 
                 Optimum optimum(0, 0);
                 double best_score = std::numeric_limits<double>::max();
-                std::launch policy = std::launch::deferred;
-                if(config_.parallel) policy |= std::launch::async;
-
-                if(config_.before_packing)
-                    config_.before_packing(merged_pile, items_, remlist);
 
                 using OptResult = opt::Result<double>;
                 using OptResults = std::vector<OptResult>;
@@ -1071,13 +1258,29 @@ private:
                     }
                 }
 
-                if( best_score < global_score ) {
+                RotationResult& res = rotresults[ri];
+                res.overfit = best_overfit;
+                if(best_score < std::numeric_limits<double>::max()) {
                     auto d = getNfpPoint(optimum) - iv;
                     d += startpos;
-                    final_tr = d;
-                    final_rot = initial_rot + rot;
+                    res.tr = d;
+                    res.score = best_score;
+                }
+            };
+
+            __parallel::enumerate(config_.rotations.begin(),
+                                  config_.rotations.end(), evaluate, policy);
+
+            // The first of the equally good rotations wins, the same as with
+            // the rotations evaluated one by one.
+            for(size_t ri = 0; ri < rotresults.size(); ++ri) {
+                auto& res = rotresults[ri];
+                best_overfit = std::min(best_overfit, res.overfit);
+                if( res.score < global_score ) {
+                    final_tr = res.tr;
+                    final_rot = initial_rot + config_.rotations[ri];
                     can_pack = true;
-                    global_score = best_score;
+                    global_score = res.score;
                 }
             }
 
@@ -785,9 +785,149 @@ TEST(GeometryAlgorithms, nfpConvexConvex) {
     testNfp<nfp::NfpLevel::CONVEX_ONLY, 1>(nfp_testdata);
 }
 
-//TEST(GeometryAlgorithms, nfpConcaveConcave) {
-//    testNfp<NfpLevel::BOTH_CONCAVE, 1000>(nfp_concave_testdata);
-//}
+// The non-convex NFP vertices come from rounded edge intersections, so the
+// placed orbiter may be off the stationary polygon by a unit or so.
+template<nfp::NfpLevel lvl>
+void testNfpApprox(const std::vector<ItemPair>& testdata, Coord tolerance) {
+    using namespace libnest2d;
+
+    auto onetest = [&](Item& orbiter, Item& stationary) {
+        orbiter.translate({210000, 0});
+
+        auto&& nfp = nfp::noFitPolygon<lvl>(stationary.rawShape(),
+                                            orbiter.transformedShape());
+
+        placers::correctNfpPosition(nfp, stationary, orbiter);
+
+        ASSERT_TRUE(shapelike::isValid(nfp.first).first);
+
+        Item infp(nfp.first);
+        infp.addOffset(tolerance);
+        ASSERT_TRUE(stationary.isInside(infp));
+
+        auto vo = nfp::referenceVertex(orbiter.transformedShape());
+
+        for(auto v : shapelike::contour(nfp.first)) {
+            Item tmp = orbiter;
+            tmp.translate({getX(v) - getX(vo), getY(v) - getY(vo)});
+
+            Item outer = tmp, inner = tmp;
+            outer.addOffset(tolerance);
+            inner.addOffset(-tolerance);
+
+            ASSERT_TRUE(Item::intersects(outer, stationary));
+            ASSERT_FALSE(Item::intersects(inner, stationary));
+        }
+    };
+
+    for(auto& td : testdata) {
+        auto orbiter = td.orbiter;
+        auto stationary = td.stationary;
+        onetest(orbiter, stationary);
+    }
+
+    for(auto& td : testdata) {
+        auto orbiter = td.stationary;
+        auto stationary = td.orbiter;
+        onetest(orbiter, stationary);
+    }
+}
+
+TEST(GeometryAlgorithms, nfpConcaveConcave) {
+    testNfpApprox<nfp::NfpLevel::BOTH_CONCAVE>(nfp_concave_testdata, 5);
+}
+
+TEST(GeometryAlgorithms, nfpWithHoles) {
+    using namespace libnest2d;
+
+    // A frame with a 60x60 hole and a 20x20 square which fits into the hole
+    Item frame({ {0, 0}, {0, 100}, {100, 100}, {100, 0}, {0, 0} },
+               { { {20, 20}, {80, 20}, {80, 80}, {20, 80}, {20, 20} } });
+    Rectangle rect(20, 20);
+
+    auto&& nfp = nfp::noFitPolygon<nfp::NfpLevel::BOTH_CONCAVE_WITH_HOLES>(
+                frame.transformedShape(), rect.transformedShape());
+
+    placers::correctNfpPosition(nfp, frame, rect);
+
+    ASSERT_TRUE(shapelike::isValid(nfp.first).first);
+
+    // The outer contour is the frame grown by the square, the hole holds the
+    // positions of the square's reference vertex inside the frame's hole.
+    ASSERT_EQ(shapelike::holeCount(nfp.first), 1);
+    ASSERT_DOUBLE_EQ(std::abs(ClipperLib::Area(nfp.first.Contour)), 120.0*120.0);
+    ASSERT_DOUBLE_EQ(std::abs(ClipperLib::Area(nfp.first.Holes.front())),
+                     40.0*40.0);
+
+    auto bb = Item(nfp.first.Holes.front()).boundingBox();
+    ASSERT_EQ(getX(bb.minCorner()), 40);
+    ASSERT_EQ(getY(bb.minCorner()), 40);
+}
+
+TEST(GeometryAlgorithms, nfpCache) {
+    using namespace libnest2d;
+    using Cache = placers::NfpCache<PolygonImpl>;
+    using __itemhash::GeometryKey;
+
+    Rectangle stat(20, 10), orb(10, 10), moved(20, 10), rotated(20, 10);
+    moved.translate({100, 50});
+    rotated.rotation(Pi/2);
+
+    auto statkey = __itemhash::geometryKey(stat);
+
+    // The translation is not part of the key, the rotation is.
+    ASSERT_TRUE(__itemhash::geometryKey(moved) == statkey);
+    ASSERT_FALSE(__itemhash::geometryKey(rotated) == statkey);
+
+    auto keyptr = [](const GeometryKey& k) {
+        return std::make_shared<GeometryKey>(k);
+    };
+
+    Cache cache;
+    auto nfp = nfp::noFitPolygon<nfp::NfpLevel::CONVEX_ONLY>(
+                stat.transformedShape(), orb.transformedShape());
+    cache.insert(Cache::Key(keyptr(statkey),
+                            keyptr(__itemhash::geometryKey(orb)), true), nfp);
+
+    // Equal geometries hit the cache, the cached NFP moved into place equals
+    // the NFP calculated for the moved item.
+    nfp::NfpResult<PolygonImpl> cached;
+    ASSERT_TRUE(cache.find(Cache::Key(keyptr(__itemhash::geometryKey(moved)),
+                                      keyptr(__itemhash::geometryKey(orb)),
+                                      true), cached));
+
+    auto calculated = nfp::noFitPolygon<nfp::NfpLevel::CONVEX_ONLY>(
+                moved.transformedShape(), orb.transformedShape());
+    placers::correctNfpPosition(cached, moved, orb);
+    placers::correctNfpPosition(calculated, moved, orb);
+    ASSERT_DOUBLE_EQ(shapelike::area(cached.first),
+                     shapelike::area(calculated.first));
+    ASSERT_EQ(Item(cached.first).boundingBox().minCorner(),
+              Item(calculated.first).boundingBox().minCorner());
+
+    // Different geometries miss, even if their hashes collide.
+    ASSERT_FALSE(cache.find(Cache::Key(keyptr(__itemhash::geometryKey(rotated)),
+                                       keyptr(__itemhash::geometryKey(orb)),
+                                       true), cached));
+
+    GeometryKey collision = __itemhash::geometryKey(orb);
+    collision.hash = statkey.hash;
+    ASSERT_FALSE(cache.find(Cache::Key(keyptr(collision),
+                                       keyptr(__itemhash::geometryKey(orb)),
+                                       true), cached));
+
+    ASSERT_FALSE(cache.find(Cache::Key(keyptr(statkey),
+                                       keyptr(__itemhash::geometryKey(orb)),
+                                       false), cached));
+
+    // The cache is dropped as a whole when it is full.
+    Cache small(1);
+    small.insert(Cache::Key(keyptr(statkey), keyptr(statkey), true), nfp);
+    small.insert(Cache::Key(keyptr(collision), keyptr(statkey), true), nfp);
+    ASSERT_EQ(small.size(), 1u);
+    ASSERT_FALSE(small.find(Cache::Key(keyptr(statkey), keyptr(statkey), true),
+                            cached));
+}
 
 TEST(GeometryAlgorithms, pointOnPolygonContour) {
     using namespace libnest2d;
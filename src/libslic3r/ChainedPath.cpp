@@ -0,0 +1,210 @@
+#include "ChainedPath.hpp"
+#include "BoundingBox.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace Slic3r {
+
+// Regular grid of the entry points of the items not yet visited by chain_items().
+class ChainingGrid
+{
+public:
+    ChainingGrid(const std::vector<std::pair<Point, Point>> &ends, const std::vector<bool> &reversible, const std::vector<char> &visited, bool ties_to_last) :
+        m_ends(ends), m_ties_to_last(ties_to_last), m_num_entries(0), m_cell_size(1.), m_cols(0), m_rows(0)
+    {
+        for (size_t i = 0; i < ends.size(); ++ i)
+            if (! visited[i]) {
+                m_entries.push_back(GridEntry(ends[i].first, i * 2));
+                if (reversible[i])
+                    m_entries.push_back(GridEntry(ends[i].second, i * 2 + 1));
+            }
+        m_num_entries = m_entries.size();
+        if (m_entries.empty())
+            return;
+
+        m_bbox.min = m_bbox.max = m_entries.front().pt;
+        for (const GridEntry &entry : m_entries) {
+            m_bbox.min = m_bbox.min.cwiseMin(entry.pt);
+            m_bbox.max = m_bbox.max.cwiseMax(entry.pt);
+        }
+        if (m_num_entries <= 64) {
+            // A linear search is cheaper than walking the grid.
+            m_cols = m_rows = 1;
+            m_cell_size = std::max(double(m_bbox.max(0) - m_bbox.min(0)), double(m_bbox.max(1) - m_bbox.min(1))) + 1.;
+        } else {
+            // Aim at a single entry point per cell on average.
+            double w = double(m_bbox.max(0) - m_bbox.min(0));
+            double h = double(m_bbox.max(1) - m_bbox.min(1));
+            double n = double(m_num_entries);
+            m_cell_size = std::max(std::max(sqrt(w * h / n), std::max(w, h) / n), 1.);
+            m_cols = size_t(w / m_cell_size) + 1;
+            m_rows = size_t(h / m_cell_size) + 1;
+        }
+
+        // Sort the entries by cells, the entries of the i-th cell are stored at m_entries[m_cell_begin[i] .. m_cell_end[i]).
+        m_cell_begin.assign(m_cols * m_rows + 1, 0);
+        for (const GridEntry &entry : m_entries)
+            ++ m_cell_begin[this->cell_idx(entry.pt) + 1];
+        for (size_t i = 1; i < m_cell_begin.size(); ++ i)
+            m_cell_begin[i] += m_cell_begin[i - 1];
+        m_cell_end.assign(m_cell_begin.begin(), m_cell_begin.end() - 1);
+        std::vector<GridEntry> entries(m_entries.size(), GridEntry(Point(0, 0), 0));
+        for (const GridEntry &entry : m_entries)
+            entries[m_cell_end[this->cell_idx(entry.pt)] ++] = entry;
+        m_entries = std::move(entries);
+    }
+
+    // Number of entry points not yet removed.
+    size_t num_entries() const { return m_num_entries; }
+    // Number of entry points the grid was built with.
+    size_t num_entries_initial() const { return m_entries.size(); }
+
+    // Find the entry point closest to pt, returns the entry index.
+    size_t nearest(const Point &pt) const
+    {
+        assert(m_num_entries > 0);
+        size_t cx = this->cell_x(pt(0));
+        size_t cy = this->cell_y(pt(1));
+        size_t best_entry = std::numeric_limits<size_t>::max();
+        double best_dist  = std::numeric_limits<double>::max();
+        auto visit_cell = [this, &pt, &best_entry, &best_dist](size_t x, size_t y) {
+            size_t cell = y * m_cols + x;
+            for (size_t i = m_cell_begin[cell]; i < m_cell_end[cell]; ++ i) {
+                const GridEntry &entry = m_entries[i];
+                double d = sqr(double(pt(0)) - double(entry.pt(0))) + sqr(double(pt(1)) - double(entry.pt(1)));
+                if (this->better(d, entry.idx, best_dist, best_entry)) {
+                    best_dist  = d;
+                    best_entry = entry.idx;
+                }
+            }
+        };
+        for (size_t r = 0;; ++ r) {
+            // Visit the cells of the r-th ring around (cx, cy).
+            size_t x0 = (cx >= r) ? cx - r : 0;
+            size_t x1 = std::min(cx + r, m_cols - 1);
+            size_t y0 = (cy >= r) ? cy - r : 0;
+            size_t y1 = std::min(cy + r, m_rows - 1);
+            for (size_t y = y0; y <= y1; ++ y) {
+                if (y + r == cy || y == cy + r) {
+                    // Top or bottom row of the ring.
+                    for (size_t x = x0; x <= x1; ++ x)
+                        visit_cell(x, y);
+                } else {
+                    // Left and right column of the ring.
+                    if (cx >= r)
+                        visit_cell(cx - r, y);
+                    if (r > 0 && cx + r < m_cols)
+                        visit_cell(cx + r, y);
+                }
+            }
+            // Lower bound of the distance of the entry points outside the cells visited so far.
+            bool   covered = true;
+            double bound   = std::numeric_limits<double>::max();
+            if (cx >= r + 1) {
+                covered = false;
+                bound = std::min(bound, double(pt(0)) - (double(m_bbox.min(0)) + double(cx - r) * m_cell_size));
+            }
+            if (cx + r + 1 < m_cols) {
+                covered = false;
+                bound = std::min(bound, double(m_bbox.min(0)) + double(cx + r + 1) * m_cell_size - double(pt(0)));
+            }
+            if (cy >= r + 1) {
+                covered = false;
+                bound = std::min(bound, double(pt(1)) - (double(m_bbox.min(1)) + double(cy - r) * m_cell_size));
+            }
+            if (cy + r + 1 < m_rows) {
+                covered = false;
+                bound = std::min(bound, double(m_bbox.min(1)) + double(cy + r + 1) * m_cell_size - double(pt(1)));
+            }
+            if (covered)
+                break;
+            bound = std::max(bound, 0.);
+            // Keep searching while an entry point outside may still be closer or equally close.
+            if (best_entry != std::numeric_limits<size_t>::max() && bound * bound > best_dist)
+                break;
+        }
+        assert(best_entry != std::numeric_limits<size_t>::max());
+        return best_entry;
+    }
+
+    // Remove the entry point from the grid.
+    void remove(size_t entry_idx)
+    {
+        const Point &pt = (entry_idx & 1) ? m_ends[entry_idx / 2].second : m_ends[entry_idx / 2].first;
+        size_t cell = this->cell_idx(pt);
+        for (size_t i = m_cell_begin[cell]; i < m_cell_end[cell]; ++ i)
+            if (m_entries[i].idx == entry_idx) {
+                std::swap(m_entries[i], m_entries[-- m_cell_end[cell]]);
+                -- m_num_entries;
+                return;
+            }
+        assert(false);
+    }
+
+private:
+    struct GridEntry {
+        GridEntry(const Point &pt, size_t idx) : pt(pt), idx(idx) {}
+        Point   pt;
+        size_t  idx;
+    };
+
+    // Same ordering as the linear searches this class replaces, see chain_items().
+    bool better(double d, size_t idx, double best_d, size_t best_idx) const
+    {
+        if (d != best_d)
+            return d < best_d;
+        return (d == 0. || ! m_ties_to_last) ? idx < best_idx : idx > best_idx;
+    }
+
+    size_t cell_x(coord_t x) const
+        { return (x <= m_bbox.min(0)) ? 0 : std::min(size_t((double(x) - double(m_bbox.min(0))) / m_cell_size), m_cols - 1); }
+    size_t cell_y(coord_t y) const
+        { return (y <= m_bbox.min(1)) ? 0 : std::min(size_t((double(y) - double(m_bbox.min(1))) / m_cell_size), m_rows - 1); }
+    size_t cell_idx(const Point &pt) const
+        { return this->cell_y(pt(1)) * m_cols + this->cell_x(pt(0)); }
+
+    const std::vector<std::pair<Point, Point>> &m_ends;
+    bool                    m_ties_to_last;
+    std::vector<GridEntry>  m_entries;
+    size_t                  m_num_entries;
+    BoundingBox             m_bbox;
+    double                  m_cell_size;
+    size_t                  m_cols;
+    size_t                  m_rows;
+    std::vector<size_t>     m_cell_begin;
+    std::vector<size_t>     m_cell_end;
+};
+
+std::vector<std::pair<size_t, bool>> chain_items(
+    const std::vector<std::pair<Point, Point>> &ends,
+    const std::vector<bool>                    &reversible,
+    Point                                       start_near,
+    bool                                        ties_to_last)
+{
+    assert(ends.size() == reversible.size());
+    std::vector<std::pair<size_t, bool>> out;
+    out.reserve(ends.size());
+    std::vector<char> visited(ends.size(), false);
+    std::unique_ptr<ChainingGrid> grid(new ChainingGrid(ends, reversible, visited, ties_to_last));
+    while (out.size() < ends.size()) {
+        // Once most of the entry points were consumed, rebuild the grid to keep the cells populated.
+        if (grid->num_entries() * 4 < grid->num_entries_initial())
+            grid.reset(new ChainingGrid(ends, reversible, visited, ties_to_last));
+        size_t entry_idx = grid->nearest(start_near);
+        size_t item_idx  = entry_idx / 2;
+        bool   reversed  = (entry_idx & 1) != 0;
+        grid->remove(item_idx * 2);
+        if (reversible[item_idx])
+            grid->remove(item_idx * 2 + 1);
+        visited[item_idx] = true;
+        out.emplace_back(item_idx, reversed);
+        start_near = reversed ? ends[item_idx].first : ends[item_idx].second;
+    }
+    return out;
+}
+
+} // namespace Slic3r
@@ -0,0 +1,35 @@
+#ifndef slic3r_ChainedPath_hpp_
+#define slic3r_ChainedPath_hpp_
+
+#include "libslic3r.h"
+#include "Point.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace Slic3r {
+
+// Greedy nearest neighbor walk over a set of items, starting at start_near.
+// The i-th item starts at ends[i].first and ends at ends[i].second. If reversible[i] is set,
+// the item may be entered through its end point, in that case it is traversed in reverse.
+// After an item is visited, the walk continues from the point the item was left at.
+//
+// The nearest entry point is searched for in a regular grid, which is rebuilt as the items get consumed,
+// therefore the walk runs in close to O(n log n) for the usual distributions of points instead of O(n^2)
+// of the linear search it replaces.
+//
+// The ties are resolved the same way the linear searches did: An entry point coinciding with the current point
+// is resolved to the lowest entry index, other entry points at the same distance are resolved to the lowest entry index
+// or to the highest entry index if ties_to_last is set. The entry index is 2 * i for the start point of the i-th item
+// and 2 * i + 1 for its end point.
+//
+// Returns pairs of (item index, reversed) in the order of visiting.
+std::vector<std::pair<size_t, bool>> chain_items(
+    const std::vector<std::pair<Point, Point>> &ends,
+    const std::vector<bool>                    &reversible,
+    Point                                       start_near,
+    bool                                        ties_to_last = false);
+
+} // namespace Slic3r
+
+#endif /* slic3r_ChainedPath_hpp_ */
@@ -119,6 +119,7 @@ PolyTreeToExPolygons(ClipperLib::PolyTree& polytree)
 Slic3r::Polygon ClipperPath_to_Slic3rPolygon(const ClipperLib::Path &input)
 {
     Polygon retval;
+    retval.points.reserve(input.size());
     for (ClipperLib::Path::const_iterator pit = input.begin(); pit != input.end(); ++pit)
         retval.points.push_back(Point( (*pit).X, (*pit).Y ));
     return retval;
@@ -127,6 +128,7 @@ Slic3r::Polygon ClipperPath_to_Slic3rPolygon(const ClipperLib::Path &input)
 Slic3r::Polyline ClipperPath_to_Slic3rPolyline(const ClipperLib::Path &input)
 {
     Polyline retval;
+    retval.points.reserve(input.size());
     for (ClipperLib::Path::const_iterator pit = input.begin(); pit != input.end(); ++pit)
         retval.points.push_back(Point( (*pit).X, (*pit).Y ));
     return retval;
@@ -170,6 +172,7 @@ ClipperLib::Path
 Slic3rMultiPoint_to_ClipperPath(const MultiPoint &input)
 {
     ClipperLib::Path retval;
+    retval.reserve(input.points.size());
     for (Points::const_iterator pit = input.points.begin(); pit != input.points.end(); ++pit)
         retval.push_back(ClipperLib::IntPoint( (*pit)(0), (*pit)(1) ));
     return retval;
@@ -188,6 +191,7 @@ Slic3rMultiPoint_to_ClipperPath_reversed(const Slic3r::MultiPoint &input)
 ClipperLib::Paths Slic3rMultiPoints_to_ClipperPaths(const Polygons &input)
 {
     ClipperLib::Paths retval;
+    retval.reserve(input.size());
     for (Polygons::const_iterator it = input.begin(); it != input.end(); ++it)
         retval.push_back(Slic3rMultiPoint_to_ClipperPath(*it));
     return retval;
@@ -196,6 +200,7 @@ ClipperLib::Paths Slic3rMultiPoints_to_ClipperPaths(const Polygons &input)
 ClipperLib::Paths Slic3rMultiPoints_to_ClipperPaths(const Polylines &input)
 {
     ClipperLib::Paths retval;
+    retval.reserve(input.size());
     for (Polylines::const_iterator it = input.begin(); it != input.end(); ++it)
         retval.push_back(Slic3rMultiPoint_to_ClipperPath(*it));
     return retval;
@@ -269,7 +274,7 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygon &expolygon, const float delta,
             co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
             ClipperLib::Paths out;
             co.Execute(out, - delta_scaled);
-            holes.insert(holes.end(), out.begin(), out.end());
+            holes.insert(holes.end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
         }
     }
 
@@ -342,7 +347,7 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delt
                     co.AddPath(input, joinType, ClipperLib::etClosedPolygon);
                     ClipperLib::Paths out;
                     co.Execute(out, - delta_scaled);
-                    holes.insert(holes.end(), out.begin(), out.end());
+                    holes.insert(holes.end(), std::make_move_iterator(out.begin()), std::make_move_iterator(out.end()));
                 }
             }
 
@@ -361,7 +366,7 @@ ClipperLib::Paths _offset(const Slic3r::ExPolygons &expolygons, const float delt
                 ClipperLib::Paths output;
                 clipper.Execute(ClipperLib::ctDifference, output, ClipperLib::pftNonZero, ClipperLib::pftNonZero);
                 if (! output.empty()) {
-                    contours_cummulative.insert(contours_cummulative.end(), output.begin(), output.end());
+                    contours_cummulative.insert(contours_cummulative.end(), std::make_move_iterator(output.begin()), std::make_move_iterator(output.end()));
                     ++ expolygons_collected;
                 } else {
                     // The offsetted holes have eaten up the offsetted outer contour.
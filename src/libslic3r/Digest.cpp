@@ -0,0 +1,26 @@
+#include "Digest.hpp"
+#include "TriangleMesh.hpp"
+
+#include <cstdio>
+
+namespace Slic3r {
+
+std::string Digest::digest()
+{
+    unsigned int digest[5];
+    m_sha1.get_digest(digest);
+    char buf[41];
+    for (size_t i = 0; i < 5; ++ i)
+        sprintf(buf + i * 8, "%08x", digest[i]);
+    return std::string(buf, 40);
+}
+
+void digest_mesh(Digest &digest, const TriangleMesh &mesh)
+{
+    const stl_file &stl = mesh.stl;
+    digest.append(uint64_t(stl.stats.number_of_facets));
+    for (int i = 0; i < stl.stats.number_of_facets; ++ i)
+        digest.append(stl.facet_start[i].vertex, 3 * sizeof(stl_vertex));
+}
+
+} // namespace Slic3r
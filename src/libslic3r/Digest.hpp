@@ -0,0 +1,49 @@
+#ifndef slic3r_Digest_hpp_
+#define slic3r_Digest_hpp_
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/uuid/detail/sha1.hpp>
+
+namespace Slic3r {
+
+class TriangleMesh;
+
+// SHA1 digest of a sequence of plain values, used as a key of the cached computations.
+class Digest
+{
+public:
+    void append(const void *data, size_t size) { m_sha1.process_bytes(data, size); }
+    template<typename T> void append(const T &value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Digest::append() accepts plain values only");
+        this->append(&value, sizeof(T));
+    }
+    template<typename T> void append(const std::vector<T> &values)
+    {
+        this->append(uint64_t(values.size()));
+        for (const T &value : values)
+            this->append(value);
+    }
+    void append(const std::string &str)
+    {
+        this->append(uint64_t(str.size()));
+        this->append(str.data(), str.size());
+    }
+
+    // Hexadecimal representation of the digest, to be used as a file name.
+    std::string digest();
+
+private:
+    boost::uuids::detail::sha1 m_sha1;
+};
+
+// Append the facet count and the vertices of all the facets of the mesh in their order.
+extern void digest_mesh(Digest &digest, const TriangleMesh &mesh);
+
+} // namespace Slic3r
+
+#endif /* slic3r_Digest_hpp_ */
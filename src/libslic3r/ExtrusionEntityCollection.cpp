@@ -1,4 +1,5 @@
 #include "ExtrusionEntityCollection.hpp"
+#include "ChainedPath.hpp"
 #include <algorithm>
 #include <cmath>
 #include <map>
@@ -111,10 +112,9 @@ void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEnt
     retval->entities.reserve(this->entities.size());
     retval->orig_indices.reserve(this->entities.size());
     
-    // if we're asked to return the original indices, build a map
-    std::map<ExtrusionEntity*,size_t> indices_map;
-    
-    ExtrusionEntitiesPtr my_paths;
+    // Indices of the entities to be chained.
+    std::vector<size_t> entity_indices;
+    entity_indices.reserve(this->entities.size());
     for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it) {
         if (role != erMixed) {
             // The caller wants only paths with a specific extrusion role.
@@ -125,36 +125,26 @@ void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEnt
                 continue;
             }
         }
-
-        ExtrusionEntity* entity = (*it)->clone();
-        my_paths.push_back(entity);
-        if (orig_indices != NULL) indices_map[entity] = it - this->entities.begin();
+        entity_indices.push_back(it - this->entities.begin());
     }
     
-    Points endpoints;
-    for (ExtrusionEntitiesPtr::iterator it = my_paths.begin(); it != my_paths.end(); ++it) {
-        endpoints.push_back((*it)->first_point());
-        if (no_reverse || !(*it)->can_reverse()) {
-            endpoints.push_back((*it)->first_point());
-        } else {
-            endpoints.push_back((*it)->last_point());
-        }
+    std::vector<std::pair<Point, Point>> endpoints;
+    std::vector<bool>                    reversible;
+    endpoints.reserve(entity_indices.size());
+    reversible.reserve(entity_indices.size());
+    for (size_t idx : entity_indices) {
+        const ExtrusionEntity *entity = this->entities[idx];
+        endpoints.emplace_back(entity->first_point(), entity->last_point());
+        // never reverse loops, since it's pointless for chained path and callers might depend on orientation
+        reversible.push_back(! no_reverse && entity->can_reverse());
     }
     
-    while (!my_paths.empty()) {
-        // find nearest point
-        int start_index = start_near.nearest_point_index(endpoints);
-        int path_index = start_index/2;
-        ExtrusionEntity* entity = my_paths.at(path_index);
-        // never reverse loops, since it's pointless for chained path and callers might depend on orientation
-        if (start_index % 2 && !no_reverse && entity->can_reverse()) {
+    for (const std::pair<size_t, bool> &item : chain_items(endpoints, reversible, start_near, true)) {
+        ExtrusionEntity* entity = this->entities[entity_indices[item.first]]->clone();
+        if (item.second)
             entity->reverse();
-        }
-        retval->entities.push_back(my_paths.at(path_index));
-        if (orig_indices != NULL) orig_indices->push_back(indices_map[entity]);
-        my_paths.erase(my_paths.begin() + path_index);
-        endpoints.erase(endpoints.begin() + 2*path_index, endpoints.begin() + 2*path_index + 2);
-        start_near = retval->entities.back()->last_point();
+        retval->entities.push_back(entity);
+        if (orig_indices != NULL) orig_indices->push_back(entity_indices[item.first]);
     }
 }
 
@@ -0,0 +1,221 @@
+#include "ExtrusionEntityCompact.hpp"
+#include "ExtrusionEntityCollection.hpp"
+
+#include <cassert>
+#include <stdexcept>
+#include <limits>
+
+namespace Slic3r {
+
+ExtrusionEntityCompact::ExtrusionEntityCompact(const ExtrusionEntityCollection &collection)
+{
+    this->append_entities(collection);
+}
+
+void ExtrusionEntityCompact::push_path(const ExtrusionPath &path)
+{
+    Path out;
+    out.first_point = uint32_t(this->points.size());
+    out.num_points  = uint32_t(path.polyline.points.size());
+    out.role        = path.role();
+    out.width       = path.width;
+    out.height      = path.height;
+    out.mm3_per_mm  = path.mm3_per_mm;
+    this->points.insert(this->points.end(), path.polyline.points.begin(), path.polyline.points.end());
+    this->paths.emplace_back(out);
+}
+
+size_t ExtrusionEntityCompact::push_entity(const ExtrusionEntity &entity)
+{
+    size_t idx = this->entities.size();
+    Entity out;
+    out.loop_role  = elrDefault;
+    out.no_sort    = false;
+    out.first_path = uint32_t(this->paths.size());
+    out.num_nested = 0;
+    this->entities.emplace_back(out);
+    if (const ExtrusionPath *path = dynamic_cast<const ExtrusionPath*>(&entity)) {
+        this->entities[idx].type = etPath;
+        this->push_path(*path);
+    } else if (const ExtrusionMultiPath *multipath = dynamic_cast<const ExtrusionMultiPath*>(&entity)) {
+        this->entities[idx].type = etMultiPath;
+        for (const ExtrusionPath &path : multipath->paths)
+            this->push_path(path);
+    } else if (const ExtrusionLoop *loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
+        this->entities[idx].type      = etLoop;
+        this->entities[idx].loop_role = loop->loop_role();
+        for (const ExtrusionPath &path : loop->paths)
+            this->push_path(path);
+    } else if (const ExtrusionEntityCollection *collection = dynamic_cast<const ExtrusionEntityCollection*>(&entity)) {
+        this->entities[idx].type    = etCollection;
+        this->entities[idx].no_sort = collection->no_sort;
+        for (const ExtrusionEntity *nested : collection->entities)
+            this->push_entity(*nested);
+        this->entities[idx].num_nested = uint32_t(this->entities.size() - idx - 1);
+    } else
+        throw std::runtime_error("ExtrusionEntityCompact: Unknown extrusion entity type");
+    this->entities[idx].num_paths = uint32_t(this->paths.size()) - this->entities[idx].first_path;
+    return idx;
+}
+
+void ExtrusionEntityCompact::append(const ExtrusionEntity &entity)
+{
+    this->push_entity(entity);
+}
+
+void ExtrusionEntityCompact::append_entities(const ExtrusionEntityCollection &collection)
+{
+    for (const ExtrusionEntity *entity : collection.entities)
+        this->push_entity(*entity);
+}
+
+void ExtrusionEntityCompact::append_paths(const Polylines &polylines, ExtrusionRole role, double mm3_per_mm, float width, float height)
+{
+    for (const Polyline &polyline : polylines)
+        if (polyline.is_valid()) {
+            Entity entity;
+            entity.type       = etPath;
+            entity.loop_role  = elrDefault;
+            entity.no_sort    = false;
+            entity.first_path = uint32_t(this->paths.size());
+            entity.num_paths  = 1;
+            entity.num_nested = 0;
+            this->entities.emplace_back(entity);
+            Path path;
+            path.first_point = uint32_t(this->points.size());
+            path.num_points  = uint32_t(polyline.points.size());
+            path.role        = role;
+            path.width       = width;
+            path.height      = height;
+            path.mm3_per_mm  = mm3_per_mm;
+            this->paths.emplace_back(path);
+            this->points.insert(this->points.end(), polyline.points.begin(), polyline.points.end());
+        }
+}
+
+void ExtrusionEntityCompact::append_loops(const Polygons &loops, ExtrusionRole role, double mm3_per_mm, float width, float height)
+{
+    for (const Polygon &poly : loops)
+        if (poly.is_valid()) {
+            Entity entity;
+            entity.type       = etLoop;
+            entity.loop_role  = elrDefault;
+            entity.no_sort    = false;
+            entity.first_path = uint32_t(this->paths.size());
+            entity.num_paths  = 1;
+            entity.num_nested = 0;
+            this->entities.emplace_back(entity);
+            Path path;
+            path.first_point = uint32_t(this->points.size());
+            // The loop is closed by repeating the first point.
+            path.num_points  = uint32_t(poly.points.size() + 1);
+            path.role        = role;
+            path.width       = width;
+            path.height      = height;
+            path.mm3_per_mm  = mm3_per_mm;
+            this->paths.emplace_back(path);
+            this->points.insert(this->points.end(), poly.points.begin(), poly.points.end());
+            this->points.emplace_back(poly.points.front());
+        }
+}
+
+std::vector<size_t> ExtrusionEntityCompact::top_level_entities() const
+{
+    std::vector<size_t> out;
+    for (size_t idx = 0; idx < this->entities.size(); idx = this->next_sibling(idx))
+        out.emplace_back(idx);
+    return out;
+}
+
+ExtrusionRole ExtrusionEntityCompact::role(size_t idx_entity) const
+{
+    const Entity &entity = this->entities[idx_entity];
+    if (entity.type != etCollection)
+        return entity.num_paths == 0 ? erNone : this->paths[entity.first_path].role;
+    ExtrusionRole out = erNone;
+    for (size_t idx = idx_entity + 1; idx < this->next_sibling(idx_entity); idx = this->next_sibling(idx)) {
+        ExtrusionRole er = this->role(idx);
+        out = (out == erNone || out == er) ? er : erMixed;
+    }
+    return out;
+}
+
+size_t ExtrusionEntityCompact::items_count() const
+{
+    size_t count = 0;
+    for (const Entity &entity : this->entities)
+        if (entity.type != etCollection)
+            ++ count;
+    return count;
+}
+
+ExtrusionPath ExtrusionEntityCompact::to_path(const Path &path) const
+{
+    ExtrusionPath out(path.role, path.mm3_per_mm, path.width, path.height);
+    out.polyline.points.assign(this->path_begin(path), this->path_end(path));
+    return out;
+}
+
+ExtrusionEntity* ExtrusionEntityCompact::to_entity(size_t idx_entity) const
+{
+    const Entity &entity = this->entities[idx_entity];
+    switch (entity.type) {
+    case etPath:
+        assert(entity.num_paths == 1);
+        return new ExtrusionPath(this->to_path(this->paths[entity.first_path]));
+    case etMultiPath:
+    {
+        ExtrusionMultiPath *out = new ExtrusionMultiPath();
+        out->paths.reserve(entity.num_paths);
+        for (uint32_t i = 0; i < entity.num_paths; ++ i)
+            out->paths.emplace_back(this->to_path(this->paths[entity.first_path + i]));
+        return out;
+    }
+    case etLoop:
+    {
+        ExtrusionLoop *out = new ExtrusionLoop(entity.loop_role);
+        out->paths.reserve(entity.num_paths);
+        for (uint32_t i = 0; i < entity.num_paths; ++ i)
+            out->paths.emplace_back(this->to_path(this->paths[entity.first_path + i]));
+        return out;
+    }
+    case etCollection:
+    default:
+    {
+        assert(entity.type == etCollection);
+        ExtrusionEntityCollection *out = new ExtrusionEntityCollection();
+        out->no_sort = entity.no_sort;
+        for (size_t idx = idx_entity + 1; idx < this->next_sibling(idx_entity); idx = this->next_sibling(idx))
+            out->entities.emplace_back(this->to_entity(idx));
+        return out;
+    }
+    }
+}
+
+void ExtrusionEntityCompact::to_collection(ExtrusionEntityCollection &out) const
+{
+    for (size_t idx = 0; idx < this->entities.size(); idx = this->next_sibling(idx))
+        out.entities.emplace_back(this->to_entity(idx));
+}
+
+double ExtrusionEntityCompact::total_volume() const
+{
+    double volume = 0.;
+    this->for_each_path([&volume](const Path &path, const Point *begin, const Point *end) {
+        double length = 0.;
+        for (const Point *pt = begin + 1; pt < end; ++ pt)
+            length += (*pt - *(pt - 1)).cast<double>().norm();
+        volume += path.mm3_per_mm * unscale<double>(length);
+    });
+    return volume;
+}
+
+double ExtrusionEntityCompact::min_mm3_per_mm() const
+{
+    double min_mm3_per_mm = std::numeric_limits<double>::max();
+    for (const Path &path : this->paths)
+        min_mm3_per_mm = std::min(min_mm3_per_mm, path.mm3_per_mm);
+    return min_mm3_per_mm;
+}
+
+}
@@ -0,0 +1,121 @@
+#ifndef slic3r_ExtrusionEntityCompact_hpp_
+#define slic3r_ExtrusionEntityCompact_hpp_
+
+#include "libslic3r.h"
+#include "BoundingBox.hpp"
+#include "ExtrusionEntity.hpp"
+
+namespace Slic3r {
+
+class ExtrusionEntityCollection;
+
+// Compact storage of a tree of extrusion entities, as produced for a single layer by the perimeter, infill
+// and support generators.
+//
+// ExtrusionEntityCollection owns a separately allocated polymorphic object per each path, multi-path, loop
+// and nested collection, and each path owns its own vector of points. For a large print, that is tens
+// of millions of small allocations, and the traversal of the extrusions is a chase of pointers.
+// Here the points of all the paths are stored in a single buffer, the paths and the entities are plain records
+// referencing ranges of the buffers. The extrusions of a layer are therefore stored in three allocations
+// and traversed linearly.
+//
+// LayerRegion::perimeters / fills are still ExtrusionEntityCollections: the perimeter and infill generators,
+// the tool ordering and the G-code export reorder, split and reverse the entities in place and key the wiping
+// overrides by the entity addresses.
+class ExtrusionEntityCompact
+{
+public:
+    enum EntityType : uint8_t {
+        etPath,
+        etMultiPath,
+        etLoop,
+        etCollection,
+    };
+
+    // A single ExtrusionPath. Only the attributes set by the generators are stored,
+    // not the attributes filled in by the G-code preview (feedrate, extruder and color).
+    struct Path {
+        // Range of this->points.
+        uint32_t            first_point;
+        uint32_t            num_points;
+        ExtrusionRole       role;
+        float               width;
+        float               height;
+        double              mm3_per_mm;
+    };
+
+    // A single ExtrusionPath, ExtrusionMultiPath, ExtrusionLoop or ExtrusionEntityCollection.
+    // The entities are stored in a depth first order, the entities nested in a collection follow the collection.
+    struct Entity {
+        EntityType          type;
+        // Valid for a loop.
+        ExtrusionLoopRole   loop_role;
+        // Valid for a collection.
+        bool                no_sort;
+        // Range of this->paths. For a collection, the paths of all the entities nested in the collection.
+        uint32_t            first_path;
+        uint32_t            num_paths;
+        // Number of entities nested in a collection, recursively. Zero for the other types.
+        uint32_t            num_nested;
+    };
+
+    Points                  points;
+    std::vector<Path>       paths;
+    std::vector<Entity>     entities;
+
+    ExtrusionEntityCompact() {}
+    // Store the entities of a collection at the top level.
+    explicit ExtrusionEntityCompact(const ExtrusionEntityCollection &collection);
+
+    bool                    empty() const { return this->entities.empty(); }
+    void                    clear() { this->points.clear(); this->paths.clear(); this->entities.clear(); }
+    void                    shrink_to_fit() { this->points.shrink_to_fit(); this->paths.shrink_to_fit(); this->entities.shrink_to_fit(); }
+    size_t                  memory_used() const
+        { return this->points.capacity() * sizeof(Point) + this->paths.capacity() * sizeof(Path) + this->entities.capacity() * sizeof(Entity); }
+
+    // Append an entity at the top level. A collection is appended as a nested collection with all its entities.
+    void                    append(const ExtrusionEntity &entity);
+    // Append the entities of a collection at the top level.
+    void                    append_entities(const ExtrusionEntityCollection &collection);
+    // Emit paths and loops directly, the same way extrusion_entities_append_paths() and extrusion_entities_append_loops() do.
+    void                    append_paths(const Polylines &polylines, ExtrusionRole role, double mm3_per_mm, float width, float height);
+    void                    append_loops(const Polygons &loops, ExtrusionRole role, double mm3_per_mm, float width, float height);
+
+    // Points of a path.
+    const Point*            path_begin(const Path &path) const { return this->points.data() + path.first_point; }
+    const Point*            path_end  (const Path &path) const { return this->points.data() + path.first_point + path.num_points; }
+    // Index of the entity following idx_entity and all the entities nested inside idx_entity.
+    size_t                  next_sibling(size_t idx_entity) const { return idx_entity + 1 + this->entities[idx_entity].num_nested; }
+    // Indices of the entities at the top level.
+    std::vector<size_t>     top_level_entities() const;
+    // Role of an entity, folded over the nested entities the same way ExtrusionEntity::role() does.
+    ExtrusionRole           role(size_t idx_entity) const;
+    // First point of the first path of an entity.
+    const Point&            first_point(size_t idx_entity) const
+        { return this->points[this->paths[this->entities[idx_entity].first_path].first_point]; }
+    // Number of the paths, multi-paths and loops, not counting the collections, see ExtrusionEntityCollection::items_count().
+    size_t                  items_count() const;
+
+    // Convert an entity back to a polymorphic object, for the algorithms working over ExtrusionEntity.
+    ExtrusionEntity*        to_entity(size_t idx_entity) const;
+    ExtrusionPath           to_path(const Path &path) const;
+    // Convert the top level entities back, appending them to a collection.
+    void                    to_collection(ExtrusionEntityCollection &out) const;
+
+    // Call fn(const Path &path, const Point *begin, const Point *end) for all the paths in their order.
+    template<typename Fn> void for_each_path(Fn fn) const
+        { for (const Path &path : this->paths) fn(path, this->path_begin(path), this->path_end(path)); }
+
+    BoundingBox             bounding_box() const { return this->points.empty() ? BoundingBox() : BoundingBox(this->points); }
+    double                  total_volume() const;
+    double                  min_mm3_per_mm() const;
+
+private:
+    void                    push_path(const ExtrusionPath &path);
+    // Push the entity together with its paths and nested entities, return the index of the entity.
+    size_t                  push_entity(const ExtrusionEntity &entity);
+};
+
+}
+
+#endif /* slic3r_ExtrusionEntityCompact_hpp_ */
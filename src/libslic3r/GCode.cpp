@@ -20,6 +20,8 @@
 #include <boost/nowide/cstdio.hpp>
 #include <boost/nowide/cstdlib.hpp>
 
+#include <tbb/pipeline.h>
+
 #include "SVG.hpp"
 
 #include <Shiny/Shiny.h>
@@ -144,8 +146,9 @@ Wipe::wipe(GCode &gcodegen, bool toolchange)
             double dE = length * (segment_length / wipe_dist) * 0.95;
             //FIXME one shall not generate the unnecessary G1 Fxxx commands, here wipe_speed is a constant inside this cycle.
             // Is it here for the cooling markers? Or should it be outside of the cycle?
-            gcode += gcodegen.writer().set_speed(wipe_speed*60, "", gcodegen.enable_cooling_markers() ? ";_WIPE" : "");
-            gcode += gcodegen.writer().extrude_to_xy(
+            gcodegen.writer().set_speed(gcode, wipe_speed*60, "", gcodegen.enable_cooling_markers() ? ";_WIPE" : "");
+            gcodegen.writer().extrude_to_xy(
+                gcode,
                 gcodegen.point_to_gcode(line.b),
                 -dE,
                 "wipe and retract"
@@ -439,6 +442,7 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
 
     try {
         m_placeholder_parser_failed_templates.clear();
+        m_placeholder_parser_templates.clear();
         this->_do_export(*print, file);
         fflush(file);
         if (ferror(file)) {
@@ -468,17 +472,6 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
         throw std::runtime_error(msg);
     }
 
-    if (print->config().remaining_times.value) {
-        BOOST_LOG_TRIVIAL(debug) << "Processing remaining times for normal mode";
-        m_normal_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
-        m_normal_time_estimator.reset();
-        if (m_silent_time_estimator_enabled) {
-            BOOST_LOG_TRIVIAL(debug) << "Processing remaining times for silent mode";
-            m_silent_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
-            m_silent_time_estimator.reset();
-        }
-    }
-
     // starts analyzer calculations
     if (m_enable_analyzer) {
         BOOST_LOG_TRIVIAL(debug) << "Preparing G-code preview data";
@@ -486,11 +479,36 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
         m_analyzer.reset();
     }
 
-    if (rename_file(path_tmp, path) != 0)
+    if (print->config().remaining_times.value) {
+        // Insert the remaining times of both modes in a single pass into a second temporary file,
+        // so that a partially written G-code never appears under the final name.
+        // The G-code is therefore written twice and read once: the export into path_tmp, this pass
+        // reading path_tmp and writing path_tmp2, which is then renamed to the final name.
+        BOOST_LOG_TRIVIAL(debug) << "Processing remaining times";
+        std::string path_tmp2 = path_tmp + "2";
+        try {
+            GCodeTimeEstimator::post_process_remaining_times(path_tmp, path_tmp2, &m_normal_time_estimator,
+                m_silent_time_estimator_enabled ? &m_silent_time_estimator : nullptr, 60.0f);
+        } catch (std::exception & /* ex */) {
+            boost::nowide::remove(path_tmp.c_str());
+            boost::nowide::remove(path_tmp2.c_str());
+            throw;
+        }
+        m_normal_time_estimator.reset();
+        if (m_silent_time_estimator_enabled)
+            m_silent_time_estimator.reset();
+        boost::nowide::remove(path_tmp.c_str());
+        path_tmp = path_tmp2;
+    }
+
+    if (rename_file(path_tmp, path) != 0) {
+        boost::nowide::remove(path_tmp.c_str());
         throw std::runtime_error(
             std::string("Failed to rename the output G-code file from ") + path_tmp + " to " + path + '\n' +
             "Is " + path_tmp + " locked?" + '\n');
+    }
 
+    ClipperLib::ReleaseScratchPool();
     BOOST_LOG_TRIVIAL(info) << "Exporting G-code finished" << log_memory_info();
 	print->set_done(psGCodeExport);
 
@@ -901,13 +919,10 @@ void GCode::_do_export(Print &print, FILE *file)
                 m_cooling_buffer->reset();
                 m_cooling_buffer->set_current_extruder(initial_extruder_id);
                 // Pair the object layers with the support layers by z, extrude them.
-                std::vector<LayerToPrint> layers_to_print = collect_layers_to_print(object);
-                for (const LayerToPrint &ltp : layers_to_print) {
-                    std::vector<LayerToPrint> lrs;
-                    lrs.emplace_back(std::move(ltp));
-                    this->process_layer(file, print, lrs, tool_ordering.tools_for_layer(ltp.print_z()), &copy - object.copies().data());
-                    print.throw_if_canceled();
-                }
+                std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> layers_to_print;
+                for (const LayerToPrint &ltp : collect_layers_to_print(object))
+                    layers_to_print.emplace_back(ltp.print_z(), std::vector<LayerToPrint>(1, ltp));
+                this->process_layers(file, print, tool_ordering, layers_to_print, &copy - object.copies().data());
                 if (m_pressure_equalizer)
                     _write(file, m_pressure_equalizer->process("", true));
                 ++ finished_objects;
@@ -957,13 +972,7 @@ void GCode::_do_export(Print &print, FILE *file)
             print.throw_if_canceled();
         }
         // Extrude the layers.
-        for (auto &layer : layers_to_print) {
-            const LayerTools &layer_tools = tool_ordering.tools_for_layer(layer.first);
-            if (m_wipe_tower && layer_tools.has_wipe_tower)
-                m_wipe_tower->next_layer();
-            this->process_layer(file, print, layer.second, layer_tools, size_t(-1));
-            print.throw_if_canceled();
-        }
+        this->process_layers(file, print, tool_ordering, layers_to_print, size_t(-1));
         if (m_pressure_equalizer)
             _write(file, m_pressure_equalizer->process("", true));
         if (m_wipe_tower)
@@ -1002,9 +1011,9 @@ void GCode::_do_export(Print &print, FILE *file)
     print.throw_if_canceled();
 
     // calculates estimated printing time
-    m_normal_time_estimator.calculate_time(false);
+    m_normal_time_estimator.calculate_time();
     if (m_silent_time_estimator_enabled)
-        m_silent_time_estimator.calculate_time(false);
+        m_silent_time_estimator.calculate_time();
 
     // Get filament stats.
     print.m_print_statistics.clear();
@@ -1049,7 +1058,10 @@ void GCode::_do_export(Print &print, FILE *file)
 std::string GCode::placeholder_parser_process(const std::string &name, const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override)
 {
     try {
-        return m_placeholder_parser.process(templ, current_extruder_id, config_override);
+        auto it = m_placeholder_parser_templates.find(templ);
+        if (it == m_placeholder_parser_templates.end())
+            it = m_placeholder_parser_templates.emplace(templ, PlaceholderParser::compile(templ)).first;
+        return m_placeholder_parser.process(it->second, current_extruder_id, config_override);
     } catch (std::runtime_error &err) {
         // Collect the names of failed template substitutions for error reporting.
         m_placeholder_parser_failed_templates.insert(name);
@@ -1224,14 +1236,123 @@ inline std::vector<GCode::ObjectByExtruder::Island>& object_islands_by_extruder(
     return islands;
 }
 
+// Generate and write out a sequence of layers. The export is organized as a pipeline, so that the G-code
+// of the next layers is being generated while the G-code of the previous layers is cooled, post-processed
+// (pressure equalizer, analyzer) and written out / fed to the time estimators.
+// process_layer() depends on the state of this GCode instance left over from the previous layer
+// (extruder, position, avoid crossing perimeters, wipe), therefore each stage except for the cooling
+// processes the layers serially in order and the output is identical to a strictly sequential export.
+// The cooling buffer captures its state at the start of each layer when the layer is generated,
+// the layers are then slowed down in parallel and the fan speed is fixed up in order by the post-processing stage.
+void GCode::process_layers(
+    FILE                                                               *file,
+    const Print                                                        &print,
+    const ToolOrdering                                                 &tool_ordering,
+    const std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>>  &layers,
+    const size_t                                                        single_object_idx)
+{
+    // G-code of a single layer travelling through the pipeline.
+    struct LayerResult {
+        std::string gcode;
+        size_t      layer_id = 0;
+        coordf_t    print_z;
+        // The layer has no extrusions, nothing to write.
+        bool        empty;
+        // State of the cooling buffer at the start of this layer.
+        CoolingBuffer::LayerState cooling;
+    };
+    // Limit the number of layers in flight, so that the memory held by the layer G-code stays bounded.
+    static const size_t max_layers_in_flight = 8;
+
+    // Shared pointers, so that the layers in flight are released if the pipeline is canceled by an exception.
+    typedef std::shared_ptr<LayerResult> LayerResultPtr;
+    size_t layer_to_print_idx = 0;
+    const auto generator = tbb::make_filter<void, LayerResultPtr>(tbb::filter::serial_in_order,
+        [this, &print, &tool_ordering, &layers, &layer_to_print_idx, single_object_idx](tbb::flow_control &fc) -> LayerResultPtr {
+            if (layer_to_print_idx == layers.size()) {
+                fc.stop();
+                return LayerResultPtr();
+            }
+            const std::pair<coordf_t, std::vector<LayerToPrint>> &layer = layers[layer_to_print_idx ++];
+            const LayerTools &layer_tools = tool_ordering.tools_for_layer(layer.first);
+            if (single_object_idx == size_t(-1) && m_wipe_tower && layer_tools.has_wipe_tower)
+                m_wipe_tower->next_layer();
+            print.throw_if_canceled();
+            LayerResultPtr result = std::make_shared<LayerResult>();
+            // In non-sequential mode, some of the objects may have no layer at this print_z.
+            // Prefer the object layer the same way process_layer() does, the layer ID controls the fan of the cooling buffer.
+            const Layer *layer_with_id = nullptr;
+            for (const LayerToPrint &ltp : layer.second)
+                if (ltp.object_layer != nullptr) {
+                    layer_with_id = ltp.object_layer;
+                    break;
+                } else if (layer_with_id == nullptr)
+                    layer_with_id = ltp.support_layer;
+            if (layer_with_id != nullptr)
+                result->layer_id = layer_with_id->id();
+            result->print_z  = layer.first;
+            result->empty    = layer_tools.extruders.empty();
+            if (! result->empty) {
+                result->gcode = this->process_layer(print, layer.second, layer_tools, single_object_idx);
+                if (m_cooling_buffer)
+                    result->cooling = m_cooling_buffer->begin_layer(result->gcode, result->layer_id);
+            }
+            return result;
+        });
+    // Apply the cooling logic; this may alter speeds. The layers are independent of each other once their
+    // cooling buffer state was captured by the generator, therefore they are processed in parallel.
+    const auto cooling = tbb::make_filter<LayerResultPtr, LayerResultPtr>(tbb::filter::parallel,
+        [this](LayerResultPtr result) -> LayerResultPtr {
+            if (! result->empty && m_cooling_buffer)
+                result->gcode = m_cooling_buffer->cool_layer(result->gcode, result->cooling);
+            return result;
+        });
+    const auto postprocessor = tbb::make_filter<LayerResultPtr, LayerResultPtr>(tbb::filter::serial_in_order,
+        [this](LayerResultPtr result) -> LayerResultPtr {
+            if (! result->empty) {
+                // Emit the fan speed at the start of the layer, which depends on the preceding layers.
+                if (m_cooling_buffer)
+                    m_cooling_buffer->end_layer(result->gcode, result->cooling);
+                // Apply pressure equalization if enabled;
+                if (m_pressure_equalizer)
+                    result->gcode = m_pressure_equalizer->process(result->gcode.c_str(), false);
+                // apply analyzer, if enabled
+                if (m_enable_analyzer)
+                    result->gcode = m_analyzer.process_gcode(result->gcode);
+            }
+            return result;
+        });
+    const auto writer = tbb::make_filter<LayerResultPtr, LayerResultPtr>(tbb::filter::serial_in_order,
+        [file](LayerResultPtr result) -> LayerResultPtr {
+            if (! result->empty)
+                fwrite(result->gcode.data(), 1, result->gcode.size(), file);
+            return result;
+        });
+    const auto estimator = tbb::make_filter<LayerResultPtr, void>(tbb::filter::serial_in_order,
+        [this](LayerResultPtr result) {
+            if (! result->empty) {
+                m_normal_time_estimator.add_gcode_block(result->gcode);
+                if (m_silent_time_estimator_enabled)
+                    m_silent_time_estimator.add_gcode_block(result->gcode);
+                BOOST_LOG_TRIVIAL(trace) << "Exported layer " << result->layer_id << " print_z " << result->print_z << 
+                    ", time estimator memory: " <<
+                        format_memsize_MB(m_normal_time_estimator.memory_used() + m_silent_time_estimator_enabled ? m_silent_time_estimator.memory_used() : 0) <<
+                    ", analyzer memory: " <<
+                        format_memsize_MB(m_analyzer.memory_used());
+            }
+        });
+    tbb::parallel_pipeline(max_layers_in_flight, generator & cooling & postprocessor & writer & estimator);
+    // The post-processing stage kept the fan speed in the cooling buffer, the writer owns it again.
+    if (m_cooling_buffer)
+        m_writer.set_fan(m_cooling_buffer->fan_speed());
+}
+
 // In sequential mode, process_layer is called once per each object and its copy, 
 // therefore layers will contain a single entry and single_object_idx will point to the copy of the object.
 // In non-sequential mode, process_layer is called per each print_z height with all object and support layers accumulated.
 // For multi-material prints, this routine minimizes extruder switches by gathering extruder specific extrusion paths
 // and performing the extruder specific extrusions together.
-void GCode::process_layer(
-    // Write into the output file.
-    FILE                            *file,
+std::string GCode::process_layer(
     const Print                     &print,
     // Set of object & print layers of the same PrintObject and with the same print_z.
     const std::vector<LayerToPrint> &layers,
@@ -1245,9 +1366,10 @@ void GCode::process_layer(
     // Either printing all copies of all objects, or just a single copy of a single object.
     assert(single_object_idx == size_t(-1) || layers.size() == 1);
 
+    std::string gcode;
     if (layer_tools.extruders.empty())
         // Nothing to extrude.
-        return;
+        return gcode;
 
     // Extract 1st object_layer and support_layer of this set of layers with an equal print_z.
     const Layer         *object_layer  = nullptr;
@@ -1283,8 +1405,6 @@ void GCode::process_layer(
     }
     // If we're going to apply spiralvase to this layer, disable loop clipping
     m_enable_loop_clipping = ! m_spiral_vase || ! m_spiral_vase->enable;
-    
-    std::string gcode;
 
     // Set new layer - this will change Z and force a retraction if retract_layer_change is enabled.
     if (! print.config().before_layer_gcode.value.empty()) {
@@ -1637,22 +1757,8 @@ void GCode::process_layer(
     if (m_spiral_vase)
         gcode = m_spiral_vase->process_layer(gcode);
 
-    // Apply cooling logic; this may alter speeds.
-    if (m_cooling_buffer)
-        gcode = m_cooling_buffer->process_layer(gcode, layer.id());
-
-    // Apply pressure equalization if enabled;
-    // printf("G-code before filter:\n%s\n", gcode.c_str());
-    if (m_pressure_equalizer)
-        gcode = m_pressure_equalizer->process(gcode.c_str(), false);
-    // printf("G-code after filter:\n%s\n", out.c_str());
-    
-    _write(file, gcode);
-    BOOST_LOG_TRIVIAL(trace) << "Exported layer " << layer.id() << " print_z " << print_z << 
-        ", time estimator memory: " <<
-            format_memsize_MB(m_normal_time_estimator.memory_used() + m_silent_time_estimator_enabled ? m_silent_time_estimator.memory_used() : 0) <<
-        ", analyzer memory: " <<
-            format_memsize_MB(m_analyzer.memory_used());
+    // The cooling buffer, pressure equalization, the analyzer and the time estimators are applied by process_layers().
+    return gcode;
 }
 
 void GCode::apply_print_config(const PrintConfig &print_config)
@@ -2505,14 +2611,15 @@ std::string GCode::_extrude(const ExtrusionPath &path, std::string description,
     }
 
     // F is mm per minute.
-    gcode += m_writer.set_speed(F, "", comment);
+    m_writer.set_speed(gcode, F, "", comment);
     double path_length = 0.;
     {
         std::string comment = m_config.gcode_comments ? description : "";
         for (const Line &line : path.polyline.lines()) {
             const double line_length = line.length() * SCALING_FACTOR;
             path_length += line_length;
-            gcode += m_writer.extrude_to_xy(
+            m_writer.extrude_to_xy(
+                gcode,
                 this->point_to_gcode(line.b),
                 e_per_mm * line_length,
                 comment);
@@ -2565,7 +2672,7 @@ std::string GCode::travel_to(const Point &point, ExtrusionRole role, std::string
     // use G1 because we rely on paths being straight (G0 may make round paths)
     Lines lines = travel.lines();
     for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line)
-	    gcode += m_writer.travel_to_xy(this->point_to_gcode(line->b), comment);
+	    m_writer.travel_to_xy(gcode, this->point_to_gcode(line->b), comment);
     
     return gcode;
 }
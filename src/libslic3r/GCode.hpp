@@ -194,9 +194,18 @@ protected:
     };
     static std::vector<GCode::LayerToPrint>                            collect_layers_to_print(const PrintObject &object);
     static std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> collect_layers_to_print(const Print &print);
-    void            process_layer(
+    void            process_layers(
         // Write into the output file.
         FILE                            *file,
+        const Print                     &print,
+        const ToolOrdering              &tool_ordering,
+        // Layers to print, sorted by print_z.
+        const std::vector<std::pair<coordf_t, std::vector<LayerToPrint>>> &layers,
+        // If set to size_t(-1), then print all copies of all objects.
+        // Otherwise print a single copy of a single object.
+        const size_t                     single_object_idx = size_t(-1));
+    // Returns the G-code of a single layer after the spiral vase post-processing, to be cooled by process_layers().
+    std::string     process_layer(
         const Print                     &print,
         // Set of object & print layers of the same PrintObject and with the same print_z.
         const std::vector<LayerToPrint> &layers,
@@ -268,6 +277,9 @@ protected:
     PlaceholderParser                   m_placeholder_parser;
     // Collection of templates, on which the placeholder substitution failed.
     std::set<std::string>               m_placeholder_parser_failed_templates;
+    // Custom G-code templates compiled during the export, keyed by their source,
+    // so that the per layer and per tool change templates are parsed just once.
+    std::map<std::string, PlaceholderParser::Template> m_placeholder_parser_templates;
     OozePrevention                      m_ooze_prevention;
     Wipe                                m_wipe;
     AvoidCrossingPerimeters             m_avoid_crossing_perimeters;
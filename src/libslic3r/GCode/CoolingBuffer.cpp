@@ -4,6 +4,7 @@
 #include <boost/algorithm/string/replace.hpp>
 #include <iostream>
 #include <float.h>
+#include <string.h>
 
 #if 0
     #define DEBUG
@@ -15,7 +16,9 @@
 
 namespace Slic3r {
 
-CoolingBuffer::CoolingBuffer(GCode &gcodegen) : m_gcodegen(gcodegen), m_current_extruder(0)
+CoolingBuffer::CoolingBuffer(GCode &gcodegen) : 
+    m_gcodegen(gcodegen), m_config(gcodegen.config()), m_toolchange_prefix(gcodegen.writer().toolchange_prefix()),
+    m_extruder_ids(gcodegen.writer().extruder_ids()), m_current_extruder(0)
 {
     this->reset();
 }
@@ -27,7 +30,7 @@ void CoolingBuffer::reset()
     m_current_pos[0] = float(pos(0));
     m_current_pos[1] = float(pos(1));
     m_current_pos[2] = float(pos(2));
-    m_current_pos[4] = float(m_gcodegen.config().travel_speed.value);
+    m_current_pos[4] = float(m_config.travel_speed.value);
 }
 
 struct CoolingLine
@@ -223,26 +226,109 @@ struct PerExtruderAdjustments
 
 std::string CoolingBuffer::process_layer(const std::string &gcode, size_t layer_id)
 {
-    std::vector<PerExtruderAdjustments> per_extruder_adjustments = this->parse_layer_gcode(gcode, m_current_pos);
+    LayerState  state     = this->begin_layer(gcode, layer_id);
+    std::string out       = this->cool_layer(gcode, state);
+    this->end_layer(out, state);
+    return out;
+}
+
+// Parse the axes of a G0, G1 or G92 line, starting after the G-code command, up to a comment or the end of the line.
+// The feedrate is converted from mm/min to mm/sec. Returns a bit mask of the axes set.
+static inline unsigned int parse_axes(const char *c, char extrusion_axis, float *pos)
+{
+    unsigned int axes = 0;
+    for (;;) {
+        // Skip whitespaces.
+        for (; *c == ' ' || *c == '\t'; ++ c);
+        if (*c == 0 || *c == ';' || *c == '\n')
+            break;
+        // Parse the axis.
+        size_t axis = (*c >= 'X' && *c <= 'Z') ? (*c - 'X') :
+                      (*c == extrusion_axis) ? 3 : (*c == 'F') ? 4 : size_t(-1);
+        if (axis != size_t(-1)) {
+            pos[axis] = float(atof(++c));
+            if (axis == 4)
+                // Convert mm/min to mm/sec.
+                pos[4] /= 60.f;
+            axes |= 1 << axis;
+        }
+        // Skip this word.
+        for (; *c != ' ' && *c != '\t' && *c != 0 && *c != '\n'; ++ c);
+    }
+    return axes;
+}
+
+CoolingBuffer::LayerState CoolingBuffer::begin_layer(const std::string &gcode, size_t layer_id)
+{
+    LayerState state;
+    state.layer_id         = layer_id;
+    state.current_pos      = m_current_pos;
+    state.current_extruder = m_current_extruder;
+
+    // The position at the end of the layer is given by the last G0, G1 or G92 line setting each axis,
+    // the extruder by the last tool change. Scan the layer backwards until all of them are known.
+    const char    extrusion_axis = m_config.get_extrusion_axis()[0];
+    unsigned int  axes_missing   = (1 << 5) - 1;
+    bool          tool_missing   = true;
+    const char   *gcode_begin    = gcode.c_str();
+    for (const char *line_end = gcode_begin + gcode.size(); axes_missing != 0 || tool_missing;) {
+        const char *line_start = line_end;
+        while (line_start > gcode_begin && line_start[-1] != '\n')
+            -- line_start;
+        if (line_start[0] == 'G' && (((line_start[1] == '0' || line_start[1] == '1') && line_start[2] == ' ') || 
+                                     (line_start[1] == '9' && line_start[2] == '2' && line_start[3] == ' '))) {
+            if (axes_missing != 0) {
+                float        pos[5];
+                unsigned int axes = parse_axes(line_start + 3, extrusion_axis, pos);
+                for (size_t axis = 0; axis < 5; ++ axis)
+                    if (axes_missing & axes & (1 << axis)) {
+                        m_current_pos[axis] = pos[axis];
+                        axes_missing &= ~ (1 << axis);
+                    }
+            }
+        } else if (tool_missing && strncmp(line_start, m_toolchange_prefix.c_str(), m_toolchange_prefix.size()) == 0) {
+            m_current_extruder = (unsigned int)atoi(line_start + m_toolchange_prefix.size());
+            tool_missing = false;
+        }
+        if (line_start == gcode_begin)
+            break;
+        // Skip the new line character of the preceding line.
+        line_end = line_start - 1;
+    }
+    return state;
+}
+
+std::string CoolingBuffer::cool_layer(const std::string &gcode, LayerState &state) const
+{
+    std::vector<float>                  current_pos              = state.current_pos;
+    std::vector<PerExtruderAdjustments> per_extruder_adjustments = this->parse_layer_gcode(gcode, current_pos, state.current_extruder);
     float layer_time_stretched = this->calculate_layer_slowdown(per_extruder_adjustments);
-    return this->apply_layer_cooldown(gcode, layer_id, layer_time_stretched, per_extruder_adjustments);
+    return this->apply_layer_cooldown(gcode, layer_time_stretched, per_extruder_adjustments, state);
+}
+
+void CoolingBuffer::end_layer(std::string &gcode, const LayerState &state)
+{
+    assert(state.fan_speed_start != -1);
+    if (unsigned(state.fan_speed_start) != m_fan_speed)
+        gcode.insert(0, GCodeWriter::set_fan(m_config.gcode_flavor.value, m_config.gcode_comments.value, state.fan_speed_start));
+    // The fan speed changes inside the layer were emitted by cool_layer(), just save the fan speed at the end of the layer.
+    m_fan_speed = state.fan_speed_end;
 }
 
 // Parse the layer G-code for the moves, which could be adjusted.
 // Return the list of parsed lines, bucketed by an extruder.
-std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos) const
+std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos, unsigned int current_extruder) const
 {
-    const FullPrintConfig       &config        = m_gcodegen.config();
-    const std::vector<Extruder> &extruders     = m_gcodegen.writer().extruders();
+    const FullPrintConfig       &config        = m_config;
     unsigned int                 num_extruders = 0;
-    for (const Extruder &ex : extruders)
-        num_extruders = std::max(ex.id() + 1, num_extruders);
+    for (unsigned int extruder_id : m_extruder_ids)
+        num_extruders = std::max(extruder_id + 1, num_extruders);
     
-    std::vector<PerExtruderAdjustments> per_extruder_adjustments(extruders.size());
+    std::vector<PerExtruderAdjustments> per_extruder_adjustments(m_extruder_ids.size());
     std::vector<size_t>                 map_extruder_to_per_extruder_adjustment(num_extruders, 0);
-    for (size_t i = 0; i < extruders.size(); ++ i) {
+    for (size_t i = 0; i < m_extruder_ids.size(); ++ i) {
 		PerExtruderAdjustments &adj			= per_extruder_adjustments[i];
-		unsigned int			extruder_id = extruders[i].id();
+		unsigned int			extruder_id = m_extruder_ids[i];
 		adj.extruder_id				  = extruder_id;
 		adj.cooling_slow_down_enabled = config.cooling.get_at(extruder_id);
 		adj.slowdown_below_layer_time = config.slowdown_below_layer_time.get_at(extruder_id);
@@ -250,8 +336,7 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
         map_extruder_to_per_extruder_adjustment[extruder_id] = i;
     }
 
-    const std::string toolchange_prefix = m_gcodegen.writer().toolchange_prefix();
-    unsigned int      current_extruder  = m_current_extruder;
+    const std::string &toolchange_prefix = m_toolchange_prefix;
     PerExtruderAdjustments *adjustment  = &per_extruder_adjustments[map_extruder_to_per_extruder_adjustment[current_extruder]];
     const char       *line_start = gcode.c_str();
     const char       *line_end   = line_start;
@@ -280,28 +365,9 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
             // G0, G1 or G92
             // Parse the G-code line.
             std::vector<float> new_pos(current_pos);
-            const char *c = sline.data() + 3;
-            for (;;) {
-                // Skip whitespaces.
-                for (; *c == ' ' || *c == '\t'; ++ c);
-                if (*c == 0 || *c == ';')
-                    break;
-                // Parse the axis.
-                size_t axis = (*c >= 'X' && *c <= 'Z') ? (*c - 'X') :
-                              (*c == extrusion_axis) ? 3 : (*c == 'F') ? 4 : size_t(-1);
-                if (axis != size_t(-1)) {
-                    new_pos[axis] = float(atof(++c));
-                    if (axis == 4) {
-                        // Convert mm/min to mm/sec.
-                        new_pos[4] /= 60.f;
-                        if ((line.type & CoolingLine::TYPE_G92) == 0)
-                            // This is G0 or G1 line and it sets the feedrate. This mark is used for reducing the duplicate F calls.
-                            line.type |= CoolingLine::TYPE_HAS_F;
-                    }
-                }
-                // Skip this word.
-                for (; *c != ' ' && *c != '\t' && *c != 0; ++ c);
-            }
+            if ((parse_axes(sline.data() + 3, extrusion_axis, new_pos.data()) & (1 << 4)) && (line.type & CoolingLine::TYPE_G92) == 0)
+                // This is G0 or G1 line and it sets the feedrate. This mark is used for reducing the duplicate F calls.
+                line.type |= CoolingLine::TYPE_HAS_F;
             bool external_perimeter = boost::contains(sline, ";_EXTERNAL_PERIMETER");
             bool wipe               = boost::contains(sline, ";_WIPE");
             if (external_perimeter)
@@ -521,7 +587,7 @@ static inline void extruder_range_slow_down_non_proportional(
 }
 
 // Calculate slow down for all the extruders.
-float CoolingBuffer::calculate_layer_slowdown(std::vector<PerExtruderAdjustments> &per_extruder_adjustments)
+float CoolingBuffer::calculate_layer_slowdown(std::vector<PerExtruderAdjustments> &per_extruder_adjustments) const
 {
     // Sort the extruders by an increasing slowdown_below_layer_time.
     // The layers with a lower slowdown_below_layer_time are slowed down
@@ -585,12 +651,13 @@ float CoolingBuffer::calculate_layer_slowdown(std::vector<PerExtruderAdjustments
 std::string CoolingBuffer::apply_layer_cooldown(
     // Source G-code for the current layer.
     const std::string                      &gcode,
-    // ID of the current layer, used to disable fan for the first n layers.
-    size_t                                  layer_id, 
     // Total time of this layer after slow down, used to control the fan.
     float                                   layer_time,
     // Per extruder list of G-code lines and their cool down attributes.
-    std::vector<PerExtruderAdjustments>    &per_extruder_adjustments)
+    std::vector<PerExtruderAdjustments>    &per_extruder_adjustments,
+    // State at the start of the layer. The ID of the layer is used to disable fan for the first n layers.
+    // The fan speeds at the start and at the end of the layer are stored here.
+    LayerState                             &state) const
 {
     // First sort the adjustment lines by of multiple extruders by their position in the source G-code.
     std::vector<const CoolingLine*> lines;
@@ -610,9 +677,11 @@ std::string CoolingBuffer::apply_layer_cooldown(
     int  fan_speed          = -1;
     bool bridge_fan_control = false;
     int  bridge_fan_speed   = 0;
-    auto change_extruder_set_fan = [ this, layer_id, layer_time, &new_gcode, &fan_speed, &bridge_fan_control, &bridge_fan_speed ]() {
-        const FullPrintConfig &config = m_gcodegen.config();
-#define EXTRUDER_CONFIG(OPT) config.OPT.get_at(m_current_extruder)
+    size_t       layer_id         = state.layer_id;
+    unsigned int current_extruder = state.current_extruder;
+    auto change_extruder_set_fan = [ this, layer_id, layer_time, &current_extruder, &new_gcode, &fan_speed, &bridge_fan_control, &bridge_fan_speed, &state ]() {
+        const FullPrintConfig &config = m_config;
+#define EXTRUDER_CONFIG(OPT) config.OPT.get_at(current_extruder)
         int min_fan_speed = EXTRUDER_CONFIG(min_fan_speed);
         int fan_speed_new = EXTRUDER_CONFIG(fan_always_on) ? min_fan_speed : 0;
         if (layer_id >= EXTRUDER_CONFIG(disable_fan_first_layers)) {
@@ -640,13 +709,17 @@ std::string CoolingBuffer::apply_layer_cooldown(
         }
         if (fan_speed_new != fan_speed) {
             fan_speed = fan_speed_new;
-            new_gcode += m_gcodegen.writer().set_fan(fan_speed);
+            if (state.fan_speed_start == -1)
+                // The fan speed at the start of the layer depends on the previous layer, it is emitted by end_layer().
+                state.fan_speed_start = fan_speed;
+            else
+                new_gcode += GCodeWriter::set_fan(config.gcode_flavor.value, config.gcode_comments.value, fan_speed);
         }
     };
 
     const char         *pos               = gcode.c_str();
     int                 current_feedrate  = 0;
-    const std::string   toolchange_prefix = m_gcodegen.writer().toolchange_prefix();
+    const std::string  &toolchange_prefix = m_toolchange_prefix;
     change_extruder_set_fan();
     for (const CoolingLine *line : lines) {
         const char *line_start  = gcode.c_str() + line->line_start;
@@ -655,17 +728,17 @@ std::string CoolingBuffer::apply_layer_cooldown(
             new_gcode.append(pos, line_start - pos);
         if (line->type & CoolingLine::TYPE_SET_TOOL) {
             unsigned int new_extruder = (unsigned int)atoi(line_start + toolchange_prefix.size());
-            if (new_extruder != m_current_extruder) {
-                m_current_extruder = new_extruder;
+            if (new_extruder != current_extruder) {
+                current_extruder = new_extruder;
                 change_extruder_set_fan();
             }
             new_gcode.append(line_start, line_end - line_start);
         } else if (line->type & CoolingLine::TYPE_BRIDGE_FAN_START) {
             if (bridge_fan_control)
-                new_gcode += m_gcodegen.writer().set_fan(bridge_fan_speed, true);
+                new_gcode += GCodeWriter::set_fan(m_config.gcode_flavor.value, m_config.gcode_comments.value, bridge_fan_speed);
         } else if (line->type & CoolingLine::TYPE_BRIDGE_FAN_END) {
             if (bridge_fan_control)
-                new_gcode += m_gcodegen.writer().set_fan(fan_speed, true);
+                new_gcode += GCodeWriter::set_fan(m_config.gcode_flavor.value, m_config.gcode_comments.value, fan_speed);
         } else if (line->type & CoolingLine::TYPE_EXTRUDE_END) {
             // Just remove this comment.
         } else if (line->type & (CoolingLine::TYPE_ADJUSTABLE | CoolingLine::TYPE_EXTERNAL_PERIMETER | CoolingLine::TYPE_WIPE | CoolingLine::TYPE_HAS_F)) {
@@ -743,6 +816,7 @@ std::string CoolingBuffer::apply_layer_cooldown(
     if (pos < gcode_end)
         new_gcode.append(pos, gcode_end - pos);
 
+    state.fan_speed_end = fan_speed;
     return new_gcode;
 }
 
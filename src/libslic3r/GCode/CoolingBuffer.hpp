@@ -4,9 +4,11 @@
 #include "libslic3r.h"
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Slic3r {
 
+class FullPrintConfig;
 class GCode;
 class Layer;
 class PerExtruderAdjustments;
@@ -22,27 +24,59 @@ class PerExtruderAdjustments;
 //
 class CoolingBuffer {
 public:
+    // State of the cooling buffer at the start of a layer, captured by begin_layer().
+    struct LayerState {
+        size_t              layer_id            = 0;
+        // X,Y,Z,E,F at the start of the layer.
+        std::vector<float>  current_pos;
+        unsigned int        current_extruder    = 0;
+        // Fan speeds at the start and at the end of the layer, set by cool_layer().
+        int                 fan_speed_start     = -1;
+        int                 fan_speed_end       = -1;
+    };
+
     CoolingBuffer(GCode &gcodegen);
     void        reset();
     void        set_current_extruder(unsigned int extruder_id) { m_current_extruder = extruder_id; }
+    // Process a layer sequentially: begin_layer(), cool_layer(), end_layer().
     std::string process_layer(const std::string &gcode, size_t layer_id);
+    // The layers are processed in three steps, so that the expensive part may run in parallel over multiple layers.
+    // begin_layer() and end_layer() have to be called in the order of layers, cool_layer() may be called
+    // for multiple layers at the same time once their begin_layer() was called.
+    // Capture the state at the start of the layer and advance the state to the end of the layer
+    // by a quick backwards scan of the layer G-code.
+    LayerState  begin_layer(const std::string &gcode, size_t layer_id);
+    // Parse the layer G-code, slow it down and enable the fan if needed. Returns the adjusted G-code.
+    std::string cool_layer(const std::string &gcode, LayerState &state) const;
+    // Emit the fan speed at the start of the layer if it differs from the fan speed left by the previous layer.
+    void        end_layer(std::string &gcode, const LayerState &state);
+    // Fan speed left by the last layer passed to end_layer().
+    unsigned int fan_speed() const { return m_fan_speed; }
     GCode* 	    gcodegen() { return &m_gcodegen; }
 
 private:
 	CoolingBuffer& operator=(const CoolingBuffer&) = delete;
-    std::vector<PerExtruderAdjustments> parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos) const;
-    float       calculate_layer_slowdown(std::vector<PerExtruderAdjustments> &per_extruder_adjustments);
+    std::vector<PerExtruderAdjustments> parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos, unsigned int current_extruder) const;
+    float       calculate_layer_slowdown(std::vector<PerExtruderAdjustments> &per_extruder_adjustments) const;
     // Apply slow down over G-code lines stored in per_extruder_adjustments, enable fan if needed.
     // Returns the adjusted G-code.
-    std::string apply_layer_cooldown(const std::string &gcode, size_t layer_id, float layer_time, std::vector<PerExtruderAdjustments> &per_extruder_adjustments);
+    std::string apply_layer_cooldown(const std::string &gcode, float layer_time, std::vector<PerExtruderAdjustments> &per_extruder_adjustments, LayerState &state) const;
 
     GCode&              m_gcodegen;
     std::string         m_gcode;
+    // Print config of m_gcodegen. Only the options common to the whole print are read,
+    // therefore they are not modified while the layers are being generated.
+    const FullPrintConfig &m_config;
+    std::string         m_toolchange_prefix;
+    std::vector<unsigned int> m_extruder_ids;
     // Internal data.
     // X,Y,Z,E,F
     std::vector<char>   m_axis;
     std::vector<float>  m_current_pos;
     unsigned int        m_current_extruder;
+    // Fan speed at the end of the last layer passed to end_layer(). It is owned by the cooling buffer while
+    // the layers are in flight and handed back to the GCodeWriter once they were all processed.
+    unsigned int        m_fan_speed = 0;
 
     // Old logic: proportional.
     bool                m_cooling_logic_proportional = false;
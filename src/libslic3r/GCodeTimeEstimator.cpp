@@ -2,6 +2,7 @@
 #include "Utils.hpp"
 #include <boost/bind.hpp>
 #include <cmath>
+#include <cstring>
 
 #include <Shiny/Shiny.h>
 
@@ -25,6 +26,10 @@ static const float DEFAULT_EXTRUDE_FACTOR_OVERRIDE_PERCENTAGE = 1.0f; // 100 per
 
 static const float PREVIOUS_FEEDRATE_THRESHOLD = 0.0001f;
 
+// Number of the newest blocks the planner keeps for the lookahead. Once twice as many blocks are buffered,
+// the older half is planned against the window and finalized.
+static const size_t PLANNER_LOOKAHEAD_BLOCKS = 1024;
+
 #if ENABLE_MOVE_STATS
 static const std::string MOVE_TYPE_STR[Slic3r::GCodeTimeEstimator::Block::Num_Types] =
 {
@@ -199,14 +204,9 @@ namespace Slic3r {
         }
     }
 
-    void GCodeTimeEstimator::calculate_time(bool start_from_beginning)
+    void GCodeTimeEstimator::calculate_time()
     {
         PROFILE_FUNC();
-        if (start_from_beginning)
-        {
-            _reset_time();
-            _last_st_synchronized_block_id = -1;
-        }
         _calculate_time();
 
 #if ENABLE_MOVE_STATS
@@ -258,82 +258,112 @@ namespace Slic3r {
 
     bool GCodeTimeEstimator::post_process_remaining_times(const std::string& filename, float interval)
     {
-        boost::nowide::ifstream in(filename);
-        if (!in.good())
-            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for reading.\n"));
-
         std::string path_tmp = filename + ".times";
 
-        FILE* out = boost::nowide::fopen(path_tmp.c_str(), "wb");
-        if (out == nullptr)
-            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for writing.\n"));
+        post_process_remaining_times(filename, path_tmp, (_mode == Silent) ? nullptr : this, (_mode == Silent) ? this : nullptr, interval);
 
-        std::string time_mask;
-        switch (_mode)
-        {
-        default:
-        case Normal:
-        {
-            time_mask = "M73 P%s R%s\n";
-            break;
-        }
-        case Silent:
+        if (rename_file(path_tmp, filename) != 0)
+            throw std::runtime_error(std::string("Failed to rename the output G-code file from ") + path_tmp + " to " + filename + '\n' +
+            "Is " + path_tmp + " locked?" + '\n');
+
+        return true;
+    }
+
+    bool GCodeTimeEstimator::post_process_remaining_times(const std::string& filename_in, const std::string& filename_out,
+        GCodeTimeEstimator* normal, GCodeTimeEstimator* silent, float interval)
+    {
+        assert(normal == nullptr || normal->_mode == Normal);
+        assert(silent == nullptr || silent->_mode == Silent);
+
+        // Export state of a single estimator. The silent lines go first, as if the file had been processed
+        // for the normal mode first and then once more for the silent mode.
+        struct Export
         {
-            time_mask = "M73 Q%s S%s\n";
-            break;
-        }
+            GCodeTimeEstimator* estimator;
+            const char* time_mask;
+            const std::string* placeholder;
+            G1LineTimes::const_iterator it_line_time;
+            float last_recorded_time;
+        };
+        std::vector<Export> exports;
+        if (silent != nullptr)
+            exports.push_back({ silent, "M73 Q%s S%s\n", &Silent_First_M73_Output_Placeholder_Tag, silent->_g1_line_times.begin(), 0.0f });
+        if (normal != nullptr)
+            exports.push_back({ normal, "M73 P%s R%s\n", &Normal_First_M73_Output_Placeholder_Tag, normal->_g1_line_times.begin(), 0.0f });
+        if (exports.empty())
+            return false;
+
+        FILE* in = boost::nowide::fopen(filename_in.c_str(), "rb");
+        if (in == nullptr)
+            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for reading.\n"));
+
+        FILE* out = boost::nowide::fopen(filename_out.c_str(), "wb");
+        if (out == nullptr) {
+            fclose(in);
+            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for writing.\n"));
         }
 
+        GCodeReader& parser = exports.front().estimator->_parser;
         unsigned int g1_lines_count = 0;
-        float last_recorded_time = 0.0f;
         std::string gcode_line;
         // buffer line to export only when greater than 64K to reduce writing calls
         std::string export_line;
         char time_line[64];
-		G1LineIdToBlockIdMap::const_iterator it_line_id = _g1_line_ids.begin();
-		while (std::getline(in, gcode_line))
-        {
-            if (!in.good())
-            {
+
+        auto write_export_line = [&]() {
+            fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
+            if (ferror(out)) {
+                fclose(in);
                 fclose(out);
-                throw std::runtime_error(std::string("Remaining times export failed.\nError while reading from file.\n"));
+                boost::nowide::remove(filename_out.c_str());
+                throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
             }
+            export_line.clear();
+        };
 
+        auto process_line = [&](const std::string& line) {
             // replaces placeholders for initial line M73 with the real lines
-            if (((_mode == Normal) && (gcode_line == Normal_First_M73_Output_Placeholder_Tag)) ||
-                ((_mode == Silent) && (gcode_line == Silent_First_M73_Output_Placeholder_Tag)))
-            {
-                sprintf(time_line, time_mask.c_str(), "0", _get_time_minutes(_time).c_str());
-                gcode_line = time_line;
+            gcode_line.clear();
+            for (const Export& e : exports)
+                if (line == *e.placeholder) {
+                    sprintf(time_line, e.time_mask, "0", _get_time_minutes(e.estimator->_time).c_str());
+                    gcode_line = time_line;
+                    break;
+                }
+            if (gcode_line.empty()) {
+                gcode_line = line;
+                gcode_line += "\n";
             }
-            else
-               gcode_line += "\n";
 
             // add remaining time lines where needed
-            _parser.parse_line(gcode_line,
-                [this, &it_line_id, &g1_lines_count, &last_recorded_time, &time_line, &gcode_line, time_mask, interval](GCodeReader& reader, const GCodeReader::GCodeLine& line)
+            parser.parse_line(gcode_line,
+                [&exports, &g1_lines_count, &time_line, &gcode_line, interval](GCodeReader& reader, const GCodeReader::GCodeLine& line)
             {
                 if (line.cmd_is("G1"))
                 {
                     ++g1_lines_count;
+                    for (Export& e : exports)
+                    {
+                        const GCodeTimeEstimator& estimator = *e.estimator;
 
-					assert(it_line_id == _g1_line_ids.end() || it_line_id->first >= g1_lines_count);
+                        assert(e.it_line_time == estimator._g1_line_times.end() || e.it_line_time->g1_line_id >= g1_lines_count);
 
-					const Block *block = nullptr;
-					if (it_line_id != _g1_line_ids.end() && it_line_id->first == g1_lines_count) {
-						if (line.has_e() && it_line_id->second < (unsigned int)_blocks.size())
-							block = &_blocks[it_line_id->second];
-						++it_line_id;
-					}
+                        const G1LineTime *line_time = nullptr;
+                        if (e.it_line_time != estimator._g1_line_times.end() && e.it_line_time->g1_line_id == g1_lines_count) {
+                            if (line.has_e())
+                                line_time = &(*e.it_line_time);
+                            ++e.it_line_time;
+                        }
 
-					if (block != nullptr && block->elapsed_time != -1.0f) {
-                        float block_remaining_time = _time - block->elapsed_time;
-                        if (std::abs(last_recorded_time - block_remaining_time) > interval)
-                        {
-                            sprintf(time_line, time_mask.c_str(), std::to_string((int)(100.0f * block->elapsed_time / _time)).c_str(), _get_time_minutes(block_remaining_time).c_str());
-                            gcode_line += time_line;
+                        if (line_time != nullptr) {
+                            float block_remaining_time = estimator._time - line_time->elapsed_time;
+                            if (std::abs(e.last_recorded_time - block_remaining_time) > interval)
+                            {
+                                sprintf(time_line, e.time_mask, std::to_string((int)(100.0f * line_time->elapsed_time / estimator._time)).c_str(), _get_time_minutes(block_remaining_time).c_str());
+                                gcode_line += time_line;
 
-                            last_recorded_time = block_remaining_time;
+                                e.last_recorded_time = block_remaining_time;
+                            }
                         }
                     }
                 }
@@ -341,37 +371,44 @@ namespace Slic3r {
 
             export_line += gcode_line;
             if (export_line.length() > 65535)
-            {
-                fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-                if (ferror(out))
-                {
-                    in.close();
-                    fclose(out);
-                    boost::nowide::remove(path_tmp.c_str());
-                    throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
+                write_export_line();
+        };
+
+        // Read the source in large blocks and split it into lines.
+        std::vector<char> buffer(1 << 20);
+        std::string line;
+        for (;;) {
+            size_t n = fread(buffer.data(), 1, buffer.size(), in);
+            if (n == 0)
+                break;
+            const char* p = buffer.data();
+            const char* end = p + n;
+            while (p < end) {
+                const char* eol = (const char*)memchr(p, '\n', end - p);
+                if (eol == nullptr) {
+                    line.append(p, end);
+                    break;
                 }
-                export_line.clear();
+                line.append(p, eol);
+                process_line(line);
+                line.clear();
+                p = eol + 1;
             }
         }
+        if (ferror(in)) {
+            fclose(in);
+            fclose(out);
+            boost::nowide::remove(filename_out.c_str());
+            throw std::runtime_error(std::string("Remaining times export failed.\nError while reading from file.\n"));
+        }
+        if (!line.empty())
+            process_line(line);
 
         if (export_line.length() > 0)
-        {
-            fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-            if (ferror(out))
-            {
-                in.close();
-                fclose(out);
-                boost::nowide::remove(path_tmp.c_str());
-                throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
-            }
-        }
+            write_export_line();
 
         fclose(out);
-        in.close();
-
-        if (rename_file(path_tmp, filename) != 0)
-            throw std::runtime_error(std::string("Failed to rename the output G-code file from ") + path_tmp + " to " + filename + '\n' +
-            "Is " + path_tmp + " locked?" + '\n');
+        fclose(in);
 
         return true;
     }
@@ -673,7 +710,7 @@ namespace Slic3r {
     {
         size_t out = sizeof(*this);
 		out += SLIC3R_STDVEC_MEMSIZE(this->_blocks, Block);
-		out += SLIC3R_STDVEC_MEMSIZE(this->_g1_line_ids, G1LineIdToBlockId);
+		out += SLIC3R_STDVEC_MEMSIZE(this->_g1_line_times, G1LineTime);
         return out;
     }
 
@@ -690,9 +727,7 @@ namespace Slic3r {
 
         reset_extruder_id();
         reset_g1_line_id();
-        _g1_line_ids.clear();
-
-        _last_st_synchronized_block_id = -1;
+        _g1_line_times.clear();
     }
 
     void GCodeTimeEstimator::_reset_time()
@@ -709,39 +744,10 @@ namespace Slic3r {
     void GCodeTimeEstimator::_calculate_time()
     {
         PROFILE_FUNC();
-        _forward_pass();
-        _reverse_pass();
-        _recalculate_trapezoids();
-
         _time += get_additional_time();
 
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
-        {
-            Block& block = _blocks[i];
-
-#if ENABLE_MOVE_STATS
-            float block_time = 0.0f;
-            block_time += block.acceleration_time();
-            block_time += block.cruise_time();
-            block_time += block.deceleration_time();
-            _time += block_time;
-            block.elapsed_time = _time;
+        _finalize_blocks(_blocks.size());
 
-            MovesStatsMap::iterator it = _moves_stats.find(block.move_type);
-            if (it == _moves_stats.end())
-                it = _moves_stats.insert(MovesStatsMap::value_type(block.move_type, MoveStats())).first;
-
-            it->second.count += 1;
-            it->second.time += block_time;
-#else
-            _time += block.acceleration_time();
-            _time += block.cruise_time();
-            _time += block.deceleration_time();
-            block.elapsed_time = _time;
-#endif // ENABLE_MOVE_STATS
-        }
-
-        _last_st_synchronized_block_id = (int)_blocks.size() - 1;
         // The additional time has been consumed (added to the total time), reset it to zero.
         set_additional_time(0.);
     }
@@ -978,7 +984,8 @@ namespace Slic3r {
 
         // calculates block entry feedrate
         float vmax_junction = _curr.safe_feedrate;
-        if (!_blocks.empty() && (_prev.feedrate > PREVIOUS_FEEDRATE_THRESHOLD))
+        // The previous feedrate is zero until the first block has been added
+        if (_prev.feedrate > PREVIOUS_FEEDRATE_THRESHOLD)
         {
             bool prev_speed_larger = _prev.feedrate > block.feedrate.cruise;
             float smaller_speed_factor = prev_speed_larger ? (block.feedrate.cruise / _prev.feedrate) : (_prev.feedrate / block.feedrate.cruise);
@@ -1045,6 +1052,8 @@ namespace Slic3r {
         block.flags.nominal_length = (block.feedrate.cruise <= v_allowable);
         block.flags.recalculate = true;
         block.safe_feedrate = _curr.safe_feedrate;
+        block.elapsed_time = -1.0f;
+        block.g1_line_id = line.has_e() ? get_g1_line_id() : 0;
 
         // calculates block trapezoid
         block.calculate_trapezoid();
@@ -1080,9 +1089,13 @@ namespace Slic3r {
             block.move_type = Block::Move;
 #endif // ENABLE_MOVE_STATS
 
-        // adds block to blocks list
+        // adds block to blocks list, the blocks since the last st_synchronize are planned forward as they come
+        if (!_blocks.empty())
+            _planner_forward_pass_kernel(_blocks.back(), block);
         _blocks.emplace_back(block);
-        _g1_line_ids.emplace_back(G1LineIdToBlockIdMap::value_type(get_g1_line_id(), (unsigned int)_blocks.size() - 1));
+
+        if (_blocks.size() >= 2 * PLANNER_LOOKAHEAD_BLOCKS)
+            _finalize_blocks(_blocks.size() - PLANNER_LOOKAHEAD_BLOCKS);
     }
 
     void GCodeTimeEstimator::_processG4(const GCodeReader::GCodeLine& line)
@@ -1363,28 +1376,61 @@ namespace Slic3r {
         _calculate_time();
     }
 
-    void GCodeTimeEstimator::_forward_pass()
+    void GCodeTimeEstimator::_finalize_blocks(size_t count)
     {
         PROFILE_FUNC();
-        if (_blocks.size() > 1)
-        {
-            for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size() - 1; ++i)
-            {
-                _planner_forward_pass_kernel(_blocks[i], _blocks[i + 1]);
-            }
-        }
-    }
+        assert(count <= _blocks.size());
+        if (count == 0)
+            return;
 
-    void GCodeTimeEstimator::_reverse_pass()
-    {
-        PROFILE_FUNC();
-        if (_blocks.size() > 1)
+        // Reverse pass over the whole window. The entry speeds planned for the blocks staying in the window are tentative,
+        // they are only used to plan the finalized blocks. The staying blocks keep their forward planned entry speeds
+        // to be planned again once newer blocks are added.
+        size_t n = _blocks.size();
+        std::vector<float> entry(n);
+        entry[n - 1] = _blocks[n - 1].feedrate.entry;
+        for (size_t i = n - 1; i > 0; --i)
+            entry[i - 1] = _planner_reverse_pass_kernel(_blocks[i - 1], entry[i]);
+
+        for (size_t i = 0; i < count; ++i)
         {
-            for (int i = (int)_blocks.size() - 1; i >= _last_st_synchronized_block_id + 2; --i)
-            {
-                _planner_reverse_pass_kernel(_blocks[i - 1], _blocks[i]);
-            }
+            Block& b = _blocks[i];
+            b.feedrate.entry = entry[i];
+
+            // Recalculate the trapezoid for the planned entry and exit speeds. The newest block exits at its safe feedrate.
+            // NOTE: Entry and exit factors always > 0 by all previous logic operations.
+            Block block = b;
+            block.feedrate.exit = (i + 1 < n) ? entry[i + 1] : b.safe_feedrate;
+            block.calculate_trapezoid();
+            b.trapezoid = block.trapezoid;
+            b.flags.recalculate = false;
+
+#if ENABLE_MOVE_STATS
+            float block_time = 0.0f;
+            block_time += b.acceleration_time();
+            block_time += b.cruise_time();
+            block_time += b.deceleration_time();
+            _time += block_time;
+            b.elapsed_time = _time;
+
+            MovesStatsMap::iterator it = _moves_stats.find(b.move_type);
+            if (it == _moves_stats.end())
+                it = _moves_stats.insert(MovesStatsMap::value_type(b.move_type, MoveStats())).first;
+
+            it->second.count += 1;
+            it->second.time += block_time;
+#else
+            _time += b.acceleration_time();
+            _time += b.cruise_time();
+            _time += b.deceleration_time();
+            b.elapsed_time = _time;
+#endif // ENABLE_MOVE_STATS
+
+            if (b.g1_line_id != 0)
+                _g1_line_times.push_back({ b.g1_line_id, b.elapsed_time });
         }
+
+        _blocks.erase(_blocks.begin(), _blocks.begin() + count);
     }
 
     void GCodeTimeEstimator::_planner_forward_pass_kernel(Block& prev, Block& curr)
@@ -1410,7 +1456,7 @@ namespace Slic3r {
         }
     }
 
-    void GCodeTimeEstimator::_planner_reverse_pass_kernel(Block& curr, Block& next)
+    float GCodeTimeEstimator::_planner_reverse_pass_kernel(const Block& curr, float next_entry)
     {
         // If entry speed is already at the maximum entry speed, no need to recheck. Block is cruising.
         // If not, block in state of acceleration or deceleration. Reset entry speed to maximum and
@@ -1419,52 +1465,12 @@ namespace Slic3r {
         {
             // If nominal length true, max junction speed is guaranteed to be reached. Only compute
             // for max allowable speed if block is decelerating and nominal length is false.
-            if (!curr.flags.nominal_length && (curr.max_entry_speed > next.feedrate.entry))
-                curr.feedrate.entry = std::min(curr.max_entry_speed, Block::max_allowable_speed(-curr.acceleration, next.feedrate.entry, curr.move_length()));
+            if (!curr.flags.nominal_length && (curr.max_entry_speed > next_entry))
+                return std::min(curr.max_entry_speed, Block::max_allowable_speed(-curr.acceleration, next_entry, curr.move_length()));
             else
-                curr.feedrate.entry = curr.max_entry_speed;
-
-            curr.flags.recalculate = true;
-        }
-    }
-
-    void GCodeTimeEstimator::_recalculate_trapezoids()
-    {
-        PROFILE_FUNC();
-        Block* curr = nullptr;
-        Block* next = nullptr;
-
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
-        {
-            Block& b = _blocks[i];
-
-            curr = next;
-            next = &b;
-
-            if (curr != nullptr)
-            {
-                // Recalculate if current block entry or exit junction speed has changed.
-                if (curr->flags.recalculate || next->flags.recalculate)
-                {
-                    // NOTE: Entry and exit factors always > 0 by all previous logic operations.
-                    Block block = *curr;
-                    block.feedrate.exit = next->feedrate.entry;
-                    block.calculate_trapezoid();
-                    curr->trapezoid = block.trapezoid;
-                    curr->flags.recalculate = false; // Reset current only to ensure next trapezoid is computed
-                }
-            }
-        }
-
-        // Last/newest block in buffer. Always recalculated.
-        if (next != nullptr)
-        {
-            Block block = *next;
-            block.feedrate.exit = next->safe_feedrate;
-            block.calculate_trapezoid();
-            next->trapezoid = block.trapezoid;
-            next->flags.recalculate = false;
+                return curr.max_entry_speed;
         }
+        return curr.feedrate.entry;
     }
 
     std::string GCodeTimeEstimator::_get_time_dhms(float time_in_secs)
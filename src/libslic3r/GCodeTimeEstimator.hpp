@@ -154,6 +154,8 @@ namespace Slic3r {
             FeedrateProfile feedrate;
             Trapezoid trapezoid;
             float elapsed_time;
+            // Id of the G1 line of this block if it extrudes, zero otherwise
+            unsigned int g1_line_id;
 
             Block();
 
@@ -209,8 +211,14 @@ namespace Slic3r {
         typedef std::map<Block::EMoveType, MoveStats> MovesStatsMap;
 #endif // ENABLE_MOVE_STATS
 
-        typedef std::pair<unsigned int, unsigned int> G1LineIdToBlockId;
-        typedef std::vector<G1LineIdToBlockId> G1LineIdToBlockIdMap;
+        // Elapsed time at the end of an extruding G1 line, used to export the remaining times
+        struct G1LineTime
+        {
+            unsigned int g1_line_id;
+            float elapsed_time; // s
+        };
+
+        typedef std::vector<G1LineTime> G1LineTimes;
 
     private:
         EMode _mode;
@@ -218,11 +226,11 @@ namespace Slic3r {
         State _state;
         Feedrates _curr;
         Feedrates _prev;
+        // Blocks not yet finalized by the planner. Like the firmware, the planner only looks ahead over a window of blocks,
+        // the older blocks get their trapezoids finalized, their time added to _time and are dropped.
         BlocksList _blocks;
-        // Map between g1 line id and blocks id, used to speed up export of remaining times
-        G1LineIdToBlockIdMap _g1_line_ids;
-        // Index of the last block already st_synchronized
-        int _last_st_synchronized_block_id;
+        // Elapsed times of the finalized extruding G1 lines, in the order of the G1 lines
+        G1LineTimes _g1_line_times;
         float _time; // s
 
 #if ENABLE_MOVE_STATS
@@ -238,11 +246,11 @@ namespace Slic3r {
         void add_gcode_block(const char *ptr);
         void add_gcode_block(const std::string &str) { this->add_gcode_block(str.c_str()); }
 
-        // Calculates the time estimate from the gcode lines added using add_gcode_line() or add_gcode_block()
-        // start_from_beginning:
-        // if set to true all blocks will be used to calculate the time estimate,
-        // if set to false only the blocks not yet processed will be used and the calculated time will be added to the current calculated time
-        void calculate_time(bool start_from_beginning);
+        // Calculates the time estimate from the gcode lines added using add_gcode_line() or add_gcode_block():
+        // The time of the blocks not yet processed is added to the current calculated time.
+        // The blocks falling out of the planner lookahead window have already been processed while adding the gcode,
+        // they are not kept, therefore the time cannot be recalculated from the beginning. Call reset() to start over.
+        void calculate_time();
 
         // Calculates the time estimate from the given gcode in string format
         void calculate_time_from_text(const std::string& gcode);
@@ -260,6 +268,13 @@ namespace Slic3r {
         // contained in the given file before to call this method
         bool post_process_remaining_times(const std::string& filename, float interval_sec);
 
+        // Process the gcode contained in the file filename_in, placing in it the M73 lines of both the normal and the silent
+        // time estimators (either of them may be null), and write the result into the file filename_out.
+        // The source file is read once and the result written once, whichever estimators are given.
+        // Both estimators should have been already used to calculate the time estimate for the gcode in the source file.
+        static bool post_process_remaining_times(const std::string& filename_in, const std::string& filename_out,
+            GCodeTimeEstimator* normal, GCodeTimeEstimator* silent, float interval_sec);
+
         // Set current position on the given axis with the given value
         void set_axis_position(EAxis axis, float position);
 
@@ -416,13 +431,13 @@ namespace Slic3r {
         // Simulates firmware st_synchronize() call
         void _simulate_st_synchronize();
 
-        void _forward_pass();
-        void _reverse_pass();
+        // Plans the blocks in the lookahead window and finalizes the oldest count of them:
+        // calculates their trapezoids, adds their time to _time and removes them from the window.
+        void _finalize_blocks(size_t count);
 
         void _planner_forward_pass_kernel(Block& prev, Block& curr);
-        void _planner_reverse_pass_kernel(Block& curr, Block& next);
-
-        void _recalculate_trapezoids();
+        // Returns the entry speed of curr planned backwards from the entry speed of the next block.
+        static float _planner_reverse_pass_kernel(const Block& curr, float next_entry);
 
         // Returns the given time is seconds in format DDd HHh MMm SSs
         static std::string _get_time_dhms(float time_in_secs);
@@ -1,5 +1,8 @@
 #include "GCodeWriter.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -7,13 +10,62 @@
 
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
-#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
-#define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
-#define XYZF_NUM(val) PRECISION(val, 3)
-#define E_NUM(val) PRECISION(val, 5)
+#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) { gcode += " ; "; gcode += comment; }
 
 namespace Slic3r {
 
+// Append val with a fixed number of decimal digits, producing the same text as
+// std::fixed << std::setprecision(digits) << val, but without a stream and without allocating
+// if the output buffer has enough capacity.
+static inline void append_fixed(std::string &out, double val, int digits)
+{
+    static const double pow10[] = { 1., 10., 100., 1000., 10000., 100000., 1000000. };
+    assert(digits > 0 && digits <= 6);
+    double a    = std::abs(val) * pow10[digits];
+    double ip   = std::floor(a);
+    double frac = a - ip;
+    // The scaled value carries a rounding error of at most one ulp. Close to a rounding tie (or for NaN, infinity
+    // and huge values) the decimal rounding cannot be decided from it, let printf round the exact binary value.
+    if (! (a < 1e15) || std::abs(frac - 0.5) < 1e-9 + a * 1e-15) {
+        char buf[64];
+        int  len = snprintf(buf, sizeof(buf), "%.*f", digits, val);
+        if (len < int(sizeof(buf))) {
+            out.append(buf, len);
+        } else {
+            std::string big(len + 1, '\0');
+            snprintf(&big[0], big.size(), "%.*f", digits, val);
+            out.append(big.data(), len);
+        }
+        return;
+    }
+    uint64_t n   = uint64_t(ip) + (frac > 0.5 ? 1 : 0);
+    char     buf[32];
+    char    *end = buf + sizeof(buf);
+    char    *p   = end;
+    for (int i = 0; i < digits; ++ i) {
+        *-- p = char('0' + n % 10);
+        n /= 10;
+    }
+    *-- p = '.';
+    do {
+        *-- p = char('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    if (std::signbit(val))
+        *-- p = '-';
+    out.append(p, end - p);
+}
+
+#define XYZF_APPEND(val) append_fixed(gcode, val, 3)
+#define E_APPEND(val) append_fixed(gcode, val, 5)
+
+// Append val the way an ostream with the default formatting prints it (6 significant digits).
+static inline void append_general(std::string &out, double val)
+{
+    char buf[32];
+    out.append(buf, snprintf(buf, sizeof(buf), "%g", val));
+}
+
 void GCodeWriter::apply_print_config(const PrintConfig &print_config)
 {
     this->config.apply(print_config, true);
@@ -136,36 +188,41 @@ std::string GCodeWriter::set_bed_temperature(unsigned int temperature, bool wait
 }
 
 std::string GCodeWriter::set_fan(unsigned int speed, bool dont_save)
+{
+    if (m_last_fan_speed == speed && ! dont_save)
+        return std::string();
+    if (! dont_save)
+        m_last_fan_speed = speed;
+    return set_fan(this->config.gcode_flavor.value, this->config.gcode_comments.value, speed);
+}
+
+std::string GCodeWriter::set_fan(GCodeFlavor gcode_flavor, bool gcode_comments, unsigned int speed)
 {
     std::ostringstream gcode;
-    if (m_last_fan_speed != speed || dont_save) {
-        if (!dont_save) m_last_fan_speed = speed;
-        
-        if (speed == 0) {
-            if (FLAVOR_IS(gcfTeacup)) {
-                gcode << "M106 S0";
-            } else if (FLAVOR_IS(gcfMakerWare) || FLAVOR_IS(gcfSailfish)) {
-                gcode << "M127";
-            } else {
-                gcode << "M107";
-            }
-            if (this->config.gcode_comments) gcode << " ; disable fan";
-            gcode << "\n";
+    if (speed == 0) {
+        if (gcode_flavor == gcfTeacup) {
+            gcode << "M106 S0";
+        } else if (gcode_flavor == gcfMakerWare || gcode_flavor == gcfSailfish) {
+            gcode << "M127";
         } else {
-            if (FLAVOR_IS(gcfMakerWare) || FLAVOR_IS(gcfSailfish)) {
-                gcode << "M126";
+            gcode << "M107";
+        }
+        if (gcode_comments) gcode << " ; disable fan";
+        gcode << "\n";
+    } else {
+        if (gcode_flavor == gcfMakerWare || gcode_flavor == gcfSailfish) {
+            gcode << "M126";
+        } else {
+            gcode << "M106 ";
+            if (gcode_flavor == gcfMach3 || gcode_flavor == gcfMachinekit) {
+                gcode << "P";
             } else {
-                gcode << "M106 ";
-                if (FLAVOR_IS(gcfMach3) || FLAVOR_IS(gcfMachinekit)) {
-                    gcode << "P";
-                } else {
-                    gcode << "S";
-                }
-                gcode << (255.0 * speed / 100.0);
+                gcode << "S";
             }
-            if (this->config.gcode_comments) gcode << " ; enable fan";
-            gcode << "\n";
+            gcode << (255.0 * speed / 100.0);
         }
+        if (gcode_comments) gcode << " ; enable fan";
+        gcode << "\n";
     }
     return gcode.str();
 }
@@ -265,29 +322,43 @@ std::string GCodeWriter::toolchange(unsigned int extruder_id)
 }
 
 std::string GCodeWriter::set_speed(double F, const std::string &comment, const std::string &cooling_marker) const
+{
+    std::string gcode;
+    this->set_speed(gcode, F, comment, cooling_marker);
+    return gcode;
+}
+
+void GCodeWriter::set_speed(std::string &gcode, double F, const std::string &comment, const std::string &cooling_marker) const
 {
     assert(F > 0.);
     assert(F < 100000.);
-    std::ostringstream gcode;
-    gcode << "G1 F" << F;
+    gcode += "G1 F";
+    append_general(gcode, F);
     COMMENT(comment);
-    gcode << cooling_marker;
-    gcode << "\n";
-    return gcode.str();
+    gcode += cooling_marker;
+    gcode += '\n';
 }
 
 std::string GCodeWriter::travel_to_xy(const Vec2d &point, const std::string &comment)
+{
+    std::string gcode;
+    this->travel_to_xy(gcode, point, comment);
+    return gcode;
+}
+
+void GCodeWriter::travel_to_xy(std::string &gcode, const Vec2d &point, const std::string &comment)
 {
     m_pos(0) = point(0);
     m_pos(1) = point(1);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    gcode += "G1 X";
+    XYZF_APPEND(point(0));
+    gcode += " Y";
+    XYZF_APPEND(point(1));
+    gcode += " F";
+    XYZF_APPEND(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
 }
 
 std::string GCodeWriter::travel_to_xyz(const Vec3d &point, const std::string &comment)
@@ -307,14 +378,18 @@ std::string GCodeWriter::travel_to_xyz(const Vec3d &point, const std::string &co
     m_lifted = 0;
     m_pos = point;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " Z" << XYZF_NUM(point(2))
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode += "G1 X";
+    XYZF_APPEND(point(0));
+    gcode += " Y";
+    XYZF_APPEND(point(1));
+    gcode += " Z";
+    XYZF_APPEND(point(2));
+    gcode += " F";
+    XYZF_APPEND(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::travel_to_z(double z, const std::string &comment)
@@ -338,12 +413,14 @@ std::string GCodeWriter::_travel_to_z(double z, const std::string &comment)
 {
     m_pos(2) = z;
     
-    std::ostringstream gcode;
-    gcode << "G1 Z" << XYZF_NUM(z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode += "G1 Z";
+    XYZF_APPEND(z);
+    gcode += " F";
+    XYZF_APPEND(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 bool GCodeWriter::will_move_z(double z) const
@@ -359,18 +436,27 @@ bool GCodeWriter::will_move_z(double z) const
 }
 
 std::string GCodeWriter::extrude_to_xy(const Vec2d &point, double dE, const std::string &comment)
+{
+    std::string gcode;
+    this->extrude_to_xy(gcode, point, dE, comment);
+    return gcode;
+}
+
+void GCodeWriter::extrude_to_xy(std::string &gcode, const Vec2d &point, double dE, const std::string &comment)
 {
     m_pos(0) = point(0);
     m_pos(1) = point(1);
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
+    gcode += "G1 X";
+    XYZF_APPEND(point(0));
+    gcode += " Y";
+    XYZF_APPEND(point(1));
+    gcode += ' ';
+    gcode += m_extrusion_axis;
+    E_APPEND(m_extruder->E());
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
 }
 
 std::string GCodeWriter::extrude_to_xyz(const Vec3d &point, double dE, const std::string &comment)
@@ -379,14 +465,19 @@ std::string GCodeWriter::extrude_to_xyz(const Vec3d &point, double dE, const std
     m_lifted = 0;
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point(0))
-          <<   " Y" << XYZF_NUM(point(1))
-          <<   " Z" << XYZF_NUM(point(2))
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
+    std::string gcode;
+    gcode += "G1 X";
+    XYZF_APPEND(point(0));
+    gcode += " Y";
+    XYZF_APPEND(point(1));
+    gcode += " Z";
+    XYZF_APPEND(point(2));
+    gcode += ' ';
+    gcode += m_extrusion_axis;
+    E_APPEND(m_extruder->E());
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::retract(bool before_wipe)
@@ -413,7 +504,7 @@ std::string GCodeWriter::retract_for_toolchange(bool before_wipe)
 
 std::string GCodeWriter::_retract(double length, double restart_extra, const std::string &comment)
 {
-    std::ostringstream gcode;
+    std::string gcode;
     
     /*  If firmware retraction is enabled, we use a fake value of 1
         since we ignore the actual configured retract_length which 
@@ -432,48 +523,55 @@ std::string GCodeWriter::_retract(double length, double restart_extra, const std
     if (dE != 0) {
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                gcode << "G22 ; retract\n";
+                gcode += "G22 ; retract\n";
             else
-                gcode << "G10 ; retract\n";
+                gcode += "G10 ; retract\n";
         } else {
-            gcode << "G1 " << m_extrusion_axis << E_NUM(m_extruder->E())
-                           << " F" << float(m_extruder->retract_speed() * 60.);
+            gcode += "G1 ";
+            gcode += m_extrusion_axis;
+            E_APPEND(m_extruder->E());
+            gcode += " F";
+            // Printed with the precision of E, as the stream used to keep it for the feed rate.
+            E_APPEND(float(m_extruder->retract_speed() * 60.));
             COMMENT(comment);
-            gcode << "\n";
+            gcode += '\n';
         }
     }
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M103 ; extruder off\n";
+        gcode += "M103 ; extruder off\n";
     
-    return gcode.str();
+    return gcode;
 }
 
 std::string GCodeWriter::unretract()
 {
-    std::ostringstream gcode;
+    std::string gcode;
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M101 ; extruder on\n";
+        gcode += "M101 ; extruder on\n";
     
     double dE = m_extruder->unretract();
     if (dE != 0) {
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                 gcode << "G23 ; unretract\n";
+                 gcode += "G23 ; unretract\n";
             else
-                 gcode << "G11 ; unretract\n";
-            gcode << this->reset_e();
+                 gcode += "G11 ; unretract\n";
+            gcode += this->reset_e();
         } else {
             // use G1 instead of G0 because G0 will blend the restart with the previous travel move
-            gcode << "G1 " << m_extrusion_axis << E_NUM(m_extruder->E())
-                           << " F" << float(m_extruder->deretract_speed() * 60.);
-            if (this->config.gcode_comments) gcode << " ; unretract";
-            gcode << "\n";
+            gcode += "G1 ";
+            gcode += m_extrusion_axis;
+            E_APPEND(m_extruder->E());
+            gcode += " F";
+            E_APPEND(float(m_extruder->deretract_speed() * 60.));
+            if (this->config.gcode_comments) gcode += " ; unretract";
+            gcode += '\n';
         }
     }
     
-    return gcode.str();
+    return gcode;
 }
 
 /*  If this method is called more than once before calling unlift(),
@@ -42,6 +42,8 @@ public:
     std::string set_temperature(unsigned int temperature, bool wait = false, int tool = -1) const;
     std::string set_bed_temperature(unsigned int temperature, bool wait = false);
     std::string set_fan(unsigned int speed, bool dont_save = false);
+    // Format the fan command without saving the fan speed, so that it may be called from multiple threads.
+    static std::string set_fan(GCodeFlavor gcode_flavor, bool gcode_comments, unsigned int speed);
     std::string set_acceleration(unsigned int acceleration);
     std::string reset_e(bool force = false);
     std::string update_progress(unsigned int num, unsigned int tot, bool allow_100 = false) const;
@@ -61,6 +63,11 @@ public:
     bool        will_move_z(double z) const;
     std::string extrude_to_xy(const Vec2d &point, double dE, const std::string &comment = std::string());
     std::string extrude_to_xyz(const Vec3d &point, double dE, const std::string &comment = std::string());
+    // The same as above, but appending the G-code line to the gcode buffer instead of returning a new string.
+    // Used by the inner loops of GCode, which emit one line per segment of a path.
+    void        set_speed(std::string &gcode, double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
+    void        travel_to_xy(std::string &gcode, const Vec2d &point, const std::string &comment = std::string());
+    void        extrude_to_xy(std::string &gcode, const Vec2d &point, double dE, const std::string &comment = std::string());
     std::string retract(bool before_wipe = false);
     std::string retract_for_toolchange(bool before_wipe = false);
     std::string unretract();
@@ -1,5 +1,6 @@
 #include "libslic3r.h"
 #include "Geometry.hpp"
+#include "ChainedPath.hpp"
 #include "ClipperUtils.hpp"
 #include "ExPolygon.hpp"
 #include "Line.hpp"
@@ -315,21 +316,13 @@ convex_hull(const Polygons &polygons)
 void
 chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near)
 {
-    PointConstPtrs my_points;
-    std::map<const Point*,Points::size_type> indices;
-    my_points.reserve(points.size());
-    for (Points::const_iterator it = points.begin(); it != points.end(); ++it) {
-        my_points.push_back(&*it);
-        indices[&*it] = it - points.begin();
-    }
-    
-    retval.reserve(points.size());
-    while (!my_points.empty()) {
-        Points::size_type idx = start_near.nearest_point_index(my_points);
-        start_near = *my_points[idx];
-        retval.push_back(indices[ my_points[idx] ]);
-        my_points.erase(my_points.begin() + idx);
-    }
+    std::vector<std::pair<Point, Point>> ends;
+    ends.reserve(points.size());
+    for (const Point &pt : points)
+        ends.emplace_back(pt, pt);
+    retval.reserve(retval.size() + points.size());
+    for (const std::pair<size_t, bool> &item : chain_items(ends, std::vector<bool>(points.size(), false), start_near, true))
+        retval.push_back(item.first);
 }
 
 void
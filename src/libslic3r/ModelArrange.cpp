@@ -1,10 +1,14 @@
 #include "ModelArrange.hpp"
 #include "Model.hpp"
 #include "SVG.hpp"
+#include "Digest.hpp"
 
 #include <libnest2d.h>
+#include <libnest2d/utils/rotfinder.hpp>
 
 #include <numeric>
+#include <mutex>
+#include <unordered_map>
 #include <ClipperUtils.hpp>
 
 #include <boost/geometry/index/rtree.hpp>
@@ -106,6 +110,9 @@ using TPacker = typename placers::_NofitPolyPlacer<PolygonImpl, TBin>;
 
 const double BIG_ITEM_TRESHOLD = 0.02;
 
+// Tolerance of simplifying the object projections in mm.
+const double PROJECTION_SIMPLIFY_TOLERANCE = 0.1;
+
 Box boundingBox(const Box& pilebb, const Box& ibb ) {
     auto& pminc = pilebb.minCorner();
     auto& pmaxc = pilebb.maxCorner();
@@ -253,8 +260,19 @@ objfunc(const PointImpl& bincenter,
     return std::make_tuple(score, fullbb);
 }
 
+// The no fit polygon cache living as long as the process. The entries are
+// keyed by the exact geometry of the item pairs, so they stay valid across
+// the arrangements. The cache is thread safe and it is dropped as a whole
+// when it grows over its capacity.
+static std::shared_ptr<placers::NfpCache<PolygonImpl>> nfpCache() {
+    static const size_t Capacity = 4096;
+    static std::shared_ptr<placers::NfpCache<PolygonImpl>> cache =
+            std::make_shared<placers::NfpCache<PolygonImpl>>(Capacity);
+    return cache;
+}
+
 template<class PConf>
-void fillConfig(PConf& pcfg) {
+void fillConfig(PConf& pcfg, const RotationHint& rothint) {
 
     // Align the arranged pile into the center of the bin
     pcfg.alignment = PConf::Alignment::CENTER;
@@ -262,16 +280,28 @@ void fillConfig(PConf& pcfg) {
     // Start placing the items from the center of the print bed
     pcfg.starting_point = PConf::Alignment::CENTER;
 
-    // TODO cannot use rotations until multiple objects of same geometry can
-    // handle different rotations
-    // arranger.useMinimumBoundigBoxRotation();
+    // The rotations tried for every item, relative to its initial rotation.
+    // The placer evaluates them in parallel.
     pcfg.rotations = { 0.0 };
+    if(rothint.step > 0) {
+        double step = rothint.step;
+        for(double r = step; r < 2*Pi - step/2; r += step)
+            pcfg.rotations.emplace_back(r);
+    }
 
     // The accuracy of optimization.
     // Goes from 0.0 to 1.0 and scales performance as well
     pcfg.accuracy = 0.65f;
 
     pcfg.parallel = true;
+
+    // The objects are nested by their exact projections. The small ones may
+    // go into the holes of the bigger ones only if asked for.
+    pcfg.explore_holes = rothint.explore_holes;
+
+    // The no fit polygons are shared by the rotations, the placements and
+    // the subsequent arrangements of the same parts.
+    pcfg.nfp_cache = nfpCache();
 }
 
 template<class TBin>
@@ -302,11 +332,12 @@ public:
 
     _ArrBase(const TBin& bin, Distance dist,
              std::function<void(unsigned)> progressind,
-             std::function<bool(void)> stopcond):
+             std::function<bool(void)> stopcond,
+             const RotationHint& rothint):
        m_pck(bin, dist), m_bin_area(sl::area(bin)),
        m_norm(std::sqrt(sl::area(bin)))
     {
-        fillConfig(m_pconf);
+        fillConfig(m_pconf, rothint);
 
         m_pconf.before_packing =
         [this](const Pile& merged_pile,            // merged pile
@@ -350,8 +381,9 @@ public:
 
     AutoArranger(const Box& bin, Distance dist,
                  std::function<void(unsigned)> progressind,
-                 std::function<bool(void)> stopcond):
-        _ArrBase<Box>(bin, dist, progressind, stopcond)
+                 std::function<bool(void)> stopcond,
+                 const RotationHint& rothint = RotationHint()):
+        _ArrBase<Box>(bin, dist, progressind, stopcond, rothint)
     {
 
         m_pconf.object_function = [this, bin] (const Item &item) {
@@ -393,8 +425,9 @@ public:
 
     AutoArranger(const lnCircle& bin, Distance dist,
                  std::function<void(unsigned)> progressind,
-                 std::function<bool(void)> stopcond):
-        _ArrBase<lnCircle>(bin, dist, progressind, stopcond) {
+                 std::function<bool(void)> stopcond,
+                 const RotationHint& rothint = RotationHint()):
+        _ArrBase<lnCircle>(bin, dist, progressind, stopcond, rothint) {
 
         m_pconf.object_function = [this, &bin] (const Item &item) {
 
@@ -436,8 +469,9 @@ class AutoArranger<PolygonImpl>: public _ArrBase<PolygonImpl> {
 public:
     AutoArranger(const PolygonImpl& bin, Distance dist,
                  std::function<void(unsigned)> progressind,
-                 std::function<bool(void)> stopcond):
-        _ArrBase<PolygonImpl>(bin, dist, progressind, stopcond)
+                 std::function<bool(void)> stopcond,
+                 const RotationHint& rothint = RotationHint()):
+        _ArrBase<PolygonImpl>(bin, dist, progressind, stopcond, rothint)
     {
         m_pconf.object_function = [this, &bin] (const Item &item) {
 
@@ -466,8 +500,9 @@ class AutoArranger<bool>: public _ArrBase<Box> {
 public:
 
     AutoArranger(Distance dist, std::function<void(unsigned)> progressind,
-                 std::function<bool(void)> stopcond):
-        _ArrBase<Box>(Box(0, 0), dist, progressind, stopcond)
+                 std::function<bool(void)> stopcond,
+                 const RotationHint& rothint = RotationHint()):
+        _ArrBase<Box>(Box(0, 0), dist, progressind, stopcond, rothint)
     {
         this->m_pconf.object_function = [this] (const Item &item) {
 
@@ -493,6 +528,43 @@ public:
 using ShapeData2D =
     std::vector<std::pair<Slic3r::ModelInstance*, Item>>;
 
+// The 2D projections of the objects, keyed by the digest of their transformed
+// meshes, so arranging the same objects again does not project them again.
+class ProjectionCache {
+public:
+    bool find(const std::string& key, ClipperLib::PolygonImpl& pn) const {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        auto it = m_map.find(key);
+        if(it == m_map.end()) return false;
+        pn = it->second;
+        return true;
+    }
+
+    void insert(const std::string& key, const ClipperLib::PolygonImpl& pn) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if(m_map.size() >= Capacity) m_map.clear();
+        m_map[key] = pn;
+    }
+
+private:
+    static const size_t Capacity = 256;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, ClipperLib::PolygonImpl> m_map;
+};
+
+static ProjectionCache& projectionCache() {
+    static ProjectionCache cache;
+    return cache;
+}
+
+static std::string projectionKey(const TriangleMesh& mesh) {
+    Digest key;
+    key.append(double(PROJECTION_SIMPLIFY_TOLERANCE));
+    digest_mesh(key, mesh);
+    return key.digest();
+}
+
 ShapeData2D projectModelFromTop(const Slic3r::Model &model) {
     ShapeData2D ret;
 
@@ -517,20 +589,38 @@ ShapeData2D projectModelFromTop(const Slic3r::Model &model) {
             rmesh.rotate_x(float(finst->get_rotation()(X)));
             rmesh.rotate_y(float(finst->get_rotation()(Y)));
 
-            // TODO export the exact 2D projection
-            auto p = rmesh.convex_hull();
-
-            p.make_clockwise();
-            p.append(p.first_point());
-            auto clpath = Slic3rMultiPoint_to_ClipperPath(p);
+            // The exact 2D projection, simplified to keep the no fit polygon
+            // calculation cheap. Objects falling apart into several islands
+            // are represented by their convex hull.
+            std::string key = projectionKey(rmesh);
+            ClipperLib::PolygonImpl pn;
+            if(! projectionCache().find(key, pn)) {
+                ExPolygons proj = rmesh.horizontal_projection();
+                if(proj.size() == 1)
+                    proj = proj.front().simplify(scale_(PROJECTION_SIMPLIFY_TOLERANCE));
+
+                if(proj.size() == 1) {
+                    ExPolygon& expoly = proj.front();
+                    expoly.contour.make_clockwise();
+                    expoly.contour.append(expoly.contour.first_point());
+                    pn.Contour = Slic3rMultiPoint_to_ClipperPath(expoly.contour);
+                    for(Polygon& h : expoly.holes) {
+                        h.make_counter_clockwise();
+                        h.append(h.first_point());
+                        pn.Holes.emplace_back(Slic3rMultiPoint_to_ClipperPath(h));
+                    }
+                } else {
+                    auto p = rmesh.convex_hull();
+                    p.make_clockwise();
+                    p.append(p.first_point());
+                    pn.Contour = Slic3rMultiPoint_to_ClipperPath(p);
+                }
+                projectionCache().insert(key, pn);
+            }
 
             for(ModelInstance* objinst : objptr->instances) {
                 if(objinst) {
-                    ClipperLib::PolygonImpl pn;
-                    pn.Contour = clpath;
-
-                    // Efficient conversion to item.
-                    Item item(std::move(pn));
+                    Item item(pn);
 
                     // Invalid geometries would throw exceptions when arranging
                     if(item.vertexCount() > 3) {
@@ -660,7 +750,8 @@ bool arrange(Model &model,
              BedShapeHint bedhint,
              bool first_bin_only,
              std::function<void (unsigned)> progressind,
-             std::function<bool ()> stopcondition)
+             std::function<bool ()> stopcondition,
+             const RotationHint& rothint)
 {
     bool ret = true;
 
@@ -677,6 +768,15 @@ bool arrange(Model &model,
         shapes.push_back(std::ref(it.second));
     });
 
+    // Start every item from the rotation with its smallest bounding box, the
+    // other rotations are tried relative to this one.
+    if(rothint.min_bounding_box)
+        __parallel::enumerate(shapes.begin(), shapes.end(),
+                              [](std::reference_wrapper<Item> item, size_t)
+        {
+            item.get().rotate(findBestRotation(item.get()));
+        });
+
     IndexedPackGroup result;
 
     // If there is no hint about the shape, we will try to guess
@@ -699,7 +799,8 @@ bool arrange(Model &model,
     case BedShapeType::BOX: {
 
         // Create the arranger for the box shaped bed
-        AutoArranger<Box> arrange(binbb, min_obj_distance, progressind, cfn);
+        AutoArranger<Box> arrange(binbb, min_obj_distance, progressind, cfn,
+                                  rothint);
 
         // Arrange and return the items with their respective indices within the
         // input sequence.
@@ -711,7 +812,8 @@ bool arrange(Model &model,
         auto c = bedhint.shape.circ;
         auto cc = to_lnCircle(c);
 
-        AutoArranger<lnCircle> arrange(cc, min_obj_distance, progressind, cfn);
+        AutoArranger<lnCircle> arrange(cc, min_obj_distance, progressind, cfn,
+                                       rothint);
         result = arrange(shapes.begin(), shapes.end());
         break;
     }
@@ -723,7 +825,8 @@ bool arrange(Model &model,
         auto ctour = Slic3rMultiPoint_to_ClipperPath(bed);
         P irrbed = sl::create<PolygonImpl>(std::move(ctour));
 
-        AutoArranger<P> arrange(irrbed, min_obj_distance, progressind, cfn);
+        AutoArranger<P> arrange(irrbed, min_obj_distance, progressind, cfn,
+                                rothint);
 
         // Arrange and return the items with their respective indices within the
         // input sequence.
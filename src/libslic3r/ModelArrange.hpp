@@ -40,6 +40,16 @@ struct BedShapeHint {
 
 BedShapeHint bedShape(const Polyline& bed);
 
+/// The rotations around Z tried for every item when arranging.
+struct RotationHint {
+    /// Angle between the tried rotations in radians, 0 disables rotating.
+    double step = 0.;
+    /// Start every item from the rotation with its minimum bounding box.
+    bool min_bounding_box = false;
+    /// Let the small items be placed into the holes of the bigger ones.
+    bool explore_holes = false;
+};
+
 /**
  * \brief Arranges the model objects on the screen.
  *
@@ -65,13 +75,16 @@ BedShapeHint bedShape(const Polyline& bed);
  * \param progressind Progress indicator callback called when an object gets
  * packed. The unsigned argument is the number of items remaining to pack.
  * \param stopcondition A predicate returning true if abort is needed.
+ * \param rothint The rotations to try for the items. The chosen rotation is
+ * written back into the model instances.
  */
 bool arrange(Model &model, coord_t min_obj_distance,
              const Slic3r::Polyline& bed,
              BedShapeHint bedhint,
              bool first_bin_only,
              std::function<void(unsigned)> progressind,
-             std::function<bool(void)> stopcondition);
+             std::function<bool(void)> stopcondition,
+             const RotationHint& rothint = RotationHint());
 
 }
 
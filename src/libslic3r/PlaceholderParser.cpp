@@ -4,6 +4,7 @@
 #include <iomanip>
 #include <sstream>
 #include <map>
+#include <memory>
 #ifdef _MSC_VER
     #include <stdlib.h>  // provides **_environ
 #else
@@ -393,7 +394,7 @@ namespace client
         {
             this->throw_if_not_numeric("Cannot divide a non-numeric type.");
             rhs.throw_if_not_numeric("Cannot divide with a non-numeric type.");
-            if ((this->type == TYPE_INT) ? (rhs.i() == 0) : (rhs.d() == 0.))
+            if ((this->type == TYPE_INT && rhs.type == TYPE_INT) ? (rhs.i() == 0) : (rhs.as_d() == 0.))
                 rhs.throw_exception("Division by zero");
             if (this->type == TYPE_DOUBLE || rhs.type == TYPE_DOUBLE) {
                 double d = this->as_d() / rhs.as_d();
@@ -405,6 +406,12 @@ namespace client
             return *this;
         }
 
+        // Arithmetic operators, store the result into lhs.
+        static void add(expr &lhs, expr &rhs) { lhs += rhs; }
+        static void sub(expr &lhs, expr &rhs) { lhs -= rhs; }
+        static void mul(expr &lhs, expr &rhs) { lhs *= rhs; }
+        static void div(expr &lhs, expr &rhs) { lhs /= rhs; }
+
         static void to_string2(expr &self, std::string &out)
         {
             out = self.to_string();
@@ -460,6 +467,7 @@ namespace client
                 boost::throw_exception(qi::expectation_failure<Iterator>(
                     lhs.it_range.begin(), rhs.it_range.end(), spirit::info("*Cannot compare the types.")));
             }
+            lhs.reset();
             lhs.type = TYPE_BOOL;
             lhs.data.b = invert ? ! value : value;
         }
@@ -505,33 +513,31 @@ namespace client
         static void min(expr &param1, expr &param2) { function_2params(param1, param2, FUNCTION_MIN); }
         static void max(expr &param1, expr &param2) { function_2params(param1, param2, FUNCTION_MAX); }
 
-        static void regex_op(expr &lhs, boost::iterator_range<Iterator> &rhs, char op)
+        // Compile the regular expression enclosed in //.
+        static SLIC3R_REGEX_NAMESPACE::regex compile_regex(const boost::iterator_range<Iterator> &rhs)
         {
-            const std::string *subject  = nullptr;
-            const std::string *mask     = nullptr;
-            if (lhs.type == TYPE_STRING) {
-                // One type is string, the other could be converted to string.
-                subject = &lhs.s();
-            } else {
-                lhs.throw_exception("Left hand side of a regex match must be a string.");
-            }
             try {
-                std::string pattern(++ rhs.begin(), -- rhs.end());
-                bool result = SLIC3R_REGEX_NAMESPACE::regex_match(*subject, SLIC3R_REGEX_NAMESPACE::regex(pattern));
-                if (op == '!')
-                    result = ! result;
-                lhs.reset();
-                lhs.type = TYPE_BOOL;
-                lhs.data.b = result;
+                return SLIC3R_REGEX_NAMESPACE::regex(std::string(++ rhs.begin(), -- rhs.end()));
             } catch (SLIC3R_REGEX_NAMESPACE::regex_error &ex) {
                 // Syntax error in the regular expression
                 boost::throw_exception(qi::expectation_failure<Iterator>(
                     rhs.begin(), rhs.end(), spirit::info(std::string("*Regular expression compilation failed: ") + ex.what())));
             }
+            // Suppress compiler warnings.
+            return SLIC3R_REGEX_NAMESPACE::regex();
         }
 
-        static void regex_matches     (expr &lhs, boost::iterator_range<Iterator> &rhs) { return regex_op(lhs, rhs, '='); }
-        static void regex_doesnt_match(expr &lhs, boost::iterator_range<Iterator> &rhs) { return regex_op(lhs, rhs, '!'); }
+        static void regex_op(expr &lhs, const SLIC3R_REGEX_NAMESPACE::regex &rhs, char op)
+        {
+            if (lhs.type != TYPE_STRING)
+                lhs.throw_exception("Left hand side of a regex match must be a string.");
+            bool result = SLIC3R_REGEX_NAMESPACE::regex_match(lhs.s(), rhs);
+            if (op == '!')
+                result = ! result;
+            lhs.reset();
+            lhs.type = TYPE_BOOL;
+            lhs.data.b = result;
+        }
 
         static void logical_op(expr &lhs, expr &rhs, char op)
         {
@@ -623,7 +629,7 @@ namespace client
         template <typename Iterator>
         static void legacy_variable_expansion(
             const MyContext                 *ctx, 
-            boost::iterator_range<Iterator> &opt_key,
+            const boost::iterator_range<Iterator> &opt_key,
             std::string                     &output)
         {
             std::string         opt_key_str(opt_key.begin(), opt_key.end());
@@ -659,8 +665,8 @@ namespace client
         template <typename Iterator>
         static void legacy_variable_expansion2(
             const MyContext                 *ctx, 
-            boost::iterator_range<Iterator> &opt_key,
-            boost::iterator_range<Iterator> &opt_vector_index,
+            const boost::iterator_range<Iterator> &opt_key,
+            const boost::iterator_range<Iterator> &opt_vector_index,
             std::string                     &output)
         {
             std::string         opt_key_str(opt_key.begin(), opt_key.end());
@@ -687,19 +693,6 @@ namespace client
 			output = vec->vserialize()[(idx >= (int)vec->size()) ? 0 : idx];
         }
 
-        template <typename Iterator>
-        static void resolve_variable(
-            const MyContext                 *ctx,
-            boost::iterator_range<Iterator> &opt_key,
-            OptWithPos<Iterator>            &output)
-        {
-            const ConfigOption *opt = ctx->resolve_symbol(std::string(opt_key.begin(), opt_key.end()));
-            if (opt == nullptr)
-                ctx->throw_exception("Not a variable name", opt_key);
-            output.opt = opt;
-            output.it_range = opt_key;
-        }
-
         template <typename Iterator>
         static void scalar_variable_reference(
             const MyContext                 *ctx,
@@ -848,6 +841,355 @@ namespace client
         return os;
     }
 
+    ///////////////////////////////////////////////////////////////////////////
+    //  Compiled macro
+    ///////////////////////////////////////////////////////////////////////////
+    // The macro_processor grammar does not evaluate the macro while parsing, it compiles the macro into a tree of nodes.
+    // The tree is not modified once compiled, therefore it may be evaluated many times against different contexts,
+    // even from multiple threads at the same time. The nodes keep iterators into the source of the macro,
+    // the runtime errors are thrown as qi::expectation_failure the same way as the syntax errors are.
+
+    template<typename Iterator>
+    struct ExprNode
+    {
+        virtual ~ExprNode() {}
+        // Evaluate the expression into an empty output.
+        virtual void eval(const MyContext *ctx, expr<Iterator> &output) const = 0;
+    };
+
+    template<typename Iterator>
+    using ExprPtr = std::shared_ptr<ExprNode<Iterator>>;
+
+    // Number, bool or string literal.
+    template<typename Iterator>
+    struct ExprLiteral : public ExprNode<Iterator>
+    {
+        explicit ExprLiteral(expr<Iterator> &&value) : value(std::move(value)) {}
+        void eval(const MyContext * /* ctx */, expr<Iterator> &output) const override { output = value; }
+
+        expr<Iterator>                   value;
+    };
+
+    // Reference of a scalar variable, or reference to a field of a vector variable.
+    template<typename Iterator>
+    struct ExprVariable : public ExprNode<Iterator>
+    {
+        void eval(const MyContext *ctx, expr<Iterator> &output) const override
+        {
+            const ConfigOption *opt = ctx->resolve_symbol(opt_key);
+            if (opt == nullptr)
+                ctx->throw_exception("Not a variable name", it_range);
+            OptWithPos<Iterator> opt_with_pos(opt, it_range);
+            if (index) {
+                expr<Iterator> expr_index;
+                index->eval(ctx, expr_index);
+                int idx = 0;
+                MyContext::evaluate_index(expr_index, idx);
+                MyContext::vector_variable_reference(ctx, opt_with_pos, idx, it_end, output);
+            } else
+                MyContext::scalar_variable_reference(ctx, opt_with_pos, output);
+        }
+
+        static void scalar(boost::iterator_range<Iterator> &it_range, ExprPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<ExprVariable<Iterator>>();
+            node->opt_key  = std::string(it_range.begin(), it_range.end());
+            node->it_range = it_range;
+            out = node;
+        }
+
+        static void vector(boost::iterator_range<Iterator> &it_range, ExprPtr<Iterator> &index, Iterator &it_end, ExprPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<ExprVariable<Iterator>>();
+            node->opt_key  = std::string(it_range.begin(), it_range.end());
+            node->it_range = it_range;
+            node->index    = index;
+            node->it_end   = it_end;
+            out = node;
+        }
+
+        std::string                      opt_key;
+        boost::iterator_range<Iterator>  it_range;
+        // Index expression of a vector variable, null for a scalar variable.
+        ExprPtr<Iterator>                index;
+        // End of the indexing brackets.
+        Iterator                         it_end;
+    };
+
+    // Unary minus, not, unary plus and braced expression.
+    template<typename Iterator>
+    struct ExprUnary : public ExprNode<Iterator>
+    {
+        ExprUnary(char op, const ExprPtr<Iterator> &arg, const Iterator &it_begin, const Iterator &it_end) :
+            op(op), arg(arg), it_begin(it_begin), it_end(it_end) {}
+
+        void eval(const MyContext *ctx, expr<Iterator> &output) const override
+        {
+            expr<Iterator> value;
+            arg->eval(ctx, value);
+            switch (op) {
+            case '-': output = value.unary_minus(it_begin); break;
+            case '!': output = value.unary_not(it_begin); break;
+            default:  output = expr<Iterator>(std::move(value), it_begin, it_end); break;
+            }
+        }
+
+        char                             op;
+        ExprPtr<Iterator>                arg;
+        Iterator                         it_begin;
+        Iterator                         it_end;
+    };
+
+    // Binary operator or a function of two parameters.
+    template<typename Iterator>
+    struct ExprBinary : public ExprNode<Iterator>
+    {
+        // Operator storing its result into lhs.
+        typedef void (*Operator)(expr<Iterator> &lhs, expr<Iterator> &rhs);
+
+        void eval(const MyContext *ctx, expr<Iterator> &output) const override
+        {
+            lhs->eval(ctx, output);
+            expr<Iterator> value;
+            rhs->eval(ctx, value);
+            op(output, value);
+        }
+
+        // Replace lhs with the binary operation over lhs and rhs.
+        static void make(ExprPtr<Iterator> &lhs, ExprPtr<Iterator> &rhs, Operator op)
+        {
+            auto node = std::make_shared<ExprBinary<Iterator>>();
+            node->lhs = std::move(lhs);
+            node->rhs = rhs;
+            node->op  = op;
+            lhs = node;
+        }
+
+        ExprPtr<Iterator>                lhs;
+        ExprPtr<Iterator>                rhs;
+        Operator                         op;
+    };
+
+    // Regular expression match, the regular expression is compiled together with the macro.
+    template<typename Iterator>
+    struct ExprRegex : public ExprNode<Iterator>
+    {
+        void eval(const MyContext *ctx, expr<Iterator> &output) const override
+        {
+            lhs->eval(ctx, output);
+            expr<Iterator>::regex_op(output, regex, op);
+        }
+
+        // Replace lhs with the match of lhs against the regular expression rhs.
+        static void make(ExprPtr<Iterator> &lhs, boost::iterator_range<Iterator> &rhs, char op)
+        {
+            auto node = std::make_shared<ExprRegex<Iterator>>();
+            node->lhs   = std::move(lhs);
+            node->regex = expr<Iterator>::compile_regex(rhs);
+            node->op    = op;
+            lhs = node;
+        }
+
+        ExprPtr<Iterator>                lhs;
+        SLIC3R_REGEX_NAMESPACE::regex    regex;
+        char                             op;
+    };
+
+    // Ternary operator (?:)
+    template<typename Iterator>
+    struct ExprTernary : public ExprNode<Iterator>
+    {
+        void eval(const MyContext *ctx, expr<Iterator> &output) const override
+        {
+            condition->eval(ctx, output);
+            expr<Iterator> value_true, value_false;
+            if_true ->eval(ctx, value_true);
+            if_false->eval(ctx, value_false);
+            expr<Iterator>::ternary_op(output, value_true, value_false);
+        }
+
+        // Replace condition with the ternary operation.
+        static void make(ExprPtr<Iterator> &condition, ExprPtr<Iterator> &if_true, ExprPtr<Iterator> &if_false)
+        {
+            auto node = std::make_shared<ExprTernary<Iterator>>();
+            node->condition = std::move(condition);
+            node->if_true   = if_true;
+            node->if_false  = if_false;
+            condition = node;
+        }
+
+        ExprPtr<Iterator>                condition;
+        ExprPtr<Iterator>                if_true;
+        ExprPtr<Iterator>                if_false;
+    };
+
+    template<typename Iterator>
+    struct TextNode
+    {
+        virtual ~TextNode() {}
+        // Append the evaluated text to output.
+        virtual void eval(const MyContext *ctx, std::string &output) const = 0;
+    };
+
+    template<typename Iterator>
+    using TextPtr = std::shared_ptr<TextNode<Iterator>>;
+
+    // Free-form text, possibly empty, possibly containing macro expansions.
+    template<typename Iterator>
+    struct TextBlock : public TextNode<Iterator>
+    {
+        void eval(const MyContext *ctx, std::string &output) const override
+        {
+            for (const TextPtr<Iterator> &item : items)
+                item->eval(ctx, output);
+        }
+
+        static void append(TextPtr<Iterator> &block, TextPtr<Iterator> &item);
+        static void append_text(TextPtr<Iterator> &block, std::string &text);
+
+        std::vector<TextPtr<Iterator>>   items;
+    };
+
+    // Free-form text inserted into the processed text without a modification.
+    template<typename Iterator>
+    struct TextLiteral : public TextNode<Iterator>
+    {
+        void eval(const MyContext * /* ctx */, std::string &output) const override { output += text; }
+
+        std::string                      text;
+    };
+
+    template<typename Iterator>
+    void TextBlock<Iterator>::append(TextPtr<Iterator> &block, TextPtr<Iterator> &item)
+    {
+        if (! block)
+            block = std::make_shared<TextBlock<Iterator>>();
+        static_cast<TextBlock<Iterator>*>(block.get())->items.emplace_back(item);
+    }
+
+    template<typename Iterator>
+    void TextBlock<Iterator>::append_text(TextPtr<Iterator> &block, std::string &text)
+    {
+        auto node = std::make_shared<TextLiteral<Iterator>>();
+        node->text = std::move(text);
+        TextPtr<Iterator> item(node);
+        append(block, item);
+    }
+
+    // Legacy variable expansion of the original Slic3r, in the form of [scalar_variable] or [vector_variable_index]
+    // or [vector_variable[index_variable]].
+    template<typename Iterator>
+    struct TextLegacyVariable : public TextNode<Iterator>
+    {
+        void eval(const MyContext *ctx, std::string &output) const override
+        {
+            std::string value;
+            if (opt_vector_index.empty())
+                MyContext::legacy_variable_expansion(ctx, opt_key, value);
+            else
+                MyContext::legacy_variable_expansion2(ctx, opt_key, opt_vector_index, value);
+            output += value;
+        }
+
+        static void make(boost::iterator_range<Iterator> &opt_key, TextPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<TextLegacyVariable<Iterator>>();
+            node->opt_key = opt_key;
+            out = node;
+        }
+
+        static void make_indexed(boost::iterator_range<Iterator> &opt_key, boost::iterator_range<Iterator> &opt_vector_index, TextPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<TextLegacyVariable<Iterator>>();
+            node->opt_key          = opt_key;
+            node->opt_vector_index = opt_vector_index;
+            out = node;
+        }
+
+        boost::iterator_range<Iterator>  opt_key;
+        // Identifier of the index variable, empty if the variable is not indexed by a variable.
+        boost::iterator_range<Iterator>  opt_vector_index;
+    };
+
+    // Expression converted to text, or a boolean expression converted to "true" / "false".
+    template<typename Iterator>
+    struct TextExpression : public TextNode<Iterator>
+    {
+        void eval(const MyContext *ctx, std::string &output) const override
+        {
+            expr<Iterator> value;
+            expression->eval(ctx, value);
+            std::string text;
+            if (boolean)
+                expr<Iterator>::evaluate_boolean_to_string(value, text);
+            else
+                expr<Iterator>::to_string2(value, text);
+            output += text;
+        }
+
+        static void make(ExprPtr<Iterator> &expression, TextPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<TextExpression<Iterator>>();
+            node->expression = expression;
+            out = node;
+        }
+
+        static void make_boolean(ExprPtr<Iterator> &expression, TextPtr<Iterator> &out)
+        {
+            auto node = std::make_shared<TextExpression<Iterator>>();
+            node->expression = expression;
+            node->boolean    = true;
+            out = node;
+        }
+
+        ExprPtr<Iterator>                expression;
+        bool                             boolean = false;
+    };
+
+    // {if}{elsif}{else}{endif} macro. Only the text block of the first satisfied condition is output,
+    // but all the conditions and all the text blocks are evaluated in their order, so that an error
+    // in a branch not taken is reported the same way the parser evaluating the macro while parsing did.
+    template<typename Iterator>
+    struct TextIf : public TextNode<Iterator>
+    {
+        void eval(const MyContext *ctx, std::string &output) const override
+        {
+            bool        consumed = false;
+            std::string discarded;
+            for (const std::pair<ExprPtr<Iterator>, TextPtr<Iterator>> &branch : branches) {
+                expr<Iterator> value;
+                branch.first->eval(ctx, value);
+                bool condition = false;
+                expr<Iterator>::evaluate_boolean(value, condition);
+                if (branch.second) {
+                    discarded.clear();
+                    branch.second->eval(ctx, (condition && ! consumed) ? output : discarded);
+                }
+                consumed |= condition;
+            }
+            if (else_block) {
+                discarded.clear();
+                else_block->eval(ctx, consumed ? discarded : output);
+            }
+        }
+
+        static void add_branch(TextPtr<Iterator> &self, ExprPtr<Iterator> &condition, TextPtr<Iterator> &block)
+        {
+            if (! self)
+                self = std::make_shared<TextIf<Iterator>>();
+            static_cast<TextIf<Iterator>*>(self.get())->branches.emplace_back(condition, block);
+        }
+
+        static void set_else(TextPtr<Iterator> &self, TextPtr<Iterator> &block)
+        {
+            static_cast<TextIf<Iterator>*>(self.get())->else_block = block;
+        }
+
+        // Pairs of a condition and a text block, the text block may be null if empty.
+        std::vector<std::pair<ExprPtr<Iterator>, TextPtr<Iterator>>> branches;
+        TextPtr<Iterator>                else_block;
+    };
+
     // Disable parsing int numbers (without decimals) and Inf/NaN symbols by the double parser.
     struct strict_real_policies_without_nan_inf : public qi::strict_real_policies<double>
     {
@@ -923,7 +1265,7 @@ namespace client
     ///////////////////////////////////////////////////////////////////////////
     // Inspired by the C grammar rules https://www.lysator.liu.se/c/ANSI-C-grammar-y.html
     template <typename Iterator>
-    struct macro_processor : qi::grammar<Iterator, std::string(const MyContext*), qi::locals<bool>, spirit::ascii::space_type>
+    struct macro_processor : qi::grammar<Iterator, TextPtr<Iterator>(const MyContext*), qi::locals<bool>, spirit::ascii::space_type>
     {
         macro_processor() : macro_processor::base_type(start)
         {
@@ -952,7 +1294,6 @@ namespace client
             qi::_3_type                 _3;
             qi::_4_type                 _4;
             qi::_a_type                 _a;
-            qi::_b_type                 _b;
             qi::_r1_type                _r1;
 
             // Starting symbol of the grammer.
@@ -962,19 +1303,19 @@ namespace client
             // depending on the context->just_boolean_expression flag. This way a single static expression parser
             // could serve both purposes.
             start = eps[px::bind(&MyContext::evaluate_full_macro, _r1, _a)] >
-                (       eps(_a==true) > text_block(_r1) [_val=_1]
-                    |   conditional_expression(_r1) [ px::bind(&expr<Iterator>::evaluate_boolean_to_string, _1, _val) ]
+                (       eps(_a==true) > text_block [_val=_1]
+                    |   conditional_expression [ px::bind(&TextExpression<Iterator>::make_boolean, _1, _val) ]
 				) > eoi;
             start.name("start");
             qi::on_error<qi::fail>(start, px::bind(&MyContext::process_error_message<Iterator>, _r1, _4, _1, _2, _3));
 
             text_block = *(
-                        text [_val+=_1]
+                        text [px::bind(&TextBlock<Iterator>::append_text, _val, _1)]
                         // Allow back tracking after '{' in case of a text_block embedded inside a condition.
                         // In that case the inner-most {else} wins and the {if}/{elsif}/{else} shall be paired.
                         // {elsif}/{else} without an {if} will be allowed to back track from the embedded text_block.
-                    |   (lit('{') >> macro(_r1) [_val+=_1] > '}')
-                    |   (lit('[') > legacy_variable_expansion(_r1) [_val+=_1] > ']')
+                    |   (lit('{') >> macro [px::bind(&TextBlock<Iterator>::append, _val, _1)] > '}')
+                    |   (lit('[') > legacy_variable_expansion [px::bind(&TextBlock<Iterator>::append, _val, _1)] > ']')
                 );
             text_block.name("text_block");
 
@@ -986,20 +1327,20 @@ namespace client
             // New style of macro expansion.
             // The macro expansion may contain numeric or string expressions, ifs and cases.
             macro =
-                    (kw["if"]     > if_else_output(_r1) [_val = _1])
+                    (kw["if"]     > if_else_output [_val = _1])
 //                |   (kw["switch"] > switch_output(_r1)  [_val = _1])
-                |   additive_expression(_r1) [ px::bind(&expr<Iterator>::to_string2, _1, _val) ];
+                |   additive_expression [ px::bind(&TextExpression<Iterator>::make, _1, _val) ];
             macro.name("macro");
 
             // An if expression enclosed in {} (the outmost {} are already parsed by the caller).
             if_else_output =
-                eps[_b=true] >
-                bool_expr_eval(_r1)[_a=_1] > '}' > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _a, _b, _1, _val)] > '{' >
-                *(kw["elsif"] > bool_expr_eval(_r1)[_a=_1] > '}' > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _a, _b, _1, _val)] > '{') >
+                eps >
+                bool_expr_eval[_a=_1] > '}' > 
+                    text_block[px::bind(&TextIf<Iterator>::add_branch, _val, _a, _1)] > '{' >
+                *(kw["elsif"] > bool_expr_eval[_a=_1] > '}' > 
+                    text_block[px::bind(&TextIf<Iterator>::add_branch, _val, _a, _1)] > '{') >
                 -(kw["else"] > lit('}') > 
-                    text_block(_r1)[px::bind(&expr<Iterator>::set_if, _b, _b, _1, _val)] > '{') >
+                    text_block[px::bind(&TextIf<Iterator>::set_else, _val, _1)] > '{') >
                 kw["endif"];
             if_else_output.name("if_else_output");
             // A switch expression enclosed in {} (the outmost {} are already parsed by the caller).
@@ -1015,9 +1356,9 @@ namespace client
             // Legacy variable expansion of the original Slic3r, in the form of [scalar_variable] or [vector_variable_index].
             legacy_variable_expansion =
                     (identifier >> &lit(']'))
-                        [ px::bind(&MyContext::legacy_variable_expansion<Iterator>, _r1, _1, _val) ]
+                        [ px::bind(&TextLegacyVariable<Iterator>::make, _1, _val) ]
                 |   (identifier > lit('[') > identifier > ']') 
-                        [ px::bind(&MyContext::legacy_variable_expansion2<Iterator>, _r1, _1, _2, _val) ]
+                        [ px::bind(&TextLegacyVariable<Iterator>::make_indexed, _1, _2, _val) ]
                 ;
             legacy_variable_expansion.name("legacy_variable_expansion");
 
@@ -1027,107 +1368,105 @@ namespace client
             identifier.name("identifier");
 
             conditional_expression =
-                logical_or_expression(_r1)                [_val = _1]
-                >> -('?' > conditional_expression(_r1) > ':' > conditional_expression(_r1)) [px::bind(&expr<Iterator>::ternary_op, _val, _1, _2)];
+                logical_or_expression                [_val = _1]
+                >> -('?' > conditional_expression > ':' > conditional_expression) [px::bind(&ExprTernary<Iterator>::make, _val, _1, _2)];
             conditional_expression.name("conditional_expression");
 
             logical_or_expression = 
-                logical_and_expression(_r1)                [_val = _1]
-                >> *(   ((kw["or"] | "||") > logical_and_expression(_r1) ) [px::bind(&expr<Iterator>::logical_or, _val, _1)] );
+                logical_and_expression                [_val = _1]
+                >> *(   ((kw["or"] | "||") > logical_and_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::logical_or)] );
             logical_or_expression.name("logical_or_expression");
 
             logical_and_expression = 
-                equality_expression(_r1)                   [_val = _1]
-                >> *(   ((kw["and"] | "&&") > equality_expression(_r1) ) [px::bind(&expr<Iterator>::logical_and, _val, _1)] );
+                equality_expression                   [_val = _1]
+                >> *(   ((kw["and"] | "&&") > equality_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::logical_and)] );
             logical_and_expression.name("logical_and_expression");
 
             equality_expression =
-                relational_expression(_r1)                   [_val = _1]
-                >> *(   ("==" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::equal,     _val, _1)]
-                    |   ("!=" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::not_equal, _val, _1)]
-                    |   ("<>" > relational_expression(_r1) ) [px::bind(&expr<Iterator>::not_equal, _val, _1)]
-                    |   ("=~" > regular_expression         ) [px::bind(&expr<Iterator>::regex_matches, _val, _1)]
-                    |   ("!~" > regular_expression         ) [px::bind(&expr<Iterator>::regex_doesnt_match, _val, _1)]
+                relational_expression                   [_val = _1]
+                >> *(   ("==" > relational_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::equal)]
+                    |   ("!=" > relational_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::not_equal)]
+                    |   ("<>" > relational_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::not_equal)]
+                    |   ("=~" > regular_expression    ) [px::bind(&ExprRegex<Iterator>::make, _val, _1, '=')]
+                    |   ("!~" > regular_expression    ) [px::bind(&ExprRegex<Iterator>::make, _val, _1, '!')]
                     );
             equality_expression.name("bool expression");
 
-            // Evaluate a boolean expression stored as expr into a boolean value.
-            // Throw if the equality_expression does not produce a expr of boolean type.
-            bool_expr_eval = conditional_expression(_r1) [ px::bind(&expr<Iterator>::evaluate_boolean, _1, _val) ];
+            // Boolean expression, the condition of an {if} or {elsif}.
+            // Throws when evaluated if the conditional_expression does not produce a expr of boolean type.
+            bool_expr_eval = conditional_expression [_val = _1];
             bool_expr_eval.name("bool_expr_eval");
 
             relational_expression = 
-                    additive_expression(_r1)                [_val  = _1]
-                >> *(   ("<="     > additive_expression(_r1) ) [px::bind(&expr<Iterator>::leq,     _val, _1)]
-                    |   (">="     > additive_expression(_r1) ) [px::bind(&expr<Iterator>::geq,     _val, _1)]
-                    |   (lit('<') > additive_expression(_r1) ) [px::bind(&expr<Iterator>::lower,   _val, _1)]
-                    |   (lit('>') > additive_expression(_r1) ) [px::bind(&expr<Iterator>::greater, _val, _1)]
+                    additive_expression                [_val  = _1]
+                >> *(   ("<="     > additive_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::leq)]
+                    |   (">="     > additive_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::geq)]
+                    |   (lit('<') > additive_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::lower)]
+                    |   (lit('>') > additive_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::greater)]
                     );
             relational_expression.name("relational_expression");
 
             additive_expression =
-                multiplicative_expression(_r1)                       [_val  = _1]
-                >> *(   (lit('+') > multiplicative_expression(_r1) ) [_val += _1]
-                    |   (lit('-') > multiplicative_expression(_r1) ) [_val -= _1]
+                multiplicative_expression                       [_val  = _1]
+                >> *(   (lit('+') > multiplicative_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::add)]
+                    |   (lit('-') > multiplicative_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::sub)]
                     );
             additive_expression.name("additive_expression");
 
             multiplicative_expression =
-                unary_expression(_r1)                       [_val  = _1]
-                >> *(   (lit('*') > unary_expression(_r1) ) [_val *= _1]
-                    |   (lit('/') > unary_expression(_r1) ) [_val /= _1]
+                unary_expression                       [_val  = _1]
+                >> *(   (lit('*') > unary_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::mul)]
+                    |   (lit('/') > unary_expression ) [px::bind(&ExprBinary<Iterator>::make, _val, _1, &expr<Iterator>::div)]
                     );
             multiplicative_expression.name("multiplicative_expression");
 
+            // The start position of the factor is stored as an empty range, so that the rule local may be printed by the debug handler.
+            typedef boost::iterator_range<Iterator> StartPos;
             struct FactorActions {
-                static void set_start_pos(Iterator &start_pos, expr<Iterator> &out)
-                        { out.it_range = boost::iterator_range<Iterator>(start_pos, start_pos); }
-                static void int_(int &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void double_(double &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void bool_(bool &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(value, out.it_range.begin(), end_pos); }
-                static void string_(boost::iterator_range<Iterator> &it_range, expr<Iterator> &out)
-                        { out = expr<Iterator>(std::string(it_range.begin() + 1, it_range.end() - 1), it_range.begin(), it_range.end()); }
-                static void expr_(expr<Iterator> &value, Iterator &end_pos, expr<Iterator> &out)
-                        { out = expr<Iterator>(std::move(value), out.it_range.begin(), end_pos); }
-                static void minus_(expr<Iterator> &value, expr<Iterator> &out)
-                        { out = value.unary_minus(out.it_range.begin()); }
-                static void not_(expr<Iterator> &value, expr<Iterator> &out)
-                        { out = value.unary_not(out.it_range.begin()); }
+                static void set_start_pos(Iterator &start_pos, StartPos &out)
+                        { out = StartPos(start_pos, start_pos); }
+                static void int_(StartPos &start_pos, int &value, Iterator &end_pos, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprLiteral<Iterator>>(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void double_(StartPos &start_pos, double &value, Iterator &end_pos, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprLiteral<Iterator>>(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void bool_(StartPos &start_pos, bool &value, Iterator &end_pos, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprLiteral<Iterator>>(expr<Iterator>(value, start_pos.begin(), end_pos)); }
+                static void string_(boost::iterator_range<Iterator> &it_range, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprLiteral<Iterator>>(expr<Iterator>(std::string(it_range.begin() + 1, it_range.end() - 1), it_range.begin(), it_range.end())); }
+                static void expr_(StartPos &start_pos, ExprPtr<Iterator> &value, Iterator &end_pos, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprUnary<Iterator>>('(', value, start_pos.begin(), end_pos); }
+                static void minus_(StartPos &start_pos, ExprPtr<Iterator> &value, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprUnary<Iterator>>('-', value, start_pos.begin(), start_pos.begin()); }
+                static void not_(StartPos &start_pos, ExprPtr<Iterator> &value, ExprPtr<Iterator> &out)
+                        { out = std::make_shared<ExprUnary<Iterator>>('!', value, start_pos.begin(), start_pos.begin()); }
             };
-            unary_expression = iter_pos[px::bind(&FactorActions::set_start_pos, _1, _val)] >> (
-                    scalar_variable_reference(_r1)                  [ _val = _1 ]
-                |   (lit('(')  > conditional_expression(_r1) > ')' > iter_pos) [ px::bind(&FactorActions::expr_, _1, _2, _val) ]
-                |   (lit('-')  > unary_expression(_r1)           )  [ px::bind(&FactorActions::minus_,  _1,     _val) ]
-                |   (lit('+')  > unary_expression(_r1) > iter_pos)  [ px::bind(&FactorActions::expr_,   _1, _2, _val) ]
-                |   ((kw["not"] | '!') > unary_expression(_r1) > iter_pos) [ px::bind(&FactorActions::not_, _1, _val) ]
-                |   (kw["min"] > '(' > conditional_expression(_r1) [_val = _1] > ',' > conditional_expression(_r1) > ')') 
-                                                                    [ px::bind(&expr<Iterator>::min, _val, _2) ]
-                |   (kw["max"] > '(' > conditional_expression(_r1) [_val = _1] > ',' > conditional_expression(_r1) > ')') 
-                                                                    [ px::bind(&expr<Iterator>::max, _val, _2) ]
-                |   (strict_double > iter_pos)                      [ px::bind(&FactorActions::double_, _1, _2, _val) ]
-                |   (int_      > iter_pos)                          [ px::bind(&FactorActions::int_,    _1, _2, _val) ]
-                |   (kw[bool_] > iter_pos)                          [ px::bind(&FactorActions::bool_,   _1, _2, _val) ]
+            unary_expression = iter_pos[px::bind(&FactorActions::set_start_pos, _1, _a)] >> (
+                    scalar_variable_reference                  [ _val = _1 ]
+                |   (lit('(')  > conditional_expression > ')' > iter_pos) [ px::bind(&FactorActions::expr_, _a, _1, _2, _val) ]
+                |   (lit('-')  > unary_expression           )  [ px::bind(&FactorActions::minus_,  _a, _1,     _val) ]
+                |   (lit('+')  > unary_expression > iter_pos)  [ px::bind(&FactorActions::expr_,   _a, _1, _2, _val) ]
+                |   ((kw["not"] | '!') > unary_expression > iter_pos) [ px::bind(&FactorActions::not_, _a, _1, _val) ]
+                |   (kw["min"] > '(' > conditional_expression [_val = _1] > ',' > conditional_expression > ')') 
+                                                                    [ px::bind(&ExprBinary<Iterator>::make, _val, _2, &expr<Iterator>::min) ]
+                |   (kw["max"] > '(' > conditional_expression [_val = _1] > ',' > conditional_expression > ')') 
+                                                                    [ px::bind(&ExprBinary<Iterator>::make, _val, _2, &expr<Iterator>::max) ]
+                |   (strict_double > iter_pos)                      [ px::bind(&FactorActions::double_, _a, _1, _2, _val) ]
+                |   (int_      > iter_pos)                          [ px::bind(&FactorActions::int_,    _a, _1, _2, _val) ]
+                |   (kw[bool_] > iter_pos)                          [ px::bind(&FactorActions::bool_,   _a, _1, _2, _val) ]
                 |   raw[lexeme['"' > *((utf8char - char_('\\') - char_('"')) | ('\\' > char_)) > '"']]
                                                                     [ px::bind(&FactorActions::string_, _1,     _val) ]
                 );
             unary_expression.name("unary_expression");
 
             scalar_variable_reference = 
-                variable_reference(_r1)[_a=_1] >>
+                identifier[_a=_1] >>
                 (
-                        ('[' > additive_expression(_r1)[px::bind(&MyContext::evaluate_index<Iterator>, _1, _b)] > ']' > 
-                            iter_pos[px::bind(&MyContext::vector_variable_reference<Iterator>, _r1, _a, _b, _1, _val)])
-                    |   eps[px::bind(&MyContext::scalar_variable_reference<Iterator>, _r1, _a, _val)]
+                        ('[' > additive_expression > ']' > iter_pos)
+                            [px::bind(&ExprVariable<Iterator>::vector, _a, _1, _2, _val)]
+                    |   eps[px::bind(&ExprVariable<Iterator>::scalar, _a, _val)]
                 );
             scalar_variable_reference.name("scalar variable reference");
 
-            variable_reference = identifier
-                [ px::bind(&MyContext::resolve_variable<Iterator>, _r1, _1, _val) ];
-            variable_reference.name("variable reference");
-
             regular_expression = raw[lexeme['/' > *((utf8char - char_('\\') - char_('/')) | ('\\' > char_)) > '/']];
             regular_expression.name("regular_expression");
 
@@ -1164,24 +1503,23 @@ namespace client
                 debug(multiplicative_expression);
                 debug(unary_expression);
                 debug(scalar_variable_reference);
-                debug(variable_reference);
                 debug(regular_expression);
             }
         }
 
-        // Generic expression over expr<Iterator>.
-        typedef qi::rule<Iterator, expr<Iterator>(const MyContext*), spirit::ascii::space_type> RuleExpression;
+        // Generic expression compiled into ExprNode<Iterator>.
+        typedef qi::rule<Iterator, ExprPtr<Iterator>(), spirit::ascii::space_type> RuleExpression;
 
         // The start of the grammar.
-        qi::rule<Iterator, std::string(const MyContext*), qi::locals<bool>, spirit::ascii::space_type> start;
+        qi::rule<Iterator, TextPtr<Iterator>(const MyContext*), qi::locals<bool>, spirit::ascii::space_type> start;
         // A free-form text.
         qi::rule<Iterator, std::string(), spirit::ascii::space_type> text;
         // A free-form text, possibly empty, possibly containing macro expansions.
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> text_block;
+        qi::rule<Iterator, TextPtr<Iterator>(), spirit::ascii::space_type> text_block;
         // Statements enclosed in curely braces {}
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> macro;
+        qi::rule<Iterator, TextPtr<Iterator>(), spirit::ascii::space_type> macro;
         // Legacy variable expansion of the original Slic3r, in the form of [scalar_variable] or [vector_variable_index].
-        qi::rule<Iterator, std::string(const MyContext*), spirit::ascii::space_type> legacy_variable_expansion;
+        qi::rule<Iterator, TextPtr<Iterator>(), spirit::ascii::space_type> legacy_variable_expansion;
         // Parsed identifier name.
         qi::rule<Iterator, boost::iterator_range<Iterator>(), spirit::ascii::space_type> identifier;
         // Ternary operator (?:) over logical_or_expression.
@@ -1199,67 +1537,124 @@ namespace client
         // Math expression consisting of */ operators over factors.
         RuleExpression multiplicative_expression;
         // Number literals, functions, braced expressions, variable references, variable indexing references.
-        RuleExpression unary_expression;
+        qi::rule<Iterator, ExprPtr<Iterator>(), qi::locals<boost::iterator_range<Iterator>>, spirit::ascii::space_type> unary_expression;
         // Rule to capture a regular expression enclosed in //.
         qi::rule<Iterator, boost::iterator_range<Iterator>(), spirit::ascii::space_type> regular_expression;
-        // Evaluate boolean expression into bool.
-        qi::rule<Iterator, bool(const MyContext*), spirit::ascii::space_type> bool_expr_eval;
+        // Boolean expression, evaluated into bool.
+        RuleExpression bool_expr_eval;
         // Reference of a scalar variable, or reference to a field of a vector variable.
-        qi::rule<Iterator, expr<Iterator>(const MyContext*), qi::locals<OptWithPos<Iterator>, int>, spirit::ascii::space_type> scalar_variable_reference;
-        // Rule to translate an identifier to a ConfigOption, or to fail.
-        qi::rule<Iterator, OptWithPos<Iterator>(const MyContext*), spirit::ascii::space_type> variable_reference;
+        qi::rule<Iterator, ExprPtr<Iterator>(), qi::locals<boost::iterator_range<Iterator>>, spirit::ascii::space_type> scalar_variable_reference;
 
-        qi::rule<Iterator, std::string(const MyContext*), qi::locals<bool, bool>, spirit::ascii::space_type> if_else_output;
+        qi::rule<Iterator, TextPtr<Iterator>(), qi::locals<ExprPtr<Iterator>>, spirit::ascii::space_type> if_else_output;
 //        qi::rule<Iterator, std::string(const MyContext*), qi::locals<expr<Iterator>, bool, std::string>, spirit::ascii::space_type> switch_output;
 
         qi::symbols<char> keywords;
     };
 }
 
-static std::string process_macro(const std::string &templ, client::MyContext &context)
+// Source of a template together with the tree the template was compiled into.
+struct PlaceholderParser::Template::Data
 {
     typedef std::string::const_iterator iterator_type;
+
+    // The compiled tree points into the source for error reporting.
+    std::string                         source;
+    client::TextPtr<iterator_type>      root;
+    bool                                just_boolean_expression = false;
+};
+
+static std::shared_ptr<const PlaceholderParser::Template::Data> compile_macro(const std::string &templ, bool just_boolean_expression)
+{
+    typedef PlaceholderParser::Template::Data::iterator_type iterator_type;
     typedef client::macro_processor<iterator_type> macro_processor;
 
     // Our whitespace skipper.
     spirit::ascii::space_type   space;
     // Our grammar, statically allocated inside the method, meaning it will be allocated the first time
-    // PlaceholderParser::process() runs.
-    //FIXME this kind of initialization is not thread safe!
+    // a template is compiled. The initialization of a function local static is thread safe with C++11
+    // and the grammar is not modified by parsing, therefore it is shared by all threads.
     static macro_processor      macro_processor_instance;
+    auto data = std::make_shared<PlaceholderParser::Template::Data>();
+    data->source                  = templ;
+    data->just_boolean_expression = just_boolean_expression;
+    client::MyContext context;
+    context.just_boolean_expression = just_boolean_expression;
     // Iterators over the source template.
-    std::string::const_iterator iter = templ.begin();
-    std::string::const_iterator end  = templ.end();
-    // Accumulator for the processed template.
-    std::string                 output;
-    bool res = phrase_parse(iter, end, macro_processor_instance(&context), space, output);
+    iterator_type iter = data->source.begin();
+    iterator_type end  = data->source.end();
+    bool res = phrase_parse(iter, end, macro_processor_instance(&context), space, data->root);
 	if (!context.error_message.empty()) {
         if (context.error_message.back() != '\n' && context.error_message.back() != '\r')
             context.error_message += '\n';
         throw std::runtime_error(context.error_message);
     }
+    return data;
+}
+
+static std::string process_macro(const PlaceholderParser::Template::Data &templ, client::MyContext &context)
+{
+    typedef PlaceholderParser::Template::Data::iterator_type iterator_type;
+
+    // Accumulator for the processed template.
+    std::string output;
+    if (templ.root) {
+        try {
+            templ.root->eval(&context, output);
+        } catch (qi::expectation_failure<iterator_type> &ex) {
+            // Report the runtime error the same way the parser reports the syntax errors.
+            client::MyContext::process_error_message(&context, ex.what_, templ.source.begin(), templ.source.end(), ex.first);
+            if (context.error_message.back() != '\n' && context.error_message.back() != '\r')
+                context.error_message += '\n';
+            throw std::runtime_error(context.error_message);
+        }
+    }
     return output;
 }
 
-std::string PlaceholderParser::process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override) const
+PlaceholderParser::Template PlaceholderParser::compile(const std::string &templ)
+{
+    Template out;
+    out.m_data = compile_macro(templ, false);
+    return out;
+}
+
+PlaceholderParser::Template PlaceholderParser::compile_boolean_expression(const std::string &templ)
+{
+    Template out;
+    out.m_data = compile_macro(templ, true);
+    return out;
+}
+
+std::string PlaceholderParser::process(const Template &templ, unsigned int current_extruder_id, const DynamicConfig *config_override) const
 {
+    assert(templ.m_data == nullptr || ! templ.m_data->just_boolean_expression);
     client::MyContext context;
     context.config              = &this->config();
     context.config_override     = config_override;
     context.current_extruder_id = current_extruder_id;
-    return process_macro(templ, context);
+    return (templ.m_data == nullptr) ? std::string() : process_macro(*templ.m_data, context);
 }
 
-// Evaluate a boolean expression using the full expressive power of the PlaceholderParser boolean expression syntax.
-// Throws std::runtime_error on syntax or runtime error.
-bool PlaceholderParser::evaluate_boolean_expression(const std::string &templ, const DynamicConfig &config, const DynamicConfig *config_override)
+std::string PlaceholderParser::process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override) const
+{
+    return this->process(compile(templ), current_extruder_id, config_override);
+}
+
+bool PlaceholderParser::evaluate_boolean_expression(const Template &templ, const DynamicConfig &config, const DynamicConfig *config_override)
 {
+    assert(templ.m_data != nullptr && templ.m_data->just_boolean_expression);
     client::MyContext context;
     context.config                  = &config;
     context.config_override         = config_override;
-    // Let the macro processor parse just a boolean expression, not the full macro language.
     context.just_boolean_expression = true;
-    return process_macro(templ, context) == "true";
+    return process_macro(*templ.m_data, context) == "true";
+}
+
+// Evaluate a boolean expression using the full expressive power of the PlaceholderParser boolean expression syntax.
+// Throws std::runtime_error on syntax or runtime error.
+bool PlaceholderParser::evaluate_boolean_expression(const std::string &templ, const DynamicConfig &config, const DynamicConfig *config_override)
+{
+    return evaluate_boolean_expression(compile_boolean_expression(templ), config, config_override);
 }
 
 }
@@ -3,6 +3,7 @@
 
 #include "libslic3r.h"
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "PrintConfig.hpp"
@@ -12,6 +13,18 @@ namespace Slic3r {
 class PlaceholderParser
 {
 public:    
+    // Template compiled by PlaceholderParser::compile() or PlaceholderParser::compile_boolean_expression(),
+    // so that it may be processed many times without being parsed again. The compiled template is immutable
+    // and cheap to copy, it may be processed by multiple threads at the same time.
+    class Template
+    {
+    public:
+        struct Data;
+    private:
+        std::shared_ptr<const Data> m_data;
+        friend class PlaceholderParser;
+    };
+
     PlaceholderParser();
     
     // Return a list of keys, which should be changed in m_config from rhs.
@@ -38,10 +51,21 @@ public:
     // Fill in the template using a macro processing language.
     // Throws std::runtime_error on syntax or runtime error.
     std::string process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override = nullptr) const;
+    // Fill in the compiled template. Throws std::runtime_error on runtime error.
+    // All the {if} / {elsif} / {else} branches are evaluated, only the text of the first satisfied one is output.
+    std::string process(const Template &templ, unsigned int current_extruder_id, const DynamicConfig *config_override = nullptr) const;
     
     // Evaluate a boolean expression using the full expressive power of the PlaceholderParser boolean expression syntax.
     // Throws std::runtime_error on syntax or runtime error.
     static bool evaluate_boolean_expression(const std::string &templ, const DynamicConfig &config, const DynamicConfig *config_override = nullptr);
+    // Evaluate a boolean expression compiled by compile_boolean_expression(). Throws std::runtime_error on runtime error.
+    static bool evaluate_boolean_expression(const Template &templ, const DynamicConfig &config, const DynamicConfig *config_override = nullptr);
+
+    // Compile the template of the macro processing language, or a boolean expression.
+    // The variables are resolved when the compiled template is processed.
+    // Throws std::runtime_error on syntax error.
+    static Template compile(const std::string &templ);
+    static Template compile_boolean_expression(const std::string &templ);
 
     // Update timestamp, year, month, day, hour, minute, second variables at the provided config.
     static void update_timestamp(DynamicConfig &config);
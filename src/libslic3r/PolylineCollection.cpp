@@ -1,76 +1,28 @@
 #include "PolylineCollection.hpp"
+#include "ChainedPath.hpp"
 
 namespace Slic3r {
 
-struct Chaining
-{
-    Point first;
-    Point last;
-    size_t idx;
-};
-
-template<typename T>
-inline int nearest_point_index(const std::vector<Chaining> &pairs, const Point &start_near, bool no_reverse)
-{
-    T dmin = std::numeric_limits<T>::max();
-    int idx = 0;
-    for (std::vector<Chaining>::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
-        T d = sqr(T(start_near(0) - it->first(0)));
-        if (d <= dmin) {
-            d += sqr(T(start_near(1) - it->first(1)));
-            if (d < dmin) {
-                idx = (it - pairs.begin()) * 2;
-                dmin = d;
-                if (dmin < EPSILON)
-                    break;
-            }
-        }
-        if (! no_reverse) {
-            d = sqr(T(start_near(0) - it->last(0)));
-            if (d <= dmin) {
-                d += sqr(T(start_near(1) - it->last(1)));
-                if (d < dmin) {
-                    idx = (it - pairs.begin()) * 2 + 1;
-                    dmin = d;
-                    if (dmin < EPSILON)
-                        break;
-                }
-            }
-        }
-    }
-    return idx;
-}
-
 Polylines PolylineCollection::_chained_path_from(
     const Polylines &src,
     Point start_near,
     bool  no_reverse, 
     bool  move_from_src)
 {
-    std::vector<Chaining> endpoints;
-    endpoints.reserve(src.size());
-    for (size_t i = 0; i < src.size(); ++ i) {
-        Chaining c;
-        c.first = src[i].first_point();
-        if (! no_reverse)
-            c.last = src[i].last_point();
-        c.idx = i;
-        endpoints.push_back(c);
-    }
+    std::vector<std::pair<Point, Point>> ends;
+    ends.reserve(src.size());
+    for (const Polyline &polyline : src)
+        ends.emplace_back(polyline.first_point(), polyline.last_point());
     Polylines retval;
-    while (! endpoints.empty()) {
-        // find nearest point
-        int endpoint_index = nearest_point_index<double>(endpoints, start_near, no_reverse);
-        assert(endpoint_index >= 0 && endpoint_index < endpoints.size() * 2);
+    retval.reserve(src.size());
+    for (const std::pair<size_t, bool> &item : chain_items(ends, std::vector<bool>(src.size(), ! no_reverse), start_near)) {
         if (move_from_src) {
-            retval.push_back(std::move(src[endpoints[endpoint_index/2].idx]));
+            retval.push_back(std::move(src[item.first]));
         } else {
-            retval.push_back(src[endpoints[endpoint_index/2].idx]);
+            retval.push_back(src[item.first]);
         }
-        if (endpoint_index & 1)
+        if (item.second)
             retval.back().reverse();
-        endpoints.erase(endpoints.begin() + endpoint_index/2);
-        start_near = retval.back().last_point();
     }
     return retval;
 }
@@ -17,6 +17,8 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/log/trivial.hpp>
 
+#include <tbb/task_group.h>
+
 //! macro used to mark string used at localization, 
 //! return same string
 #define L(s) Slic3r::I18N::translate(s)
@@ -154,6 +156,8 @@ bool Print::invalidate_state_by_config_options(const std::vector<t_config_option
         "retract_restart_extra_toolchange",
         "retract_speed",
         "single_extruder_multi_material_priming",
+        "slice_cache_dir",
+        "slicing_memory_limit",
         "slowdown_below_layer_time",
         "standby_temperature_delta",
         "start_gcode",
@@ -194,9 +198,7 @@ bool Print::invalidate_state_by_config_options(const std::vector<t_config_option
         } else if (opt_key == "brim_width") {
             steps.emplace_back(psBrim);
             steps.emplace_back(psSkirt);
-        } else if (
-               opt_key == "nozzle_diameter"
-            || opt_key == "resolution") {
+        } else if (invalidates_object_slices(opt_key)) {
             osteps.emplace_back(posSlice);
         } else if (
                opt_key == "complete_objects"
@@ -1472,33 +1474,64 @@ void Print::auto_assign_extruders(ModelObject* model_object) const
     }
 }
 
+void Print::set_object_status(int percent, const std::string &message)
+{
+    tbb::mutex::scoped_lock lock(m_object_status_mutex);
+    if (percent > m_object_status_percent) {
+        m_object_status_percent = percent;
+        this->set_status(percent, message);
+    }
+}
+
 // Slicing process, running at a background thread.
 void Print::process()
 {
     BOOST_LOG_TRIVIAL(info) << "Staring the slicing process." << log_memory_info();
-    for (PrintObject *obj : m_objects)
-        obj->make_perimeters();
-    this->set_status(70, "Infilling layers");
-    for (PrintObject *obj : m_objects)
-        obj->infill();
-    for (PrintObject *obj : m_objects)
-        obj->generate_support_material();
-    if (this->set_started(psSkirt)) {
-        m_skirt.clear();
-        if (this->has_skirt()) {
-            this->set_status(88, "Generating skirt");
-            this->_make_skirt();
-        }
-        this->set_done(psSkirt);
+    {
+        // The PrintObjects are independent of each other, therefore each PrintObject runs its chain of steps
+        // (posSlice -> posPerimeters -> posPrepareInfill -> posInfill -> posSupportMaterial) as a separate task.
+        // The steps parallelize over layers on the same TBB pool, so that a plate with many small objects
+        // is processed concurrently, while a single large object keeps being parallelized over its layers.
+        // If a task throws (for example CanceledException), the other tasks are canceled and wait() rethrows.
+        m_object_status_percent = 0;
+        tbb::task_group objects_group;
+        for (PrintObject *obj : m_objects)
+            objects_group.run([this, obj]() {
+                obj->make_perimeters();
+                this->set_object_status(70, "Infilling layers");
+                obj->infill();
+                obj->generate_support_material();
+            });
+        objects_group.wait();
+        m_object_status_percent = 0;
     }
-	if (this->set_started(psBrim)) {
-        m_brim.clear();
-        if (m_config.brim_width > 0) {
-            this->set_status(88, "Generating brim");
-            this->_make_brim();
-        }
-       this->set_done(psBrim);
+    {
+        // Skirt and brim depend on all the PrintObjects, but not on each other.
+        tbb::task_group print_group;
+        print_group.run([this]() {
+            if (this->set_started(psSkirt)) {
+                m_skirt.clear();
+                if (this->has_skirt()) {
+                    this->set_status(88, "Generating skirt");
+                    this->_make_skirt();
+                }
+                this->set_done(psSkirt);
+            }
+        });
+        print_group.run([this]() {
+            if (this->set_started(psBrim)) {
+                m_brim.clear();
+                if (m_config.brim_width > 0) {
+                    this->set_status(88, "Generating brim");
+                    this->_make_brim();
+                }
+                this->set_done(psBrim);
+            }
+        });
+        print_group.wait();
     }
+    // The wipe tower may insert support layers into the first PrintObject, therefore it shall not run
+    // concurrently with the skirt and brim, which read the support layers.
     if (this->set_started(psWipeTower)) {
         m_wipe_tower_data.clear();
         if (this->has_wipe_tower()) {
@@ -1507,6 +1540,8 @@ void Print::process()
         }
        this->set_done(psWipeTower);
     }
+    // Return the scratch memory of the clipping operations back to the heap.
+    ClipperLib::ReleaseScratchPool();
     BOOST_LOG_TRIVIAL(info) << "Slicing process finished." << log_memory_info();
 }
 
@@ -181,6 +181,10 @@ private:
     void _slice();
     std::string _fix_slicing_errors();
     void _simplify_slices(double distance);
+    // Persistent slice cache, see the slice_cache_dir configuration option.
+    std::string _slice_cache_key() const;
+    bool _load_slices_from_cache(const std::string &cache_dir, const std::string &key);
+    void _store_slices_to_cache(const std::string &cache_dir, const std::string &key) const;
     void _make_perimeters();
     bool has_support_material() const;
     void detect_surfaces_type();
@@ -365,10 +369,17 @@ protected:
 
     // Invalidates the step, and its depending steps in Print.
     bool                invalidate_step(PrintStep step);
+    // PrintConfig options invalidating the posSlice step of all the objects.
+    static bool         invalidates_object_slices(const t_config_option_key &opt_key)
+        { return opt_key == "nozzle_diameter" || opt_key == "resolution"; }
 
 private:
     bool                invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys);
 
+    // Status reported by the PrintObjects, which are processed concurrently. Only a progress beyond
+    // the already reported one is passed to set_status(), so that the progress never goes backwards.
+    void                set_object_status(int percent, const std::string &message);
+
     void                _make_skirt();
     void                _make_brim();
     void                _make_wipe_tower();
@@ -393,6 +404,10 @@ private:
     // Estimated print time, filament consumed.
     PrintStatistics                         m_print_statistics;
 
+    // Highest progress reported by set_object_status() during process().
+    int                                     m_object_status_percent = 0;
+    tbb::mutex                              m_object_status_mutex;
+
     // To allow GCode to set the Print's GCodeExport step status.
     friend class GCode;
     // Allow PrintObject to access m_mutex and m_cancel_callback.
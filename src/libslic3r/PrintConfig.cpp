@@ -1704,6 +1704,26 @@ void PrintConfigDef::init_fff_params()
     def->mode = comAdvanced;
     def->default_value = new ConfigOptionInt(1);
     
+    def = this->add("slice_cache_dir", coString);
+    def->label = L("Slice cache directory");
+    def->tooltip = L("If set, the slices of the objects are stored into this directory, keyed by a digest of the meshes, "
+                   "their placement and the parameters affecting the slicing. Repeated runs with the same inputs "
+                   "load the slices from the cache instead of slicing the meshes again.");
+    def->cli = "slice-cache-dir=s";
+    def->readonly = true;
+    def->default_value = new ConfigOptionString("");
+
+    def = this->add("slicing_memory_limit", coInt);
+    def->label = L("Slicing memory limit");
+    def->tooltip = L("Limit of the memory used to slice a mesh. If non-zero, the mesh is sliced in bands of layers, "
+                   "so that the intersection lines of a single band fit into this limit. Set to zero to slice "
+                   "all layers at once.");
+    def->sidetext = L("MB");
+    def->cli = "slicing-memory-limit=i";
+    def->readonly = true;
+    def->min = 0;
+    def->default_value = new ConfigOptionInt(0);
+
     def = this->add("slowdown_below_layer_time", coInts);
     def->label = L("Slow down if layer print time is below");
     def->tooltip = L("If layer print time is estimated below this number of seconds, print moves "
@@ -2999,6 +3019,32 @@ CLIConfigDef::CLIConfigDef()
 {
     ConfigOptionDef *def;
     
+    def = this->add("arrange_rotation_step", coFloat);
+    def->label = L("Arrange rotation step");
+    def->tooltip = L("When arranging, try rotating the objects around the Z axis by multiples of this angle "
+                     "in degrees to pack them tighter (default: 0, the objects are not rotated). If enabled, "
+                     "the objects are arranged onto the bed shape and the option --center will be ignored.");
+    def->cli = "arrange-rotation-step";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0);
+
+    def = this->add("batch", coString);
+    def->label = L("Batch");
+    def->tooltip = L("Process the jobs listed in the given file, one JSON object per line "
+                     "({\"model\": \"file.stl\", \"output\": \"file.gcode\", \"config\": {\"layer_height\": \"0.2\"}}). "
+                     "Use - to read the jobs from the standard input. The jobs share the configuration loaded "
+                     "from the command line, a status line is written to the standard output for each finished job.");
+    def->cli = "batch";
+    def->default_value = new ConfigOptionString("");
+
+    def = this->add("batch_jobs", coInt);
+    def->label = L("Batch jobs");
+    def->tooltip = L("Maximum number of jobs of the --batch mode processed concurrently "
+                     "(0 for the number of the available cores).");
+    def->cli = "batch-jobs";
+    def->min = 0;
+    def->default_value = new ConfigOptionInt(0);
+
     def = this->add("cut", coFloat);
     def->label = L("Cut");
     def->tooltip = L("Cut model at the given Z.");
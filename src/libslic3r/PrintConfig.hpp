@@ -762,6 +762,8 @@ public:
     ConfigOptionFloat               skirt_distance;
     ConfigOptionInt                 skirt_height;
     ConfigOptionInt                 skirts;
+    ConfigOptionString              slice_cache_dir;
+    ConfigOptionInt                 slicing_memory_limit;
     ConfigOptionInts                slowdown_below_layer_time;
     ConfigOptionBool                spiral_vase;
     ConfigOptionInt                 standby_temperature_delta;
@@ -840,6 +842,8 @@ protected:
         OPT_PTR(skirt_distance);
         OPT_PTR(skirt_height);
         OPT_PTR(skirts);
+        OPT_PTR(slice_cache_dir);
+        OPT_PTR(slicing_memory_limit);
         OPT_PTR(slowdown_below_layer_time);
         OPT_PTR(spiral_vase);
         OPT_PTR(standby_temperature_delta);
@@ -1107,6 +1111,9 @@ extern const CLIConfigDef cli_config_def;
 class CLIConfig : public virtual ConfigBase, public StaticConfig
 {
 public:
+    ConfigOptionFloat               arrange_rotation_step;
+    ConfigOptionString              batch;
+    ConfigOptionInt                 batch_jobs;
     ConfigOptionFloat               cut;
     ConfigOptionString              datadir;
     ConfigOptionBool                dont_arrange;
@@ -1137,6 +1144,9 @@ public:
 
     ConfigOption*			optptr(const t_config_option_key &opt_key, bool create = false) override
     {
+        OPT_PTR(arrange_rotation_step);
+        OPT_PTR(batch);
+        OPT_PTR(batch_jobs);
         OPT_PTR(cut);
         OPT_PTR(datadir);
         OPT_PTR(dont_arrange);
@@ -0,0 +1,74 @@
+#include "PrintExport.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <miniz/miniz_zip.h>
+
+namespace Slic3r {
+
+class LayerWriter<SLAMinizZipFmt>::Impl {
+public:
+    mz_zip_archive archive;
+    Impl() { std::memset(&archive, 0, sizeof(archive)); }
+};
+
+LayerWriter<SLAMinizZipFmt>::LayerWriter(const std::string& zipfile_path):
+    m_impl(new Impl()),
+    m_name(boost::filesystem::path(zipfile_path).stem().string())
+{
+    m_ok = mz_zip_writer_init_file(&m_impl->archive, zipfile_path.c_str(), 0) != 0;
+    if(!m_ok)
+        throw std::runtime_error("Cannot create zip file.");
+}
+
+LayerWriter<SLAMinizZipFmt>::~LayerWriter()
+{
+    // Errors can't be reported from the destructor, they are only logged.
+    try {
+        this->close();
+    } catch(std::exception& e) {
+        BOOST_LOG_TRIVIAL(error) << e.what();
+    }
+}
+
+void LayerWriter<SLAMinizZipFmt>::flush_entry()
+{
+    if(m_ok && !m_entry.empty()) {
+        mz_uint level = boost::iends_with(m_entry, ".png") ?
+                    MZ_NO_COMPRESSION : MZ_DEFAULT_COMPRESSION;
+        if(!mz_zip_writer_add_mem(&m_impl->archive, m_entry.c_str(),
+                                  m_data.data(), m_data.size(), level)) {
+            m_ok = false;
+            BOOST_LOG_TRIVIAL(error) << "Unable to add " << m_entry
+                                     << " to the zip archive";
+        }
+    }
+    m_entry.clear();
+    m_data.clear();
+}
+
+void LayerWriter<SLAMinizZipFmt>::next_entry(const std::string& fname)
+{
+    this->flush_entry();
+    m_entry = fname;
+}
+
+void LayerWriter<SLAMinizZipFmt>::close()
+{
+    if(!m_impl) return;
+    this->flush_entry();
+    if(m_ok && !mz_zip_writer_finalize_archive(&m_impl->archive)) {
+        m_ok = false;
+        BOOST_LOG_TRIVIAL(error) << "Unable to finalize the zip archive";
+    }
+    mz_zip_writer_end(&m_impl->archive);
+    m_impl.reset();
+    if(!m_ok)
+        throw std::runtime_error("Unable to write the zip archive.");
+}
+
+}
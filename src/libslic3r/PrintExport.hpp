@@ -2,12 +2,19 @@
 #define PRINTEXPORT_HPP
 
 // For png export of the sliced model
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
 #include <sstream>
+#include <stdexcept>
+#include <memory>
 #include <vector>
 
 #include <boost/log/trivial.hpp>
 
+#include <tbb/pipeline.h>
+
 #include "Rasterizer/Rasterizer.hpp"
 //#include <tbb/parallel_for.h>
 //#include <tbb/spin_mutex.h>//#include "tbb/mutex.h"
@@ -69,9 +76,9 @@ public:
 // Provokes static_assert in the right way.
 template<class T = void> struct VeryFalse { static const bool value = false; };
 
-// This has to be explicitly implemented in the gui layer or a default zlib
-// based implementation is needed. I don't have time for that and I'm delegating
-// the implementation to the gui layer where the gui toolkit can cover this.
+// This has to be explicitly implemented for every archive format. The gui
+// layer provides a wxWidgets based implementation, the miniz based one below
+// is usable without the gui toolkit (e.g. from the command line).
 template<class Fmt> class LayerWriter {
 public:
 
@@ -93,6 +100,47 @@ public:
     void close() {}
 };
 
+// Pseudo type for specializing LayerWriter with the miniz based zip archive.
+struct SLAMinizZipFmt {};
+
+// The implementation of creating zipped archives with miniz. The data of an
+// entry is collected until the next entry is started or the archive is closed.
+// The PNG entries are stored without compression, deflating them again would
+// only cost time.
+template<> class LayerWriter<SLAMinizZipFmt> {
+    class Impl;
+    std::unique_ptr<Impl> m_impl;
+    std::string m_name;
+    std::string m_entry;
+    std::string m_data;
+    bool m_ok = false;
+
+    void flush_entry();
+
+public:
+
+    LayerWriter(const std::string& zipfile_path);
+    LayerWriter(const LayerWriter&) = delete;
+    LayerWriter& operator=(const LayerWriter&) = delete;
+    ~LayerWriter();
+
+    void next_entry(const std::string& fname);
+
+    std::string get_name() const { return m_name; }
+
+    bool is_ok() const { return m_ok; }
+
+    LayerWriter& operator<<(const std::string& arg) {
+        m_data += arg; return *this;
+    }
+
+    template<class T> LayerWriter& operator<<(const T& arg) {
+        std::ostringstream ss; ss << arg; m_data += ss.str(); return *this;
+    }
+
+    void close();
+};
+
 // Implementation for PNG raster output
 // Be aware that if a large number of layers are allocated, it can very well
 // exhaust the available memory especially on 32 bit platform.
@@ -117,6 +165,7 @@ template<> class FilePrinter<FilePrinterFormat::SLA_PNGZIP>
     double m_exp_time_s = .0, m_exp_time_first_s = .0;
     double m_layer_height = .0;
     Raster::Origin m_o = Raster::Origin::TOP_LEFT;
+    Raster::Backend m_backend = Raster::Backend::TILED;
 
     std::string createIniContent(const std::string& projectname) {
         double layer_height = m_layer_height;
@@ -166,12 +215,18 @@ public:
     // slice images, we can flip the x and y coordinates of the input polygons
     // and do the Y flipping of the image. This will generate the correct
     // orientation in portrait mode.
+    //
+    // The raster backend is not a print setting on purpose: both backends
+    // produce byte identical images, the tiled one holding less memory, so
+    // SLAPrint always uses the default. The dense backend is kept as the
+    // reference for sandboxes/rasterbench.
 
     inline FilePrinter(double width_mm, double height_mm,
                        unsigned width_px, unsigned height_px,
                        double layer_height,
                        double exp_time, double exp_time_first,
-                       RasterOrientation ro = RO_PORTRAIT):
+                       RasterOrientation ro = RO_PORTRAIT,
+                       Raster::Backend backend = Raster::Backend::TILED):
         m_res(width_px, height_px),
         m_pxdim(width_mm/width_px, height_mm/height_px),
         m_exp_time_s(exp_time),
@@ -180,7 +235,8 @@ public:
 
         // Here is the trick with the orientation.
         m_o(ro == RO_LANDSCAPE? Raster::Origin::BOTTOM_LEFT :
-                                Raster::Origin::TOP_LEFT )
+                                Raster::Origin::TOP_LEFT ),
+        m_backend(backend)
     {
     }
 
@@ -198,14 +254,20 @@ public:
         m_layers_rst[lyr].first.draw(p);
     }
 
+    inline void draw_polygon(const ExPolygon& p, unsigned lyr,
+                             const Raster::Trafo& tr) {
+        assert(lyr < m_layers_rst.size());
+        m_layers_rst[lyr].first.draw(p, tr);
+    }
+
     inline void begin_layer(unsigned lyr) {
         if(m_layers_rst.size() <= lyr) m_layers_rst.resize(lyr+1);
-        m_layers_rst[lyr].first.reset(m_res, m_pxdim, m_o);
+        m_layers_rst[lyr].first.reset(m_res, m_pxdim, m_o, m_backend);
     }
 
     inline void begin_layer() {
         m_layers_rst.emplace_back();
-        m_layers_rst.front().first.reset(m_res, m_pxdim, m_o);
+        m_layers_rst.front().first.reset(m_res, m_pxdim, m_o, m_backend);
     }
 
     inline void finish_layer(unsigned lyr_id) {
@@ -223,24 +285,35 @@ public:
         }
     }
 
+    // Close the archive, throw if any of its entries could not be written.
+    // Otherwise a truncated archive would be reported as a successful export.
+    template<class LyrFmt>
+    static void finish_archive(LayerWriter<LyrFmt>& writer,
+                               const std::string& path)
+    {
+        // Some writers only report the errors of the last entry and of the
+        // archive directory from close().
+        bool ok = writer.is_ok();
+        if(ok) try { writer.close(); } catch(std::exception&) { ok = false; }
+        if(!ok)
+            throw std::runtime_error(std::string("SLA archive export to ") +
+                                     path + " failed\nIs the disk full?\n");
+    }
+
     template<class LyrFmt>
     inline void save(const std::string& path) {
         try {
             LayerWriter<LyrFmt> writer(path);
-            if(!writer.is_ok()) return;
-
             std::string project = writer.get_name();
 
             writer.next_entry("config.ini");
-            if(!writer.is_ok()) return;
-
-            writer << createIniContent(project);
+            if(writer.is_ok()) writer << createIniContent(project);
 
             for(unsigned i = 0; i < m_layers_rst.size() && writer.is_ok(); i++)
             {
                 if(m_layers_rst[i].second.rdbuf()->in_avail() > 0) {
-                    char lyrnum[6];
-                    std::sprintf(lyrnum, "%.5d", i);
+                    char lyrnum[16];
+                    std::snprintf(lyrnum, sizeof(lyrnum), "%.5u", i);
                     auto zfilename = project + lyrnum + ".png";
                     writer.next_entry(zfilename);
 
@@ -252,6 +325,88 @@ public:
                     //m_layers_rst[i].second.str("");
                 }
             }
+
+            finish_archive(writer, path);
+        } catch(std::exception& e) {
+            BOOST_LOG_TRIVIAL(error) << e.what();
+            // Rethrow the exception
+            throw;
+        }
+    }
+
+    // Rasterize, compress and save all the layers without keeping them in
+    // the printer. The layers are drawn by draw_fn(Raster&, unsigned layer)
+    // and compressed in parallel, then appended to the archive in order as
+    // they are finished. At most "window" layers are held in memory at once.
+    template<class LyrFmt, class DrawFn>
+    inline void save_streaming(const std::string& path, unsigned window,
+                               DrawFn draw_fn)
+    {
+        // Compressed PNG of a single layer travelling through the pipeline.
+        struct LayerResult {
+            unsigned    layer_id;
+            std::string png;
+        };
+        // Shared pointers, so that the layers in flight are released if the
+        // pipeline is canceled by an exception.
+        typedef std::shared_ptr<LayerResult> LayerResultPtr;
+
+        try {
+            LayerWriter<LyrFmt> writer(path);
+            std::string project = writer.get_name();
+
+            writer.next_entry("config.ini");
+            if(writer.is_ok()) writer << createIniContent(project);
+
+            auto lyrcnt = unsigned(m_layers_rst.size());
+            unsigned next_layer = 0;
+            // Set by the output stage once the writer failed. The writer itself
+            // is only touched by the output stage.
+            std::atomic<bool> failed(! writer.is_ok());
+
+            const auto generator = tbb::make_filter<void, LayerResultPtr>(
+                tbb::filter::serial_in_order,
+                [&next_layer, &failed, lyrcnt](tbb::flow_control &fc)
+                    -> LayerResultPtr
+            {
+                if(next_layer == lyrcnt || failed.load()) {
+                    fc.stop();
+                    return LayerResultPtr();
+                }
+                LayerResultPtr result = std::make_shared<LayerResult>();
+                result->layer_id = next_layer ++;
+                return result;
+            });
+
+            const auto rasterizer =
+                    tbb::make_filter<LayerResultPtr, LayerResultPtr>(
+                tbb::filter::parallel,
+                [this, &draw_fn](LayerResultPtr result) -> LayerResultPtr
+            {
+                Raster raster(m_res, m_pxdim, m_o, m_backend);
+                draw_fn(raster, result->layer_id);
+                std::ostringstream ss;
+                raster.save(ss, Raster::Compression::PNG);
+                result->png = ss.str();
+                return result;
+            });
+
+            const auto output = tbb::make_filter<LayerResultPtr, void>(
+                tbb::filter::serial_in_order,
+                [&writer, &project, &failed](LayerResultPtr result)
+            {
+                if(failed.load()) return;
+                char lyrnum[16];
+                std::snprintf(lyrnum, sizeof(lyrnum), "%.5u", result->layer_id);
+                writer.next_entry(project + lyrnum + ".png");
+                if(writer.is_ok()) writer << result->png;
+                if(!writer.is_ok()) failed.store(true);
+            });
+
+            tbb::parallel_pipeline(std::max(window, 1u),
+                                   generator & rasterizer & output);
+
+            finish_archive(writer, path);
         } catch(std::exception& e) {
             BOOST_LOG_TRIVIAL(error) << e.what();
             // Rethrow the exception
@@ -263,8 +418,8 @@ public:
         unsigned i = lyr;
         assert(i < m_layers_rst.size());
 
-        char lyrnum[6];
-        std::sprintf(lyrnum, "%.5d", lyr);
+        char lyrnum[16];
+        std::snprintf(lyrnum, sizeof(lyrnum), "%.5u", lyr);
         std::string loc = path + "layer" + lyrnum + ".png";
 
         std::fstream out(loc, std::fstream::out | std::fstream::binary);
@@ -4,6 +4,7 @@
 #include "Geometry.hpp"
 #include "SupportMaterial.hpp"
 #include "Surface.hpp"
+#include "SliceCache.hpp"
 #include "Slicing.hpp"
 #include "Utils.hpp"
 
@@ -105,18 +106,24 @@ void PrintObject::slice()
 {
     if (! this->set_started(posSlice))
         return;
-    m_print->set_status(10, "Processing triangulated mesh");
-    this->_slice();
-    m_print->throw_if_canceled();
-    // Fix the model.
-    //FIXME is this the right place to do? It is done repeateadly at the UI and now here at the backend.
-    std::string warning = this->_fix_slicing_errors();
-    m_print->throw_if_canceled();
-    if (! warning.empty())
-        BOOST_LOG_TRIVIAL(info) << warning;
-    // Simplify slices if required.
-    if (m_print->config().resolution)
-        this->_simplify_slices(scale_(this->print()->config().resolution));
+    m_print->set_object_status(10, "Processing triangulated mesh");
+    const std::string &cache_dir = m_print->config().slice_cache_dir.value;
+    std::string        cache_key = cache_dir.empty() ? std::string() : this->_slice_cache_key();
+    if (cache_key.empty() || ! this->_load_slices_from_cache(cache_dir, cache_key)) {
+        this->_slice();
+        m_print->throw_if_canceled();
+        // Fix the model.
+        //FIXME is this the right place to do? It is done repeateadly at the UI and now here at the backend.
+        std::string warning = this->_fix_slicing_errors();
+        m_print->throw_if_canceled();
+        if (! warning.empty())
+            BOOST_LOG_TRIVIAL(info) << warning;
+        // Simplify slices if required.
+        if (m_print->config().resolution)
+            this->_simplify_slices(scale_(this->print()->config().resolution));
+        if (! cache_key.empty() && ! m_layers.empty())
+            this->_store_slices_to_cache(cache_dir, cache_key);
+    }
     if (m_layers.empty())
         throw std::runtime_error("No layers were detected. You might want to repair your STL file(s) or check their size or thickness and retry.\n");    
     this->set_done(posSlice);
@@ -133,7 +140,7 @@ void PrintObject::make_perimeters()
     if (! this->set_started(posPerimeters))
         return;
 
-    m_print->set_status(20, "Generating perimeters");
+    m_print->set_object_status(20, "Generating perimeters");
     BOOST_LOG_TRIVIAL(info) << "Generating perimeters..." << log_memory_info();
     
     // merge slices if they were split into types
@@ -243,7 +250,7 @@ void PrintObject::prepare_infill()
     if (! this->set_started(posPrepareInfill))
         return;
 
-    m_print->set_status(30, "Preparing infill");
+    m_print->set_object_status(30, "Preparing infill");
 
     // This will assign a type (top/bottom/internal) to $layerm->slices.
     // Then the classifcation of $layerm->slices is transfered onto 
@@ -383,7 +390,7 @@ void PrintObject::generate_support_material()
     if (this->set_started(posSupportMaterial)) {
         this->clear_support_layers();
         if ((m_config.support_material || m_config.raft_layers > 0) && m_layers.size() > 1) {
-            m_print->set_status(85, "Generating support material");    
+            m_print->set_object_status(85, "Generating support material");    
             this->_generate_support_material();
             m_print->throw_if_canceled();
         } else {
@@ -430,6 +437,124 @@ SupportLayerPtrs::const_iterator PrintObject::insert_support_layer(SupportLayerP
     return m_support_layers.insert(pos, new SupportLayer(id, this, height, print_z, slice_z));
 }
 
+// Classify a change of a PrintObjectConfig or PrintRegionConfig option: Fill in the PrintObject and Print steps it invalidates
+// and whether it resets the layer height profile. Returns false for the options not listed here, which invalidate all the steps.
+// Shared by PrintObject::invalidate_state_by_config_options() and by the key of the slice cache, see PrintObject::_slice_cache_key().
+static bool steps_invalidated_by_option(const t_config_option_key &opt_key, std::vector<PrintObjectStep> &steps, std::vector<PrintStep> &print_steps, bool &reset_layer_height_profile)
+{
+    if (   opt_key == "perimeters"
+        || opt_key == "extra_perimeters"
+        || opt_key == "gap_fill_speed"
+        || opt_key == "overhangs"
+        || opt_key == "first_layer_extrusion_width"
+        || opt_key == "perimeter_extrusion_width"
+        || opt_key == "infill_overlap"
+        || opt_key == "thin_walls"
+        || opt_key == "external_perimeters_first") {
+        steps.emplace_back(posPerimeters);
+    } else if (
+           opt_key == "layer_height"
+        || opt_key == "first_layer_height"
+        || opt_key == "raft_layers") {
+        steps.emplace_back(posSlice);
+        reset_layer_height_profile = true;
+    } else if (
+           opt_key == "clip_multipart_objects"
+        || opt_key == "elefant_foot_compensation"
+        || opt_key == "support_material_contact_distance" 
+        || opt_key == "xy_size_compensation") {
+        steps.emplace_back(posSlice);
+    } else if (
+           opt_key == "support_material"
+        || opt_key == "support_material_auto"
+        || opt_key == "support_material_angle"
+        || opt_key == "support_material_buildplate_only"
+        || opt_key == "support_material_enforce_layers"
+        || opt_key == "support_material_extruder"
+        || opt_key == "support_material_extrusion_width"
+        || opt_key == "support_material_interface_layers"
+        || opt_key == "support_material_interface_contact_loops"
+        || opt_key == "support_material_interface_extruder"
+        || opt_key == "support_material_interface_spacing"
+        || opt_key == "support_material_pattern"
+        || opt_key == "support_material_xy_spacing"
+        || opt_key == "support_material_spacing"
+        || opt_key == "support_material_synchronize_layers"
+        || opt_key == "support_material_threshold"
+        || opt_key == "support_material_with_sheath"
+        || opt_key == "dont_support_bridges"
+        || opt_key == "first_layer_extrusion_width") {
+        steps.emplace_back(posSupportMaterial);
+    } else if (
+           opt_key == "interface_shells"
+        || opt_key == "infill_only_where_needed"
+        || opt_key == "infill_every_layers"
+        || opt_key == "solid_infill_every_layers"
+        || opt_key == "bottom_solid_layers"
+        || opt_key == "top_solid_layers"
+        || opt_key == "solid_infill_below_area"
+        || opt_key == "infill_extruder"
+        || opt_key == "solid_infill_extruder"
+        || opt_key == "infill_extrusion_width"
+        || opt_key == "ensure_vertical_shell_thickness"
+        || opt_key == "bridge_angle") {
+        steps.emplace_back(posPrepareInfill);
+    } else if (
+           opt_key == "external_fill_pattern"
+        || opt_key == "external_fill_link_max_length"
+        || opt_key == "fill_angle"
+        || opt_key == "fill_pattern"
+        || opt_key == "fill_link_max_length"
+        || opt_key == "top_infill_extrusion_width"
+        || opt_key == "first_layer_extrusion_width") {
+        steps.emplace_back(posInfill);
+    } else if (
+           opt_key == "fill_density"
+        || opt_key == "solid_infill_extrusion_width") {
+        steps.emplace_back(posPerimeters);
+        steps.emplace_back(posPrepareInfill);
+    } else if (
+           opt_key == "external_perimeter_extrusion_width"
+        || opt_key == "perimeter_extruder") {
+        steps.emplace_back(posPerimeters);
+        steps.emplace_back(posSupportMaterial);
+    } else if (opt_key == "bridge_flow_ratio") {
+        steps.emplace_back(posPerimeters);
+        steps.emplace_back(posInfill);
+    } else if (
+           opt_key == "seam_position"
+        || opt_key == "seam_preferred_direction"
+        || opt_key == "seam_preferred_direction_jitter"
+        || opt_key == "support_material_speed"
+        || opt_key == "support_material_interface_speed"
+        || opt_key == "bridge_speed"
+        || opt_key == "external_perimeter_speed"
+        || opt_key == "infill_speed"
+        || opt_key == "perimeter_speed"
+        || opt_key == "small_perimeter_speed"
+        || opt_key == "solid_infill_speed"
+        || opt_key == "top_solid_infill_speed") {
+        print_steps.emplace_back(psGCodeExport);
+    } else if (
+           opt_key == "wipe_into_infill"
+        || opt_key == "wipe_into_objects") {
+        print_steps.emplace_back(psWipeTower);
+        print_steps.emplace_back(psGCodeExport);
+    } else
+        return false;
+    return true;
+}
+
+// Does a change of a PrintObjectConfig or PrintRegionConfig option invalidate the slices?
+static bool invalidates_slices(const t_config_option_key &opt_key)
+{
+    std::vector<PrintObjectStep> steps;
+    std::vector<PrintStep>       print_steps;
+    bool                         reset_layer_height_profile = false;
+    return ! steps_invalidated_by_option(opt_key, steps, print_steps, reset_layer_height_profile) ||
+        std::find(steps.begin(), steps.end(), posSlice) != steps.end();
+}
+
 // Called by Print::apply_config().
 // This method only accepts PrintObjectConfig and PrintRegionConfig option keys.
 bool PrintObject::invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys)
@@ -438,115 +563,23 @@ bool PrintObject::invalidate_state_by_config_options(const std::vector<t_config_
         return false;
 
     std::vector<PrintObjectStep> steps;
+    std::vector<PrintStep>       print_steps;
     bool invalidated = false;
     for (const t_config_option_key &opt_key : opt_keys) {
-        if (   opt_key == "perimeters"
-            || opt_key == "extra_perimeters"
-            || opt_key == "gap_fill_speed"
-            || opt_key == "overhangs"
-            || opt_key == "first_layer_extrusion_width"
-            || opt_key == "perimeter_extrusion_width"
-            || opt_key == "infill_overlap"
-            || opt_key == "thin_walls"
-            || opt_key == "external_perimeters_first") {
-            steps.emplace_back(posPerimeters);
-        } else if (
-               opt_key == "layer_height"
-            || opt_key == "first_layer_height"
-            || opt_key == "raft_layers") {
-            steps.emplace_back(posSlice);
-			this->reset_layer_height_profile();
-		}
-		else if (
-               opt_key == "clip_multipart_objects"
-            || opt_key == "elefant_foot_compensation"
-            || opt_key == "support_material_contact_distance" 
-            || opt_key == "xy_size_compensation") {
-            steps.emplace_back(posSlice);
-        } else if (
-               opt_key == "support_material"
-            || opt_key == "support_material_auto"
-            || opt_key == "support_material_angle"
-            || opt_key == "support_material_buildplate_only"
-            || opt_key == "support_material_enforce_layers"
-            || opt_key == "support_material_extruder"
-            || opt_key == "support_material_extrusion_width"
-            || opt_key == "support_material_interface_layers"
-            || opt_key == "support_material_interface_contact_loops"
-            || opt_key == "support_material_interface_extruder"
-            || opt_key == "support_material_interface_spacing"
-            || opt_key == "support_material_pattern"
-            || opt_key == "support_material_xy_spacing"
-            || opt_key == "support_material_spacing"
-            || opt_key == "support_material_synchronize_layers"
-            || opt_key == "support_material_threshold"
-            || opt_key == "support_material_with_sheath"
-            || opt_key == "dont_support_bridges"
-            || opt_key == "first_layer_extrusion_width") {
-            steps.emplace_back(posSupportMaterial);
-        } else if (
-               opt_key == "interface_shells"
-            || opt_key == "infill_only_where_needed"
-            || opt_key == "infill_every_layers"
-            || opt_key == "solid_infill_every_layers"
-            || opt_key == "bottom_solid_layers"
-            || opt_key == "top_solid_layers"
-            || opt_key == "solid_infill_below_area"
-            || opt_key == "infill_extruder"
-            || opt_key == "solid_infill_extruder"
-            || opt_key == "infill_extrusion_width"
-            || opt_key == "ensure_vertical_shell_thickness"
-            || opt_key == "bridge_angle") {
-            steps.emplace_back(posPrepareInfill);
-        } else if (
-               opt_key == "external_fill_pattern"
-            || opt_key == "external_fill_link_max_length"
-            || opt_key == "fill_angle"
-            || opt_key == "fill_pattern"
-            || opt_key == "fill_link_max_length"
-            || opt_key == "top_infill_extrusion_width"
-            || opt_key == "first_layer_extrusion_width") {
-            steps.emplace_back(posInfill);
-        } else if (
-               opt_key == "fill_density"
-            || opt_key == "solid_infill_extrusion_width") {
-            steps.emplace_back(posPerimeters);
-            steps.emplace_back(posPrepareInfill);
-        } else if (
-               opt_key == "external_perimeter_extrusion_width"
-            || opt_key == "perimeter_extruder") {
-            steps.emplace_back(posPerimeters);
-            steps.emplace_back(posSupportMaterial);
-        } else if (opt_key == "bridge_flow_ratio") {
-            steps.emplace_back(posPerimeters);
-            steps.emplace_back(posInfill);
-        } else if (
-               opt_key == "seam_position"
-            || opt_key == "seam_preferred_direction"
-            || opt_key == "seam_preferred_direction_jitter"
-            || opt_key == "support_material_speed"
-            || opt_key == "support_material_interface_speed"
-            || opt_key == "bridge_speed"
-            || opt_key == "external_perimeter_speed"
-            || opt_key == "infill_speed"
-            || opt_key == "perimeter_speed"
-            || opt_key == "small_perimeter_speed"
-            || opt_key == "solid_infill_speed"
-            || opt_key == "top_solid_infill_speed") {
-            invalidated |= m_print->invalidate_step(psGCodeExport);
-        } else if (
-               opt_key == "wipe_into_infill"
-            || opt_key == "wipe_into_objects") {
-            invalidated |= m_print->invalidate_step(psWipeTower);
-            invalidated |= m_print->invalidate_step(psGCodeExport);
-        } else {
+        bool reset_layer_height_profile = false;
+        if (! steps_invalidated_by_option(opt_key, steps, print_steps, reset_layer_height_profile)) {
             // for legacy, if we can't handle this option let's invalidate all steps
             this->invalidate_all_steps();
-			this->reset_layer_height_profile();
+            reset_layer_height_profile = true;
             invalidated = true;
         }
+        if (reset_layer_height_profile)
+            this->reset_layer_height_profile();
     }
 
+    sort_remove_duplicates(print_steps);
+    for (PrintStep step : print_steps)
+        invalidated |= m_print->invalidate_step(step);
     sort_remove_duplicates(steps);
     for (PrintObjectStep step : steps)
         invalidated |= this->invalidate_step(step);
@@ -1528,7 +1561,7 @@ end:
             }
         });
     m_print->throw_if_canceled();
-    BOOST_LOG_TRIVIAL(debug) << "Slicing objects - make_slices in parallel - end";
+    BOOST_LOG_TRIVIAL(debug) << "Slicing objects - make_slices in parallel - end" << log_memory_info();
 }
 
 std::vector<ExPolygons> PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier)
@@ -1592,6 +1625,11 @@ std::vector<ExPolygons> PrintObject::_slice_volumes(const std::vector<float> &z,
             const Print *print = this->print();
             auto callback = TriangleMeshSlicer::throw_on_cancel_callback_type([print](){print->throw_if_canceled();});
             mslicer.init(&mesh, callback);
+            if (m_print->config().slicing_memory_limit.value > 0) {
+                // Slice in bands of layers to bound the memory allocated for the intersection lines.
+                mslicer.init_z_index(callback);
+                mslicer.set_lines_memory_limit(size_t(m_print->config().slicing_memory_limit.value) * 1000000);
+            }
             mslicer.slice(z, &layers, callback);
             m_print->throw_if_canceled();
         }
@@ -1702,6 +1740,107 @@ void PrintObject::_simplify_slices(double distance)
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - siplifying slices in parallel - end";
 }
 
+// Digest of all the inputs of the posSlice step: The meshes of the volumes and their placement, the Z coordinates
+// of the layers and the configuration values applied to the slices.
+std::string PrintObject::_slice_cache_key() const
+{
+    SliceCacheKey key;
+    SlicingParameters slicing_params = this->slicing_parameters();
+    key.append(generate_object_layers(slicing_params, this->layer_height_profile));
+    key.append(uint64_t(slicing_params.raft_layers()));
+    key.append(slicing_params.object_print_z_min);
+    key.append(m_trafo.matrix().data(), 16 * sizeof(double));
+    key.append(m_copies_shift(0));
+    key.append(m_copies_shift(1));
+    key.append(uint64_t(this->region_volumes.size()));
+    for (const std::vector<int> &volumes : this->region_volumes) {
+        key.append(uint64_t(volumes.size()));
+        for (int volume_id : volumes) {
+            const ModelVolume *volume = this->model_object()->volumes[volume_id];
+            key.append(int32_t(volume->type()));
+            key.append(volume->get_matrix().matrix().data(), 16 * sizeof(double));
+            digest_mesh(key, volume->mesh);
+        }
+    }
+    // All the configuration values, which invalidate the posSlice step when changed, see invalidate_state_by_config_options().
+    auto append_config = [&key](const ConfigBase &config, bool print_config) {
+        for (const t_config_option_key &opt_key : config.keys())
+            if (print_config ? Print::invalidates_object_slices(opt_key) : invalidates_slices(opt_key)) {
+                key.append(opt_key);
+                key.append(config.serialize(opt_key));
+            }
+    };
+    append_config(m_print->config(), true);
+    append_config(m_config, false);
+    for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id)
+        if (! this->region_volumes[region_id].empty())
+            append_config(m_print->regions()[region_id]->config(), false);
+    key.append(uint64_t(this->model_object()->layer_height_ranges.size()));
+    for (const std::pair<const t_layer_height_range, coordf_t> &range : this->model_object()->layer_height_ranges) {
+        key.append(range.first.first);
+        key.append(range.first.second);
+        key.append(range.second);
+    }
+    return key.digest();
+}
+
+// Replace the layers with the slices stored in the cache. Returns false if the cache entry is missing or unusable.
+bool PrintObject::_load_slices_from_cache(const std::string &cache_dir, const std::string &key)
+{
+    std::string data;
+    if (! slice_cache_load(cache_dir, key, data))
+        return false;
+
+    this->typed_slices = false;
+    this->clear_layers();
+    SliceCacheReader reader(data);
+    uint64_t num_layers  = 0;
+    uint64_t num_regions = 0;
+    if (reader.read(num_layers) && reader.read(num_regions) && num_regions == this->region_volumes.size()) {
+        Layer *prev = nullptr;
+        for (uint64_t i = 0; i < num_layers && ! reader.failed(); ++ i) {
+            int32_t  id;
+            coordf_t height, print_z, slice_z;
+            if (! reader.read(id) || ! reader.read(height) || ! reader.read(print_z) || ! reader.read(slice_z))
+                break;
+            Layer *layer = this->add_layer(id, height, print_z, slice_z);
+            if (prev != nullptr) {
+                prev->upper_layer = layer;
+                layer->lower_layer = prev;
+            }
+            for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id)
+                reader.read(layer->add_region(this->print()->regions()[region_id])->slices.surfaces);
+            reader.read(layer->slices.expolygons);
+            prev = layer;
+        }
+    }
+    if (reader.failed() || ! reader.eof() || m_layers.size() != num_layers || m_layers.empty()) {
+        BOOST_LOG_TRIVIAL(warning) << "Slicing objects - ignoring an invalid slice cache entry " << key;
+        this->clear_layers();
+        return false;
+    }
+    BOOST_LOG_TRIVIAL(info) << "Slicing objects - loaded " << m_layers.size() << " layers from the slice cache entry " << key;
+    return true;
+}
+
+void PrintObject::_store_slices_to_cache(const std::string &cache_dir, const std::string &key) const
+{
+    SliceCacheWriter writer;
+    writer.write(uint64_t(m_layers.size()));
+    writer.write(uint64_t(this->region_volumes.size()));
+    for (const Layer *layer : m_layers) {
+        writer.write(int32_t(layer->id()));
+        writer.write(layer->height);
+        writer.write(layer->print_z);
+        writer.write(layer->slice_z);
+        for (const LayerRegion *layerm : layer->regions())
+            writer.write(layerm->slices.surfaces);
+        writer.write(layer->slices.expolygons);
+    }
+    if (slice_cache_store(cache_dir, key, writer.data()))
+        BOOST_LOG_TRIVIAL(info) << "Slicing objects - stored " << m_layers.size() << " layers to the slice cache entry " << key;
+}
+
 void PrintObject::_make_perimeters()
 {
     if (! this->set_started(posPerimeters))
@@ -1895,179 +2034,297 @@ void PrintObject::clip_fill_surfaces()
 void PrintObject::discover_horizontal_shells()
 {
     BOOST_LOG_TRIVIAL(trace) << "discover_horizontal_shells()";
-    
-    for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id) {
-        for (int i = 0; i < int(m_layers.size()); ++ i) {
-            m_print->throw_if_canceled();
-            LayerRegion             *layerm = m_layers[i]->regions()[region_id];
-            const PrintRegionConfig &region_config = layerm->region()->config();
-            if (region_config.solid_infill_every_layers.value > 0 && region_config.fill_density.value > 0 &&
-                (i % region_config.solid_infill_every_layers) == 0) {
-                // Insert a solid internal layer. Mark stInternal surfaces as stInternalSolid or stInternalBridge.
-                SurfaceType type = (region_config.fill_density == 100) ? stInternalSolid : stInternalBridge;
-                for (Surface &surface : layerm->fill_surfaces.surfaces)
-                    if (surface.surface_type == stInternal)
-                        surface.surface_type = type;
-            }
 
-            // If ensure_vertical_shell_thickness, then the rest has already been performed by discover_vertical_shells().
-            if (region_config.ensure_vertical_shell_thickness.value)
+    // In the serial order, the layers are processed bottom up: for each layer the marking of a solid infill layer
+    // comes first, then the projection of its top, bottom and bottom bridge surfaces into the neighbor layers.
+    // Therefore a bottom surface is projected into the layers above before they are marked, while a top surface
+    // is projected into the layers below after they were marked and after they received all their bottom shells.
+    // A projection only moves the stInternal areas of its neighbors to stInternalSolid, so the area covered
+    // by the stInternal and stInternalSolid surfaces of a layer is only changed by the marking, and the
+    // top / bottom surfaces of a layer are only trimmed by the internal areas they do not overlap.
+    // The parallel version keeps these dependencies in three phases: the bottom projections are calculated
+    // from the unmarked layers, then the solid infill layers are marked, then the top projections are calculated
+    // from the marked layers. The projections of a phase are calculated in parallel, then they are applied to each
+    // layer in the serial order of the steps, the layers in parallel.
+    // The result is equivalent to the serial one in the area covered by each surface type of each layer, it is not
+    // bit identical: a projection is clipped by a different polygonal partition of the stInternal and stInternalSolid
+    // areas of its neighbor than the serial order would present to it, so the Clipper output may differ in the vertex
+    // order, in the splitting into ExPolygons and in the rounding to the integer grid.
+    // Regions do not share any data, they are processed in parallel as well.
+    struct ShellStep {
+        ShellStep(int layer, SurfaceType type) : layer(layer), type(type) {}
+        int                             layer;
+        // Type of the surfaces to be projected.
+        SurfaceType                     type;
+        // New internal solid areas of the neighbor layers, in the order of the neighbors.
+        std::vector<std::pair<int, Polygons>> projections;
+    };
+    static const SurfaceType shell_types[] = { stTop, stBottom, stBottomBridge };
+
+    // Insert a solid internal layer. Mark stInternal surfaces as stInternalSolid or stInternalBridge.
+    auto mark_solid_infill_layer = [this](size_t region_id, int i) {
+        m_print->throw_if_canceled();
+        LayerRegion             *layerm = m_layers[i]->regions()[region_id];
+        const PrintRegionConfig &region_config = layerm->region()->config();
+        SurfaceType type = (region_config.fill_density == 100) ? stInternalSolid : stInternalBridge;
+        for (Surface &surface : layerm->fill_surfaces.surfaces)
+            if (surface.surface_type == stInternal)
+                surface.surface_type = type;
+    };
+
+    // Project the surfaces of the given type of the i-th layer into the neighbor layers,
+    // top_solid_layers below a top surface or bottom_solid_layers above a bottom surface.
+    // The layers are not modified, the new internal solid areas are collected into step.projections.
+    auto discover_shells = [this](size_t region_id, ShellStep &step) {
+        m_print->throw_if_canceled();
+        const int                i      = step.layer;
+        const SurfaceType        type   = step.type;
+        const LayerRegion       *layerm = m_layers[i]->regions()[region_id];
+        const PrintRegionConfig &region_config = layerm->region()->config();
+        // Find slices of current type for current layer.
+        // Use slices instead of fill_surfaces, because they also include the perimeter area,
+        // which needs to be propagated in shells; we need to grow slices like we did for
+        // fill_surfaces though. Using both ungrown slices and grown fill_surfaces will
+        // not work in some situations, as there won't be any grown region in the perimeter 
+        // area (this was seen in a model where the top layer had one extra perimeter, thus
+        // its fill_surfaces were thinner than the lower layer's infill), however it's the best
+        // solution so far. Growing the external slices by EXTERNAL_INFILL_MARGIN will put
+        // too much solid infill inside nearly-vertical slopes.
+
+        // Surfaces including the area of perimeters. Everything, that is visible from the top / bottom
+        // (not covered by a layer above / below).
+        // This does not contain the areas covered by perimeters!
+        Polygons solid;
+        for (const Surface &surface : layerm->slices.surfaces)
+            if (surface.surface_type == type)
+                polygons_append(solid, to_polygons(surface.expolygon));
+        // Infill areas (slices without the perimeters).
+        for (const Surface &surface : layerm->fill_surfaces.surfaces)
+            if (surface.surface_type == type)
+                polygons_append(solid, to_polygons(surface.expolygon));
+        if (solid.empty())
+            return;
+//                Slic3r::debugf "Layer %d has %s surfaces\n", $i, ($type == S_TYPE_TOP) ? 'top' : 'bottom';
+        
+        size_t solid_layers = (type == stTop) ? region_config.top_solid_layers.value : region_config.bottom_solid_layers.value;                
+        for (int n = (type == stTop) ? i-1 : i+1; std::abs(n - i) < solid_layers; (type == stTop) ? -- n : ++ n) {
+            if (n < 0 || n >= int(m_layers.size()))
                 continue;
+//                    Slic3r::debugf "  looking for neighbors on layer %d...\n", $n;                  
+            // Reference to the lower layer of a TOP surface, or an upper layer of a BOTTOM surface.
+            const LayerRegion *neighbor_layerm = m_layers[n]->regions()[region_id];
             
-            for (int idx_surface_type = 0; idx_surface_type < 3; ++ idx_surface_type) {
-                m_print->throw_if_canceled();
-                SurfaceType type = (idx_surface_type == 0) ? stTop : (idx_surface_type == 1) ? stBottom : stBottomBridge;
-                // Find slices of current type for current layer.
-                // Use slices instead of fill_surfaces, because they also include the perimeter area,
-                // which needs to be propagated in shells; we need to grow slices like we did for
-                // fill_surfaces though. Using both ungrown slices and grown fill_surfaces will
-                // not work in some situations, as there won't be any grown region in the perimeter 
-                // area (this was seen in a model where the top layer had one extra perimeter, thus
-                // its fill_surfaces were thinner than the lower layer's infill), however it's the best
-                // solution so far. Growing the external slices by EXTERNAL_INFILL_MARGIN will put
-                // too much solid infill inside nearly-vertical slopes.
-
-                // Surfaces including the area of perimeters. Everything, that is visible from the top / bottom
-                // (not covered by a layer above / below).
-                // This does not contain the areas covered by perimeters!
-                Polygons solid;
-                for (const Surface &surface : layerm->slices.surfaces)
-                    if (surface.surface_type == type)
-                        polygons_append(solid, to_polygons(surface.expolygon));
-                // Infill areas (slices without the perimeters).
-                for (const Surface &surface : layerm->fill_surfaces.surfaces)
-                    if (surface.surface_type == type)
-                        polygons_append(solid, to_polygons(surface.expolygon));
-                if (solid.empty())
+            // find intersection between neighbor and current layer's surfaces
+            // intersections have contours and holes
+            // we update $solid so that we limit the next neighbor layer to the areas that were
+            // found on this one - in other words, solid shells on one layer (for a given external surface)
+            // are always a subset of the shells found on the previous shell layer
+            // this approach allows for DWIM in hollow sloping vases, where we want bottom
+            // shells to be generated in the base but not in the walls (where there are many
+            // narrow bottom surfaces): reassigning $solid will consider the 'shadow' of the 
+            // upper perimeter as an obstacle and shell will not be propagated to more upper layers
+            //FIXME How does it work for S_TYPE_INTERNALBRIDGE? This is set for sparse infill. Likely this does not work.
+            Polygons new_internal_solid;
+            {
+                Polygons internal;
+                for (const Surface &surface : neighbor_layerm->fill_surfaces.surfaces)
+                    if (surface.surface_type == stInternal || surface.surface_type == stInternalSolid)
+                        polygons_append(internal, to_polygons(surface.expolygon));
+                new_internal_solid = intersection(solid, internal, true);
+            }
+            if (new_internal_solid.empty()) {
+                // No internal solid needed on this layer. In order to decide whether to continue
+                // searching on the next neighbor (thus enforcing the configured number of solid
+                // layers, use different strategies according to configured infill density:
+                if (region_config.fill_density.value == 0) {
+                    // If user expects the object to be void (for example a hollow sloping vase),
+                    // don't continue the search. In this case, we only generate the external solid
+                    // shell if the object would otherwise show a hole (gap between perimeters of 
+                    // the two layers), and internal solid shells are a subset of the shells found 
+                    // on each previous layer.
+                    return;
+                } else {
+                    // If we have internal infill, we can generate internal solid shells freely.
                     continue;
-//                Slic3r::debugf "Layer %d has %s surfaces\n", $i, ($type == S_TYPE_TOP) ? 'top' : 'bottom';
-                
-                size_t solid_layers = (type == stTop) ? region_config.top_solid_layers.value : region_config.bottom_solid_layers.value;                
-                for (int n = (type == stTop) ? i-1 : i+1; std::abs(n - i) < solid_layers; (type == stTop) ? -- n : ++ n) {
-                    if (n < 0 || n >= int(m_layers.size()))
-                        continue;
-//                    Slic3r::debugf "  looking for neighbors on layer %d...\n", $n;                  
-                    // Reference to the lower layer of a TOP surface, or an upper layer of a BOTTOM surface.
-                    LayerRegion *neighbor_layerm = m_layers[n]->regions()[region_id];
-                    
-                    // find intersection between neighbor and current layer's surfaces
-                    // intersections have contours and holes
-                    // we update $solid so that we limit the next neighbor layer to the areas that were
-                    // found on this one - in other words, solid shells on one layer (for a given external surface)
-                    // are always a subset of the shells found on the previous shell layer
-                    // this approach allows for DWIM in hollow sloping vases, where we want bottom
-                    // shells to be generated in the base but not in the walls (where there are many
-                    // narrow bottom surfaces): reassigning $solid will consider the 'shadow' of the 
-                    // upper perimeter as an obstacle and shell will not be propagated to more upper layers
-                    //FIXME How does it work for S_TYPE_INTERNALBRIDGE? This is set for sparse infill. Likely this does not work.
-                    Polygons new_internal_solid;
-                    {
-                        Polygons internal;
-                        for (const Surface &surface : neighbor_layerm->fill_surfaces.surfaces)
-                            if (surface.surface_type == stInternal || surface.surface_type == stInternalSolid)
-                                polygons_append(internal, to_polygons(surface.expolygon));
-                        new_internal_solid = intersection(solid, internal, true);
-                    }
-                    if (new_internal_solid.empty()) {
-                        // No internal solid needed on this layer. In order to decide whether to continue
-                        // searching on the next neighbor (thus enforcing the configured number of solid
-                        // layers, use different strategies according to configured infill density:
-                        if (region_config.fill_density.value == 0) {
-                            // If user expects the object to be void (for example a hollow sloping vase),
-                            // don't continue the search. In this case, we only generate the external solid
-                            // shell if the object would otherwise show a hole (gap between perimeters of 
-                            // the two layers), and internal solid shells are a subset of the shells found 
-                            // on each previous layer.
-                            goto EXTERNAL;
-                        } else {
-                            // If we have internal infill, we can generate internal solid shells freely.
-                            continue;
-                        }
-                    }
-                    
-                    if (region_config.fill_density.value == 0) {
-                        // if we're printing a hollow object we discard any solid shell thinner
-                        // than a perimeter width, since it's probably just crossing a sloping wall
-                        // and it's not wanted in a hollow print even if it would make sense when
-                        // obeying the solid shell count option strictly (DWIM!)
-                        float margin = float(neighbor_layerm->flow(frExternalPerimeter).scaled_width());
-                        Polygons too_narrow = diff(
-                            new_internal_solid, 
-                            offset2(new_internal_solid, -margin, +margin, jtMiter, 5), 
-                            true);
-                        // Trim the regularized region by the original region.
-                        if (! too_narrow.empty())
-                            new_internal_solid = solid = diff(new_internal_solid, too_narrow);
-                    }
+                }
+            }
+            
+            if (region_config.fill_density.value == 0) {
+                // if we're printing a hollow object we discard any solid shell thinner
+                // than a perimeter width, since it's probably just crossing a sloping wall
+                // and it's not wanted in a hollow print even if it would make sense when
+                // obeying the solid shell count option strictly (DWIM!)
+                float margin = float(neighbor_layerm->flow(frExternalPerimeter).scaled_width());
+                Polygons too_narrow = diff(
+                    new_internal_solid, 
+                    offset2(new_internal_solid, -margin, +margin, jtMiter, 5), 
+                    true);
+                // Trim the regularized region by the original region.
+                if (! too_narrow.empty())
+                    new_internal_solid = solid = diff(new_internal_solid, too_narrow);
+            }
 
-                    // make sure the new internal solid is wide enough, as it might get collapsed
-                    // when spacing is added in Fill.pm
-                    {
-                        //FIXME Vojtech: Disable this and you will be sorry.
-                        // https://github.com/prusa3d/Slic3r/issues/26 bottom
-                        float margin = 3.f * layerm->flow(frSolidInfill).scaled_width(); // require at least this size
-                        // we use a higher miterLimit here to handle areas with acute angles
-                        // in those cases, the default miterLimit would cut the corner and we'd
-                        // get a triangle in $too_narrow; if we grow it below then the shell
-                        // would have a different shape from the external surface and we'd still
-                        // have the same angle, so the next shell would be grown even more and so on.
-                        Polygons too_narrow = diff(
-                            new_internal_solid,
-                            offset2(new_internal_solid, -margin, +margin, ClipperLib::jtMiter, 5),
-                            true);
-                        if (! too_narrow.empty()) {
-                            // grow the collapsing parts and add the extra area to  the neighbor layer 
-                            // as well as to our original surfaces so that we support this 
-                            // additional area in the next shell too
-                            // make sure our grown surfaces don't exceed the fill area
-                            Polygons internal;
-                            for (const Surface &surface : neighbor_layerm->fill_surfaces.surfaces)
-                                if (surface.is_internal() && !surface.is_bridge())
-                                    polygons_append(internal, to_polygons(surface.expolygon));
-                            polygons_append(new_internal_solid, 
-                                intersection(
-                                    offset(too_narrow, +margin),
-                                    // Discard bridges as they are grown for anchoring and we can't
-                                    // remove such anchors. (This may happen when a bridge is being 
-                                    // anchored onto a wall where little space remains after the bridge
-                                    // is grown, and that little space is an internal solid shell so 
-                                    // it triggers this too_narrow logic.)
-                                    internal));
-                            solid = new_internal_solid;
+            // make sure the new internal solid is wide enough, as it might get collapsed
+            // when spacing is added in Fill.pm
+            {
+                //FIXME Vojtech: Disable this and you will be sorry.
+                // https://github.com/prusa3d/Slic3r/issues/26 bottom
+                float margin = 3.f * layerm->flow(frSolidInfill).scaled_width(); // require at least this size
+                // we use a higher miterLimit here to handle areas with acute angles
+                // in those cases, the default miterLimit would cut the corner and we'd
+                // get a triangle in $too_narrow; if we grow it below then the shell
+                // would have a different shape from the external surface and we'd still
+                // have the same angle, so the next shell would be grown even more and so on.
+                Polygons too_narrow = diff(
+                    new_internal_solid,
+                    offset2(new_internal_solid, -margin, +margin, ClipperLib::jtMiter, 5),
+                    true);
+                if (! too_narrow.empty()) {
+                    // grow the collapsing parts and add the extra area to  the neighbor layer 
+                    // as well as to our original surfaces so that we support this 
+                    // additional area in the next shell too
+                    // make sure our grown surfaces don't exceed the fill area
+                    Polygons internal;
+                    for (const Surface &surface : neighbor_layerm->fill_surfaces.surfaces)
+                        if (surface.is_internal() && !surface.is_bridge())
+                            polygons_append(internal, to_polygons(surface.expolygon));
+                    polygons_append(new_internal_solid, 
+                        intersection(
+                            offset(too_narrow, +margin),
+                            // Discard bridges as they are grown for anchoring and we can't
+                            // remove such anchors. (This may happen when a bridge is being 
+                            // anchored onto a wall where little space remains after the bridge
+                            // is grown, and that little space is an internal solid shell so 
+                            // it triggers this too_narrow logic.)
+                            internal));
+                    solid = new_internal_solid;
+                }
+            }
+
+            step.projections.emplace_back(n, std::move(new_internal_solid));
+        }
+    };
+
+    // Assign the new internal solid area to the neighbor layer.
+    auto apply_shell = [this](size_t region_id, int n, Polygons new_internal_solid) {
+        LayerRegion *neighbor_layerm = m_layers[n]->regions()[region_id];
+        // internal-solid are the union of the existing internal-solid surfaces
+        // and new ones
+        SurfaceCollection backup = std::move(neighbor_layerm->fill_surfaces);
+        polygons_append(new_internal_solid, to_polygons(backup.filter_by_type(stInternalSolid)));
+        ExPolygons internal_solid = union_ex(new_internal_solid, false);
+        // assign new internal-solid surfaces to layer
+        neighbor_layerm->fill_surfaces.set(internal_solid, stInternalSolid);
+        // subtract intersections from layer surfaces to get resulting internal surfaces
+        Polygons polygons_internal = to_polygons(std::move(internal_solid));
+        ExPolygons internal = diff_ex(
+            to_polygons(backup.filter_by_type(stInternal)),
+            polygons_internal,
+            true);
+        // assign resulting internal surfaces to layer
+        neighbor_layerm->fill_surfaces.append(internal, stInternal);
+        polygons_append(polygons_internal, to_polygons(std::move(internal)));
+        // assign top and bottom surfaces to layer
+        SurfaceType surface_types_solid[] = { stTop, stBottom, stBottomBridge };
+        backup.keep_types(surface_types_solid, 3);
+        std::vector<SurfacesPtr> top_bottom_groups;
+        backup.group(&top_bottom_groups);
+        for (SurfacesPtr &group : top_bottom_groups)
+            neighbor_layerm->fill_surfaces.append(
+                diff_ex(to_polygons(group), polygons_internal),
+                // Use an existing surface as a template, it carries the bridge angle etc.
+                *group.front());
+    };
+
+    // Calculate the projections of the steps in parallel, then apply them to each layer in the order of the steps.
+    auto run_steps = [this, &discover_shells, &apply_shell](size_t region_id, std::vector<ShellStep> &steps) {
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, steps.size()),
+            [region_id, &steps, &discover_shells](const tbb::blocked_range<size_t>& range) {
+                for (size_t idx_step = range.begin(); idx_step < range.end(); ++ idx_step)
+                    discover_shells(region_id, steps[idx_step]);
+            });
+        std::vector<std::vector<std::pair<size_t, size_t>>> layer_steps(m_layers.size());
+        for (size_t idx_step = 0; idx_step < steps.size(); ++ idx_step)
+            for (size_t idx_projection = 0; idx_projection < steps[idx_step].projections.size(); ++ idx_projection)
+                layer_steps[steps[idx_step].projections[idx_projection].first].emplace_back(idx_step, idx_projection);
+        tbb::parallel_for(
+            tbb::blocked_range<int>(0, int(m_layers.size())),
+            [this, region_id, &steps, &layer_steps, &apply_shell](const tbb::blocked_range<int>& range) {
+                for (int n = range.begin(); n < range.end(); ++ n) {
+                    m_print->throw_if_canceled();
+                    for (const std::pair<size_t, size_t> &idx : layer_steps[n])
+                        apply_shell(region_id, n, std::move(steps[idx.first].projections[idx.second].second));
+                }
+            });
+    };
+
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, this->region_volumes.size()),
+        [this, &mark_solid_infill_layer, &run_steps](const tbb::blocked_range<size_t>& range) {
+            for (size_t region_id = range.begin(); region_id < range.end(); ++ region_id) {
+                const PrintRegionConfig &region_config = m_print->get_region(region_id)->config();
+                const int  num_layers  = int(m_layers.size());
+                auto       solid_infill_layer = [&region_config](int i) {
+                    return region_config.solid_infill_every_layers.value > 0 && region_config.fill_density.value > 0 &&
+                        (i % region_config.solid_infill_every_layers) == 0;
+                };
+                // If ensure_vertical_shell_thickness, then the projections have already been performed by discover_vertical_shells().
+                const bool project = ! region_config.ensure_vertical_shell_thickness.value;
+
+                // Surface types present at each layer, one bit per shell_types. The steps only ever trim
+                // the top / bottom surfaces of their neighbors, so a layer without a surface type at the start
+                // will never have one and the projection of that type is a no-op, which is not scheduled.
+                std::vector<unsigned char> layer_types(num_layers, 0);
+                if (project)
+                    tbb::parallel_for(
+                        tbb::blocked_range<int>(0, num_layers),
+                        [this, region_id, &layer_types](const tbb::blocked_range<int>& range) {
+                            for (int i = range.begin(); i < range.end(); ++ i) {
+                                const LayerRegion *layerm = m_layers[i]->regions()[region_id];
+                                unsigned char types = 0;
+                                for (const SurfaceCollection *surfaces : { &layerm->slices, &layerm->fill_surfaces })
+                                    for (const Surface &surface : surfaces->surfaces)
+                                        for (int idx_type = 0; idx_type < 3; ++ idx_type)
+                                            if (surface.surface_type == shell_types[idx_type])
+                                                types |= 1 << idx_type;
+                                layer_types[i] = types;
+                            }
+                        });
+                // Steps projecting the surface types of the mask, in the serial order.
+                auto collect_steps = [num_layers, &region_config, &layer_types](unsigned char mask) {
+                    std::vector<ShellStep> steps;
+                    for (int i = 0; i < num_layers; ++ i)
+                        for (int idx_type = 0; idx_type < 3; ++ idx_type) {
+                            SurfaceType type         = shell_types[idx_type];
+                            int         solid_layers = (type == stTop) ? region_config.top_solid_layers.value : region_config.bottom_solid_layers.value;
+                            // A projection without any neighbor layers does not modify anything.
+                            if ((mask & layer_types[i] & (1 << idx_type)) && solid_layers > 1)
+                                steps.emplace_back(i, type);
                         }
-                    }
-                    
-                    // internal-solid are the union of the existing internal-solid surfaces
-                    // and new ones
-                    SurfaceCollection backup = std::move(neighbor_layerm->fill_surfaces);
-                    polygons_append(new_internal_solid, to_polygons(backup.filter_by_type(stInternalSolid)));
-                    ExPolygons internal_solid = union_ex(new_internal_solid, false);
-                    // assign new internal-solid surfaces to layer
-                    neighbor_layerm->fill_surfaces.set(internal_solid, stInternalSolid);
-                    // subtract intersections from layer surfaces to get resulting internal surfaces
-                    Polygons polygons_internal = to_polygons(std::move(internal_solid));
-                    ExPolygons internal = diff_ex(
-                        to_polygons(backup.filter_by_type(stInternal)),
-                        polygons_internal,
-                        true);
-                    // assign resulting internal surfaces to layer
-                    neighbor_layerm->fill_surfaces.append(internal, stInternal);
-                    polygons_append(polygons_internal, to_polygons(std::move(internal)));
-                    // assign top and bottom surfaces to layer
-                    SurfaceType surface_types_solid[] = { stTop, stBottom, stBottomBridge };
-                    backup.keep_types(surface_types_solid, 3);
-                    std::vector<SurfacesPtr> top_bottom_groups;
-                    backup.group(&top_bottom_groups);
-                    for (SurfacesPtr &group : top_bottom_groups)
-                        neighbor_layerm->fill_surfaces.append(
-                            diff_ex(to_polygons(group), polygons_internal),
-                            // Use an existing surface as a template, it carries the bridge angle etc.
-                            *group.front());
+                    return steps;
+                };
+
+                // 1) The bottom surfaces are projected into the layers above, which are not marked yet.
+                if (project) {
+                    std::vector<ShellStep> steps = collect_steps(2 | 4);
+                    run_steps(region_id, steps);
                 }
-		EXTERNAL:;
-            } // foreach type (stTop, stBottom, stBottomBridge)
-        } // for each layer
-    } // for each region
+                // 2) Mark the solid infill layers.
+                tbb::parallel_for(
+                    tbb::blocked_range<int>(0, num_layers),
+                    [region_id, &solid_infill_layer, &mark_solid_infill_layer](const tbb::blocked_range<int>& range) {
+                        for (int i = range.begin(); i < range.end(); ++ i)
+                            if (solid_infill_layer(i))
+                                mark_solid_infill_layer(region_id, i);
+                    });
+                // 3) The top surfaces are projected into the layers below, which are marked already.
+                if (project) {
+                    std::vector<ShellStep> steps = collect_steps(1);
+                    run_steps(region_id, steps);
+                }
+            } // for each region
+        });
 
 #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
     for (size_t region_id = 0; region_id < this->region_volumes.size(); ++ region_id) {
@@ -2123,72 +2380,81 @@ void PrintObject::combine_infill()
             combine[m_layers.size() - 1] = num_layers;
         }
         
-        // loop through layers to which we have assigned layers to combine
-        for (size_t layer_idx = 0; layer_idx < m_layers.size(); ++ layer_idx) {
-            m_print->throw_if_canceled();
-            size_t num_layers = combine[layer_idx];
-			if (num_layers <= 1)
-                continue;
-            // Get all the LayerRegion objects to be combined.
-            std::vector<LayerRegion*> layerms;
-            layerms.reserve(num_layers);
-			for (size_t i = layer_idx + 1 - num_layers; i <= layer_idx; ++ i)
-                layerms.emplace_back(m_layers[i]->regions()[region_id]);
-            // We need to perform a multi-layer intersection, so let's split it in pairs.
-            // Initialize the intersection with the candidates of the lowest layer.
-            ExPolygons intersection = to_expolygons(layerms.front()->fill_surfaces.filter_by_type(stInternal));
-            // Start looping from the second layer and intersect the current intersection with it.
-            for (size_t i = 1; i < layerms.size(); ++ i)
-                intersection = intersection_ex(
-                    to_polygons(intersection),
-                    to_polygons(layerms[i]->fill_surfaces.filter_by_type(stInternal)),
-                    false);
-            double area_threshold = layerms.front()->infill_area_threshold();
-            if (! intersection.empty() && area_threshold > 0.)
-                intersection.erase(std::remove_if(intersection.begin(), intersection.end(), 
-                    [area_threshold](const ExPolygon &expoly) { return expoly.area() <= area_threshold; }), 
-                    intersection.end());
-            if (intersection.empty())
-                continue;
-//            Slic3r::debugf "  combining %d %s regions from layers %d-%d\n",
-//                scalar(@$intersection),
-//                ($type == S_TYPE_INTERNAL ? 'internal' : 'internal-solid'),
-//                $layer_idx-($every-1), $layer_idx;
-            // intersection now contains the regions that can be combined across the full amount of layers,
-            // so let's remove those areas from all layers.
-            Polygons intersection_with_clearance;
-            intersection_with_clearance.reserve(intersection.size());
-            float clearance_offset = 
-                0.5f * layerms.back()->flow(frPerimeter).scaled_width() +
-             // Because fill areas for rectilinear and honeycomb are grown 
-             // later to overlap perimeters, we need to counteract that too.
-                ((region->config().fill_pattern == ipRectilinear   ||
-                  region->config().fill_pattern == ipGrid          ||
-                  region->config().fill_pattern == ipLine          ||
-                  region->config().fill_pattern == ipHoneycomb) ? 1.5f : 0.5f) * 
-                    layerms.back()->flow(frSolidInfill).scaled_width();
-            for (ExPolygon &expoly : intersection)
-                polygons_append(intersection_with_clearance, offset(expoly, clearance_offset));
-            for (LayerRegion *layerm : layerms) {
-                Polygons internal = to_polygons(layerm->fill_surfaces.filter_by_type(stInternal));
-                layerm->fill_surfaces.remove_type(stInternal);
-                layerm->fill_surfaces.append(diff_ex(internal, intersection_with_clearance, false), stInternal);
-                if (layerm == layerms.back()) {
-                    // Apply surfaces back with adjusted depth to the uppermost layer.
-                    Surface templ(stInternal, ExPolygon());
-                    templ.thickness = 0.;
-                    for (LayerRegion *layerm2 : layerms)
-                        templ.thickness += layerm2->layer()->height;
-                    templ.thickness_layers = (unsigned short)layerms.size();
-                    layerm->fill_surfaces.append(intersection, templ);
-                } else {
-                    // Save void surfaces.
-                    layerm->fill_surfaces.append(
-                        intersection_ex(internal, intersection_with_clearance, false),
-                        stInternalVoid);
+        // Layers to which we have assigned layers to combine. The groups of combined layers do not overlap,
+        // therefore the groups are processed in parallel.
+        std::vector<size_t> combined_layers;
+        for (size_t layer_idx = 0; layer_idx < m_layers.size(); ++ layer_idx)
+            if (combine[layer_idx] > 1)
+                combined_layers.emplace_back(layer_idx);
+
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, combined_layers.size()),
+            [this, region, region_id, &combine, &combined_layers](const tbb::blocked_range<size_t>& range) {
+                for (size_t idx_combined = range.begin(); idx_combined < range.end(); ++ idx_combined) {
+                    m_print->throw_if_canceled();
+                    size_t layer_idx  = combined_layers[idx_combined];
+                    size_t num_layers = combine[layer_idx];
+                    // Get all the LayerRegion objects to be combined.
+                    std::vector<LayerRegion*> layerms;
+                    layerms.reserve(num_layers);
+                    for (size_t i = layer_idx + 1 - num_layers; i <= layer_idx; ++ i)
+                        layerms.emplace_back(m_layers[i]->regions()[region_id]);
+                    // We need to perform a multi-layer intersection, so let's split it in pairs.
+                    // Initialize the intersection with the candidates of the lowest layer.
+                    ExPolygons intersection = to_expolygons(layerms.front()->fill_surfaces.filter_by_type(stInternal));
+                    // Start looping from the second layer and intersect the current intersection with it.
+                    for (size_t i = 1; i < layerms.size(); ++ i)
+                        intersection = intersection_ex(
+                            to_polygons(intersection),
+                            to_polygons(layerms[i]->fill_surfaces.filter_by_type(stInternal)),
+                            false);
+                    double area_threshold = layerms.front()->infill_area_threshold();
+                    if (! intersection.empty() && area_threshold > 0.)
+                        intersection.erase(std::remove_if(intersection.begin(), intersection.end(), 
+                            [area_threshold](const ExPolygon &expoly) { return expoly.area() <= area_threshold; }), 
+                            intersection.end());
+                    if (intersection.empty())
+                        continue;
+//                    Slic3r::debugf "  combining %d %s regions from layers %d-%d\n",
+//                        scalar(@$intersection),
+//                        ($type == S_TYPE_INTERNAL ? 'internal' : 'internal-solid'),
+//                        $layer_idx-($every-1), $layer_idx;
+                    // intersection now contains the regions that can be combined across the full amount of layers,
+                    // so let's remove those areas from all layers.
+                    Polygons intersection_with_clearance;
+                    intersection_with_clearance.reserve(intersection.size());
+                    float clearance_offset = 
+                        0.5f * layerms.back()->flow(frPerimeter).scaled_width() +
+                     // Because fill areas for rectilinear and honeycomb are grown 
+                     // later to overlap perimeters, we need to counteract that too.
+                        ((region->config().fill_pattern == ipRectilinear   ||
+                          region->config().fill_pattern == ipGrid          ||
+                          region->config().fill_pattern == ipLine          ||
+                          region->config().fill_pattern == ipHoneycomb) ? 1.5f : 0.5f) * 
+                            layerms.back()->flow(frSolidInfill).scaled_width();
+                    for (ExPolygon &expoly : intersection)
+                        polygons_append(intersection_with_clearance, offset(expoly, clearance_offset));
+                    for (LayerRegion *layerm : layerms) {
+                        Polygons internal = to_polygons(layerm->fill_surfaces.filter_by_type(stInternal));
+                        layerm->fill_surfaces.remove_type(stInternal);
+                        layerm->fill_surfaces.append(diff_ex(internal, intersection_with_clearance, false), stInternal);
+                        if (layerm == layerms.back()) {
+                            // Apply surfaces back with adjusted depth to the uppermost layer.
+                            Surface templ(stInternal, ExPolygon());
+                            templ.thickness = 0.;
+                            for (LayerRegion *layerm2 : layerms)
+                                templ.thickness += layerm2->layer()->height;
+                            templ.thickness_layers = (unsigned short)layerms.size();
+                            layerm->fill_surfaces.append(intersection, templ);
+                        } else {
+                            // Save void surfaces.
+                            layerm->fill_surfaces.append(
+                                intersection_ex(internal, intersection_with_clearance, false),
+                                stInternalVoid);
+                        }
+                    }
                 }
-            }
-        }
+            });
     }
 }
 
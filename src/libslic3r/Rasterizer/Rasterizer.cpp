@@ -2,6 +2,9 @@
 #include <ExPolygon.hpp>
 
 #include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <vector>
 
 // For rasterizing
 #include <agg/agg_basics.h>
@@ -35,89 +38,235 @@ public:
     static const TPixel ColorBlack;
 
     using Origin = Raster::Origin;
+    using Backend = Raster::Backend;
+
+    // Edge length of the square tiles of the tiled backend in pixels.
+    static const unsigned TileSize = 64;
 
 private:
+    // Renders the anti-aliased scanlines into the tiles, allocating the
+    // tiles on demand. The pixels are blended by the same pixel format as
+    // the dense backend uses, thus both backends produce the same image.
+    class TiledRenderer {
+        Impl& m_impl;
+    public:
+        TiledRenderer(Impl& impl): m_impl(impl) {}
+
+        void prepare() {}
+
+        template<class Scanline> void render(const Scanline& sl) {
+            int y = sl.y();
+            if(y < 0 || y >= int(m_impl.m_resolution.height_px)) return;
+
+            auto span = sl.begin();
+            for(unsigned n = sl.num_spans(); n > 0; --n, ++span) {
+                int x = span->x;
+                int len = span->len;
+                // A negative length is a solid span with a single cover.
+                bool solid = len < 0;
+                if(solid) len = -len;
+
+                const agg::int8u* covers = span->covers;
+                if(x < 0) {
+                    len += x;
+                    if(!solid) covers -= x;
+                    x = 0;
+                }
+                len = std::min(len, int(m_impl.m_resolution.width_px) - x);
+
+                // Split the span at the tile boundaries.
+                while(len > 0) {
+                    int tx = x / int(TileSize);
+                    int piece = std::min(len, int(TileSize) * (tx + 1) - x);
+                    TPixelRenderer pixfmt(m_impl.tile(unsigned(tx),
+                                                      unsigned(y) / TileSize));
+                    int xt = x - tx * int(TileSize);
+                    int yt = y % int(TileSize);
+                    if(solid)
+                        pixfmt.blend_hline(xt, yt, unsigned(piece),
+                                           ColorWhite, *covers);
+                    else {
+                        pixfmt.blend_solid_hspan(xt, yt, unsigned(piece),
+                                                 ColorWhite, covers);
+                        covers += piece;
+                    }
+                    x += piece;
+                    len -= piece;
+                }
+            }
+        }
+    };
+
     Raster::Resolution m_resolution;
     Raster::PixelDim m_pxdim;
+    Origin m_o;
+    Backend m_backend;
+
+    // Pixels of the dense backend.
     TBuffer m_buf;
     TRawBuffer m_rbuf;
     TPixelRenderer m_pixfmt;
     TRawRenderer m_raw_renderer;
     TRendererAA m_renderer;
-    Origin m_o;
+
+    // Tiles of the tiled backend in row major order, an empty tile was not
+    // touched and it is black.
+    unsigned m_tiles_x = 0, m_tiles_y = 0;
+    std::vector<TBuffer> m_tiles;
+    TRawBuffer m_tile_rbuf;
 
     inline void flipy(agg::path_storage& path) const {
         path.flip_y(0, m_resolution.height_px);
     }
 
+    // Get a tile for drawing, allocate it if it was not touched yet.
+    TRawBuffer& tile(unsigned tx, unsigned ty) {
+        TBuffer& t = m_tiles[ty * m_tiles_x + tx];
+        if(t.empty()) t.assign(TileSize * TileSize, TBuffer::value_type());
+        m_tile_rbuf.attach(reinterpret_cast<TPixelRenderer::value_type*>(
+                               t.data()), TileSize, TileSize,
+                           int(TileSize*TPixelRenderer::num_components));
+        return m_tile_rbuf;
+    }
+
 public:
 
     inline Impl(const Raster::Resolution& res, const Raster::PixelDim &pd,
-                Origin o):
-        m_resolution(res), m_pxdim(pd),
-        m_buf(res.pixels()),
+                Origin o, Backend b):
+        m_resolution(res), m_pxdim(pd), m_o(o), m_backend(b),
+        m_buf(b == Backend::DENSE ? res.pixels() : 0),
         m_rbuf(reinterpret_cast<TPixelRenderer::value_type*>(m_buf.data()),
               res.width_px, res.height_px,
               int(res.width_px*TPixelRenderer::num_components)),
         m_pixfmt(m_rbuf),
         m_raw_renderer(m_pixfmt),
-        m_renderer(m_raw_renderer),
-        m_o(o)
+        m_renderer(m_raw_renderer)
     {
         m_renderer.color(ColorWhite);
 
+        if(b == Backend::TILED) {
+            m_tiles_x = (res.width_px + TileSize - 1) / TileSize;
+            m_tiles_y = (res.height_px + TileSize - 1) / TileSize;
+            m_tiles.resize(m_tiles_x * m_tiles_y);
+        }
+
         // If we would like to play around with gamma
         // ras.gamma(agg::gamma_power(1.0));
 
         clear();
     }
 
-    void draw(const ExPolygon &poly) {
+    void draw(const ExPolygon &poly, const Raster::Trafo& trafo) {
         agg::rasterizer_scanline_aa<> ras;
         agg::scanline_p8 scanlines;
 
-        auto&& path = to_path(poly.contour);
+        PointTransformer tr(trafo);
+
+        auto&& path = to_path(poly.contour, tr);
 
         if(m_o == Origin::TOP_LEFT) flipy(path);
 
         ras.add_path(path);
 
-        for(auto h : poly.holes) {
-            auto&& holepath = to_path(h);
+        for(auto& h : poly.holes) {
+            auto&& holepath = to_path(h, tr);
             if(m_o == Origin::TOP_LEFT) flipy(holepath);
             ras.add_path(holepath);
         }
 
-        agg::render_scanlines(ras, scanlines, m_renderer);
+        if(m_backend == Backend::TILED) {
+            TiledRenderer renderer(*this);
+            agg::render_scanlines(ras, scanlines, renderer);
+        } else
+            agg::render_scanlines(ras, scanlines, m_renderer);
     }
 
     inline void clear() {
-        m_raw_renderer.clear(ColorBlack);
+        if(m_backend == Backend::TILED)
+            for(TBuffer& t : m_tiles) TBuffer().swap(t);
+        else
+            m_raw_renderer.clear(ColorBlack);
     }
 
-    inline TBuffer& buffer()  { return m_buf; }
+    // Get the pixels of a row. The row of the tiled backend is assembled
+    // into the tmp buffer, which has to be kept for the consecutive rows.
+    const TBuffer::value_type* row(unsigned r, TBuffer& tmp) const {
+        if(m_backend == Backend::DENSE)
+            return m_buf.data() + size_t(r) * m_resolution.width_px;
+
+        tmp.resize(m_resolution.width_px);
+        unsigned ty = r / TileSize;
+        const TBuffer* tiles = m_tiles.data() + ty * m_tiles_x;
+        size_t offset = (r % TileSize) * TileSize;
+        for(unsigned tx = 0; tx < m_tiles_x; ++tx) {
+            auto dst = tmp.begin() + tx * TileSize;
+            auto len = std::min(TileSize, m_resolution.width_px - tx * TileSize);
+            if(tiles[tx].empty())
+                std::fill(dst, dst + len, TBuffer::value_type());
+            else
+                std::copy(tiles[tx].begin() + offset,
+                          tiles[tx].begin() + offset + len, dst);
+        }
+        return tmp.data();
+    }
+
+    size_t memory_used() const {
+        size_t pixels = m_buf.capacity();
+        for(const TBuffer& t : m_tiles) pixels += t.capacity();
+        return pixels * sizeof(TBuffer::value_type) +
+               m_tiles.capacity() * sizeof(TBuffer);
+    }
 
     inline const Raster::Resolution resolution() { return m_resolution; }
 
     inline Origin origin() const /*noexcept*/ { return m_o; }
 
+    inline Backend backend() const /*noexcept*/ { return m_backend; }
+
 private:
-    double getPx(const Point& p) {
+    // Applies Raster::Trafo to the points in scaled coordinates.
+    struct PointTransformer {
+        const Raster::Trafo& trafo;
+        bool rotate;
+        double c, s;
+
+        PointTransformer(const Raster::Trafo& t):
+            trafo(t), rotate(t.rotation != 0.),
+            c(std::cos(t.rotation)), s(std::sin(t.rotation)) {}
+
+        Vec2d operator()(const Point& p) const {
+            double x = double(p(0)), y = double(p(1));
+            if(rotate) {
+                // Rounded the same way as MultiPoint::rotate().
+                double rx = std::round(c * x - s * y);
+                y = std::round(c * y + s * x);
+                x = rx;
+            }
+            x += trafo.shift_x;
+            y += trafo.shift_y;
+            return trafo.swap_xy ? Vec2d(y, x) : Vec2d(x, y);
+        }
+    };
+
+    double getPx(const Vec2d& p) {
         return p(0) * SCALING_FACTOR/m_pxdim.w_mm;
     }
 
-    double getPy(const Point& p) {
+    double getPy(const Vec2d& p) {
         return p(1) * SCALING_FACTOR/m_pxdim.h_mm;
     }
 
-    agg::path_storage to_path(const Polygon& poly) {
+    agg::path_storage to_path(const Polygon& poly, const PointTransformer& tr) {
         agg::path_storage path;
         auto it = poly.points.begin();
-        path.move_to(getPx(*it), getPy(*it));
-        while(++it != poly.points.end())
-            path.line_to(getPx(*it), getPy(*it));
+        Vec2d first = tr(*it);
+        path.move_to(getPx(first), getPy(first));
+        while(++it != poly.points.end()) {
+            Vec2d p = tr(*it);
+            path.line_to(getPx(p), getPy(p));
+        }
 
-        path.line_to(getPx(poly.points.front()), getPy(poly.points.front()));
+        path.line_to(getPx(first), getPy(first));
         return path;
     }
 
@@ -125,9 +274,10 @@ private:
 
 const Raster::Impl::TPixel Raster::Impl::ColorWhite = Raster::Impl::TPixel(255);
 const Raster::Impl::TPixel Raster::Impl::ColorBlack = Raster::Impl::TPixel(0);
+const unsigned Raster::Impl::TileSize;
 
-Raster::Raster(const Resolution &r, const PixelDim &pd, Origin o):
-    m_impl(new Impl(r, pd, o)) {}
+Raster::Raster(const Resolution &r, const PixelDim &pd, Origin o, Backend b):
+    m_impl(new Impl(r, pd, o, b)) {}
 
 Raster::Raster() {}
 
@@ -146,9 +296,16 @@ void Raster::reset(const Raster::Resolution &r, const Raster::PixelDim &pd)
 
 void Raster::reset(const Raster::Resolution &r, const Raster::PixelDim &pd,
                    Raster::Origin o)
+{
+    auto b = m_impl? m_impl->backend() : Backend::DENSE;
+    reset(r, pd, o, b);
+}
+
+void Raster::reset(const Raster::Resolution &r, const Raster::PixelDim &pd,
+                   Raster::Origin o, Raster::Backend b)
 {
     m_impl.reset();
-    m_impl.reset(new Impl(r, pd, o));
+    m_impl.reset(new Impl(r, pd, o, b));
 }
 
 void Raster::reset()
@@ -163,6 +320,16 @@ Raster::Resolution Raster::resolution() const
     return Resolution(0, 0);
 }
 
+Raster::Backend Raster::backend() const
+{
+    return m_impl? m_impl->backend() : Backend::DENSE;
+}
+
+size_t Raster::memory_used() const
+{
+    return m_impl? m_impl->memory_used() : 0;
+}
+
 void Raster::clear()
 {
     assert(m_impl);
@@ -172,7 +339,13 @@ void Raster::clear()
 void Raster::draw(const ExPolygon &poly)
 {
     assert(m_impl);
-    m_impl->draw(poly);
+    m_impl->draw(poly, Trafo());
+}
+
+void Raster::draw(const ExPolygon &poly, const Trafo &trafo)
+{
+    assert(m_impl);
+    m_impl->draw(poly, trafo);
 }
 
 void Raster::save(std::ostream& stream, Compression comp)
@@ -191,13 +364,12 @@ void Raster::save(std::ostream& stream, Compression comp)
 
         wr.write_info();
 
-        auto& b = m_impl->buffer();
-        auto ptr = reinterpret_cast<png::byte*>( b.data() );
-        unsigned stride =
-                sizeof(Impl::TBuffer::value_type) *  resolution().width_px;
-
-        for(unsigned r = 0; r < resolution().height_px; r++, ptr+=stride) {
-            wr.write_row(ptr);
+        // The rows are encoded one by one, the tiled backend never
+        // assembles the whole image.
+        Impl::TBuffer tmp;
+        for(unsigned r = 0; r < resolution().height_px; r++) {
+            auto ptr = reinterpret_cast<const png::byte*>(m_impl->row(r, tmp));
+            wr.write_row(const_cast<png::byte*>(ptr));
         }
 
         break;
@@ -208,9 +380,12 @@ void Raster::save(std::ostream& stream, Compression comp)
                << m_impl->resolution().height_px << " "
                << "255 ";
 
-        auto sz = m_impl->buffer().size()*sizeof(Impl::TBuffer::value_type);
-        stream.write(reinterpret_cast<const char*>(m_impl->buffer().data()),
-                     std::streamsize(sz));
+        auto sz = m_impl->resolution().width_px *
+                  sizeof(Impl::TBuffer::value_type);
+        Impl::TBuffer tmp;
+        for(unsigned r = 0; r < resolution().height_px; r++)
+            stream.write(reinterpret_cast<const char*>(m_impl->row(r, tmp)),
+                         std::streamsize(sz));
     }
     }
 }
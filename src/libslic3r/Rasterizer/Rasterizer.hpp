@@ -3,6 +3,7 @@
 
 #include <ostream>
 #include <memory>
+#include <cstddef>
 
 namespace Slic3r {
 
@@ -39,6 +40,15 @@ public:
         BOTTOM_LEFT
     };
 
+    /// The storage of the pixels. The dense backend allocates the whole
+    /// canvas. The tiled backend allocates only the tiles touched by the
+    /// drawn polygons, which saves most of the memory and of the clearing
+    /// when the slices cover only a small part of the display.
+    enum class Backend {
+        DENSE,
+        TILED
+    };
+
     /// Type that represents a resolution in pixels.
     struct Resolution {
         unsigned width_px;
@@ -57,9 +67,23 @@ public:
             w_mm(px_width_mm), h_mm(px_height_mm) {}
     };
 
+    /// Transformation of the drawn polygons: rotation around the origin,
+    /// translation by a shift in scaled coordinates and an optional swap of
+    /// the X and Y axes, in this order. The rotated points are rounded to
+    /// the scaled coordinates the same way ExPolygon::rotate() does.
+    struct Trafo {
+        double rotation = 0.;
+        double shift_x = 0., shift_y = 0.;
+        bool swap_xy = false;
+        inline Trafo() {}
+        inline Trafo(double rot, double sx, double sy, bool swp):
+            rotation(rot), shift_x(sx), shift_y(sy), swap_xy(swp) {}
+    };
+
     /// Constructor taking the resolution and the pixel dimension.
     explicit Raster(const Resolution& r, const PixelDim& pd,
-                    Origin o = Origin::BOTTOM_LEFT );
+                    Origin o = Origin::BOTTOM_LEFT,
+                    Backend b = Backend::DENSE);
     Raster();
     Raster(const Raster& cpy) = delete;
     Raster& operator=(const Raster& cpy) = delete;
@@ -69,6 +93,7 @@ public:
     /// Reallocated everything for the given resolution and pixel dimension.
     void reset(const Resolution& r, const PixelDim& pd);
     void reset(const Resolution& r, const PixelDim& pd, Origin o);
+    void reset(const Resolution& r, const PixelDim& pd, Origin o, Backend b);
 
     /**
      * Release the allocated resources. Drawing in this state ends in
@@ -79,12 +104,22 @@ public:
     /// Get the resolution of the raster.
     Resolution resolution() const;
 
+    /// Get the backend storing the pixels.
+    Backend backend() const;
+
+    /// Memory allocated for the pixels in bytes.
+    size_t memory_used() const;
+
     /// Clear the raster with black color.
     void clear();
 
     /// Draw a polygon with holes.
     void draw(const ExPolygon& poly);
 
+    /// Draw a transformed polygon with holes without copying it. This way
+    /// the instances of an object share the geometry of its slices.
+    void draw(const ExPolygon& poly, const Trafo& trafo);
+
     /// Save the raster on the specified stream.
     void save(std::ostream& stream, Compression comp = Compression::RAW);
 };
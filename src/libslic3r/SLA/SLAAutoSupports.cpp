@@ -1,6 +1,3 @@
-#include "igl/random_points_on_mesh.h"
-#include "igl/AABB.h"
-
 #include "SLAAutoSupports.hpp"
 #include "Model.hpp"
 #include "ExPolygon.hpp"
@@ -10,17 +7,16 @@
 
 #include <iostream>
 #include <random>
+#include <unordered_map>
+
+#include <tbb/parallel_for.h>
 
 namespace Slic3r {
 
 SLAAutoSupports::SLAAutoSupports(const TriangleMesh& mesh, const sla::EigenMesh3D& emesh, const std::vector<ExPolygons>& slices, const std::vector<float>& heights, 
     const Config& config, std::function<void(void)> throw_on_cancel)
-: m_config(config), m_V(emesh.V), m_F(emesh.F), m_throw_on_cancel(throw_on_cancel)
+: m_config(config), m_emesh(emesh), m_V(emesh.V), m_F(emesh.F), m_throw_on_cancel(throw_on_cancel)
 {
-    // FIXME: It might be safer to get rid of the rand() calls altogether, because it is probably
-    // not always thread-safe and can be slow if it is.
-    srand(time(NULL)); // rand() is used by igl::random_point_on_mesh
-
     // Find all separate islands that will need support. The coord_t number denotes height
     // of a point just below the mesh (so that we can later project the point precisely
     // on the mesh by raycasting (done by igl) and not risking we will place the point inside).
@@ -41,16 +37,13 @@ SLAAutoSupports::SLAAutoSupports(const TriangleMesh& mesh, const sla::EigenMesh3
 }
 
 
-float SLAAutoSupports::approximate_geodesic_distance(const Vec3d& p1, const Vec3d& p2, Vec3d& n1, Vec3d& n2)
+float SLAAutoSupports::approximate_geodesic_distance(const Vec3d& p1, const Vec3d& p2, const Vec3d& n1, const Vec3d& n2)
 {
-    n1.normalize();
-    n2.normalize();
-
     Vec3d v = (p2-p1);
     v.normalize();
 
-    float c1 = n1.dot(v);
-    float c2 = n2.dot(v);
+    float c1 = n1.normalized().dot(v);
+    float c2 = n2.normalized().dot(v);
     float result = pow(p1(0)-p2(0), 2) + pow(p1(1)-p2(1), 2) + pow(p1(2)-p2(2), 2);
     // Check for division by zero:
     if(fabs(c1 - c2) > 0.0001)
@@ -58,112 +51,178 @@ float SLAAutoSupports::approximate_geodesic_distance(const Vec3d& p1, const Vec3
     return result;
 }
 
+namespace {
+
+// Uniform grid of the support points, hashed by the cell coordinates.
+class SupportPointGrid {
+public:
+    SupportPointGrid(double cell_size) : m_cell_size(cell_size) {}
+
+    void insert(const Vec3d& pt, size_t idx) { m_cells[cell_key(cell_coord(pt))].emplace_back(idx); ++ m_size; }
+
+    // Call fn(idx) for all the points closer to pt than radius and possibly some more,
+    // until fn returns false.
+    template<typename Fn> void visit(const Vec3d& pt, double radius, Fn fn) const
+    {
+        Vec3i lo = cell_coord(pt - Vec3d(radius, radius, radius));
+        Vec3i hi = cell_coord(pt + Vec3d(radius, radius, radius));
+        Vec3i size = hi - lo + Vec3i(1, 1, 1);
+        if (double(size(0)) * double(size(1)) * double(size(2)) > double(m_size)) {
+            // The neighborhood spans more cells than there are points.
+            for (size_t idx = 0; idx < m_size; ++ idx)
+                if (! fn(idx))
+                    return;
+            return;
+        }
+        for (int i = lo(0); i <= hi(0); ++ i)
+            for (int j = lo(1); j <= hi(1); ++ j)
+                for (int k = lo(2); k <= hi(2); ++ k) {
+                    auto it = m_cells.find(cell_key(Vec3i(i, j, k)));
+                    if (it != m_cells.end())
+                        for (size_t idx : it->second)
+                            if (! fn(idx))
+                                return;
+                }
+    }
+
+private:
+    Vec3i cell_coord(const Vec3d& pt) const
+        { return Vec3i(int(std::floor(pt(0) / m_cell_size)), int(std::floor(pt(1) / m_cell_size)), int(std::floor(pt(2) / m_cell_size))); }
+    // Cells far apart may share a key, which only adds points to be tested.
+    static int64_t cell_key(const Vec3i& cell)
+        { return (int64_t(cell(0) & 0x1FFFFF) << 42) | (int64_t(cell(1) & 0x1FFFFF) << 21) | int64_t(cell(2) & 0x1FFFFF); }
+
+    double                                              m_cell_size;
+    size_t                                              m_size = 0;
+    std::unordered_map<int64_t, std::vector<size_t>>    m_cells;
+};
+
+} // namespace
 
 void SLAAutoSupports::sprinkle_mesh(const TriangleMesh& mesh)
 {
-    std::vector<Vec3d> points;
-    // Loads the ModelObject raw_mesh and transforms it by first instance's transformation matrix (disregarding translation).
-    // Instances only differ in z-rotation, so it does not matter which of them will be used for the calculation.
-    // The supports point will be calculated on this mesh (so scaling ang vertical direction is correctly accounted for).
-    // Results will be inverse-transformed to raw_mesh coordinates.
-    //TriangleMesh mesh = m_model_object.raw_mesh();
-    //Transform3d transformation_matrix = m_model_object.instances[0]->get_matrix(true/*dont_translate*/);
-    //mesh.transform(transformation_matrix);
-
     // Check that the object is thick enough to produce any support points
     BoundingBoxf3 bb = mesh.bounding_box();
     if (bb.size()(2) < m_config.minimal_z)
         return;
 
-    // All points that we curretly have must be transformed too, so distance to them is correcly calculated.
-    //for (Vec3f& point : m_model_object.sla_support_points)
-    //    point = transformation_matrix.cast<float>() * point;
-
-
-    // In order to calculate distance to already placed points, we must keep know which facet the point lies on.
-    std::vector<Vec3d> facets_normals;
-
-    // Only points belonging to islands were added so far - they all lie on horizontal surfaces:
-    for (unsigned int i=0; i<m_output.size(); ++i)
-        facets_normals.push_back(Vec3d(0,0,-1));
-
-    // The AABB hierarchy will be used to find normals of already placed points.
-    // The points added automatically will just push_back the new normal on the fly.
-    /*igl::AABB<Eigen::MatrixXf,3> aabb;
-    aabb.init(V, F);
-    for (unsigned int i=0; i<m_model_object.sla_support_points.size(); ++i) {
-        int facet_idx = 0;
-        Eigen::Matrix<float, 1, 3> dump;
-        Eigen::MatrixXf query_point = m_model_object.sla_support_points[i];
-        aabb.squared_distance(V, F, query_point, facet_idx, dump);
-        Vec3f a1 = V.row(F(facet_idx,1)) - V.row(F(facet_idx,0));
-        Vec3f a2 = V.row(F(facet_idx,2)) - V.row(F(facet_idx,0));
-        Vec3f normal = a1.cross(a2);
-        normal.normalize();
-        facets_normals.push_back(normal);
-    }*/
-
-    // New potential support point is randomly generated on the mesh and distance to all already placed points is calculated.
-    // In case it is never smaller than certain limit (depends on the new point's facet normal), the point is accepted.
-    // The process stops after certain number of points is refused in a row.
-    Vec3d point;
-    Vec3d normal;
-    int added_points = 0;
-    int refused_points = 0;
-    const int refused_limit = 30;
     // Angle at which the density reaches zero:
     const float threshold_angle = std::min(M_PI_2, M_PI_4 * acos(0.f/m_config.density_at_horizontal) / acos(m_config.density_at_45/m_config.density_at_horizontal));
 
-    size_t cancel_test_cntr = 0;
-    while (refused_points < refused_limit) {
-        if (++ cancel_test_cntr == 500) {
-            // Don't call the cancellation routine too often as the multi-core cache synchronization
-            // may be pretty expensive.
-            m_throw_on_cancel();
-            cancel_test_cntr = 0;
-        }
-        // Place a random point on the mesh and calculate corresponding facet's normal:
-        Eigen::VectorXi FI;
-        Eigen::MatrixXd B;
-        igl::random_points_on_mesh(1, m_V, m_F, B, FI);
-        point = B(0,0)*m_V.row(m_F(FI(0),0)) +
-                B(0,1)*m_V.row(m_F(FI(0),1)) +
-                B(0,2)*m_V.row(m_F(FI(0),2));
-        if (point(2) - bb.min(2) < m_config.minimal_z)
+    // Area weighted sampler of the facets, which may receive a support point. The facets steeper than the threshold angle
+    // and the facets below the minimal height would never produce a valid point, therefore they are left out.
+    std::vector<int>    facets;
+    std::vector<Vec3d>  facets_normals;
+    std::vector<double> facets_cumulative_area;
+    double              area_total = 0.;
+    for (int i = 0; i < m_F.rows(); ++ i) {
+        Vec3d p0 = m_V.row(m_F(i, 0));
+        Vec3d p1 = m_V.row(m_F(i, 1));
+        Vec3d p2 = m_V.row(m_F(i, 2));
+        Vec3d normal = (p1 - p0).cross(p2 - p0);
+        double area = 0.5 * normal.norm();
+        if (area == 0. || std::max(std::max(p0(2), p1(2)), p2(2)) - bb.min(2) < m_config.minimal_z)
             continue;
-
-        Vec3d a1 = m_V.row(m_F(FI(0),1)) - m_V.row(m_F(FI(0),0));
-        Vec3d a2 = m_V.row(m_F(FI(0),2)) - m_V.row(m_F(FI(0),0));
-        normal = a1.cross(a2);
         normal.normalize();
-
-        // calculate angle between the normal and vertical:
-        float angle = angle_from_normal(normal.cast<float>());
-        if (angle > threshold_angle)
+        // The density is zero at the threshold angle, such a facet does not need any support point.
+        if (angle_from_normal(normal.cast<float>()) >= threshold_angle)
             continue;
+        facets.emplace_back(i);
+        facets_normals.emplace_back(normal);
+        facets_cumulative_area.emplace_back(area_total += area);
+    }
+    if (facets.empty())
+        return;
 
-        const float limit = distance_limit(angle);
-        bool add_it = true;
-        for (unsigned int i=0; i<points.size(); ++i) {
-            if (approximate_geodesic_distance(points[i], point, facets_normals[i], normal) < limit) {
-                add_it = false;
-                ++refused_points;
-                break;
+    // Points placed so far. Only the points belonging to islands were added, they all lie on horizontal surfaces.
+    // In order to calculate distance to already placed points, we must know the normal of the facet the point lies on.
+    std::vector<Vec3d> points = m_output;
+    std::vector<Vec3d> normals(points.size(), Vec3d(0., 0., -1.));
+
+    // The approximate geodesic distance is never shorter than the squared euclidean distance, therefore only the points
+    // closer than sqrt(distance_limit) have to be tested. The limit is the lowest for the horizontal surfaces.
+    double cell_size = std::sqrt(distance_limit(0.f));
+    if (! (cell_size > 0. && cell_size < bb.size().maxCoeff()))
+        cell_size = std::max(bb.size().maxCoeff(), EPSILON);
+    SupportPointGrid grid(cell_size);
+    // All the points lie inside the bounding box, a larger search radius would only visit more empty cells.
+    const double max_radius = bb.size().norm();
+    for (size_t i = 0; i < points.size(); ++ i)
+        grid.insert(points[i], i);
+
+    struct Candidate {
+        Vec3d point;
+        Vec3d normal;
+        float limit;
+        // Is the point high enough above the bed?
+        bool  valid;
+        // Is the point too close to the points placed before the current batch?
+        bool  refused;
+    };
+    auto too_close = [this, &points, &normals](const Candidate &candidate, size_t idx) {
+        return approximate_geodesic_distance(points[idx], candidate.point, normals[idx], candidate.normal) < candidate.limit;
+    };
+
+    // New potential support point is randomly generated on the mesh and distance to all already placed points is calculated.
+    // In case it is never smaller than certain limit (depends on the new point's facet normal), the point is accepted.
+    // The process stops after certain number of points is refused in a row.
+    // The candidates are generated and tested against the points placed so far in parallel, in batches. Then the candidates
+    // of a batch are accepted in their order, testing them against the points accepted from the same batch only,
+    // which gives the same result as generating and testing the candidates one by one.
+    const int    refused_limit = 30;
+    const size_t batch_chunks  = 8;
+    const size_t chunk_size    = 64;
+    std::vector<Candidate> candidates(batch_chunks * chunk_size);
+    size_t first_chunk    = 0;
+    int    refused_points = 0;
+    while (refused_points < refused_limit) {
+        m_throw_on_cancel();
+        tbb::parallel_for(size_t(0), batch_chunks, [&](size_t ichunk) {
+            // Each chunk draws from its own generator, so that the result does not depend on the scheduling.
+            std::mt19937 rng(unsigned(first_chunk + ichunk));
+            std::uniform_real_distribution<double> dis(0., 1.);
+            for (size_t i = ichunk * chunk_size; i < (ichunk + 1) * chunk_size; ++ i) {
+                Candidate &candidate = candidates[i];
+                size_t idx = std::upper_bound(facets_cumulative_area.begin(), facets_cumulative_area.end(), dis(rng) * area_total) - facets_cumulative_area.begin();
+                idx = std::min(idx, facets.size() - 1);
+                // Uniformly distributed point on a triangle.
+                double s = dis(rng);
+                double t = std::sqrt(dis(rng));
+                int    f = facets[idx];
+                candidate.point   = (1. - t) * m_V.row(m_F(f, 0)) + (1. - s) * t * m_V.row(m_F(f, 1)) + s * t * m_V.row(m_F(f, 2));
+                candidate.normal  = facets_normals[idx];
+                candidate.limit   = distance_limit(angle_from_normal(candidate.normal.cast<float>()));
+                candidate.valid   = candidate.point(2) - bb.min(2) >= m_config.minimal_z;
+                // A point, where the required density is zero due to rounding, is refused as if it was too close to another point.
+                candidate.refused = ! std::isfinite(candidate.limit);
+                if (candidate.valid && ! candidate.refused)
+                    grid.visit(candidate.point, std::min(1.01 * std::sqrt(candidate.limit), max_radius), [&candidate, &too_close](size_t idx) {
+                        return ! (candidate.refused = too_close(candidate, idx));
+                    });
+            }
+        });
+        first_chunk += batch_chunks;
+
+        size_t first_point = points.size();
+        for (const Candidate &candidate : candidates) {
+            if (! candidate.valid)
+                continue;
+            bool refused = candidate.refused;
+            for (size_t i = first_point; ! refused && i < points.size(); ++ i)
+                refused = too_close(candidate, i);
+            if (refused) {
+                if (++ refused_points == refused_limit)
+                    break;
+            } else {
+                grid.insert(candidate.point, points.size());
+                points.emplace_back(candidate.point);
+                normals.emplace_back(candidate.normal);
+                refused_points = 0;
             }
-        }
-        if (add_it) {
-            points.push_back(point.cast<double>());
-            facets_normals.push_back(normal);
-            ++added_points;
-            refused_points = 0;
         }
     }
 
-    m_output.insert(m_output.end(), points.begin(), points.end());
-
-    // Now transform all support points to mesh coordinates:
-    //for (Vec3f& point : m_model_object.sla_support_points)
-    //    point = transformation_matrix.inverse().cast<float>() * point;
+    m_output.insert(m_output.end(), points.begin() + m_output.size(), points.end());
 }
 
 
@@ -321,13 +380,14 @@ HOLE_HIT:
 
 void SLAAutoSupports::project_upward_onto_mesh(std::vector<Vec3d>& points) const
 {
-    Vec3f dir(0., 0., 1.);
-    igl::Hit hit{0, 0, 0.f, 0.f, 0.f};
+    Vec3d dir(0., 0., 1.);
     for (Vec3d& p : points) {
-        igl::ray_mesh_intersect(p.cast<float>(), dir, m_V, m_F, hit);
-        int fid = hit.id;
-        Vec3f bc(1-hit.u-hit.v, hit.u, hit.v);
-        p = (bc(0) * m_V.row(m_F(fid, 0)) + bc(1) * m_V.row(m_F(fid, 1)) + bc(2)*m_V.row(m_F(fid, 2))).cast<double>();
+        sla::EigenMesh3D::Hit hit = m_emesh.query_ray_hit(p, dir);
+        int fid = hit.face;
+        if (fid < 0)
+            continue;
+        Vec3d bc(1-hit.u-hit.v, hit.u, hit.v);
+        p = bc(0) * m_V.row(m_F(fid, 0)) + bc(1) * m_V.row(m_F(fid, 1)) + bc(2)*m_V.row(m_F(fid, 2));
     }
 }
 
@@ -28,7 +28,7 @@ private:
     static float angle_from_normal(const stl_normal& normal) { return acos((-normal.normalized())(2)); }
     float get_required_density(float angle) const;
     float distance_limit(float angle) const;
-    static float approximate_geodesic_distance(const Vec3d& p1, const Vec3d& p2, Vec3d& n1, Vec3d& n2);
+    static float approximate_geodesic_distance(const Vec3d& p1, const Vec3d& p2, const Vec3d& n1, const Vec3d& n2);
     std::vector<std::pair<ExPolygon, coord_t>> find_islands(const std::vector<ExPolygons>& slices, const std::vector<float>& heights) const;
     void sprinkle_mesh(const TriangleMesh& mesh);
     std::vector<Vec3d> uniformly_cover(const std::pair<ExPolygon, coord_t>& island);
@@ -40,6 +40,7 @@ private:
 
     SLAAutoSupports::Config m_config;
     std::function<void(void)> m_throw_on_cancel;
+    const sla::EigenMesh3D& m_emesh;
     const Eigen::MatrixXd& m_V;
     const Eigen::MatrixXi& m_F;
 };
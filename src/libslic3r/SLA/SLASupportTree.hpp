@@ -5,6 +5,7 @@
 #include <array>
 #include <cstdint>
 #include <memory>
+#include <limits>
 #include <Eigen/Geometry>
 
 namespace Slic3r {
@@ -99,6 +100,30 @@ struct EigenMesh3D {
     Eigen::MatrixXd V;
     Eigen::MatrixXi F;
     double ground_level = 0;
+
+    /// Axis aligned bounding box tree over the triangles, accelerating the
+    /// ray and distance queries below. Without the tree, the queries test
+    /// every triangle. The tree is shared by the copies of the mesh and it
+    /// has to be rebuilt by build_aabb() whenever V or F are modified.
+    class AABBImpl;
+    std::shared_ptr<const AABBImpl> aabb;
+
+    void build_aabb();
+
+    /// The first intersection of a ray with the mesh.
+    struct Hit {
+        // Distance along dir, infinity if the ray misses the mesh.
+        double t = std::numeric_limits<double>::infinity();
+        int face = -1;
+        // Barycentric coordinates of the intersection on the face.
+        double u = 0, v = 0;
+    };
+
+    Hit query_ray_hit(const Vec3d& s, const Vec3d& dir) const;
+
+    /// Squared distance of a point to the mesh, the index of the closest
+    /// face and the closest point on it.
+    double squared_distance(const Vec3d& p, int& face, Vec3d& closest) const;
 };
 
 using PointSet = Eigen::MatrixXd;
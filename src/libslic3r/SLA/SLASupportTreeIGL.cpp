@@ -10,6 +10,7 @@
 #include "boost/geometry/index/rtree.hpp"
 
 #include <igl/ray_mesh_intersect.h>
+#include <igl/AABB.h>
 #include <igl/point_mesh_squared_distance.h>
 #include <igl/remove_duplicate_vertices.h>
 
@@ -27,6 +28,54 @@ public:
     BoostIndex m_store;
 };
 
+class EigenMesh3D::AABBImpl: public igl::AABB<Eigen::MatrixXd, 3> {};
+
+void EigenMesh3D::build_aabb()
+{
+    auto tree = std::make_shared<AABBImpl>();
+    tree->init(V, F);
+    aabb = std::move(tree);
+}
+
+EigenMesh3D::Hit EigenMesh3D::query_ray_hit(const Vec3d &s,
+                                            const Vec3d &dir) const
+{
+    igl::Hit hit;
+    hit.t = std::numeric_limits<float>::infinity();
+    bool is_hit = aabb ?
+        aabb->intersect_ray(V, F, s.transpose(), dir.transpose(), hit) :
+        igl::ray_mesh_intersect(s, dir, V, F, hit);
+
+    Hit ret;
+    if(is_hit) {
+        ret.t = double(hit.t);
+        ret.face = hit.id;
+        ret.u = double(hit.u);
+        ret.v = double(hit.v);
+    }
+    return ret;
+}
+
+double EigenMesh3D::squared_distance(const Vec3d &p, int &face,
+                                     Vec3d &closest) const
+{
+    double sqdst = 0;
+    Eigen::Matrix<double, 1, 3> pp = p.transpose();
+    Eigen::Matrix<double, 1, 3> cc;
+    if(aabb) {
+        sqdst = aabb->squared_distance(V, F, pp, face, cc);
+    } else {
+        Eigen::MatrixXd P = pp;
+        Eigen::VectorXd dists;
+        Eigen::VectorXi I;
+        Eigen::MatrixXd C;
+        igl::point_mesh_squared_distance(P, V, F, dists, I, C);
+        sqdst = dists(0); face = I(0); cc = C.row(0);
+    }
+    closest = cc.transpose();
+    return sqdst;
+}
+
 SpatIndex::SpatIndex(): m_impl(new Impl()) {}
 SpatIndex::~SpatIndex() {}
 
@@ -111,7 +160,12 @@ PointSet normals(const PointSet& points, const EigenMesh3D& emesh,
     igl::remove_duplicate_vertices(emesh.V, emesh.F, dEPS,
                                    mesh.V, SVI, SVJ, mesh.F);
 
-    igl::point_mesh_squared_distance( points, mesh.V, mesh.F, dists, I, C);
+    // The deduplication keeps the order of the faces, therefore the tree
+    // of the original mesh yields the same face indices.
+    if(emesh.aabb)
+        emesh.aabb->squared_distance(emesh.V, emesh.F, points, dists, I, C);
+    else
+        igl::point_mesh_squared_distance(points, mesh.V, mesh.F, dists, I, C);
 
     PointSet ret(I.rows(), 3);
     for(int i = 0; i < I.rows(); i++) {
@@ -226,10 +280,7 @@ double ray_mesh_intersect(const Vec3d& s,
                           const Vec3d& dir,
                           const EigenMesh3D& m)
 {
-    igl::Hit hit;
-    hit.t = std::numeric_limits<float>::infinity();
-    igl::ray_mesh_intersect(s, dir, m.V, m.F, hit);
-    return double(hit.t);
+    return m.query_ray_hit(s, dir).t;
 }
 
 // Clustering a set of points by the given criteria
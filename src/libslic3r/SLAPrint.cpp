@@ -3,11 +3,13 @@
 #include "SLA/SLABasePool.hpp"
 #include "SLA/SLAAutoSupports.hpp"
 #include "MTUtils.hpp"
+#include "clipper.hpp"
 
 #include <unordered_set>
 #include <numeric>
 
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <boost/log/trivial.hpp>
 
 //#include <tbb/spin_mutex.h>//#include "tbb/mutex.h"
@@ -414,11 +416,6 @@ sla::SupportConfig make_support_cfg(const SLAPrintObjectConfig& c) {
     return scfg;
 }
 
-void swapXY(ExPolygon& expoly) {
-    for(auto& p : expoly.contour.points) std::swap(p(X), p(Y));
-    for(auto& h : expoly.holes) for(auto& p : h.points) std::swap(p(X), p(Y));
-}
-
 }
 
 std::vector<float> SLAPrint::calculate_heights(const BoundingBoxf3& bb3d,
@@ -442,6 +439,42 @@ std::vector<float> SLAPrint::calculate_heights(const BoundingBoxf3& bb3d,
     return heights;
 }
 
+void SLAPrint::draw_level(unsigned level_id,
+                          const std::function<void(const ExPolygon&,
+                                                   const Raster::Trafo&)>& draw) const
+{
+    assert(level_id < m_printer_levels.size());
+
+    // If the raster has vertical orientation, we will flip the coordinates
+    bool flpXY = m_printer_config.display_orientation.getInt() ==
+            SLADisplayOrientation::sladoPortrait;
+
+    for(auto& lyrref : *m_printer_levels[level_id]) { // for all layers in the level
+        if(canceled()) break;
+        const Layer& sl = lyrref.lref;   // get the layer reference
+        const LayerCopies& copies = lyrref.copies;
+
+        // Draw all the polygons in the slice to the actual layer. The
+        // rasterizer applies the rotation before the translation and the
+        // flipping of the axes last.
+        for(auto& cp : copies) {
+            Raster::Trafo tr(double(cp.rotation),
+                             double(cp.shift(X)), double(cp.shift(Y)), flpXY);
+            for(const ExPolygon& slice : sl) draw(slice, tr);
+        }
+    }
+}
+
+void SLAPrint::set_export_window(unsigned layers)
+{
+    if(layers == m_export_window) return;
+    tbb::mutex::scoped_lock lock(this->state_mutex());
+    // The layers are rasterized by a different step, thus the printer
+    // has to be set up again.
+    this->invalidate_step(slapsRasterize);
+    m_export_window = layers;
+}
+
 template<class...Args>
 void report_status(SLAPrint& p, int st, const std::string& msg, Args&&...args) {
     BOOST_LOG_TRIVIAL(info) << st << "% " << msg;
@@ -469,6 +502,38 @@ void SLAPrint::process()
     // are set up for <0, 100>. They need to be scaled into the whole process
     const double ostepd = (max_objstatus - min_objstatus) / (objcount * 100.0);
 
+    // The objects are processed concurrently, therefore their progress is
+    // aggregated: objstatus_done accumulates the OBJ_STEP_LEVELS of the
+    // finished steps of all objects, the reported status never goes back.
+    SpinMutex objstatus_mutex;
+    unsigned objstatus_done = 0;
+    unsigned objstatus_reported = min_objstatus;
+
+    // Report the aggregated status extended with the progress of a running
+    // step (in the OBJ_STEP_LEVELS units)
+    auto report_objstatus = [this, &objstatus_mutex, &objstatus_done,
+                             &objstatus_reported, ostepd]
+            (unsigned running, const std::string& msg)
+    {
+        unsigned st;
+        {
+            std::lock_guard<SpinMutex> lck(objstatus_mutex);
+            st = min_objstatus + unsigned((objstatus_done + running) * ostepd);
+            if(st < objstatus_reported) return;
+            objstatus_reported = st;
+        }
+        // The status callback may take long (it updates the GUI), it is not
+        // called with the spin lock held.
+        report_status(*this, int(st), msg);
+    };
+
+    auto finish_objstep = [&objstatus_mutex, &objstatus_done]
+            (SLAPrintObjectStep step)
+    {
+        std::lock_guard<SpinMutex> lck(objstatus_mutex);
+        objstatus_done += OBJ_STEP_LEVELS[step];
+    };
+
     // The slicing will be performed on an imaginary 1D grid which starts from
     // the bottom of the bounding box created around the supported model. So
     // the first layer which is usually thicker will be part of the supports
@@ -501,6 +566,7 @@ void SLAPrint::process()
         const ModelObject& mo = *po.m_model_object;
         po.m_supportdata.reset(new SLAPrintObject::SupportData());
         po.m_supportdata->emesh = sla::to_eigenmesh(po.transformed_mesh());
+        po.m_supportdata->emesh.build_aabb();
 
         BOOST_LOG_TRIVIAL(debug) << "Support point count "
                                  << mo.sla_support_points.size();
@@ -549,7 +615,7 @@ void SLAPrint::process()
     };
 
     // In this step we create the supports
-    auto support_tree = [this, objcount, ostepd](SLAPrintObject& po) {
+    auto support_tree = [this, &report_objstatus](SLAPrintObject& po) {
         if(!po.m_supportdata) return;
 
         if(!po.m_config.supports_enable.getBool()) {
@@ -562,20 +628,13 @@ void SLAPrint::process()
             sla::SupportConfig scfg = make_support_cfg(po.m_config);
             sla::Controller ctl;
 
-            // some magic to scale the status values coming from the support
-            // tree creation into the whole print process
-            auto stfirst = OBJ_STEP_LEVELS.begin();
-            auto stthis = stfirst + slaposSupportTree;
-            // we need to add up the status portions until this operation
-            int init = std::accumulate(stfirst, stthis, 0);
-            init = int(init * ostepd);     // scale the init portion
+            // scale the status values coming from the support tree creation
+            // into the portion of this step in the aggregated object status
+            double d = OBJ_STEP_LEVELS[slaposSupportTree] / 100.0;
 
-            // scaling for the sub operations
-            double d = *stthis / (objcount * 100.0);
-
-            ctl.statuscb = [this, init, d](unsigned st, const std::string& msg)
+            ctl.statuscb = [&report_objstatus, d](unsigned st, const std::string& msg)
             {
-                report_status(*this, int(init + st*d), msg);
+                report_objstatus(unsigned(st * d), msg);
             };
 
             ctl.stopcondition = [this](){ return canceled(); };
@@ -773,9 +832,10 @@ void SLAPrint::process()
             }
         }
 
-        // collect all the keys
-        std::vector<long long> keys; keys.reserve(m_printer_input.size());
-        for(auto& e : m_printer_input) keys.emplace_back(e.first);
+        // collect all the levels in the order of the printer layers
+        m_printer_levels.clear();
+        m_printer_levels.reserve(m_printer_input.size());
+        for(auto& e : m_printer_input) m_printer_levels.emplace_back(&e.second);
 
         // If the raster has vertical orientation, we will flip the coordinates
         bool flpXY = m_printer_config.display_orientation.getInt() ==
@@ -807,6 +867,10 @@ void SLAPrint::process()
         auto lvlcnt = unsigned(m_printer_input.size());
         printer.layers(lvlcnt);
 
+        // The layers will be rasterized by export_raster() in a streaming
+        // fashion, a window of layers at a time.
+        if(m_export_window > 0) return;
+
         // slot is the portion of 100% that is realted to rasterization
         unsigned slot = PRINT_STEP_LEVELS[slapsRasterize];
         // ist: initial state; pst: previous state
@@ -818,45 +882,30 @@ void SLAPrint::process()
 
         // procedure to process one height level. This will run in parallel
         auto lvlfn =
-        [this, &slck, &keys, &printer, slot, sd, ist, &pst, flpXY]
+        [this, &slck, &printer, slot, sd, ist, &pst]
             (unsigned level_id)
         {
             if(canceled()) return;
 
-            LayerRefs& lrange = m_printer_input[keys[level_id]];
-
             // Switch to the appropriate layer in the printer
             printer.begin_layer(level_id);
 
-            for(auto& lyrref : lrange) { // for all layers in the current level
-                if(canceled()) break;
-                const Layer& sl = lyrref.lref;   // get the layer reference
-                const LayerCopies& copies = lyrref.copies;
-
-                // Draw all the polygons in the slice to the actual layer.
-                for(auto& cp : copies) {
-                    for(ExPolygon slice : sl) {
-                        // The order is important here:
-                        // apply rotation before translation...
-                        slice.rotate(double(cp.rotation));
-                        slice.translate(cp.shift(X), cp.shift(Y));
-                        if(flpXY) swapXY(slice);
-                        printer.draw_polygon(slice, level_id);
-                    }
-                }
-            }
+            draw_level(level_id, [&printer, level_id](const ExPolygon& p,
+                                                  const Raster::Trafo& tr) {
+                printer.draw_polygon(p, level_id, tr);
+            });
 
             // Finish the layer for later saving it.
             printer.finish_layer(level_id);
 
-            // Status indication guarded with the spinlock
+            // Status indication guarded with the spinlock, the status
+            // callback itself is called after the lock is released.
             auto st = ist + unsigned(sd*level_id*slot/m_printer_input.size());
             { std::lock_guard<SpinMutex> lck(slck);
-            if( st > pst) {
-                report_status(*this, int(st), PRINT_STEP_LABELS[slapsRasterize]);
-                pst = st;
-            }
+            if( st <= pst) return;
+            pst = st;
             }
+            report_status(*this, int(st), PRINT_STEP_LABELS[slapsRasterize]);
         };
 
         // last minute escape
@@ -898,15 +947,18 @@ void SLAPrint::process()
         [](){}  // validate
     };
 
-    unsigned st = min_objstatus;
-    unsigned incr = 0;
-
     BOOST_LOG_TRIVIAL(info) << "Start slicing process.";
 
-    // TODO: this loop could run in parallel but should not exhaust all the CPU
-    // power available
-    for(SLAPrintObject * po : m_objects) {
+    // The objects are processed concurrently, each object runs its steps in
+    // order. The arena bounds the number of threads used by the whole
+    // process including the parallel loops inside the steps.
+    tbb::task_arena arena(m_max_concurrency > 0 ? int(m_max_concurrency) :
+                                                  tbb::task_arena::automatic);
 
+    auto process_object = [this, &objectsteps, &pobj_program,
+                           &report_objstatus, &finish_objstep]
+            (SLAPrintObject *po)
+    {
         BOOST_LOG_TRIVIAL(info) << "Slicing object " << po->model_object()->name;
 
         for(size_t s = 0; s < objectsteps.size(); ++s) {
@@ -917,18 +969,23 @@ void SLAPrint::process()
             // execution gets to this point and throws the canceled signal.
             throw_if_canceled();
 
-            st += unsigned(incr * ostepd);
-
             if(po->m_stepmask[currentstep] && po->set_started(currentstep)) {
-                report_status(*this, int(st), OBJ_STEP_LABELS[currentstep]);
+                report_objstatus(0, OBJ_STEP_LABELS[currentstep]);
                 pobj_program[currentstep](*po);
                 throw_if_canceled();
                 po->set_done(currentstep);
             }
 
-            incr = OBJ_STEP_LEVELS[currentstep];
+            finish_objstep(currentstep);
         }
-    }
+    };
+
+    // If any of the objects throws (e.g. canceled), the exception is
+    // propagated out of the parallel loop and out of the arena.
+    arena.execute([this, &process_object]() {
+        tbb::parallel_for(size_t(0), m_objects.size(), [this, &process_object]
+                          (size_t idx) { process_object(m_objects[idx]); });
+    });
 
     std::array<SLAPrintStep, slapsCount> printsteps = {
         slapsRasterize, slapsValidate
@@ -938,7 +995,7 @@ void SLAPrint::process()
 //    m_stepmask[slapsRasterize] = false;
 
     double pstd = (100 - max_objstatus) / 100.0;
-    st = max_objstatus;
+    unsigned st = max_objstatus;
     for(size_t s = 0; s < print_program.size(); ++s) {
         auto currentstep = printsteps[s];
 
@@ -947,7 +1004,7 @@ void SLAPrint::process()
         if(m_stepmask[currentstep] && set_started(currentstep))
         {
             report_status(*this, int(st), PRINT_STEP_LABELS[currentstep]);
-            print_program[currentstep]();
+            arena.execute(print_program[currentstep]);
             throw_if_canceled();
             set_done(currentstep);
         }
@@ -955,6 +1012,9 @@ void SLAPrint::process()
         st += unsigned(PRINT_STEP_LEVELS[currentstep] * pstd);
     }
 
+    // Return the scratch memory of the clipping operations back to the heap.
+    ClipperLib::ReleaseScratchPool();
+
     // If everything vent well
     report_status(*this, 100, L("Slicing done"));
 }
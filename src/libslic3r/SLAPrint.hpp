@@ -193,10 +193,32 @@ public:
 	bool                finished() const override { return this->is_step_done(slaposIndexSlices) && this->Inherited::is_step_done(slapsRasterize); }
 
     template<class Fmt> void export_raster(const std::string& fname) {
-        if(m_printer) m_printer->save<Fmt>(fname);
+        if(!m_printer) return;
+        if(m_export_window > 0)
+            m_printer->save_streaming<Fmt>(fname, m_export_window,
+                [this](Raster& raster, unsigned level_id) {
+                    this->draw_level(level_id,
+                        [&raster](const ExPolygon& p, const Raster::Trafo& tr) {
+                            raster.draw(p, tr);
+                        });
+                });
+        else
+            m_printer->save<Fmt>(fname);
     }
+
+    // Rasterize the layers while exporting them instead of during process(),
+    // holding at most the given number of layers in memory. Zero (default)
+    // rasterizes and compresses all the layers in process() and keeps them
+    // until the export.
+    void set_export_window(unsigned layers);
+    unsigned export_window() const { return m_export_window; }
     const PrintObjects& objects() const { return m_objects; }
 
+    // Limit the number of threads used by process(), zero for all the
+    // available cores. The objects are processed concurrently on these threads.
+    void set_max_concurrency(unsigned threads) { m_max_concurrency = threads; }
+    unsigned max_concurrency() const { return m_max_concurrency; }
+
 	std::string         output_filename() const override 
         { return this->PrintBase::output_filename(m_print_config.output_filename_format.value, "zip"); }
 
@@ -214,6 +236,7 @@ private:
 
     PrintObjects                    m_objects;
     std::vector<bool>               m_stepmask;
+    unsigned                        m_max_concurrency = 0;
 
     // Definition of the print input map. It consists of the slices indexed
     // with scaled (clipper) Z coordinates. Also contains the instance
@@ -228,12 +251,21 @@ private:
             lref(std::cref(lyr)), copies(std::cref(cp)) {}
     };
 
+    // Draw all the slices of a level with all the instances. The slices are
+    // shared by the instances, each instance passes its own transformation.
+    void draw_level(unsigned level_id,
+                    const std::function<void(const ExPolygon&,
+                                             const Raster::Trafo&)>& draw) const;
+
     std::vector<float> calculate_heights(const BoundingBoxf3& bb, float elevation, float initial_layer_height, float layer_height) const;
 
     // One level may contain multiple slices from multiple objects and their
     // supports
     using LayerRefs = std::vector<LayerRef>;
     std::map<LevelID, LayerRefs>            m_printer_input;
+    // Levels of m_printer_input in the order of the printer layers.
+    std::vector<const LayerRefs*>           m_printer_levels;
+    unsigned                                m_export_window = 0;
 
     // The printer itself
     SLAPrinterPtr                           m_printer;
@@ -0,0 +1,151 @@
+#include "SliceCache.hpp"
+
+#include <cstdio>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/nowide/cstdio.hpp>
+#include <boost/nowide/fstream.hpp>
+
+namespace Slic3r {
+
+void SliceCacheWriter::write(const Polygon &polygon)
+{
+    this->write(uint64_t(polygon.points.size()));
+    for (const Point &pt : polygon.points) {
+        // Point is not trivially copyable, write its coordinates one by one, the same way SliceCacheReader reads them.
+        this->write(coord_t(pt(0)));
+        this->write(coord_t(pt(1)));
+    }
+}
+
+void SliceCacheWriter::write(const ExPolygon &expolygon)
+{
+    this->write(expolygon.contour);
+    this->write(uint64_t(expolygon.holes.size()));
+    for (const Polygon &hole : expolygon.holes)
+        this->write(hole);
+}
+
+void SliceCacheWriter::write(const ExPolygons &expolygons)
+{
+    this->write(uint64_t(expolygons.size()));
+    for (const ExPolygon &expolygon : expolygons)
+        this->write(expolygon);
+}
+
+void SliceCacheWriter::write(const Surfaces &surfaces)
+{
+    // Only the surface type and the shape are stored, the other Surface attributes are not yet assigned after slicing.
+    this->write(uint64_t(surfaces.size()));
+    for (const Surface &surface : surfaces) {
+        this->write(int32_t(surface.surface_type));
+        this->write(surface.expolygon);
+    }
+}
+
+bool SliceCacheReader::read_count(size_t item_size, size_t &count)
+{
+    uint64_t n;
+    if (! this->read(n) || n > uint64_t(m_end - m_ptr) / item_size)
+        return this->fail();
+    count = size_t(n);
+    return true;
+}
+
+bool SliceCacheReader::read(Polygon &polygon)
+{
+    size_t n;
+    if (! this->read_count(2 * sizeof(coord_t), n))
+        return false;
+    polygon.points.assign(n, Point());
+    for (Point &pt : polygon.points) {
+        // Point is not trivially copyable, read its coordinates one by one.
+        coord_t x, y;
+        this->read(x);
+        this->read(y);
+        pt = Point(x, y);
+    }
+    return true;
+}
+
+bool SliceCacheReader::read(ExPolygon &expolygon)
+{
+    size_t num_holes;
+    if (! this->read(expolygon.contour) || ! this->read_count(sizeof(uint64_t), num_holes))
+        return false;
+    expolygon.holes.assign(num_holes, Polygon());
+    for (Polygon &hole : expolygon.holes)
+        if (! this->read(hole))
+            return false;
+    return true;
+}
+
+bool SliceCacheReader::read(ExPolygons &expolygons)
+{
+    size_t n;
+    if (! this->read_count(2 * sizeof(uint64_t), n))
+        return false;
+    expolygons.assign(n, ExPolygon());
+    for (ExPolygon &expolygon : expolygons)
+        if (! this->read(expolygon))
+            return false;
+    return true;
+}
+
+bool SliceCacheReader::read(Surfaces &surfaces)
+{
+    size_t n;
+    if (! this->read_count(sizeof(int32_t) + 2 * sizeof(uint64_t), n))
+        return false;
+    surfaces.clear();
+    surfaces.reserve(n);
+    for (size_t i = 0; i < n; ++ i) {
+        int32_t   type;
+        ExPolygon expolygon;
+        if (! this->read(type) || ! this->read(expolygon))
+            return false;
+        if (type < int32_t(stTop) || type > int32_t(stPerimeter))
+            return this->fail();
+        surfaces.emplace_back(SurfaceType(type), std::move(expolygon));
+    }
+    return true;
+}
+
+bool slice_cache_load(const std::string &cache_dir, const std::string &key, std::string &data)
+{
+    boost::filesystem::path path = boost::filesystem::path(cache_dir) / (key + ".slices");
+    boost::nowide::ifstream ifs(path.string(), std::ios::in | std::ios::binary);
+    if (! ifs)
+        return false;
+    data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return ! ifs.bad();
+}
+
+bool slice_cache_store(const std::string &cache_dir, const std::string &key, const std::string &data)
+{
+    try {
+        boost::filesystem::path dir(cache_dir);
+        boost::filesystem::create_directories(dir);
+        boost::filesystem::path path     = dir / (key + ".slices");
+        boost::filesystem::path path_tmp = dir / (key + boost::filesystem::unique_path(".%%%%-%%%%.tmp").string());
+        {
+            boost::nowide::ofstream ofs(path_tmp.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+            ofs.write(data.data(), data.size());
+            ofs.close();
+            if (ofs.fail()) {
+                boost::system::error_code ec;
+                boost::filesystem::remove(path_tmp, ec);
+                BOOST_LOG_TRIVIAL(warning) << "Failed to write the slice cache entry " << path_tmp.string();
+                return false;
+            }
+        }
+        boost::filesystem::rename(path_tmp, path);
+    } catch (const std::exception &ex) {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to store the slice cache entry " << key << ": " << ex.what();
+        return false;
+    }
+    return true;
+}
+
+} // namespace Slic3r
@@ -0,0 +1,91 @@
+#ifndef slic3r_SliceCache_hpp_
+#define slic3r_SliceCache_hpp_
+
+#include "libslic3r.h"
+#include "Digest.hpp"
+#include "ExPolygon.hpp"
+#include "Surface.hpp"
+
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Slic3r {
+
+// Bump this number whenever the layout of the cached data or the inputs hashed into the key change,
+// so that the stale cache entries are not picked up.
+#define SLIC3R_SLICE_CACHE_VERSION 3
+
+// Digest of the inputs of a cached computation, see PrintObject::slice().
+class SliceCacheKey : public Digest
+{
+public:
+    SliceCacheKey() { this->append(uint32_t(SLIC3R_SLICE_CACHE_VERSION)); }
+};
+
+// Serializes the slices into a memory buffer in the native byte order.
+// The cache is meant to be reused on the same machine, it is not a file exchange format.
+class SliceCacheWriter
+{
+public:
+    template<typename T> void write(const T &value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "SliceCacheWriter::write() accepts plain values only");
+        m_data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    void write(const Polygon &polygon);
+    void write(const ExPolygon &expolygon);
+    void write(const ExPolygons &expolygons);
+    void write(const Surfaces &surfaces);
+
+    const std::string& data() const { return m_data; }
+
+private:
+    std::string m_data;
+};
+
+// Counterpart of SliceCacheWriter. All read methods return false if the data is truncated or damaged,
+// the reader then stays in the failed state.
+class SliceCacheReader
+{
+public:
+    SliceCacheReader(const std::string &data) : m_ptr(data.data()), m_end(data.data() + data.size()), m_failed(false) {}
+
+    template<typename T> bool read(T &value)
+    {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "SliceCacheReader::read() accepts plain values only");
+        if (m_failed || size_t(m_end - m_ptr) < sizeof(T))
+            return this->fail();
+        memcpy(&value, m_ptr, sizeof(T));
+        m_ptr += sizeof(T);
+        return true;
+    }
+    bool read(Polygon &polygon);
+    bool read(ExPolygon &expolygon);
+    bool read(ExPolygons &expolygons);
+    bool read(Surfaces &surfaces);
+
+    bool failed() const { return m_failed; }
+    bool eof()    const { return m_ptr == m_end; }
+
+private:
+    // Number of items to be read, which must fit into the rest of the buffer at item_size bytes each.
+    bool read_count(size_t item_size, size_t &count);
+    bool fail() { m_failed = true; return false; }
+
+    const char *m_ptr;
+    const char *m_end;
+    bool        m_failed;
+};
+
+// Load the cache entry stored in the cache directory under the given key. Returns false if not found.
+extern bool slice_cache_load(const std::string &cache_dir, const std::string &key, std::string &data);
+// Store the cache entry, the cache directory is created if it does not exist.
+// The entry is written into a temporary file first, which is then renamed, so that a concurrently running
+// instance never reads a partially written entry. Returns false on failure, the failure is not fatal.
+extern bool slice_cache_store(const std::string &cache_dir, const std::string &key, const std::string &data);
+
+} // namespace Slic3r
+
+#endif /* slic3r_SliceCache_hpp_ */
@@ -1,6 +1,7 @@
 #include "TriangleMesh.hpp"
 #include "ClipperUtils.hpp"
 #include "Geometry.hpp"
+#include "Utils.hpp"
 #include "qhull/src/libqhullcpp/Qhull.h"
 #include "qhull/src/libqhullcpp/QhullFacetList.h"
 #include "qhull/src/libqhullcpp/QhullVertexSet.h"
@@ -12,12 +13,14 @@
 #include <map>
 #include <utility>
 #include <algorithm>
+#include <limits>
 #include <math.h>
 #include <type_traits>
 
 #include <boost/log/trivial.hpp>
 
 #include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
 
 #include <Eigen/Dense>
 
@@ -657,6 +660,10 @@ void TriangleMesh::require_shared_vertices()
 void TriangleMeshSlicer::init(TriangleMesh *_mesh, throw_on_cancel_callback_type throw_on_cancel)
 {
     mesh = _mesh;
+    // Invalidate the Z sorted facet index of a previously assigned mesh.
+    facets_z_sorted.clear();
+    facets_max_z_tree.clear();
+    facets_max_z_leaves = 0;
     _mesh->require_shared_vertices();
     throw_on_cancel();
     facets_edges.assign(_mesh->stl.stats.number_of_facets * 3, -1);
@@ -771,76 +778,174 @@ void TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons
         type is float.
     */
     
-    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do";
-    std::vector<IntersectionLines> lines(z.size());
-    {
-        boost::mutex lines_mutex;
+    // Split the layers into bands, so that the intersection lines of a single band fit into lines_memory_limit.
+    // Without the limit, all layers are sliced at once.
+    std::vector<size_t> bands { 0 };
+    if (this->lines_memory_limit > 0) {
+        std::vector<size_t> lines_per_layer = this->_estimate_lines_per_layer(z);
+        size_t band_memory = 0;
+        for (size_t layer_idx = 0; layer_idx < z.size(); ++ layer_idx) {
+            size_t layer_memory = lines_per_layer[layer_idx] * sizeof(IntersectionLine);
+            if (band_memory > 0 && band_memory + layer_memory > this->lines_memory_limit) {
+                bands.emplace_back(layer_idx);
+                band_memory = 0;
+            }
+            band_memory += layer_memory;
+        }
+        BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::slice - " << bands.size() << " bands of layers to fit into " << format_memsize_MB(this->lines_memory_limit);
+    }
+    bands.emplace_back(z.size());
+
+    layers->resize(z.size());
+    for (size_t band_idx = 0; band_idx + 1 < bands.size(); ++ band_idx) {
+        const size_t band_begin = bands[band_idx];
+        const size_t band_end   = bands[band_idx + 1];
+        std::vector<IntersectionLines> lines;
+        if (bands.size() == 2)
+            this->_slice_lines(z, lines, throw_on_cancel);
+        else
+            this->_slice_lines(std::vector<float>(z.begin() + band_begin, z.begin() + band_end), lines, throw_on_cancel);
+
+        // build loops
+        BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_make_loops_do - layers " << band_begin << " to " << band_end << log_memory_info();
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, lines.size()),
+            [&lines, &layers, band_begin, throw_on_cancel, this](const tbb::blocked_range<size_t>& range) {
+                for (size_t line_idx = range.begin(); line_idx < range.end(); ++ line_idx) {
+                    if ((line_idx & 0x0ffff) == 0)
+                        throw_on_cancel();
+                    this->make_loops(lines[line_idx], &(*layers)[band_begin + line_idx]);
+                }
+            }
+        );
+
+#ifdef SLIC3R_DEBUG
+        {
+            static int iRun = 0;
+            for (size_t i = 0; i < lines.size(); ++ i) {
+                Polygons  &polygons   = (*layers)[band_begin + i];
+                ExPolygons expolygons = union_ex(polygons, true);
+                SVG::export_expolygons(debug_out_path("slice_%d_%d.svg", iRun, band_begin + i).c_str(), expolygons);
+                {
+                    BoundingBox bbox;
+                    for (const IntersectionLine &l : lines[i]) {
+                        bbox.merge(l.a);
+                        bbox.merge(l.b);
+                    }
+                    SVG svg(debug_out_path("slice_loops_%d_%d.svg", iRun, band_begin + i).c_str(), bbox);
+                    svg.draw(expolygons);
+                    for (const IntersectionLine &l : lines[i])
+                        svg.draw(l, "red", 0);
+                    svg.draw_outline(expolygons, "black", "blue", 0);
+                    svg.Close();
+                }
+#if 0
+//FIXME slice_facet() may create zero length edges due to rounding of doubles into coord_t.
+                for (Polygon &poly : polygons) {
+                    for (size_t i = 1; i < poly.points.size(); ++ i)
+                        assert(poly.points[i-1] != poly.points[i]);
+                    assert(poly.points.front() != poly.points.back());
+                }
+#endif
+            }
+            if (band_idx + 2 == bands.size())
+                ++ iRun;
+        }
+#endif
+        // The intersection lines of this band are released here.
+    }
+    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::slice finished" << log_memory_info();
+}
+
+// Slice the facets with the planes of z, collect the intersection lines per layer.
+void TriangleMeshSlicer::_slice_lines(const std::vector<float> &z, std::vector<IntersectionLines> &lines, throw_on_cancel_callback_type throw_on_cancel) const
+{
+    lines.assign(z.size(), IntersectionLines());
+    if (this->has_z_index()) {
+        // The layers are split into ranges, each range is swept independently and it writes into its own layers only.
+        BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_sweep";
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, z.size()),
+            [&lines, &z, throw_on_cancel, this](const tbb::blocked_range<size_t>& range) {
+                this->_slice_sweep(z, range.begin(), range.end(), &lines, throw_on_cancel);
+            }
+        );
+    } else {
+        BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do";
+        // Each worker thread collects the intersection lines into its own per layer buckets,
+        // so that the facets are sliced without contending for a shared lock.
+        typedef tbb::enumerable_thread_specific<std::vector<IntersectionLines>> IntersectionLinesTLS;
+        IntersectionLinesTLS lines_tls([&z]() { return std::vector<IntersectionLines>(z.size()); });
         tbb::parallel_for(
             tbb::blocked_range<int>(0,this->mesh->stl.stats.number_of_facets),
-            [&lines, &lines_mutex, &z, throw_on_cancel, this](const tbb::blocked_range<int>& range) {
+            [&lines_tls, &z, throw_on_cancel, this](const tbb::blocked_range<int>& range) {
+                std::vector<IntersectionLines> &lines_local = lines_tls.local();
                 for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
                     if ((facet_idx & 0x0ffff) == 0)
                         throw_on_cancel();
-                    this->_slice_do(facet_idx, &lines, &lines_mutex, z);
+                    this->_slice_do(facet_idx, &lines_local, z);
+                }
+            }
+        );
+        throw_on_cancel();
+
+        // Merge the thread local buckets layer by layer.
+        BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do - merge " << lines_tls.size() << " thread local buckets";
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(0, z.size()),
+            [&lines_tls, &lines](const tbb::blocked_range<size_t>& range) {
+                for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                    size_t num_lines = 0;
+                    for (const std::vector<IntersectionLines> &lines_local : lines_tls)
+                        num_lines += lines_local[layer_idx].size();
+                    IntersectionLines &dst = lines[layer_idx];
+                    dst.reserve(num_lines);
+                    for (std::vector<IntersectionLines> &lines_local : lines_tls) {
+                        IntersectionLines &src = lines_local[layer_idx];
+                        dst.insert(dst.end(), src.begin(), src.end());
+                        // Release the memory of the thread local bucket right away.
+                        IntersectionLines().swap(src);
+                    }
                 }
             }
         );
     }
     throw_on_cancel();
+}
 
-    // v_scaled_shared could be freed here
-    
-    // build loops
-    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_make_loops_do";
-    layers->resize(z.size());
+// Estimate the number of intersection lines per layer by the number of facets spanning each slicing plane.
+std::vector<size_t> TriangleMeshSlicer::_estimate_lines_per_layer(const std::vector<float> &z) const
+{
+    // Difference array: +1 at the first layer of a facet, -1 after the last layer of a facet.
+    tbb::enumerable_thread_specific<std::vector<int>> delta_tls([&z]() { return std::vector<int>(z.size() + 1, 0); });
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, z.size()),
-        [&lines, &layers, throw_on_cancel, this](const tbb::blocked_range<size_t>& range) {
-            for (size_t line_idx = range.begin(); line_idx < range.end(); ++ line_idx) {
-                if ((line_idx & 0x0ffff) == 0)
-                    throw_on_cancel();
-                this->make_loops(lines[line_idx], &(*layers)[line_idx]);
+        tbb::blocked_range<int>(0, this->mesh->stl.stats.number_of_facets),
+        [&delta_tls, &z, this](const tbb::blocked_range<int>& range) {
+            std::vector<int> &delta = delta_tls.local();
+            for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
+                const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
+                const float min_z = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
+                const float max_z = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
+                auto min_layer = std::lower_bound(z.begin(), z.end(), min_z);
+                auto max_layer = std::upper_bound(min_layer, z.end(), max_z);
+                ++ delta[min_layer - z.begin()];
+                -- delta[max_layer - z.begin()];
             }
         }
     );
-    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::slice finished";
-
-#ifdef SLIC3R_DEBUG
-    {
-        static int iRun = 0;
-        for (size_t i = 0; i < z.size(); ++ i) {
-            Polygons  &polygons   = (*layers)[i];
-            ExPolygons expolygons = union_ex(polygons, true);
-            SVG::export_expolygons(debug_out_path("slice_%d_%d.svg", iRun, i).c_str(), expolygons);
-            {
-                BoundingBox bbox;
-                for (const IntersectionLine &l : lines[i]) {
-                    bbox.merge(l.a);
-                    bbox.merge(l.b);
-                }
-                SVG svg(debug_out_path("slice_loops_%d_%d.svg", iRun, i).c_str(), bbox);
-                svg.draw(expolygons);
-                for (const IntersectionLine &l : lines[i])
-                    svg.draw(l, "red", 0);
-                svg.draw_outline(expolygons, "black", "blue", 0);
-                svg.Close();
-            }
-#if 0
-//FIXME slice_facet() may create zero length edges due to rounding of doubles into coord_t.
-            for (Polygon &poly : polygons) {
-                for (size_t i = 1; i < poly.points.size(); ++ i)
-                    assert(poly.points[i-1] != poly.points[i]);
-                assert(poly.points.front() != poly.points.back());
-            }
-#endif
-        }
-        ++ iRun;
+    std::vector<size_t> out(z.size(), 0);
+    int num_facets = 0;
+    for (size_t layer_idx = 0; layer_idx < z.size(); ++ layer_idx) {
+        for (const std::vector<int> &delta : delta_tls)
+            num_facets += delta[layer_idx];
+        out[layer_idx] = size_t(num_facets);
     }
-#endif
+    return out;
 }
 
-void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, 
-    const std::vector<float> &z) const
+// Slice a single facet with all the planes of z it spans, append the intersection lines to the per layer buckets of lines.
+// lines are not shared between threads, therefore no locking is required.
+void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, const std::vector<float> &z) const
 {
     const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
     
@@ -864,39 +969,116 @@ void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLin
     printf("layers: min = %d, max = %d\n", (int)(min_layer - z.begin()), (int)(max_layer - z.begin()) - 1);
     #endif /* SLIC3R_TRIANGLEMESH_DEBUG */
     
-    for (std::vector<float>::const_iterator it = min_layer; it != max_layer; ++it) {
-        std::vector<float>::size_type layer_idx = it - z.begin();
-        IntersectionLine il;
-        if (this->slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing) {
-            boost::lock_guard<boost::mutex> l(*lines_mutex);
-            if (il.edge_type == feHorizontal) {
-                // Insert all marked edges of the face. The marked edges do not share an edge with another horizontal face
-                // (they may not have a nighbor, or their neighbor is vertical)
-                const int *vertices = this->mesh->stl.v_indices[facet_idx].vertex;
-                const bool reverse  = this->mesh->stl.facet_start[facet_idx].normal(2) < 0;
-                for (int j = 0; j < 3; ++ j)
-                    if (il.flags & ((IntersectionLine::EDGE0_NO_NEIGHBOR | IntersectionLine::EDGE0_FOLD) << j)) {
-                        int a_id = vertices[j % 3];
-                        int b_id = vertices[(j+1) % 3];
-                        if (reverse)
-                            std::swap(a_id, b_id);
-                        const stl_vertex &a = this->v_scaled_shared[a_id];
-                        const stl_vertex &b = this->v_scaled_shared[b_id];
-                        il.a(0)    = a(0);
-                        il.a(1)    = a(1);
-                        il.b(0)    = b(0);
-                        il.b(1)    = b(1);
-                        il.a_id   = a_id;
-                        il.b_id   = b_id;
-                        assert(il.a != il.b);
-                        // This edge will not be used as a seed for loop extraction if it was added due to a fold of two overlapping horizontal faces.
-                        il.set_no_seed((IntersectionLine::EDGE0_FOLD << j) != 0);
-                        (*lines)[layer_idx].emplace_back(il);
-                    }
-            } else
-                (*lines)[layer_idx].emplace_back(il);
-        }
+    for (std::vector<float>::const_iterator it = min_layer; it != max_layer; ++it)
+        this->_slice_facet_at(facet_idx, facet, *it, min_z, max_z, (*lines)[it - z.begin()]);
+}
+
+// Slice a single facet with a single plane, append the intersection line (or the marked edges of a horizontal facet) to lines.
+void TriangleMeshSlicer::_slice_facet_at(size_t facet_idx, const stl_facet &facet, float slice_z, float min_z, float max_z, IntersectionLines &lines) const
+{
+    IntersectionLine il;
+    if (this->slice_facet(slice_z / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il) == TriangleMeshSlicer::Slicing) {
+        if (il.edge_type == feHorizontal) {
+            // Insert all marked edges of the face. The marked edges do not share an edge with another horizontal face
+            // (they may not have a nighbor, or their neighbor is vertical)
+            const int *vertices = this->mesh->stl.v_indices[facet_idx].vertex;
+            const bool reverse  = this->mesh->stl.facet_start[facet_idx].normal(2) < 0;
+            for (int j = 0; j < 3; ++ j)
+                if (il.flags & ((IntersectionLine::EDGE0_NO_NEIGHBOR | IntersectionLine::EDGE0_FOLD) << j)) {
+                    int a_id = vertices[j % 3];
+                    int b_id = vertices[(j+1) % 3];
+                    if (reverse)
+                        std::swap(a_id, b_id);
+                    const stl_vertex &a = this->v_scaled_shared[a_id];
+                    const stl_vertex &b = this->v_scaled_shared[b_id];
+                    il.a(0)    = a(0);
+                    il.a(1)    = a(1);
+                    il.b(0)    = b(0);
+                    il.b(1)    = b(1);
+                    il.a_id   = a_id;
+                    il.b_id   = b_id;
+                    assert(il.a != il.b);
+                    // This edge will not be used as a seed for loop extraction if it was added due to a fold of two overlapping horizontal faces.
+                    il.set_no_seed((IntersectionLine::EDGE0_FOLD << j) != 0);
+                    lines.emplace_back(il);
+                }
+        } else
+            lines.emplace_back(il);
+    }
+}
+
+// Collect the facets of facets_z_sorted[0, facets_end) with max_z >= slice_z, in the order of facets_z_sorted.
+// Only the subtrees of facets_max_z_tree reaching above slice_z are descended into.
+void TriangleMeshSlicer::_facets_crossing(size_t node, size_t block_begin, size_t block_end, size_t facets_end, float slice_z, std::vector<const FacetZSpan*> &out) const
+{
+    if (block_begin * facets_z_block >= facets_end || this->facets_max_z_tree[node] < slice_z)
+        return;
+    if (block_end - block_begin == 1) {
+        size_t end = std::min(facets_end, (block_begin + 1) * facets_z_block);
+        for (size_t i = block_begin * facets_z_block; i < end; ++ i)
+            if (this->facets_z_sorted[i].max_z >= slice_z)
+                out.emplace_back(&this->facets_z_sorted[i]);
+    } else {
+        size_t block_mid = (block_begin + block_end) / 2;
+        this->_facets_crossing(2 * node,     block_begin, block_mid, facets_end, slice_z, out);
+        this->_facets_crossing(2 * node + 1, block_mid,   block_end, facets_end, slice_z, out);
+    }
+}
+
+// Sweep a plane over the layers z[layer_begin, layer_end) using the facets sorted by their minimum Z.
+// Only the facets, which touch the layer range, are visited: The facets crossing the first plane are queried
+// from the max Z tree, then a facet enters the active set once the plane reaches its minimum Z
+// and it leaves the active set once the plane passes its maximum Z.
+void TriangleMeshSlicer::_slice_sweep(const std::vector<float> &z, size_t layer_begin, size_t layer_end, std::vector<IntersectionLines>* lines,
+    throw_on_cancel_callback_type throw_on_cancel) const
+{
+    if (layer_begin >= layer_end)
+        return;
+    auto it_next = std::upper_bound(this->facets_z_sorted.begin(), this->facets_z_sorted.end(), z[layer_begin],
+        [](float z, const FacetZSpan &span) { return z < span.min_z; });
+    std::vector<const FacetZSpan*> active;
+    this->_facets_crossing(1, 0, this->facets_max_z_leaves, it_next - this->facets_z_sorted.begin(), z[layer_begin], active);
+    for (size_t layer_idx = layer_begin; layer_idx < layer_end; ++ layer_idx) {
+        throw_on_cancel();
+        const float slice_z = z[layer_idx];
+        // Activate the facets starting below or at this plane.
+        for (; it_next != this->facets_z_sorted.end() && it_next->min_z <= slice_z; ++ it_next)
+            active.emplace_back(&(*it_next));
+        // Retire the facets ending below this plane.
+        active.erase(std::remove_if(active.begin(), active.end(), [slice_z](const FacetZSpan *span) { return span->max_z < slice_z; }), active.end());
+        for (const FacetZSpan *span : active)
+            this->_slice_facet_at(span->facet_idx, this->mesh->stl.facet_start[span->facet_idx], slice_z, span->min_z, span->max_z, (*lines)[layer_idx]);
+    }
+}
+
+void TriangleMeshSlicer::init_z_index(throw_on_cancel_callback_type throw_on_cancel)
+{
+    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::init_z_index";
+    this->facets_z_sorted.assign(this->mesh->stl.stats.number_of_facets, FacetZSpan());
+    for (int facet_idx = 0; facet_idx < this->mesh->stl.stats.number_of_facets; ++ facet_idx) {
+        const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
+        FacetZSpan      &span  = this->facets_z_sorted[facet_idx];
+        // Calculated the same way as in _slice_do() to slice each facet with the very same set of planes.
+        span.min_z     = fminf(facet.vertex[0](2), fminf(facet.vertex[1](2), facet.vertex[2](2)));
+        span.max_z     = fmaxf(facet.vertex[0](2), fmaxf(facet.vertex[1](2), facet.vertex[2](2)));
+        span.facet_idx = facet_idx;
+    }
+    throw_on_cancel();
+    std::sort(this->facets_z_sorted.begin(), this->facets_z_sorted.end(), 
+        [](const FacetZSpan &l, const FacetZSpan &r) { return l.min_z < r.min_z || (l.min_z == r.min_z && l.facet_idx < r.facet_idx); });
+    throw_on_cancel();
+    // Build the max Z tree bottom up. The leaves past the last block stay at -infinity.
+    size_t num_blocks = (this->facets_z_sorted.size() + facets_z_block - 1) / facets_z_block;
+    this->facets_max_z_leaves = 1;
+    while (this->facets_max_z_leaves < num_blocks)
+        this->facets_max_z_leaves *= 2;
+    this->facets_max_z_tree.assign(2 * this->facets_max_z_leaves, - std::numeric_limits<float>::max());
+    for (size_t i = 0; i < this->facets_z_sorted.size(); ++ i) {
+        float &leaf = this->facets_max_z_tree[this->facets_max_z_leaves + i / facets_z_block];
+        leaf = std::max(leaf, this->facets_z_sorted[i].max_z);
     }
+    for (size_t node = this->facets_max_z_leaves - 1; node > 0; -- node)
+        this->facets_max_z_tree[node] = std::max(this->facets_max_z_tree[2 * node], this->facets_max_z_tree[2 * node + 1]);
 }
 
 void TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<ExPolygons>* layers, throw_on_cancel_callback_type throw_on_cancel) const
@@ -163,6 +163,16 @@ public:
     // Not quite nice, but the constructor and init() methods require non-const mesh pointer to be able to call mesh->require_shared_vertices()
 	TriangleMeshSlicer(TriangleMesh* mesh) { this->init(mesh, [](){}); }
     void init(TriangleMesh *mesh, throw_on_cancel_callback_type throw_on_cancel);
+    // Optionally sort the facets by their minimum Z. If the index is available, slice() sweeps the slicing planes
+    // over the sorted facets and visits only the facets touching the slicing planes, so that slicing a narrow range
+    // of layers (for example after a local layer height profile edit) costs proportionally to the facets in that range.
+    void init_z_index(throw_on_cancel_callback_type throw_on_cancel);
+    bool has_z_index() const { return ! this->facets_z_sorted.empty(); }
+    // Limit the memory allocated by slice() for the intersection lines, zero for no limit.
+    // With a limit set, slice() processes the layers in bands: The facets are sliced for a band of layers,
+    // the intersection lines are chained into loops and released before the next band is sliced.
+    // Slicing in bands is efficient with the Z sorted facet index only, see init_z_index().
+    void set_lines_memory_limit(size_t bytes) { this->lines_memory_limit = bytes; }
     void slice(const std::vector<float> &z, std::vector<Polygons>* layers, throw_on_cancel_callback_type throw_on_cancel) const;
     void slice(const std::vector<float> &z, std::vector<ExPolygons>* layers, throw_on_cancel_callback_type throw_on_cancel) const;
     enum FacetSliceType {
@@ -180,8 +190,29 @@ private:
     std::vector<int>         facets_edges;
     // Scaled copy of this->mesh->stl.v_shared
     std::vector<stl_vertex>  v_scaled_shared;
-
-    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, const std::vector<float> &z) const;
+    // Z span of a facet, used by the Z sorted facet index.
+    struct FacetZSpan {
+        float min_z;
+        float max_z;
+        int   facet_idx;
+    };
+    // Facets sorted by their minimum Z, filled in by init_z_index().
+    std::vector<FacetZSpan>  facets_z_sorted;
+    // Implicit binary tree over the blocks of facets_z_sorted, storing the maximum of max_z of a subtree.
+    // The root is at index 1, the children of node i are at 2i and 2i+1, the leaves are the blocks.
+    // It finds the facets crossing the first plane of a range of layers without scanning all the facets below.
+    std::vector<float>       facets_max_z_tree;
+    size_t                   facets_max_z_leaves = 0;
+    static const size_t      facets_z_block = 16;
+    // Memory limit for the intersection lines of a band of layers, zero for no limit.
+    size_t                   lines_memory_limit = 0;
+
+    void _slice_lines(const std::vector<float> &z, std::vector<IntersectionLines> &lines, throw_on_cancel_callback_type throw_on_cancel) const;
+    std::vector<size_t> _estimate_lines_per_layer(const std::vector<float> &z) const;
+    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, const std::vector<float> &z) const;
+    void _slice_facet_at(size_t facet_idx, const stl_facet &facet, float slice_z, float min_z, float max_z, IntersectionLines &lines) const;
+    void _facets_crossing(size_t node, size_t block_begin, size_t block_end, size_t facets_end, float slice_z, std::vector<const FacetZSpan*> &out) const;
+    void _slice_sweep(const std::vector<float> &z, size_t layer_begin, size_t layer_end, std::vector<IntersectionLines>* lines, throw_on_cancel_callback_type throw_on_cancel) const;
     void make_loops(std::vector<IntersectionLine> &lines, Polygons* loops) const;
     void make_expolygons(const Polygons &loops, ExPolygons* slices) const;
     void make_expolygons_simple(std::vector<IntersectionLine> &lines, ExPolygons* slices) const;
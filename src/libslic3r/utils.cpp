@@ -11,6 +11,7 @@
 #include <psapi.h>
 #else
 #include <unistd.h>
+#include <sys/resource.h>
 #endif
 
 #include <boost/log/core.hpp>
@@ -431,18 +432,57 @@ std::string log_memory_info()
         if (hProcess != nullptr) {
             PROCESS_MEMORY_COUNTERS_EX pmc;
             if (GetProcessMemoryInfo(hProcess, (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)))
-				out = " WorkingSet: " + format_memsize_MB(pmc.WorkingSetSize) + " PrivateBytes: " + format_memsize_MB(pmc.PrivateUsage) + " Pagefile(peak): " + format_memsize_MB(pmc.PagefileUsage) + "(" + format_memsize_MB(pmc.PeakPagefileUsage) + ")";
+				out = " WorkingSet(peak): " + format_memsize_MB(pmc.WorkingSetSize) + "(" + format_memsize_MB(pmc.PeakWorkingSetSize) + ") PrivateBytes: " + format_memsize_MB(pmc.PrivateUsage) + " Pagefile(peak): " + format_memsize_MB(pmc.PagefileUsage) + "(" + format_memsize_MB(pmc.PeakPagefileUsage) + ")";
             CloseHandle(hProcess);
         }
     }
     return out;
 }
 
+#elif defined(__linux__)
+
+std::string log_memory_info()
+{
+    std::string out;
+    if (logSeverity <= boost::log::trivial::info) {
+        // Resident set size and its peak ("high water mark") as reported by the kernel in kB.
+        size_t rss = 0, rss_peak = 0;
+        FILE *file = fopen("/proc/self/status", "r");
+        if (file != nullptr) {
+            char line[128];
+            while (fgets(line, sizeof(line), file) != nullptr) {
+                unsigned long value = 0;
+                if (sscanf(line, "VmRSS: %lu kB", &value) == 1)
+                    rss = size_t(value) * 1024;
+                else if (sscanf(line, "VmHWM: %lu kB", &value) == 1)
+                    rss_peak = size_t(value) * 1024;
+            }
+            fclose(file);
+            out = " RSS(peak): " + format_memsize_MB(rss) + "(" + format_memsize_MB(rss_peak) + ")";
+        }
+    }
+    return out;
+}
+
 #else
+
 std::string log_memory_info()
 {
-    return std::string();
+    std::string out;
+    if (logSeverity <= boost::log::trivial::info) {
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef __APPLE__
+            // ru_maxrss is in bytes on OSX.
+            out = " PeakRSS: " + format_memsize_MB(size_t(usage.ru_maxrss));
+#else
+            // ru_maxrss is in kilobytes elsewhere.
+            out = " PeakRSS: " + format_memsize_MB(size_t(usage.ru_maxrss) * 1024);
+#endif
+    }
+    return out;
 }
+
 #endif
 
 }; // namespace Slic3r
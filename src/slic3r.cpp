@@ -15,17 +15,28 @@
 #include <cstdio>
 #include <string>
 #include <cstring>
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <sstream>
 #include <math.h>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/nowide/args.hpp>
 #include <boost/nowide/cenv.hpp>
+#include <boost/nowide/fstream.hpp>
 #include <boost/nowide/iostream.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <tbb/pipeline.h>
+#include <tbb/task_scheduler_init.h>
 
 #include "libslic3r/libslic3r.h"
 #include "libslic3r/Config.hpp"
 #include "libslic3r/Geometry.hpp"
 #include "libslic3r/Model.hpp"
+#include "libslic3r/ModelArrange.hpp"
 #include "libslic3r/Print.hpp"
 #include "libslic3r/SLAPrint.hpp"
 #include "libslic3r/TriangleMesh.hpp"
@@ -40,6 +51,230 @@ using namespace Slic3r;
 /// utility function for displaying CLI usage
 void printUsage();
 
+// Load a model file and apply the command line transformations.
+static Model load_model(const std::string &file, DynamicPrintConfig &print_config, const CLIConfig &cli_config)
+{
+    Model model = Model::read_from_file(file, &print_config, true);
+    model.add_default_instances();
+    // apply command line transform options
+    for (ModelObject* o : model.objects) {
+/*
+        if (cli_config.scale_to_fit.is_positive_volume())
+            o->scale_to_fit(cli_config.scale_to_fit.value);
+*/
+        // TODO: honor option order?
+        o->scale(cli_config.scale.value);
+        o->rotate(Geometry::deg2rad(cli_config.rotate_x.value), X);
+        o->rotate(Geometry::deg2rad(cli_config.rotate_y.value), Y);
+        o->rotate(Geometry::deg2rad(cli_config.rotate.value), Z);
+    }
+    return model;
+}
+
+// Slice the model and export it. If outfile is empty, it is set to a name derived from the model.
+// Returns the validation or slicing error, empty on success.
+static std::string slice_model(Model &model, DynamicPrintConfig &print_config, const CLIConfig &cli_config, std::string &outfile)
+{
+    PrinterTechnology printer_technology = print_config.option<ConfigOptionEnum<PrinterTechnology>>("printer_technology", true)->value;
+    Print       fff_print;
+    SLAPrint    sla_print;
+    PrintBase  *print = (printer_technology == ptFFF) ? static_cast<PrintBase*>(&fff_print) : static_cast<PrintBase*>(&sla_print);
+    if (! cli_config.dont_arrange && cli_config.arrange_rotation_step.value > 0.) {
+        // Rotating the objects needs the arrangement of their outlines onto the bed.
+        Polyline bed;
+        for (const Vec2d &pt : print_config.option<ConfigOptionPoints>("bed_shape", true)->values)
+            bed.append(Point::new_scale(pt(0), pt(1)));
+        arr::RotationHint rothint;
+        rothint.step = Geometry::deg2rad(cli_config.arrange_rotation_step.value);
+        arr::arrange(model, coord_t(scale_(fff_print.config().min_object_distance())), bed, arr::bedShape(bed), false,
+            [](unsigned) {}, []() { return false; }, rothint);
+    } else if (! cli_config.dont_arrange) {
+        //FIXME make the min_object_distance configurable.
+        model.arrange_objects(fff_print.config().min_object_distance());
+        model.center_instances_around_point(cli_config.print_center);
+    }
+    if (outfile.empty()) {
+        outfile = model.propose_export_file_name();
+        outfile += (printer_technology == ptFFF) ? ".gcode" : ".zip";
+    }
+    if (printer_technology == ptFFF) {
+        for (auto* mo : model.objects)
+            fff_print.auto_assign_extruders(mo);
+    }
+    print_config.normalize();
+    print->apply(model, print_config);
+    std::string err = print->validate();
+    if (err.empty()) {
+        if (printer_technology == ptFFF) {
+            // Print::export_gcode() expects the print to be processed already, it does not slice on its own.
+            try {
+                fff_print.process();
+                fff_print.export_gcode(outfile, nullptr);
+            } catch (const std::exception &ex) {
+                err = ex.what();
+            }
+        } else {
+            assert(printer_technology == ptSLA);
+            // The same limit of the worker threads as for the FFF print, see the "threads" option.
+            if (print_config.has("threads"))
+                sla_print.set_max_concurrency(unsigned(std::max(0, print_config.opt_int("threads"))));
+            // Rasterize the layers while writing the archive, so that only a few layers per thread are held in memory.
+            sla_print.set_export_window(2 * unsigned(tbb::task_scheduler_init::default_num_threads()));
+            sla_print.process();
+            sla_print.export_raster<SLAMinizZipFmt>(outfile);
+        }
+    }
+    return err;
+}
+
+// A single job of the --batch mode.
+struct BatchJob
+{
+    // Line of the manifest the job was read from.
+    size_t              line = 0;
+    std::string         model;
+    std::string         output;
+    DynamicPrintConfig  config;
+    std::string         error;
+    double              seconds = 0.;
+};
+
+// Parse a manifest line in the form of {"model": "file.stl", "output": "file.gcode", "config": {"key": "value", ...}}.
+// The config overrides are applied over the configuration shared by all the jobs.
+static void parse_batch_job(const std::string &line, BatchJob &job)
+{
+    namespace pt = boost::property_tree;
+    try {
+        pt::ptree root;
+        std::istringstream iss(line);
+        pt::read_json(iss, root);
+        job.model  = root.get<std::string>("model", "");
+        job.output = root.get<std::string>("output", "");
+        if (job.model.empty())
+            job.error = "Missing model file name";
+        else if (boost::optional<pt::ptree&> overrides = root.get_child_optional("config"))
+            for (const auto &kvp : *overrides)
+                job.config.set_deserialize(kvp.first, kvp.second.data());
+    } catch (std::exception &ex) {
+        job.error = ex.what();
+    }
+}
+
+// Quote a string as a JSON string literal.
+static std::string json_quote(const std::string &str)
+{
+    std::string out;
+    out.reserve(str.size() + 2);
+    out += '"';
+    for (char c : str) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char buf[8];
+                sprintf(buf, "\\u%04x", (unsigned int)(unsigned char)c);
+                out += buf;
+            } else
+                out += c;
+        }
+    }
+    out += '"';
+    return out;
+}
+
+// Status line of a finished job: a single line JSON object with the line number and the time in seconds
+// emitted as JSON numbers, for example
+// {"line":3,"model":"a.stl","output":"a.gcode","status":"error","error":"No such file: a.stl","seconds":0.002}
+static std::string batch_job_status(const BatchJob &job)
+{
+    // The numbers are formatted independently of the current locale.
+    std::ostringstream ss;
+    ss.imbue(std::locale::classic());
+    ss << "{\"line\":" << job.line
+       << ",\"model\":" << json_quote(job.model)
+       << ",\"output\":" << json_quote(job.output)
+       << ",\"status\":" << (job.error.empty() ? "\"ok\"" : "\"error\"");
+    if (! job.error.empty())
+        ss << ",\"error\":" << json_quote(job.error);
+    ss << ",\"seconds\":" << job.seconds << "}\n";
+    return ss.str();
+}
+
+// Process the jobs of a manifest, one job per line, see the --batch option. The jobs are read while the preceding jobs
+// are being processed, therefore the manifest may be a pipe feeding the jobs as they come.
+// The thread pool is initialized once and shared by all the jobs, at most batch_jobs jobs are processed at the same time.
+// A status line (a JSON object) is written to the standard output for each job, in the order of the manifest.
+static int run_batch(const CLIConfig &cli_config, const DynamicPrintConfig &print_config)
+{
+    boost::nowide::ifstream ifs;
+    std::istream *in = &boost::nowide::cin;
+    if (cli_config.batch.value != "-") {
+        ifs.open(cli_config.batch.value);
+        if (! ifs) {
+            boost::nowide::cerr << "No such file: " << cli_config.batch.value << std::endl;
+            return 1;
+        }
+        in = &ifs;
+    }
+
+    int threads = print_config.has("threads") ? print_config.opt_int("threads") : 0;
+    tbb::task_scheduler_init tbb_init((threads > 0) ? threads : tbb::task_scheduler_init::automatic);
+    size_t max_jobs = (cli_config.batch_jobs.value > 0) ?
+        size_t(cli_config.batch_jobs.value) : size_t(tbb::task_scheduler_init::default_num_threads());
+
+    size_t line_idx = 0;
+    size_t num_failed = 0;
+    tbb::parallel_pipeline(max_jobs,
+        tbb::make_filter<void, std::shared_ptr<BatchJob>>(tbb::filter::serial_in_order,
+            [in, &line_idx, &print_config](tbb::flow_control &fc) -> std::shared_ptr<BatchJob> {
+                std::string line;
+                while (std::getline(*in, line)) {
+                    ++ line_idx;
+                    boost::algorithm::trim(line);
+                    // Skip empty lines and comments.
+                    if (line.empty() || line.front() == '#')
+                        continue;
+                    auto job = std::make_shared<BatchJob>();
+                    job->line   = line_idx;
+                    job->config = print_config;
+                    parse_batch_job(line, *job);
+                    return job;
+                }
+                fc.stop();
+                return nullptr;
+            }) &
+        tbb::make_filter<std::shared_ptr<BatchJob>, std::shared_ptr<BatchJob>>(tbb::filter::parallel,
+            [&cli_config](std::shared_ptr<BatchJob> job) -> std::shared_ptr<BatchJob> {
+                if (job->error.empty()) {
+                    auto t_start = std::chrono::steady_clock::now();
+                    try {
+                        if (! boost::filesystem::exists(job->model))
+                            throw std::runtime_error("No such file: " + job->model);
+                        Model model = load_model(job->model, job->config, cli_config);
+                        if (model.objects.empty())
+                            throw std::runtime_error("Error: file is empty: " + job->model);
+                        job->error = slice_model(model, job->config, cli_config, job->output);
+                    } catch (std::exception &ex) {
+                        job->error = ex.what();
+                    }
+                    job->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+                }
+                return job;
+            }) &
+        tbb::make_filter<std::shared_ptr<BatchJob>, void>(tbb::filter::serial_in_order,
+            [&num_failed](std::shared_ptr<BatchJob> job) {
+                if (! job->error.empty())
+                    ++ num_failed;
+                boost::nowide::cout << batch_job_status(*job);
+                boost::nowide::cout.flush();
+            }));
+    return (num_failed == 0) ? 0 : 1;
+}
+
 #ifdef _MSC_VER
 int slic3r_main_(int argc, char **argv)
 #else
@@ -95,7 +330,7 @@ int main(int argc, char **argv)
 
     DynamicPrintConfig print_config;
 
-    if ((argc == 1 || cli_config.gui.value) && ! cli_config.no_gui.value && ! cli_config.help.value && cli_config.save.value.empty()) {
+    if ((argc == 1 || cli_config.gui.value) && ! cli_config.no_gui.value && ! cli_config.help.value && cli_config.save.value.empty() && cli_config.batch.value.empty()) {
 #if 1
         GUI::GUI_App *gui = new GUI::GUI_App();
         GUI::GUI_App::SetInstance(gui);
@@ -136,6 +371,9 @@ int main(int argc, char **argv)
         return 0;
     }
 
+    if (! cli_config.batch.value.empty())
+        return run_batch(cli_config, print_config);
+
     // read input file(s) if any
     std::vector<Model> models;
     for (const t_config_option_key &file : input_files) {
@@ -145,7 +383,7 @@ int main(int argc, char **argv)
         }
         Model model;
         try {
-            model = Model::read_from_file(file, &print_config, true);
+            model = load_model(file, print_config, cli_config);
         } catch (std::exception &e) {
             boost::nowide::cerr << file << ": " << e.what() << std::endl;
             exit(1);
@@ -154,19 +392,6 @@ int main(int argc, char **argv)
             boost::nowide::cerr << "Error: file is empty: " << file << std::endl;
             continue;
         }
-        model.add_default_instances();        
-        // apply command line transform options
-        for (ModelObject* o : model.objects) {
-/*
-            if (cli_config.scale_to_fit.is_positive_volume())
-                o->scale_to_fit(cli_config.scale_to_fit.value);
-*/
-            // TODO: honor option order?
-            o->scale(cli_config.scale.value);
-            o->rotate(Geometry::deg2rad(cli_config.rotate_x.value), X);
-            o->rotate(Geometry::deg2rad(cli_config.rotate_y.value), Y);
-            o->rotate(Geometry::deg2rad(cli_config.rotate.value), Z);
-        }
         // TODO: handle --merge
         models.push_back(model);
     }
@@ -207,35 +432,9 @@ int main(int argc, char **argv)
                 //     lower.mesh().write_binary((outfile + "_lower.stl").c_str());
             }
         } else if (cli_config.slice) {
-            PrinterTechnology printer_technology = print_config.option<ConfigOptionEnum<PrinterTechnology>>("printer_technology", true)->value;
             std::string outfile = cli_config.output.value;
-            Print       fff_print;
-            SLAPrint    sla_print;
-            PrintBase  *print = (printer_technology == ptFFF) ? static_cast<PrintBase*>(&fff_print) : static_cast<PrintBase*>(&sla_print);
-            if (! cli_config.dont_arrange) {
-                //FIXME make the min_object_distance configurable.
-                model.arrange_objects(fff_print.config().min_object_distance());
-                model.center_instances_around_point(cli_config.print_center);
-            }
-            if (outfile.empty()) {
-                outfile = model.propose_export_file_name();
-                outfile += (printer_technology == ptFFF) ? ".gcode" : ".zip";
-            }
-            if (printer_technology == ptFFF) {
-                for (auto* mo : model.objects)
-                    fff_print.auto_assign_extruders(mo);
-            }
-            print_config.normalize();
-            print->apply(model, print_config);
-            std::string err = print->validate();
-            if (err.empty()) {
-                if (printer_technology == ptFFF) {
-                    fff_print.export_gcode(outfile, nullptr);
-                } else {
-                    assert(printer_technology == ptSLA);
-					//FIXME add the output here
-                }
-            } else
+            std::string err = slice_model(model, print_config, cli_config, outfile);
+            if (! err.empty())
                 std::cerr << err << "\n";
         } else {
             boost::nowide::cerr << "error: command not supported" << std::endl;
@@ -62,6 +62,10 @@ void AppConfig::set_defaults()
     if (get("remember_output_path").empty())
         set("remember_output_path", "1");
 
+    // Angle in whole degrees between the rotations of the objects tried by the arrange, 0 disables rotating.
+    if (get("arrange_rotation_step").empty())
+        set("arrange_rotation_step", "0");
+
     // Remove legacy window positions/sizes
     erase("", "main_frame_maximized");
     erase("", "main_frame_pos");
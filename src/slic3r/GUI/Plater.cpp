@@ -30,6 +30,7 @@
 #include "libslic3r/Format/AMF.hpp"
 #include "libslic3r/Format/3mf.hpp"
 #include "libslic3r/GCode/PreviewData.hpp"
+#include "libslic3r/Geometry.hpp"
 #include "libslic3r/Model.hpp"
 #include "libslic3r/ModelArrange.hpp"
 #include "libslic3r/Polygon.hpp"
@@ -1676,13 +1677,18 @@ void Plater::priv::arrange()
         // TODO: from Sasha from GUI or
         hint.type = arr::BedShapeType::WHO_KNOWS;
 
+        // Rotations of the objects to try, see the "Arrange rotation step" preference.
+        arr::RotationHint rothint;
+        rothint.step = Geometry::deg2rad(double(std::max(0, atoi(get_config("arrange_rotation_step").c_str()))));
+
         arr::arrange(model,
                      min_obj_distance,
                      bed,
                      hint,
                      false, // create many piles not just one pile
                      [statusfn](unsigned st) { statusfn(st, arrangestr); },
-                     [this] () { return !arranging.load(); });
+                     [this] () { return !arranging.load(); },
+                     rothint);
     } catch(std::exception& /*e*/) {
         GUI::show_error(this->q, L("Could not arrange model objects! "
                                    "Some geometries may be invalid."));
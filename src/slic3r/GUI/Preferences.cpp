@@ -17,7 +17,10 @@ void PreferencesDialog::build()
 	m_optgroup = std::make_shared<ConfigOptionsGroup>(this, _(L("General")));
 	m_optgroup->label_width = 400;
 	m_optgroup->m_on_change = [this](t_config_option_key opt_key, boost::any value){
-		m_values[opt_key] = boost::any_cast<bool>(value) ? "1" : "0";
+		if (opt_key == "arrange_rotation_step")
+			m_values[opt_key] = std::to_string(boost::any_cast<int>(value));
+		else
+			m_values[opt_key] = boost::any_cast<bool>(value) ? "1" : "0";
 	};
 
 	// TODO
@@ -96,6 +99,17 @@ void PreferencesDialog::build()
 	option = Option (def,"use_legacy_opengl");
 	m_optgroup->append_single_option_line(option);
 
+	def.label = L("Arrange rotation step");
+	def.type = coInt;
+	def.tooltip = L("When arranging, try rotating the objects around the Z axis by multiples of this angle "
+					  "to pack them tighter. Set zero to keep the rotation of the objects.");
+	def.sidetext = L("°");
+	def.min = 0;
+	def.max = 180;
+	def.default_value = new ConfigOptionInt{ atoi(app_config->get("arrange_rotation_step").c_str()) };
+	option = Option (def,"arrange_rotation_step");
+	m_optgroup->append_single_option_line(option);
+
 	auto sizer = new wxBoxSizer(wxVERTICAL);
 	sizer->Add(m_optgroup->sizer, 0, wxEXPAND | wxBOTTOM | wxLEFT | wxRIGHT, 10);
 
@@ -1,4 +1,4 @@
-use Test::More tests => 81;
+use Test::More tests => 84;
 use strict;
 use warnings;
 
@@ -262,6 +262,30 @@ use Slic3r::Test;
     }
 }
 
+{
+    # The layer G-code template is compiled once per export and evaluated for each layer.
+    # Its output shall match the template parsed and evaluated anew for the same variables.
+    my $config = Slic3r::Config::new_from_defaults;
+    my $template = ';LAYER [layer_num] {layer_num * 2 + 1} {if layer_num == 2 * (layer_num / 2)}even{else}odd{endif}'
+        . ' {if layer_num < 3}low{elsif layer_num < 10}mid{else}high{endif} {min(layer_num, 5)} [temperature_0]'
+        . ' {if "PLA" =~ /P.A/}regex{endif}';
+    $config->set('layer_gcode', $template);
+    my $gcode = Slic3r::Test::gcode(Slic3r::Test::init_print('20mm_cube', config => $config));
+
+    my $parser = Slic3r::GCode::PlaceholderParser->new;
+    $parser->apply_config($config);
+    my (@compiled, @parsed);
+    foreach my $line (grep /^;LAYER /, split /\R+/, $gcode) {
+        my ($layer_num) = $line =~ /^;LAYER (\d+)/;
+        $parser->set('layer_num' => $layer_num);
+        push @compiled, $line;
+        push @parsed, $parser->process($template);
+    }
+    ok @compiled > 10, 'layer G-code template is processed for each layer';
+    is_deeply \@compiled, \@parsed, 'compiled layer G-code template matches the parsed one';
+    is $compiled[0], ';LAYER 0 1 even low 0 ' . $config->temperature->[0] . ' regex', 'compiled layer G-code template evaluated';
+}
+
 {
     my $config = Slic3r::Config::new_from_defaults;
     $config->set('complete_objects', 1);
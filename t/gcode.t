@@ -1,4 +1,4 @@
-use Test::More tests => 25;
+use Test::More tests => 29;
 use strict;
 use warnings;
 
@@ -217,6 +217,26 @@ use Slic3r::Test;
 }
 
 
+{
+    # Tests that the remaining times inserted into the G-code add up to the estimated printing time.
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('remaining_times', 1);
+    my $gcode = Slic3r::Test::gcode(Slic3r::Test::init_print('20mm_cube', config => $config, duplicate => 2));
+
+    my ($estimate) = $gcode =~ /^; estimated printing time \(normal mode\) = (.+)$/m;
+    my %units = (d => 86400, h => 3600, m => 60, s => 1);
+    my $total = 0;
+    $total += $1 * $units{$2} while defined $estimate && $estimate =~ /(\d+)([dhms])/g;
+    ok $total > 0, 'printing time is estimated';
+
+    my @m73 = map [ /P(\d+) R(\d+)/ ], $gcode =~ /^(M73 P\d+ R\d+)$/mg;
+    ok @m73 > 2 && $m73[0][0] == 0 && abs($m73[0][1] - $total / 60) <= 1,
+        'first remaining time matches the estimated printing time';
+    ok !(first { $m73[$_][0] < $m73[$_-1][0] || $m73[$_][1] > $m73[$_-1][1] } 1..$#m73),
+        'progress increases and remaining time decreases';
+    ok $m73[-1][0] <= 100 && $m73[-1][1] <= 1, 'remaining time reaches zero at the end of the print';
+}
+
 {
     # Tests that the Repetier flavor produces M201 Xnnn Ynnn for resetting
     # acceleration, also that M204 Snnn syntax is not generated. 
@@ -1,4 +1,4 @@
-use Test::More tests => 21;
+use Test::More tests => 25;
 use strict;
 use warnings;
 
@@ -10,7 +10,9 @@ BEGIN {
 
 use List::Util qw(first sum);
 use Slic3r;
-use Slic3r::Geometry qw(epsilon);
+use Slic3r::Geometry qw(epsilon unscale);
+use Slic3r::Geometry::Clipper qw(union_ex);
+use Slic3r::Surface qw(S_TYPE_INTERNAL);
 use Slic3r::Test;
 
 {
@@ -318,4 +320,35 @@ use Slic3r::Test;
     is $diagonal_moves, 0, 'no spiral moves on two-island object';
 }
 
+{
+    # The marking of the solid infill layers over sparse infill changes the surfaces seen by the projections
+    # of the top and bottom shells, which discover_horizontal_shells() calculates in parallel phases.
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.2);
+    $config->set('first_layer_height', 0.2);
+    $config->set('solid_infill_every_layers', 2);
+    $config->set('fill_density', '20%');
+    $config->set('top_solid_layers', 3);
+    $config->set('bottom_solid_layers', 3);
+    
+    foreach my $model_name (qw(pyramid overhang)) {
+        my $print = Slic3r::Test::init_print($model_name, config => $config);
+        $print->process;
+        my $internal_on_solid_layer = 0;
+        my $overlapping = 0;
+        foreach my $layer (@{$print->print->get_object(0)->layers}) {
+            my @surfaces = @{$layer->get_region(0)->fill_surfaces};
+            # The solid infill layers have no sparse infill left, not even after the top shells were projected into them.
+            $internal_on_solid_layer++
+                if $layer->id % 2 == 0 && grep $_->surface_type == S_TYPE_INTERNAL, @surfaces;
+            # The projections applied to a layer keep its fill surfaces a partition of the fill area.
+            my $area       = sum(0, map $_->area, @surfaces);
+            my $union_area = sum(0, map $_->area, @{union_ex([ map @{$_->p}, @surfaces ])});
+            $overlapping++ if unscale(unscale($area - $union_area)) > 0.01;
+        }
+        is $internal_on_solid_layer, 0, "no sparse infill on the solid infill layers ($model_name)";
+        is $overlapping, 0, "fill surfaces of the horizontal shells do not overlap ($model_name)";
+    }
+}
+
 __END__
@@ -0,0 +1,47 @@
+use Test::More tests => 6;
+use strict;
+use warnings;
+
+BEGIN {
+    use FindBin;
+    use lib "$FindBin::Bin/../lib";
+    use local::lib "$FindBin::Bin/../local-lib";
+}
+
+use File::Temp qw(tempdir);
+use Slic3r;
+use Slic3r::Test;
+
+{
+    my $cache_dir = tempdir(CLEANUP => 1);
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('slice_cache_dir', $cache_dir);
+
+    my $num_entries = sub { scalar(my @entries = glob("$cache_dir/*.slices")) };
+    my $gcode = sub {
+        my ($model) = @_;
+        return Slic3r::Test::gcode(Slic3r::Test::init_print($model // '20mm_cube', config => $config));
+    };
+
+    my $gcode_sliced = $gcode->();
+    is $num_entries->(), 1, 'slices are stored to the cache';
+
+    my $gcode_cached = $gcode->();
+    is $num_entries->(), 1, 'cache entry is reused by the same print';
+    is $gcode_cached, $gcode_sliced, 'G-code generated from the cached slices matches';
+
+    $config->set('perimeters', 5);
+    $gcode->();
+    is $num_entries->(), 1, 'option not affecting the slices reuses the cache entry';
+
+    $config->set('xy_size_compensation', 0.1);
+    $gcode->();
+    is $num_entries->(), 2, 'option affecting the slices invalidates the cache entry';
+
+    my $model = Slic3r::Test::model('20mm_cube');
+    $model->objects->[0]->set_layer_height_ranges([ [ 0, 5, 0.1 ] ]);
+    $gcode->($model);
+    is $num_entries->(), 3, 'layer height ranges invalidate the cache entry';
+}
+
+__END__